@@ -13,11 +13,9 @@
 // #include <fstream> // Included via CommonIncludes.h for the original main's
 // ofstream
 
-// This was defined in your original Heinzinger.cpp.
-// It's used in constructor, set_voltage, set_current.
-// For better design, this could be a static const member in Heinzinger.h
-// or passed as a constructor argument if it can vary per instance/board.
-#define BOARD_MAX_VOLT 11.3
+// Used in the constructors and the setpoint conversions. The value lives in
+// Heinzinger.h so AnalogPSUDriver can check model ranges at compile time.
+#define BOARD_MAX_VOLT HeinzingerVia16BitDAC::board_max_volt()
 
 // --- Method Definitions for HeinzingerVia16BitDAC ---
 
@@ -27,32 +25,41 @@ HeinzingerVia16BitDAC::HeinzingerVia16BitDAC(
     double max_voltage,
     double max_current_param,
     bool verbose_param,
-    double max_input_voltage)
+    double max_input_voltage,
+    bool lazy)
     : max_volt(max_voltage),                 // Initialize from parameter
       max_curr(max_current_param),           // Initialize from parameter
       verbose(verbose_param),                // Initialize from parameter
       max_analog_in_volt(max_input_voltage), // Initialize from parameter
       set_volt_cache(0.0), set_curr_cache(0.0), relay_cache(false),
-      max_analog_in_volt_bin(0), _usbIndex(0) // Initialize _usbIndex to 0 for path-based
+      skipped_writes(0),
+      max_analog_in_volt_bin(0), _usbIndex(0), stream_lent(0), ilk_tripped(false), async_pending(0), async_written(false),
+      async_target_pending(false), async_target(0) // Initialize _usbIndex to 0 for path-based
 {
-  Interface.Close(); // ensure nothing is open
+  Interface.Verbose = this->verbose; // before the open, which reports itself
   // Use new path-based device opening
-  if (!Interface.Bridge.OpenDeviceByPath(0xA0A0, 0x000C, 0, usb_path)) {
+  if (lazy) {
+    Interface.SetTargetPath(usb_path); // opened by the first I/O
+  } else if (!Interface.OpenPath(usb_path)) {
     Utter("Unable to open USB device at path: " + usb_path);
   }
-  if (!Interface) {
+  if (!lazy && !Interface) {
     Utter("Unable to open interface to analog PSU interface board.\n");
   }
 
-  Interface.Verbose = this->verbose; // Set interface verbosity
+  clear_interlock();
+  clear_regulation();
+  forget_setpoints();
+  Interface.AsyncAdmit = [this](const FGAnalogPSUInterface::Status_t &cmd) {
+    return async_admitted(cmd);
+  };
+  link_generation = Interface.LinkGeneration();
   
   if (BOARD_MAX_VOLT < this->max_analog_in_volt) {
     Utter("The board has insufficient output voltage to control the PSU");
   }
 
-  // Initialize the max_analog_in_volt_bin from max_analog_in_volt
-  max_analog_in_volt_bin = static_cast<uint16_t>(
-      UINT16_MAX * (this->max_analog_in_volt / BOARD_MAX_VOLT));
+  init_scales();
   if (verbose) {
     std::cout << "Max analog input voltage: " << max_analog_in_volt << " V" << std::endl;
     std::cout << "Max analog input voltage bin: " << max_analog_in_volt_bin << std::endl;
@@ -65,24 +72,36 @@ HeinzingerVia16BitDAC::HeinzingerVia16BitDAC(
     double max_voltage,
     double max_current_param,
     bool verbose_param,
-    double max_input_voltage)
+    double max_input_voltage,
+    bool lazy)
     : max_volt(max_voltage),                 // Initialize from parameter
       max_curr(max_current_param),           // Initialize from parameter
       verbose(verbose_param),                // Initialize from parameter
       max_analog_in_volt(max_input_voltage), // Initialize from parameter
       set_volt_cache(0.0), set_curr_cache(0.0), relay_cache(false),
-      max_analog_in_volt_bin(0), _usbIndex(device_index)
+      skipped_writes(0),
+      max_analog_in_volt_bin(0), _usbIndex(device_index), stream_lent(0),
+      ilk_tripped(false), async_pending(0), async_written(false),
+      async_target_pending(false), async_target(0)
 {
-  Interface.Close(); // ensure nothing is open
+  Interface.Verbose = this->verbose; // Use the initialized member 'verbose'
   // Use legacy device_index method
-  if (!Interface.Bridge.OpenDevice(0xA0A0, 0x000C, 0, device_index)) {
+  if (lazy) {
+    Interface.SetTargetIndex(device_index);
+  } else if (!Interface.OpenIndex(device_index)) {
     Utter("Unable to open USB device #" + std::to_string(device_index));
   }
-  if (!Interface) {
+  if (!lazy && !Interface) {
     Utter("Unable to open interface to analog PSU interface board.\n");
   }
 
-  Interface.Verbose = this->verbose; // Use the initialized member 'verbose'
+  clear_interlock();
+  clear_regulation();
+  forget_setpoints();
+  Interface.AsyncAdmit = [this](const FGAnalogPSUInterface::Status_t &cmd) {
+    return async_admitted(cmd);
+  };
+  link_generation = Interface.LinkGeneration();
 
   if (BOARD_MAX_VOLT <
       this->max_analog_in_volt) { // Use member 'max_analog_in_volt'
@@ -90,9 +109,52 @@ HeinzingerVia16BitDAC::HeinzingerVia16BitDAC(
     // Consider throwing an exception
   }
 
-  // Calculate max_analog_in_volt_bin using member max_analog_in_volt
-  this->max_analog_in_volt_bin = static_cast<uint16_t>(
+  init_scales();
+}
+
+// Transport-injected constructor, used with FGMockAnalogBoard
+HeinzingerVia16BitDAC::HeinzingerVia16BitDAC(
+    FGBulkBridge &transport,
+    double max_voltage,
+    double max_current_param,
+    bool verbose_param,
+    double max_input_voltage)
+    : max_volt(max_voltage), max_curr(max_current_param),
+      verbose(verbose_param), max_analog_in_volt(max_input_voltage),
+      set_volt_cache(0.0), set_curr_cache(0.0), relay_cache(false),
+      skipped_writes(0),
+      max_analog_in_volt_bin(0), _usbIndex(-1), stream_lent(0),
+      ilk_tripped(false), async_pending(0), async_written(false),
+      async_target_pending(false), async_target(0)
+{
+  Interface.SetTransport(&transport);
+  Interface.Verbose = this->verbose;
+  clear_interlock();
+  clear_regulation();
+  forget_setpoints();
+  Interface.AsyncAdmit = [this](const FGAnalogPSUInterface::Status_t &cmd) {
+    return async_admitted(cmd);
+  };
+  link_generation = Interface.LinkGeneration();
+
+  if (BOARD_MAX_VOLT < this->max_analog_in_volt) {
+    Utter("The board has insufficient output voltage to control the PSU");
+  }
+  init_scales();
+}
+
+// Folds the fixed parts of the conversions (0.98 headroom, board range, ADC
+// front end, 0-10 V monitors) into one factor per direction.
+void HeinzingerVia16BitDAC::init_scales() {
+  volt_channel = 2;
+  curr_channel = 3;
+  max_analog_in_volt_bin = static_cast<uint16_t>(
       UINT16_MAX * (this->max_analog_in_volt / BOARD_MAX_VOLT));
+  max_reg = UINT16_MAX * (this->max_analog_in_volt / BOARD_MAX_VOLT);
+  reg_per_volt = max_reg / (0.98 * this->max_volt);
+  reg_per_curr = max_reg / (0.98 * this->max_curr);
+  volt_per_count = this->max_volt * adc_gain() / UINT16_MAX / 10;
+  curr_per_count = this->max_curr * adc_gain() / UINT16_MAX / 10;
 }
 
 // Private helper method implementation
@@ -112,154 +174,386 @@ bool HeinzingerVia16BitDAC::update() {
   }
 }
 
+// Setpoint (physical units) -> DAC register value. Callers range-check.
+uint16_t HeinzingerVia16BitDAC::voltage_to_register(double set_val) const {
+  if (cal.setpoint.valid()) {
+    double reg = std::floor(cal.setpoint.eval(set_val) + 0.5);
+    return static_cast<uint16_t>(
+        reg < 0 ? 0 : (reg > max_analog_in_volt_bin ? max_analog_in_volt_bin
+                                                     : reg));
+  }
+  // max_analog_in_volt * set_val / 0.98 / max_volt, as a BOARD_MAX_VOLT
+  // fraction, clamped to the PSU's analog input range (the 0.98 factor can
+  // push the top of the range past it).
+  double reg = set_val * reg_per_volt;
+  return static_cast<uint16_t>(reg < 0 ? 0 : (reg > max_reg ? max_reg : reg));
+}
+
+uint16_t HeinzingerVia16BitDAC::current_to_register(double set_val) const {
+  double reg = set_val * reg_per_curr;
+  return static_cast<uint16_t>(reg < 0 ? 0 : (reg > max_reg ? max_reg : reg));
+}
+
 // Public method implementations
-bool HeinzingerVia16BitDAC::switch_on() {
-  Interface.SetRelay(false);
-  // Original code had: relay = update(); return relay;
-  // 'relay' was a local variable in your original main's scope or uninitialized
-  // member. Assuming 'update()' returning true means the operation was
-  // successful. If you want to cache the relay state: if (update()) {
-  //     this->relay_cache = Interface.Relay_val; // Assuming Interface updates
-  //     a readable relay state return this->relay_cache;
-  // }
-  // return false;
-  return update(); // Simpler: return true if update (which reads back) is
-                   // successful
+
+// Writes every field selected in mask with one packet; the response to that
+// packet is the readback, so this is a single USB round trip.
+bool HeinzingerVia16BitDAC::apply(const Setpoint &sp, uint8_t mask,
+                                  bool force) {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  Setpoint out = sp;
+  return retarget_locked(out, mask) && apply_locked(out, mask, force);
 }
 
-bool HeinzingerVia16BitDAC::switch_off() {
-  Interface.SetRelay(true);
-  // Similar logic to switch_on for caching and returning state
-  return update();
+bool HeinzingerVia16BitDAC::apply(const Setpoint &sp, uint8_t mask,
+                                  PSUSnapshot &readback, bool force) {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  memset(&readback, 0, sizeof(readback));
+  bool sent = false;
+  Setpoint out = sp;
+  if (!retarget_locked(out, mask) || !apply_locked(out, mask, force, &sent))
+    return false;
+  if (!sent && !Interface.Readout())
+    return false;
+  fill_snapshot(readback);
+  return true;
 }
 
-bool HeinzingerVia16BitDAC::set_voltage(
-    double set_val_param) { // Renamed parameter
-  if (set_val_param > this->max_volt || set_val_param < 0) {
+// Range and interlock checks shared by apply() and apply_async().
+bool HeinzingerVia16BitDAC::setpoint_allowed(const Setpoint &sp, uint8_t mask,
+                                             bool tripped) const {
+  if (tripped &&
+      (((mask & FGAnalogPSUInterface::SetDACAMask) && sp.volt > 0) ||
+       ((mask & FGAnalogPSUInterface::SetRelayMask) && sp.relay_on))) {
+    std::cerr << "Interlock tripped; call reset_interlock() before raising "
+                 "the output again\n";
+    return false;
+  }
+  if ((mask & FGAnalogPSUInterface::SetDACAMask) &&
+      (sp.volt > this->max_volt || sp.volt < 0)) {
     std::cerr << "Set voltage value lies outside of device's specified range\n";
     return false;
   }
-
-  // Using this-> to be explicit about members
-  double set_percent_of_max = set_val_param / 0.98 / this->max_volt; 
-  double required_analog_volt = this->max_analog_in_volt * set_percent_of_max;
-  // Ensure required_analog_volt doesn't exceed max_analog_in_volt (could happen
-  // if set_val_param is at the edge due to 0.98 factor)
-  if (required_analog_volt > this->max_analog_in_volt) {
-    required_analog_volt = this->max_analog_in_volt;
-  }
-  if (required_analog_volt < 0) {
-    required_analog_volt = 0;
-  }
-
-  uint16_t required_register_value = static_cast<uint16_t>(
-      UINT16_MAX * (required_analog_volt / BOARD_MAX_VOLT));
-  if (required_register_value > this->max_analog_in_volt_bin &&
-      this->max_analog_in_volt < BOARD_MAX_VOLT) {
-    // This check is a bit complex. If max_analog_in_volt_bin represents the
-    // true writable max for the analog voltage, use that. The original code
-    // directly calculated required_register_value based on BOARD_MAX_VOLT. If
-    // max_analog_in_volt_bin is the cap for register values due to PSU input
-    // limits: required_register_value =
-    // static_cast<uint16_t>(this->max_analog_in_volt_bin * set_percent_of_max);
-    // This needs careful review of how max_analog_in_volt_bin is intended to be
-    // used. Sticking to your original calculation logic for now:
-  }
-
-  Interface.SetDACA(required_register_value);
-  // if (update()) {
-  //     this->set_volt_cache = set_val_param; // Cache the requested set value
-  //     return true;
-  // }
-  // return false;
-  return update();
+  if ((mask & FGAnalogPSUInterface::SetDACBMask) &&
+      (sp.curr > this->max_curr || sp.curr < 0)) {
+    std::cerr << "Set current value lies outside of device's specified range\n";
+    return false;
+  }
+  return true;
 }
 
-bool HeinzingerVia16BitDAC::set_current(
-    double set_val_param) { // Renamed parameter
-  if (set_val_param > this->max_curr || set_val_param < 0) {
-    std::cerr << "Set current value lies outside of device's specified range\n";
+bool HeinzingerVia16BitDAC::apply_locked(const Setpoint &sp, uint8_t mask,
+                                         bool force, bool *sent) {
+  if (sent)
+    *sent = false;
+  if (!setpoint_allowed(sp, mask, ilk.trip.tripped))
     return false;
+
+  uint16_t daca = voltage_to_register(sp.volt);
+  uint16_t dacb = current_to_register(sp.curr);
+  // switch_on() has always written Relay=0 and switch_off() Relay=1
+  uint8_t relay = sp.relay_on ? 0 : 1;
+
+  // A reopened board may have been power cycled: trust nothing cached.
+  if (Interface.LinkGeneration() != link_generation) {
+    link_generation = Interface.LinkGeneration();
+    forget_setpoints();
+  }
+  // Nor after writes that went around the cache.
+  if (async_written.exchange(false) || async_pending > 0)
+    forget_setpoints();
+
+  // A field is only skipped if our last acknowledged write and the board's
+  // latest report (any response, including stream readouts) agree on it.
+  if (!force) {
+    uint8_t unchanged = 0;
+    if (acked.daca_known && acked.daca == daca && Interface.DACA_val == daca)
+      unchanged |= FGAnalogPSUInterface::SetDACAMask;
+    if (acked.dacb_known && acked.dacb == dacb && Interface.DACB_val == dacb)
+      unchanged |= FGAnalogPSUInterface::SetDACBMask;
+    if (acked.relay_known && acked.relay == relay &&
+        Interface.Relay_val == relay)
+      unchanged |= FGAnalogPSUInterface::SetRelayMask;
+    for (uint8_t bit = 1; bit <= 4; bit <<= 1)
+      if (mask & unchanged & bit)
+        ++skipped_writes;
+    mask &= ~unchanged;
+    if (!(mask & (FGAnalogPSUInterface::SetDACAMask |
+                  FGAnalogPSUInterface::SetDACBMask |
+                  FGAnalogPSUInterface::SetRelayMask)))
+      return true;
   }
 
-  double set_percent_of_max = set_val_param / 0.98 / this->max_curr;
-  double required_analog_volt = this->max_analog_in_volt * set_percent_of_max;
-  if (required_analog_volt > this->max_analog_in_volt) {
-    required_analog_volt = this->max_analog_in_volt;
+  if (sent)
+    *sent = true;
+  bool ok = Interface.Set(mask, daca, dacb, relay != 0);
+  // Trust the cache only for fields the response shows were taken.
+  if (mask & FGAnalogPSUInterface::SetDACAMask) {
+    acked.daca_known = ok && Interface.DACA_val == daca;
+    acked.daca = daca;
+    if (acked.daca_known)
+      set_volt_cache = sp.volt;
+  }
+  if (mask & FGAnalogPSUInterface::SetDACBMask) {
+    acked.dacb_known = ok && Interface.DACB_val == dacb;
+    acked.dacb = dacb;
+    if (acked.dacb_known)
+      set_curr_cache = sp.curr;
   }
-  if (required_analog_volt < 0) {
-    required_analog_volt = 0;
+  if (mask & FGAnalogPSUInterface::SetRelayMask) {
+    acked.relay_known = ok && Interface.Relay_val == relay;
+    acked.relay = relay;
+    if (acked.relay_known)
+      relay_cache = sp.relay_on;
   }
-  uint16_t required_register_value = static_cast<uint16_t>(
-      UINT16_MAX * (required_analog_volt / BOARD_MAX_VOLT));
+  return ok;
+}
 
-  Interface.SetDACB(required_register_value);
-  // if (update()) {
-  //     this->set_curr_cache = set_val_param;
-  //     return true;
-  // }
-  // return false;
-  return update();
+// Fail on a model without a relay, as IPowerSupply::switch_on() does, rather
+// than succeed with nothing written.
+bool HeinzingerVia16BitDAC::switch_on(bool force) {
+  Setpoint sp = {0.0, 0.0, true};
+  return has(PSUCapRelay) &&
+         apply(sp, FGAnalogPSUInterface::SetRelayMask, force);
+}
+
+bool HeinzingerVia16BitDAC::switch_off(bool force) {
+  Setpoint sp = {0.0, 0.0, false};
+  return has(PSUCapRelay) &&
+         apply(sp, FGAnalogPSUInterface::SetRelayMask, force);
+}
+
+bool HeinzingerVia16BitDAC::set_voltage(double set_val, bool force) {
+  Setpoint sp = {set_val, 0.0, false};
+  return apply(sp, FGAnalogPSUInterface::SetDACAMask, force);
+}
+
+bool HeinzingerVia16BitDAC::set_current(double set_val, bool force) {
+  Setpoint sp = {0.0, set_val, false};
+  return apply(sp, FGAnalogPSUInterface::SetDACBMask, force);
+}
+
+double HeinzingerVia16BitDAC::adc_to_voltage(double raw) const {
+  if (cal.readback.valid())
+    return cal.readback.eval(raw);
+  // The PSU's monitor output is 0-10 V for 0-max_volt
+  return raw * volt_per_count;
+}
+
+double HeinzingerVia16BitDAC::adc_to_current(double raw) const {
+  return raw * curr_per_count;
+}
+
+bool HeinzingerVia16BitDAC::open() {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  if (Interface.IsOpen())
+    return true;
+  if (Interface.Open())
+    return true;
+  ShoutAt("Unable to open the analog PSU interface board.",
+          Interface.Bridge.Location());
+  return false;
+}
+
+std::shared_ptr<const PSUBlockConverter>
+HeinzingerVia16BitDAC::voltage_converter() const {
+  std::lock_guard<std::mutex> lock(conv_mutex);
+  if (!volt_block)
+    volt_block = std::make_shared<const PSUBlockConverter>(cal.readback,
+                                                           volt_per_count);
+  return volt_block;
+}
+
+std::shared_ptr<const PSUBlockConverter>
+HeinzingerVia16BitDAC::current_converter() const {
+  return std::make_shared<const PSUBlockConverter>(curr_per_count);
+}
+
+double HeinzingerVia16BitDAC::current_to_adc(double curr) const {
+  return curr / curr_per_count;
 }
 
-double HeinzingerVia16BitDAC::read_voltage() {
+double HeinzingerVia16BitDAC::read_voltage(bool filtered) {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  if (filtered) {
+    double counts;
+    if (!filtered_counts(volt_channel, counts)) {
+      ShoutAt("Failed to readout interface for voltage reading.",
+              Interface.Bridge.Location());
+      return -1.0;
+    }
+    return adc_to_voltage(counts);
+  }
   if (!Interface.Readout()) { // Ensure data is fresh
-    std::cerr << "Failed to readout interface for voltage reading."
-              << std::endl;
+    ShoutAt("Failed to readout interface for voltage reading.",
+            Interface.Bridge.Location());
     return -1.0; // Or some other error indicator, or throw exception
   }
 
-  uint16_t readout_register_value =
-      Interface.ADCB[2]; // Assuming ADCB is populated by Readout()
-  // Constants from your original code for conversion:
-  const double adc_conversion_factor = 3.2 * 3.3 * 1.12; //equals 11.376
-  double readout_analog_volt =
-      adc_conversion_factor * readout_register_value / UINT16_MAX;
-  // The PSU's analog input for voltage monitoring is 0-10V, representing
-  // 0-max_volt
-  double converted_output_volt = this->max_volt * readout_analog_volt / 10; //previously divide by 10
-
-  return converted_output_volt;
+  // Assuming ADCB is populated by Readout()
+  return adc_to_voltage(Interface.ADCB[volt_channel]);
 }
 
-double HeinzingerVia16BitDAC::read_current() {
+double HeinzingerVia16BitDAC::read_current(bool filtered) {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  if (filtered) {
+    double counts;
+    if (!filtered_counts(curr_channel, counts)) {
+      ShoutAt("Failed to readout interface for current reading.",
+              Interface.Bridge.Location());
+      return -1.0;
+    }
+    return adc_to_current(counts);
+  }
   if (!Interface.Readout()) { // Ensure data is fresh
-    std::cerr << "Failed to readout interface for current reading."
-              << std::endl;
+    ShoutAt("Failed to readout interface for current reading.",
+            Interface.Bridge.Location());
     return -1.0; // Or some other error indicator, or throw exception
   }
 
-  uint16_t readout_register_value =
-      Interface.ADCB[3]; // Assuming ADCB is populated by Readout()
-  const double adc_conversion_factor = 3.2 * 3.3 * 1.12;
-  double readout_analog_volt =
-      adc_conversion_factor * readout_register_value / UINT16_MAX;
-  // The PSU's analog input for current monitoring is 0-10V, representing
-  // 0-max_curr
-  double converted_output_curr = this->max_curr * readout_analog_volt / 10; //previously divide by 10
+  // Assuming ADCB is populated by Readout()
+  return adc_to_current(Interface.ADCB[curr_channel]);
+}
+
+// Single Readout() for voltage, current, relay and the raw registers, instead
+// of one round trip per quantity.
+PSUSnapshot HeinzingerVia16BitDAC::read_snapshot() {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  PSUSnapshot snap;
+  memset(&snap, 0, sizeof(snap));
+  if (!Interface.Readout()) {
+    ShoutAt("Failed to readout interface for snapshot.",
+            Interface.Bridge.Location());
+    return snap; // snap.ok stays false
+  }
+  fill_snapshot(snap);
+  return snap;
+}
+
+// Converts whatever the last Query left in Interface. Caller holds io_mutex.
+void HeinzingerVia16BitDAC::fill_snapshot(PSUSnapshot &snap) const {
+  snap.ok = true;
+  snap.voltage = adc_to_voltage(Interface.ADCB[volt_channel]);
+  snap.current = adc_to_current(Interface.ADCB[curr_channel]);
+  snap.relay_on = Interface.Relay_val == 0; // relay register 0: output on
+  snap.daca = Interface.DACA_val;
+  snap.dacb = Interface.DACB_val;
+  snap.sequence_no = Interface.SequenceNo_val;
+  snap.errors = Interface.Errors;
+  for (int i = 0; i < 4; ++i) {
+    snap.adca[i] = Interface.ADCA[i];
+    snap.adcb[i] = Interface.ADCB[i];
+  }
+}
+
+void HeinzingerVia16BitDAC::read_snapshot_async(AsyncCallback done) {
+  FGAnalogPSUInterface::Status_t cmd;
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.MagicNo = FGAnalogPSUInterface::ExpectedMagic;
+  submit_async(cmd, std::move(done), false);
+}
+
+void HeinzingerVia16BitDAC::apply_async(const Setpoint &sp, uint8_t mask,
+                                        AsyncCallback done) {
+  mask &= FGAnalogPSUInterface::SetDACAMask |
+          FGAnalogPSUInterface::SetDACBMask |
+          FGAnalogPSUInterface::SetRelayMask;
+  if (!setpoint_allowed(sp, mask, ilk_tripped)) {
+    PSUSnapshot fail;
+    memset(&fail, 0, sizeof(fail));
+    done(fail);
+    return;
+  }
+  FGAnalogPSUInterface::Status_t cmd;
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.MagicNo = FGAnalogPSUInterface::ExpectedMagic;
+  cmd.SetMask = mask;
+  {
+    std::lock_guard<std::mutex> lock(conv_mutex);
+    cmd.DACA = voltage_to_register(sp.volt);
+    cmd.DACB = current_to_register(sp.curr);
+    // Regulation would steer back to its old target otherwise. The
+    // io_mutex it lives under is not ours to wait for here.
+    if (mask & FGAnalogPSUInterface::SetDACAMask) {
+      async_target_pending = true;
+      async_target = sp.volt;
+    }
+  }
+  cmd.Relay = sp.relay_on ? 0 : 1; // as apply_locked
+  submit_async(cmd, std::move(done), mask != 0);
+}
+
+// The interlock check of setpoint_allowed(), again when the command takes
+// the link: a raise queued behind the interlock's shutdown must not follow
+// it out.
+bool HeinzingerVia16BitDAC::async_admitted(
+    const FGAnalogPSUInterface::Status_t &cmd) const {
+  if (!ilk_tripped)
+    return true;
+  return !((cmd.SetMask & FGAnalogPSUInterface::SetDACAMask) && cmd.DACA > 0) &&
+         !((cmd.SetMask & FGAnalogPSUInterface::SetRelayMask) && cmd.Relay == 0);
+}
+
+void HeinzingerVia16BitDAC::submit_async(
+    const FGAnalogPSUInterface::Status_t &cmd,
+    std::function<void(const PSUSnapshot &)> done, bool write) {
+  if (write)
+    ++async_pending;
+  Interface.QueryAsync(
+      cmd,
+      [this, done, write](bool ok, const FGAnalogPSUInterface::Status_t &r) {
+        PSUSnapshot snap;
+        memset(&snap, 0, sizeof(snap));
+        if (ok)
+          snapshot_from(r, snap);
+        if (write) {
+          async_written = true;
+          --async_pending;
+        }
+        done(snap);
+      },
+      false);
+}
 
-  return converted_output_curr;
+// fill_snapshot() for a response the Interface did not store.
+void HeinzingerVia16BitDAC::snapshot_from(
+    const FGAnalogPSUInterface::Status_t &r, PSUSnapshot &snap) const {
+  std::lock_guard<std::mutex> lock(conv_mutex);
+  snap.ok = true;
+  snap.voltage = adc_to_voltage(r.ADCB[volt_channel]);
+  snap.current = adc_to_current(r.ADCB[curr_channel]);
+  snap.relay_on = r.Relay == 0; // as fill_snapshot()
+  snap.daca = r.DACA;
+  snap.dacb = r.DACB;
+  snap.sequence_no = r.SequenceNo;
+  snap.errors = r.Response;
+  for (int i = 0; i < 4; ++i) {
+    snap.adca[i] = r.ADCA[i];
+    snap.adcb[i] = r.ADCB[i];
+  }
 }
 
 bool HeinzingerVia16BitDAC::set_max_volt() {
+  std::lock_guard<std::mutex> lock(io_mutex);
   // This sets the DACA to its max value. The resulting voltage depends on
   // how max_analog_in_volt relates to BOARD_MAX_VOLT and the PSU's response.
   // If max_analog_in_volt_bin is the calibrated max register value for desired
   // max_analog_in_volt: Interface.SetDACA(this->max_analog_in_volt_bin); Your
   // original code just used UINT16_MAX which sets the DAC to its max physical
   // output.
-  Interface.SetDACA(UINT16_MAX);
-  return update();
+  return Interface.SetDACA(UINT16_MAX);
 }
 
 bool HeinzingerVia16BitDAC::set_max_curr() {
-  Interface.SetDACB(UINT16_MAX);
-  return update();
+  std::lock_guard<std::mutex> lock(io_mutex);
+  return Interface.SetDACB(UINT16_MAX);
 }
 
 void HeinzingerVia16BitDAC::readADC() {
+  std::lock_guard<std::mutex> lock(io_mutex);
   if (!Interface.Readout()) {
-    std::cerr << "Failed to readout interface for ADC reading." << std::endl;
+    ShoutAt("Failed to readout interface for ADC reading.",
+            Interface.Bridge.Location());
     return;
   }
   // Interface.ADCB should be populated by Interface.Readout()
@@ -269,6 +563,290 @@ void HeinzingerVia16BitDAC::readADC() {
   std::cout << std::endl;
 }
 
+// Runs on the stream thread.
+bool HeinzingerVia16BitDAC::acquire_sample(PSUStreamSample &s) {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  // A regulation write's response is this sample's readout, and so is an
+  // interlock shutdown the board has not acknowledged yet: that one is
+  // resent every sample until it is, whether the readouts work or not.
+  bool sent = false;
+  if (ilk.trip.tripped && !ilk.trip.shutdown_ok)
+    ilk.trip.shutdown_ok = sent = interlock_shutdown();
+  else if (reg.enabled && !regulate_step(sent))
+    return false;
+  if (!sent && !Interface.Readout())
+    return false;
+
+  s.t = psu_wall_time();
+  const double now = psu_steady_time(); // for intervals: slew, PI step
+  s.sequence_no = Interface.SequenceNo_val;
+  s.response = (int16_t)Interface.Errors;
+  for (int i = 0; i < 4; ++i) {
+    s.adca[i] = Interface.ADCA[i];
+    s.adcb[i] = Interface.ADCB[i];
+  }
+  s.daca = Interface.DACA_val;
+  s.dacb = Interface.DACB_val;
+  s.relay = Interface.Relay_val;
+  bool fresh = false;
+  for (int i = 0; i < 4; ++i)
+    fresh |= filt[i].push(s.adcb[i]) && i == volt_channel;
+  if (ilk.enabled)
+    check_interlock(s, now);
+  // The next sample's packet carries the new command.
+  if (reg.enabled && reg.active && fresh) {
+    reg.ctl.update(now, adc_to_voltage(filt[volt_channel].value()));
+    ++reg.updates;
+  }
+  return true;
+}
+
+// Stream thread, io_mutex held, before the sample's Query. Writes the
+// command from the last update if its register differs from the board's;
+// holds the loop while there is nothing to regulate.
+bool HeinzingerVia16BitDAC::regulate_step(bool &sent) {
+  sent = false;
+  {
+    std::lock_guard<std::mutex> lock(conv_mutex);
+    if (async_target_pending)
+      reg.ctl.retarget(async_target);
+    async_target_pending = false;
+  }
+  reg.active = !ilk.trip.tripped && Interface.Relay_val == 0 &&
+               filt[volt_channel].ready();
+  if (!reg.active) {
+    reg.ctl.hold();
+    return true;
+  }
+  Setpoint sp = {reg.ctl.command(), 0.0, false};
+  if (!apply_locked(sp, FGAnalogPSUInterface::SetDACAMask, false, &sent))
+    return false;
+  if (sent)
+    ++reg.writes;
+  return true;
+}
+
+// Caller holds io_mutex. While regulating, a voltage write moves the target
+// and sends the trimmed command in place of the bare setpoint.
+bool HeinzingerVia16BitDAC::retarget_locked(Setpoint &sp, uint8_t mask) {
+  if (!reg.enabled || !(mask & FGAnalogPSUInterface::SetDACAMask))
+    return true;
+  if (!setpoint_allowed(sp, mask, ilk.trip.tripped))
+    return false;
+  {
+    std::lock_guard<std::mutex> lock(conv_mutex);
+    async_target_pending = false; // older than this write
+  }
+  reg.ctl.retarget(sp.volt);
+  sp.volt = reg.ctl.command();
+  return true;
+}
+
+void HeinzingerVia16BitDAC::clear_regulation() {
+  reg.enabled = false;
+  reg.active = false;
+  reg.updates = 0;
+  reg.writes = 0;
+}
+
+bool HeinzingerVia16BitDAC::regulate_voltage(double target) {
+  return regulate_voltage(target, PSURegulatorConfig::defaults(max_volt));
+}
+
+bool HeinzingerVia16BitDAC::regulate_voltage(double target,
+                                             const PSURegulatorConfig &config) {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  Setpoint sp = {target, 0.0, false};
+  if (!setpoint_allowed(sp, FGAnalogPSUInterface::SetDACAMask,
+                        ilk.trip.tripped) ||
+      !reg.ctl.configure(config, 0.0, max_volt))
+    return false;
+  {
+    std::lock_guard<std::mutex> lock(conv_mutex);
+    async_target_pending = false;
+  }
+  if (reg.enabled) {
+    reg.ctl.retarget(target);
+  } else {
+    clear_regulation();
+    reg.ctl.start(target);
+    reg.enabled = true;
+  }
+  sp.volt = reg.ctl.command();
+  return apply_locked(sp, FGAnalogPSUInterface::SetDACAMask, false);
+}
+
+void HeinzingerVia16BitDAC::stop_regulation() {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  reg.enabled = false;
+  reg.active = false;
+}
+
+PSURegulatorStatus HeinzingerVia16BitDAC::regulation() const {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  PSURegulatorStatus st;
+  st.enabled = reg.enabled;
+  st.active = reg.enabled && reg.active && stream.running();
+  st.target = reg.ctl.target();
+  st.command = reg.ctl.command();
+  st.measured = reg.ctl.measured();
+  st.error = reg.ctl.error();
+  st.integral = reg.ctl.integral();
+  st.updates = reg.updates;
+  st.writes = reg.writes;
+  return st;
+}
+
+// Caller holds io_mutex. The stream's running value if there is one, else
+// a private filter run over fresh readouts so the stream's state is left
+// alone.
+bool HeinzingerVia16BitDAC::filtered_counts(int channel, double &counts) {
+  if (stream.running() && filt[channel].ready()) {
+    counts = filt[channel].value();
+    return true;
+  }
+  PSUChannelFilter f;
+  f.configure(filt[channel].config());
+  for (unsigned int n = f.config().settle_samples(); n > 0; --n) {
+    if (!Interface.Readout())
+      return false;
+    f.push(Interface.ADCB[channel]);
+  }
+  counts = f.value();
+  return f.ready();
+}
+
+bool HeinzingerVia16BitDAC::set_retry_policy(const FGUSBRetryPolicy &p) {
+  if (!p.Valid())
+    return false;
+  std::lock_guard<std::mutex> lock(io_mutex);
+  Interface.SetPolicy(p);
+  stream.set_retry_delay(p.ReconnectMinMs);
+  return true;
+}
+
+FGUSBRetryPolicy HeinzingerVia16BitDAC::retry_policy() const {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  return Interface.Policy();
+}
+
+bool HeinzingerVia16BitDAC::set_filter(const PSUFilterConfig &config) {
+  if (!PSUChannelFilter::valid(config))
+    return false;
+  std::lock_guard<std::mutex> lock(io_mutex);
+  for (int i = 0; i < 4; ++i)
+    filt[i].configure(config);
+  return true;
+}
+
+PSUFilterConfig HeinzingerVia16BitDAC::filter() const {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  return filt[0].config();
+}
+
+void HeinzingerVia16BitDAC::clear_interlock() {
+  ilk.enabled = false;
+  ilk.detector.reset();
+  memset(&ilk.trip, 0, sizeof(ilk.trip));
+}
+
+// Runs on the stream thread with io_mutex held, right after the sample was
+// read, so a trip is acted on before the next Query.
+void HeinzingerVia16BitDAC::check_interlock(const PSUStreamSample &s,
+                                            double now) {
+  uint16_t raw = s.adcb[curr_channel];
+  double slew;
+  bool by_slew;
+  if (!ilk.detector.check(now, raw, slew, by_slew) || ilk.trip.tripped)
+    return; // an unacknowledged shutdown is retried by acquire_sample()
+
+  ilk.trip.tripped = true;
+  ilk_tripped = true;
+  ilk.trip.t = s.t;
+  ilk.trip.current = adc_to_current(raw);
+  ilk.trip.slew = slew * adc_to_current(UINT16_MAX) / UINT16_MAX;
+  ilk.trip.by_slew = by_slew;
+  reg.enabled = false; // nothing may raise the output again by itself
+  ilk.trip.shutdown_ok = interlock_shutdown();
+  std::cerr << "Interlock tripped at " << ilk.trip.current
+            << (ilk.trip.by_slew ? " (slew limit)" : " (current limit)")
+            << (ilk.trip.shutdown_ok ? ", output shut down\n"
+                                     : ", shutdown not acknowledged, "
+                                       "retrying every sample\n");
+}
+
+// Stream thread, io_mutex held: DACA=0 and the relay open in one packet,
+// always sent. apply_locked() bypasses the model's mask, so the relay bit
+// is left out here on models without one.
+bool HeinzingerVia16BitDAC::interlock_shutdown() {
+  Setpoint off = {0.0, 0.0, false};
+  return apply_locked(off,
+                      FGAnalogPSUInterface::SetDACAMask |
+                          (has(PSUCapRelay) ? FGAnalogPSUInterface::SetRelayMask
+                                            : 0),
+                      true);
+}
+
+void HeinzingerVia16BitDAC::set_interlock(double max_current, double max_slew,
+                                          int debounce) {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  ilk.detector.configure(current_to_adc(max_current),
+                         max_slew > 0 ? current_to_adc(max_slew) : 0,
+                         debounce);
+  ilk.enabled = true;
+}
+
+void HeinzingerVia16BitDAC::disable_interlock() {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  ilk.enabled = false;
+}
+
+InterlockTrip HeinzingerVia16BitDAC::interlock_trip() const {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  return ilk.trip;
+}
+
+void HeinzingerVia16BitDAC::reset_interlock() {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  memset(&ilk.trip, 0, sizeof(ilk.trip));
+  ilk_tripped = false;
+  ilk.detector.reset();
+}
+
+bool HeinzingerVia16BitDAC::start_stream(double rate_hz, size_t capacity) {
+  if (!is_streaming()) {
+    // Old samples would otherwise leak into the new stream's filters.
+    std::lock_guard<std::mutex> lock(io_mutex);
+    for (int i = 0; i < 4; ++i)
+      filt[i].reset();
+    reg.ctl.hold(); // the time stopped is not integrated
+    // An unpaced stream waits this long after a failure, as the reopen does.
+    stream.set_retry_delay(Interface.Policy().ReconnectMinMs);
+  }
+  // Already running: the block lent out is still the consumer's to release.
+  if (!stream.start(rate_hz, capacity, [this](PSUStreamSample &s) {
+        return acquire_sample(s);
+      }))
+    return false;
+  stream_lent = 0;
+  return true;
+}
+
+void HeinzingerVia16BitDAC::stop_stream() {
+  stream.stop();
+  stream_lent = 0;
+}
+
+size_t HeinzingerVia16BitDAC::borrow_stream(
+    const PSUStreamSample *&data, size_t max_samples,
+    std::shared_ptr<const void> *storage) {
+  stream.ring().Pop(stream_lent);
+  stream_lent = stream.ring().Peek(data, max_samples);
+  if (storage)
+    *storage = stream.ring().Storage();
+  return stream_lent;
+}
+
 // The main() function from your original Heinzinger.cpp is guarded here.
 // It will not be compiled into the Python module if PYBIND11_MODULE_BUILD is
 // defined. You could define PYBIND11_MODULE_BUILD in your CMakeLists.txt for
@@ -276,12 +854,74 @@ void HeinzingerVia16BitDAC::readADC() {
 // PRIVATE PYBIND11_MODULE_BUILD) Or simply remove the main() function if you no
 // longer need to build Heinzinger.cpp as a standalone executable.
 #ifndef PYBIND11_MODULE_BUILD
+#include <cstdlib>  // For strtod in the daemon options
 #include <fstream>  // For ofstream in main
 #include <unistd.h> // For sleep in main
 
-int main() {
+#include "headers/PSUDaemon.h"
+
+// Heinzinger --daemon [--rate HZ] [--shm NAME] [--socket PATH]
+//                     --board PATH[,MAX_V,MAX_C] [--board ...]
+static int daemon_usage() {
+  std::cerr << "Usage: Heinzinger --daemon [--rate HZ] [--shm NAME] "
+               "[--socket PATH] --board PATH[,MAX_V,MAX_C] [--board ...]"
+            << std::endl;
+  return 1;
+}
+
+static int daemon_main(int argc, char **argv) {
+  double rate = 50.0;
+  std::string shm = PSU_TELEMETRY_DEFAULT_NAME;
+  std::string sock = PSU_DAEMON_DEFAULT_SOCKET;
+  std::vector<PSUDaemonBoard> boards;
+  for (int i = 2; i < argc; i += 2) {
+    std::string opt = argv[i];
+    if (i + 1 == argc) {
+      std::cerr << "Option " << opt << " needs a value" << std::endl;
+      return daemon_usage();
+    }
+    std::string val = argv[i + 1];
+    if (opt == "--rate")
+      rate = strtod(val.c_str(), nullptr);
+    else if (opt == "--shm")
+      shm = val;
+    else if (opt == "--socket")
+      sock = val;
+    else if (opt == "--board") {
+      PSUDaemonBoard b = {val, 30000.0, 2.0};
+      size_t comma = val.find(',');
+      if (comma != std::string::npos) {
+        b.path = val.substr(0, comma);
+        const char *rest = val.c_str() + comma + 1;
+        char *end;
+        b.max_voltage = strtod(rest, &end);
+        if (*end == ',')
+          b.max_current = strtod(end + 1, nullptr);
+      }
+      boards.push_back(b);
+    } else {
+      std::cerr << "Unknown option " << opt << std::endl;
+      return daemon_usage();
+    }
+  }
+
+  PSUDaemon daemon(rate, shm, sock);
+  for (size_t i = 0; i < boards.size(); ++i)
+    if (!daemon.add_board(boards[i])) {
+      std::cerr << "Too many boards" << std::endl;
+      return 1;
+    }
+  std::cout << "Serving " << boards.size() << " board(s): telemetry in " << shm
+            << ", commands on " << sock << std::endl;
+  return daemon.run();
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && std::string(argv[1]) == "--daemon")
+    return daemon_main(argc, argv);
+
   HeinzingerVia16BitDAC dev(
-      30000, 2, true, 10); // Example initialization matching header defaults
+      0, 30000, 2, true, 10); // Example initialization matching header defaults
 
   // dev.set_current(2); // Redundant if constructor default is 2mA, but ok
 
@@ -0,0 +1,67 @@
+"""Benchmark of the pybind11 layer against heinzinger_control.MockAnalogBoard.
+
+Times the Python-visible calls end to end (argument conversion, GIL
+release, C++ call) and prints throughput and p50/p99 latency per call, the
+same columns as bench_psu. Run from devices/ after building the module:
+
+    python bench/bench_bindings.py --iterations 20000 --latency-us 0
+"""
+import argparse
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'build'))
+import heinzinger_control as hc  # noqa: E402
+
+
+def run_case(name, iterations, call):
+    lat = []
+    failures = 0
+    t0 = time.perf_counter()
+    for i in range(iterations):
+        start = time.perf_counter()
+        if call(i) is False:
+            failures += 1
+        lat.append((time.perf_counter() - start) * 1e6)
+    total = time.perf_counter() - t0
+    lat.sort()
+    p50 = lat[len(lat) // 2] if lat else 0.0
+    p99 = lat[min(len(lat) - 1, len(lat) * 99 // 100)] if lat else 0.0
+    return name, iterations, failures, total, p50, p99
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--iterations', type=int, default=20000)
+    parser.add_argument('--latency-us', type=int, default=0)
+    parser.add_argument('--error-rate', type=float, default=0.0)
+    parser.add_argument('--corrupt-rate', type=float, default=0.0)
+    args = parser.parse_args()
+
+    board = hc.MockAnalogBoard(args.latency_us, args.error_rate,
+                               args.corrupt_rate)
+    psu = hc.HeinzingerPSU(board, max_voltage=30000.0, max_current=2.0)
+    setpoint = hc.Setpoint(volt=1000.0, curr=0.5, relay_on=True)
+
+    cases = [
+        ('set_voltage', lambda i: psu.set_voltage(float(i % 30000))),
+        ('read_voltage', lambda i: psu.read_voltage() >= 0),
+        ('read_current', lambda i: psu.read_current() >= 0),
+        ('read_snapshot', lambda i: psu.read_snapshot().ok),
+        ('apply', lambda i: psu.apply(setpoint)),
+    ]
+    results = [run_case(name, args.iterations, call) for name, call in cases]
+
+    print('mock board: latency %d us, error rate %g, corrupt rate %g'
+          % (args.latency_us, args.error_rate, args.corrupt_rate))
+    print('%-24s %10s %9s %12s %10s %10s'
+          % ('case', 'calls', 'failed', 'calls/s', 'p50 us', 'p99 us'))
+    for name, calls, failed, total, p50, p99 in results:
+        rate = calls / total if total > 0 else 0.0
+        print('%-24s %10d %9d %12.0f %10.2f %10.2f'
+              % (name, calls, failed, rate, p50, p99))
+
+
+if __name__ == '__main__':
+    main()
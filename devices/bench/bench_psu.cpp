@@ -0,0 +1,197 @@
+/*
+ * bench_psu.cpp
+ *
+ * Host-side overhead of the PSU stack, measured against FGMockAnalogBoard so
+ * no hardware is needed. Every case is timed per call and reported as
+ * throughput and p50/p99 latency; with --latency-us 0 the numbers are pure
+ * host cost (packet build, checksum, locking, conversion).
+ *
+ *   bench_psu [--iterations N] [--latency-us US] [--error-rate P]
+ *             [--corrupt-rate P] [--trace FILE]
+ *
+ * --trace turns on FGPacketTrace for every query, to measure its cost.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Error.h"
+#include "FGMockAnalogBoard.h"
+#include "Heinzinger.h"
+#include "PSUGroup.h"
+
+struct BenchResult {
+  std::string name;
+  size_t calls;
+  size_t failures;
+  double seconds;
+  double p50_us;
+  double p99_us;
+};
+
+static BenchResult run_case(const std::string &name, size_t iterations,
+                            const std::function<bool(size_t)> &call) {
+  typedef std::chrono::steady_clock clock;
+  std::vector<double> us;
+  us.reserve(iterations);
+  size_t failures = 0;
+
+  clock::time_point t0 = clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    clock::time_point start = clock::now();
+    if (!call(i))
+      ++failures;
+    us.push_back(
+        std::chrono::duration<double, std::micro>(clock::now() - start)
+            .count());
+  }
+  double total = std::chrono::duration<double>(clock::now() - t0).count();
+
+  std::sort(us.begin(), us.end());
+  BenchResult r;
+  r.name = name;
+  r.calls = iterations;
+  r.failures = failures;
+  r.seconds = total;
+  r.p50_us = us.empty() ? 0 : us[us.size() / 2];
+  r.p99_us = us.empty() ? 0 : us[std::min(us.size() - 1, us.size() * 99 / 100)];
+  return r;
+}
+
+int main(int argc, char **argv) {
+  size_t iterations = 100000;
+  unsigned int latency_us = 0;
+  double error_rate = 0, corrupt_rate = 0;
+  std::string trace_path;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--iterations")
+      iterations = strtoul(argv[i + 1], nullptr, 10);
+    else if (arg == "--latency-us")
+      latency_us = strtoul(argv[i + 1], nullptr, 10);
+    else if (arg == "--error-rate")
+      error_rate = atof(argv[i + 1]);
+    else if (arg == "--corrupt-rate")
+      corrupt_rate = atof(argv[i + 1]);
+    else if (arg == "--trace")
+      trace_path = argv[i + 1];
+    else {
+      std::cerr << "Unknown option " << arg << "\n";
+      return 1;
+    }
+  }
+
+  // Injected failures are expected; keep their logging out of the output
+  // (the formatting cost is still paid and measured).
+  std::ostream discard(nullptr);
+  ErrorStream = &discard;
+  std::streambuf *cerr_buf = std::cerr.rdbuf(nullptr);
+
+  if (!trace_path.empty() && !FGPacketTrace::Get().Enable(trace_path)) {
+    std::cerr << "Cannot open trace file " << trace_path << "\n";
+    return 1;
+  }
+
+  FGMockAnalogBoard board(latency_us, error_rate, corrupt_rate);
+
+  FGAnalogPSUInterface raw;
+  raw.Verbose = false;
+  raw.SetTransport(&board.Transport());
+
+  HeinzingerVia16BitDAC psu(board.Transport(), 30000.0, 2.0, false, 10.0);
+
+  std::vector<BenchResult> results;
+  results.push_back(run_case("Query (Readout)", iterations,
+                             [&](size_t) { return raw.Readout(); }));
+  results.push_back(run_case("Query (Set A+B+relay)", iterations, [&](size_t i) {
+    return raw.Set(7, (uint16_t)i, (uint16_t)~i, i & 1);
+  }));
+  results.push_back(run_case("set_voltage", iterations, [&](size_t i) {
+    return psu.set_voltage((double)(i % 30000));
+  }));
+  results.push_back(run_case("set_voltage (unchanged)", iterations,
+                             [&](size_t) { return psu.set_voltage(1000.0); }));
+  results.push_back(run_case("read_voltage", iterations,
+                             [&](size_t) { return psu.read_voltage() >= 0; }));
+  results.push_back(run_case("read_current", iterations,
+                             [&](size_t) { return psu.read_current() >= 0; }));
+  results.push_back(run_case("read_snapshot", iterations,
+                             [&](size_t) { return psu.read_snapshot().ok; }));
+
+  // Batch conversion of one stream block's voltage column, strided as read
+  // from the ring or a recording.
+  std::vector<PSUStreamSample> block(4096);
+  for (size_t i = 0; i < block.size(); ++i)
+    block[i].adcb[2] = (uint16_t)(i * 16);
+  std::vector<double> volts(block.size());
+  std::shared_ptr<const PSUBlockConverter> conv = psu.voltage_converter();
+  results.push_back(run_case("convert_block (4096)", iterations / 100 + 1,
+                             [&](size_t) {
+                               conv->convert(&block[0].adcb[2],
+                                             sizeof(PSUStreamSample),
+                                             block.size(), volts.data());
+                               return volts[1] > 0;
+                             }));
+
+  // Four boards, read sequentially vs. through a PSUGroup; with nonzero
+  // latency the group should cost about one round trip.
+  const size_t group_size = 4;
+  std::vector<std::unique_ptr<FGMockAnalogBoard>> boards;
+  std::vector<std::unique_ptr<HeinzingerVia16BitDAC>> members;
+  PSUGroup group;
+  for (size_t i = 0; i < group_size; ++i) {
+    boards.push_back(std::unique_ptr<FGMockAnalogBoard>(
+        new FGMockAnalogBoard(latency_us, error_rate, corrupt_rate)));
+    members.push_back(std::unique_ptr<HeinzingerVia16BitDAC>(
+        new HeinzingerVia16BitDAC(boards.back()->Transport(), 30000.0, 2.0,
+                                  false, 10.0)));
+    group.add(*members.back());
+  }
+  size_t group_iterations = std::max<size_t>(1, iterations / group_size);
+  results.push_back(run_case("4x read_snapshot", group_iterations, [&](size_t) {
+    bool ok = true;
+    for (size_t i = 0; i < group_size; ++i)
+      ok = members[i]->read_snapshot().ok && ok;
+    return ok;
+  }));
+  results.push_back(run_case("group read_all (4)", group_iterations,
+                             [&](size_t) {
+                               std::vector<PSUSnapshot> s = group.read_all();
+                               for (size_t i = 0; i < s.size(); ++i)
+                                 if (!s[i].ok)
+                                   return false;
+                               return true;
+                             }));
+  results.push_back(run_case("group shutdown (4)", group_iterations,
+                             [&](size_t) {
+                               std::vector<char> r = group.shutdown();
+                               return std::find(r.begin(), r.end(), 0) ==
+                                      r.end();
+                             }));
+
+  std::cerr.rdbuf(cerr_buf);
+
+  printf("mock board: latency %u us, error rate %g, corrupt rate %g\n",
+         latency_us, error_rate, corrupt_rate);
+  if (!trace_path.empty()) {
+    FGPacketTrace::Get().Flush(5.0);
+    printf("trace: %llu records written, %llu dropped\n",
+           (unsigned long long)FGPacketTrace::Get().WrittenCount(),
+           (unsigned long long)FGPacketTrace::Get().DroppedCount());
+  }
+  printf("%-24s %10s %9s %12s %10s %10s\n", "case", "calls", "failed",
+         "calls/s", "p50 us", "p99 us");
+  for (const BenchResult &r : results)
+    printf("%-24s %10zu %9zu %12.0f %10.2f %10.2f\n", r.name.c_str(), r.calls,
+           r.failures, r.seconds > 0 ? r.calls / r.seconds : 0.0, r.p50_us,
+           r.p99_us);
+  return 0;
+}
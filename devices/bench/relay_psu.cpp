@@ -0,0 +1,180 @@
+/*
+ * relay_psu.cpp
+ *
+ * Output state as the drivers report it: after switch_on(),
+ * read_snapshot().relay_on and is_relay_on() must both say true, and false
+ * after switch_off(), whatever the device's own encoding (the analog
+ * board's relay register is 0 when on); so must the completion of
+ * apply_async(). Driven through IPowerSupply, the way groups, the daemon
+ * and scripts see a supply, for both kinds of driver:
+ *
+ *   analog   HeinzingerVia16BitDAC on FGMockAnalogBoard
+ *   serial   TDKLambdaPSU on a Genesys stand-in behind tcp://127.0.0.1
+ *           (a loopback socket, as for a Moxa port)
+ *
+ *   relay_psu
+ *
+ * Exits 1 if any check fails.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <future>
+#include <memory>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "Error.h"
+#include "FGMockAnalogBoard.h"
+#include "Heinzinger.h"
+#include "SerialPSU.h"
+
+// Answers the TDKLambdaGenesys command set on one loopback connection:
+// "OK" to settings, the output state to OUT?, zeros to MV?/MC?.
+class FakeGenesys {
+public:
+  FakeGenesys() : listener(-1), conn(-1), port(0), out(false) {
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(a);
+    if (listener < 0 || bind(listener, (sockaddr *)&a, sizeof(a)) != 0 ||
+        listen(listener, 1) != 0 ||
+        getsockname(listener, (sockaddr *)&a, &len) != 0)
+      return;
+    port = ntohs(a.sin_port);
+    worker = std::thread(&FakeGenesys::serve, this);
+  }
+  ~FakeGenesys() {
+    shutdown(listener, SHUT_RDWR);
+    if (conn >= 0)
+      shutdown(conn, SHUT_RDWR);
+    if (worker.joinable())
+      worker.join();
+    close(listener);
+  }
+
+  std::string url() const {
+    return "tcp://127.0.0.1:" + std::to_string(port);
+  }
+
+private:
+  int listener, conn, port;
+  bool out;
+  std::thread worker;
+
+  void serve() {
+    conn = accept(listener, nullptr, nullptr);
+    if (conn < 0)
+      return;
+    std::string in;
+    char buf[256];
+    ssize_t n;
+    while ((n = read(conn, buf, sizeof(buf))) > 0) {
+      in.append(buf, n);
+      size_t end;
+      while ((end = in.find('\r')) != std::string::npos) {
+        std::string reply = answer(in.substr(0, end)) + "\r";
+        in.erase(0, end + 1);
+        if (write(conn, reply.data(), reply.size()) < 0)
+          break;
+      }
+    }
+    close(conn);
+  }
+
+  std::string answer(const std::string &cmd) {
+    if (cmd == "IDN?")
+      return "LAMBDA,GEN60-12.5";
+    if (cmd == "OUT?")
+      return out ? "ON" : "OFF";
+    if (cmd == "MV?" || cmd == "MC?")
+      return "0.000";
+    if (cmd == "OUT 1" || cmd == "OUT 0")
+      out = cmd == "OUT 1";
+    else if (cmd == "RST")
+      out = false;
+    return "OK";
+  }
+};
+
+struct RelayCheck {
+  std::string name;
+  bool passed;
+};
+
+// switch_on, then switch_off, each followed by a readback.
+static void check_switching(const std::string &driver, IPowerSupply &psu,
+                            std::vector<RelayCheck> &checks) {
+  bool on = psu.switch_on(true);
+  PSUSnapshot snap = psu.read_snapshot();
+  checks.push_back({driver + ": switch_on", on});
+  checks.push_back({driver + ": snapshot on", snap.ok && snap.relay_on});
+  checks.push_back({driver + ": is_relay_on on", psu.is_relay_on()});
+
+  bool off = psu.switch_off(true);
+  snap = psu.read_snapshot();
+  checks.push_back({driver + ": switch_off", off});
+  checks.push_back({driver + ": snapshot off", snap.ok && !snap.relay_on});
+  checks.push_back({driver + ": is_relay_on off", !psu.is_relay_on()});
+}
+
+// The completion's readback of an apply_async() of the output alone;
+// ok false if it did not complete within a second.
+static PSUSnapshot switched_async(IPowerSupply &psu, bool on) {
+  std::shared_ptr<std::promise<PSUSnapshot>> done =
+      std::make_shared<std::promise<PSUSnapshot>>();
+  std::future<PSUSnapshot> result = done->get_future();
+  Setpoint sp = {0.0, 0.0, on};
+  psu.apply_async(sp, PSUSetRelay,
+                  [done](const PSUSnapshot &snap) { done->set_value(snap); });
+  PSUSnapshot snap;
+  memset(&snap, 0, sizeof(snap));
+  if (result.wait_for(std::chrono::seconds(1)) == std::future_status::ready)
+    snap = result.get();
+  return snap;
+}
+
+static void check_async(const std::string &driver, IPowerSupply &psu,
+                        std::vector<RelayCheck> &checks) {
+  PSUSnapshot snap = switched_async(psu, true);
+  checks.push_back({driver + ": apply_async on", snap.ok && snap.relay_on});
+  snap = switched_async(psu, false);
+  checks.push_back({driver + ": apply_async off", snap.ok && !snap.relay_on});
+}
+
+int main() {
+  std::vector<RelayCheck> checks;
+
+  FGMockAnalogBoard board;
+  HeinzingerVia16BitDAC analog(board.Transport(), 30000.0, 2.0, false, 10.0);
+  checks.push_back({"analog: off at power-up", !analog.is_relay_on()});
+  check_switching("analog", analog, checks);
+  check_async("analog", analog, checks);
+
+  {
+    FakeGenesys genesys;
+    TDKLambdaPSU serial(genesys.url(), TDKLambdaGenesys(6), 60.0, 12.5);
+    checks.push_back({"serial: off at power-up", !serial.is_relay_on()});
+    check_switching("serial", serial, checks);
+    check_async("serial", serial, checks);
+    // The stand-in going away is reported by the TCP thread; expected here.
+    static std::ostream discard(nullptr);
+    ErrorStream = &discard;
+  }
+
+  bool passed = true;
+  for (const RelayCheck &c : checks) {
+    printf("%-32s %s\n", c.name.c_str(), c.passed ? "pass" : "FAIL");
+    passed = passed && c.passed;
+  }
+  return passed ? 0 : 1;
+}
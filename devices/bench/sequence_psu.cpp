@@ -0,0 +1,125 @@
+/*
+ * sequence_psu.cpp
+ *
+ * Loopback harness for the response sequence check of FGAnalogPSUInterface
+ * (CheckSequence), against FGMockAnalogBoard. Every query writes a new DACA
+ * value, so a response taken for the wrong command shows up as a readback
+ * of another value. Cases:
+ *
+ *   late responses      the board counts packets; some responses arrive a
+ *                       turn late. No wrong readback, the check stays on.
+ *   board not counting  SequenceNo never moves. The check turns itself off
+ *                       within MaxDesyncStreak queries, and the stale
+ *                       responses are never taken for failed transfers
+ *                       (which on USB would count towards a link loss).
+ *   ... and reopened    the same with a resync every few queries, as each
+ *                       reopen does; the check must still turn off.
+ *
+ *   sequence_psu [--queries N] [--late-rate P]
+ *
+ * Exits 1 if any case fails.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "Error.h"
+#include "FGMockAnalogBoard.h"
+
+struct SequenceResult {
+  std::string name;
+  size_t queries;
+  size_t ok;
+  size_t wrong; // ok, but the readback answers another command
+  FGTransportStats::Snapshot stats;
+  bool check_on;
+  bool passed;
+};
+
+// Sets DACA to the query's index each time; reopen_every > 0 resyncs the
+// interface that often, as a reconnect does.
+static SequenceResult run_case(const std::string &name,
+                               FGMockAnalogBoard &board, size_t queries,
+                               size_t reopen_every) {
+  FGAnalogPSUInterface psu;
+  psu.Verbose = false;
+  psu.SetTransport(&board.Transport());
+  SequenceResult r;
+  r.name = name;
+  r.queries = queries;
+  r.ok = r.wrong = 0;
+  for (size_t i = 0; i < queries; ++i) {
+    if (reopen_every > 0 && i > 0 && i % reopen_every == 0)
+      psu.SetTransport(&board.Transport());
+    uint16_t daca = (uint16_t)(i + 1);
+    if (!psu.Set(FGAnalogPSUInterface::SetDACAMask, daca, 0, true))
+      continue;
+    ++r.ok;
+    if (psu.DACA_val != daca)
+      ++r.wrong;
+  }
+  r.stats = psu.Stats.Read();
+  r.check_on = psu.SequenceCheckEnabled();
+  r.passed = r.wrong == 0;
+  return r;
+}
+
+int main(int argc, char **argv) {
+  size_t queries = 1000;
+  double late_rate = 0.05;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--queries")
+      queries = strtoul(argv[i + 1], nullptr, 10);
+    else if (arg == "--late-rate")
+      late_rate = atof(argv[i + 1]);
+    else {
+      std::cerr << "Unknown option " << arg << "\n";
+      return 1;
+    }
+  }
+
+  // Injected failures are expected; keep their logging out of the output.
+  std::ostream discard(nullptr);
+  ErrorStream = &discard;
+  std::streambuf *cerr_buf = std::cerr.rdbuf(nullptr);
+
+  const size_t streak = 8; // FGAnalogPSUInterface::MaxDesyncStreak
+  SequenceResult results[3];
+
+  FGMockAnalogBoard late;
+  late.LateRate = late_rate;
+  results[0] = run_case("late responses", late, queries, 0);
+  results[0].passed = results[0].passed && results[0].check_on;
+
+  FGMockAnalogBoard flat;
+  flat.CountsPackets = false;
+  results[1] = run_case("board not counting", flat, queries, 0);
+  results[1].passed = results[1].passed && !results[1].check_on &&
+                      results[1].stats.ReadFailures == 0 &&
+                      results[1].ok + streak >= queries;
+
+  FGMockAnalogBoard reopened;
+  reopened.CountsPackets = false;
+  results[2] = run_case("... and reopened", reopened, queries, 3);
+  results[2].passed = results[2].passed && !results[2].check_on &&
+                      results[2].stats.ReadFailures == 0;
+
+  std::cerr.rdbuf(cerr_buf);
+
+  printf("%-20s %8s %8s %6s %6s %8s %8s %6s %6s\n", "case", "queries", "ok",
+         "wrong", "stale", "desyncs", "rd fail", "check", "");
+  bool passed = true;
+  for (const SequenceResult &r : results) {
+    printf("%-20s %8zu %8zu %6zu %6llu %8llu %8llu %6s %6s\n",
+           r.name.c_str(), r.queries, r.ok, r.wrong,
+           (unsigned long long)r.stats.StaleResponses,
+           (unsigned long long)r.stats.Desyncs,
+           (unsigned long long)r.stats.ReadFailures,
+           r.check_on ? "on" : "off", r.passed ? "pass" : "FAIL");
+    passed = passed && r.passed;
+  }
+  return passed ? 0 : 1;
+}
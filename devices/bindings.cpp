@@ -1,8 +1,22 @@
+#include <pybind11/numpy.h> // For zero-copy stream blocks
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h> // For automatic C++/Python STL conversions if needed elsewhere
+#include <stdexcept>
+#include <unordered_map>
 
+#include "headers/AnalogPSUDriver.h"
+#include "headers/FGMockAnalogBoard.h"
+#include "headers/FGMoxa.h"
 #include "headers/Error.h" // Include Error.h again for direct access to 'extern int Verbosity'
 #include "headers/Heinzinger.h" // This includes AnalogPSU.h -> FGUSBBulk.h -> Error.h (for Verbosity decl)
+#include "headers/PSUCalibrator.h"
+#include "headers/PSUCompletionQueue.h"
+#include "headers/PSUFactory.h"
+#include "headers/PSUGroup.h"
+#include "headers/PSURamp.h"
+#include "headers/PSURecorder.h"
+#include "headers/PSUTelemetry.h"
+#include "headers/SerialPSU.h"
 
 namespace py = pybind11;
 
@@ -14,49 +28,1495 @@ int get_cpp_global_verbosity() { return Verbosity; }
 
 void set_cpp_global_verbosity(int v) { Verbosity = v; }
 
+// Registered on first use instead of at import: registering imports NumPy,
+// most of the module's start-up, and many scripts never read a stream
+// block or a recording. The GIL serialises callers.
+static void register_sample_dtypes() {
+  static bool registered = false;
+  if (registered)
+    return;
+  PYBIND11_NUMPY_DTYPE(PSUStreamSample, t, sequence_no, response, adca, adcb,
+                       daca, dacb, relay);
+  PYBIND11_NUMPY_DTYPE(SerialPSUSample, t, voltage, current, output_on);
+  registered = true;
+}
+
+// Structured dtype matching the sample type, so stream blocks map 1:1.
+template <class PSU, class Sample>
+static py::array_t<Sample> stream_block(py::object self, size_t max_samples) {
+  register_sample_dtypes();
+  typedef std::shared_ptr<const void> Owner;
+  PSU &psu = self.cast<PSU &>();
+  const Sample *data = nullptr;
+  Owner storage;
+  size_t n = psu.borrow_stream(data, max_samples, &storage);
+  // View onto the ring memory. Its base owns that memory, which a restart of
+  // the stream would otherwise free under it.
+  py::capsule base(new Owner(storage),
+                   [](void *p) { delete static_cast<Owner *>(p); });
+  py::array_t<Sample> block(std::vector<ssize_t>{(ssize_t)n},
+                            std::vector<ssize_t>{(ssize_t)sizeof(Sample)},
+                            data, base);
+  block.attr("flags").attr("writeable") = false;
+  return block;
+}
+
+// Read-only view of one recording chunk. Its base owns the chunk's mapping,
+// so the view stays valid when the Recording is reopened or collected.
+static py::array_t<PSUStreamSample> recording_chunk(py::object self,
+                                                    size_t index) {
+  typedef std::shared_ptr<const PSURecordingChunk> Owner;
+  register_sample_dtypes();
+  const PSURecording &rec = self.cast<const PSURecording &>();
+  const PSUStreamSample *data = nullptr;
+  size_t n = 0;
+  py::object base = self;
+  if (index < rec.chunk_count()) {
+    n = rec.records(index, data);
+    base = py::capsule(new Owner(rec.chunk(index)), [](void *p) {
+      delete static_cast<Owner *>(p);
+    });
+  }
+  py::array_t<PSUStreamSample> chunk(
+      std::vector<ssize_t>{(ssize_t)n},
+      std::vector<ssize_t>{(ssize_t)sizeof(PSUStreamSample)}, data, base);
+  chunk.attr("flags").attr("writeable") = false;
+  return chunk;
+}
+
+static py::dict recording_header(const PSURecording &rec, size_t index) {
+  py::dict d;
+  if (index >= rec.chunk_count())
+    return d;
+  const PSURecordingHeader &h = rec.header(index);
+  d["device"] = std::string(h.device);
+  d["location_id"] = h.location_id;
+  d["t_start"] = h.t_start;
+  d["rate_hz"] = h.rate_hz;
+  d["max_voltage"] = h.max_voltage;
+  d["max_current"] = h.max_current;
+  d["max_input_voltage"] = h.max_input_voltage;
+  d["adc_gain"] = h.adc_gain;
+  d["volts_per_count"] = h.max_voltage * h.adc_gain / UINT16_MAX / 10;
+  d["current_per_count"] = h.max_current * h.adc_gain / UINT16_MAX / 10;
+  d["chunk_index"] = h.chunk_index;
+  d["chunk_capacity"] = h.chunk_capacity;
+  return d;
+}
+
+template <class Out>
+static py::array convert_into(const PSUBlockConverter &conv,
+                              const py::array_t<uint16_t> &raw,
+                              const py::object &out) {
+  ssize_t n = raw.shape(0);
+  py::array_t<Out> res;
+  if (out.is_none()) {
+    res = py::array_t<Out>(n);
+  } else {
+    if (!py::isinstance<py::array_t<Out>>(out))
+      throw py::type_error("out must be a float32 or float64 array");
+    res = out.cast<py::array_t<Out>>();
+    if (res.ndim() != 1 || res.shape(0) != n ||
+        res.strides(0) != (ssize_t)sizeof(Out))
+      throw py::value_error("out must be contiguous, 1-D and as long as raw");
+  }
+  const uint16_t *src = raw.data();
+  Out *dst = res.mutable_data(); // raises for a read-only out
+  {
+    py::gil_scoped_release release;
+    conv.convert(src, raw.strides(0), n, dst);
+  }
+  return res;
+}
+
+// raw: 1-D uint16 with any strides, so a view such as
+// recording.chunk(i)["adcb"][:, 2] is read in place from the mapped file.
+// The result is a new array of `dtype` (float32 or float64), or `out`.
+static py::array convert_block(const PSUBlockConverter &conv,
+                               const py::array_t<uint16_t> &raw,
+                               const py::object &dtype,
+                               const py::object &out) {
+  if (raw.ndim() != 1)
+    throw py::value_error("raw must be 1-D");
+  py::dtype dt = out.is_none() ? py::dtype::from_args(dtype)
+                               : py::array(out).dtype();
+  if (dt.kind() == 'f' && dt.itemsize() == 4)
+    return convert_into<float>(conv, raw, out);
+  if (dt.kind() == 'f' && dt.itemsize() == 8)
+    return convert_into<double>(conv, raw, out);
+  throw py::type_error("dtype must be float32 or float64");
+}
+
+static py::dict histogram_dict(const FGLatencyHistogram::Snapshot &h) {
+  std::vector<uint64_t> limits;
+  for (int i = 0; i < FGLatencyHistogram::Buckets; ++i)
+    limits.push_back(FGLatencyHistogram::BucketLimitUs(i));
+  py::dict d;
+  d["bucket_limits_us"] = limits; // upper edges; the last bucket is open
+  d["counts"] = std::vector<uint64_t>(h.Counts.begin(), h.Counts.end());
+  d["count"] = h.Count;
+  d["sum_us"] = h.SumUs;
+  d["max_us"] = h.MaxUs;
+  return d;
+}
+
+// Flat dict, so exporters can map keys to metric names directly.
+template <class PSU> static py::dict stats_dict(const PSU &psu) {
+  FGTransportStats::Snapshot s = psu.get_stats();
+  py::dict d;
+  d["queries"] = s.Queries;
+  d["failures"] = s.Failures;
+  d["write_failures"] = s.WriteFailures;
+  d["read_failures"] = s.ReadFailures;
+  d["magic_errors"] = s.MagicErrors;
+  d["checksum_errors"] = s.ChecksumErrors;
+  d["device_errors"] = s.DeviceErrors;
+  d["device_f00"] = s.DeviceF00;
+  d["sequence_gaps"] = s.SequenceGaps;
+  d["stale_responses"] = s.StaleResponses;
+  d["desyncs"] = s.Desyncs;
+  d["flushed"] = s.Flushed;
+  d["retries"] = s.Retries;
+  d["timeouts"] = s.Timeouts;
+  d["clear_halts"] = s.ClearHalts;
+  d["link_losses"] = s.LinkLosses;
+  d["reconnects"] = s.Reconnects;
+  d["refused"] = s.Refused;
+  d["write_latency"] = histogram_dict(s.WriteLatency);
+  d["read_latency"] = histogram_dict(s.ReadLatency);
+  d["query_latency"] = histogram_dict(s.QueryLatency);
+  return d;
+}
+
+static std::vector<bool> as_bools(const std::vector<char> &v) {
+  return std::vector<bool>(v.begin(), v.end());
+}
+
+// asyncio side of the *_async methods. Each call creates a future on the
+// running event loop, so only from a coroutine, and submits the operation
+// without blocking; the completion is posted from the USB event thread to a
+// PSUCompletionQueue whose eventfd the loop watches with add_reader(), so
+// the loop resolves the futures itself: no executor thread and no GIL for
+// in-flight calls.
+// Everything but the queue is only touched with the GIL held.
+class PSUAsyncDispatcher {
+public:
+  enum Kind { Snapshot, Ok, SnapshotList, OkList };
+
+  // Never destroyed: it owns Python objects, which must not be released
+  // after the interpreter has gone.
+  static PSUAsyncDispatcher &get() {
+    static PSUAsyncDispatcher *d = new PSUAsyncDispatcher;
+    return *d;
+  }
+
+  // start(id) must lead to exactly one post(id, ...), from any thread; it
+  // runs without the GIL. owner (the PSU or group the operation runs on) is
+  // kept alive until that post has been dispatched, so `del psu` with a
+  // future outstanding cannot free it under the USB event thread.
+  py::object submit(Kind kind, py::object owner,
+                    const std::function<void(uint64_t)> &start) {
+    if (!queue.valid())
+      throw std::runtime_error("eventfd unavailable for asynchronous calls");
+    // Raises RuntimeError outside a coroutine: the future needs a loop that
+    // is running to ever complete.
+    py::object current =
+        py::module::import("asyncio").attr("get_running_loop")();
+    attach(current);
+    py::object future = current.attr("create_future")();
+    uint64_t id = next_id++;
+    Pending p = {future, kind, owner};
+    pending[id] = p;
+    {
+      py::gil_scoped_release nogil;
+      start(id);
+    }
+    return future;
+  }
+
+  void post(uint64_t id, const PSUSnapshot &snap) {
+    Result r = {id, std::vector<PSUSnapshot>(1, snap)};
+    queue.post(std::move(r));
+  }
+  void post(uint64_t id, std::vector<PSUSnapshot> &snaps) {
+    Result r = {id, std::vector<PSUSnapshot>()};
+    r.snaps.swap(snaps);
+    queue.post(std::move(r));
+  }
+
+private:
+  struct Result {
+    uint64_t id;
+    std::vector<PSUSnapshot> snaps;
+  };
+  struct Pending {
+    py::object future; // None once its loop has been left
+    Kind kind;
+    py::object owner;
+  };
+  PSUCompletionQueue<Result> queue;
+  py::object loop;
+  std::unordered_map<uint64_t, Pending> pending;
+  std::vector<Result> batch;
+  uint64_t next_id = 1;
+
+  // One loop at a time; moving on is fine once the old one is closed (as
+  // after asyncio.run()) or has nothing outstanding.
+  void attach(py::object current) {
+    if (loop && loop.is(current))
+      return;
+    if (loop) {
+      if (!pending.empty() && !loop.attr("is_closed")().cast<bool>())
+        throw std::runtime_error(
+            "asynchronous PSU calls are still pending on another event loop");
+      // Their operations may still be running: the owners stay referenced
+      // until the results come in, only the futures are dropped.
+      for (auto &p : pending)
+        p.second.future = py::none();
+      try {
+        loop.attr("remove_reader")(queue.fd());
+      } catch (py::error_already_set &) {
+        // a closed loop has no readers left to remove
+      }
+    }
+    current.attr("add_reader")(queue.fd(),
+                               py::cpp_function([this]() { dispatch(); }));
+    loop = current;
+  }
+
+  // On the loop thread.
+  void dispatch() {
+    queue.drain(batch);
+    for (size_t i = 0; i < batch.size(); ++i) {
+      auto it = pending.find(batch[i].id);
+      if (it == pending.end())
+        continue;
+      py::object future = it->second.future;
+      Kind kind = it->second.kind;
+      pending.erase(it); // may release the owner; the operation is over
+      if (future.is_none())
+        continue; // from a loop we have moved away from
+      if (future.attr("done")().cast<bool>())
+        continue; // cancelled; the operation still ran
+      const std::vector<PSUSnapshot> &snaps = batch[i].snaps;
+      py::object value;
+      switch (kind) {
+      case Snapshot:
+        value = py::cast(snaps[0]);
+        break;
+      case Ok:
+        value = py::bool_(snaps[0].ok);
+        break;
+      case SnapshotList:
+        value = py::cast(snaps);
+        break;
+      case OkList: {
+        py::list oks;
+        for (size_t k = 0; k < snaps.size(); ++k)
+          oks.append(py::bool_(snaps[k].ok));
+        value = oks;
+        break;
+      }
+      }
+      future.attr("set_result")(value);
+    }
+    batch.clear();
+  }
+};
+
+// The Python object already wrapping obj, for PSUAsyncDispatcher::submit().
+template <class T> static py::object python_owner(T &obj) {
+  return py::cast(&obj, py::return_value_policy::reference);
+}
+
+static py::object apply_async(HeinzingerVia16BitDAC &psu, const Setpoint &sp,
+                              uint8_t mask) {
+  return PSUAsyncDispatcher::get().submit(
+      PSUAsyncDispatcher::Ok, python_owner(psu),
+      [&psu, sp, mask](uint64_t id) {
+        psu.apply_async(sp, mask, [id](const PSUSnapshot &snap) {
+          PSUAsyncDispatcher::get().post(id, snap);
+        });
+      });
+}
+
+// The group's completion runs once for all members.
+template <class Start>
+static py::object group_async(PSUGroup &group, PSUAsyncDispatcher::Kind kind,
+                              Start start) {
+  return PSUAsyncDispatcher::get().submit(
+      kind, python_owner(group), [start](uint64_t id) {
+        start([id](std::vector<PSUSnapshot> &snaps) {
+          PSUAsyncDispatcher::get().post(id, snaps);
+        });
+      });
+}
+
+// Constructors that bring the device up do it through open() on a lazily
+// built driver, raising if it is not there: the drivers' own eager
+// constructors Utter(), which would end the interpreter.
+template <class PSU>
+static PSU *opened(PSU *built, bool lazy, const std::string &what) {
+  std::unique_ptr<PSU> psu(built);
+  if (!lazy && !psu->open())
+    throw std::runtime_error("Unable to open " + what);
+  return psu.release();
+}
+
+static void check_input_voltage(double max_input_voltage) {
+  if (max_input_voltage <= 0 ||
+      max_input_voltage > HeinzingerVia16BitDAC::board_max_volt())
+    throw py::value_error(
+        "The board has insufficient output voltage to control the PSU");
+}
+
+// One Python class per AnalogPSUDriver model, derived from HeinzingerPSU.
+// Python cannot reject relay calls at compile time, so a relay-less model
+// overrides them to raise instead.
+template <class Model>
+static void bind_psu_model(py::module &m, const char *name) {
+  typedef AnalogPSUDriver<Model> Driver;
+  py::call_guard<py::gil_scoped_release> release_gil;
+  py::class_<Driver, HeinzingerVia16BitDAC> c(m, name);
+  c.def(py::init([](const std::string &usb_path, bool verbose, bool lazy) {
+          return opened(new Driver(usb_path, verbose, true), lazy,
+                        std::string(Model::name()) + " at " + usb_path);
+        }),
+        py::arg("usb_path"), py::arg("verbose") = false,
+        py::arg("lazy") = false, release_gil)
+      .def(py::init([](FGMockAnalogBoard &board, bool verbose) {
+             return new Driver(board.Transport(), verbose);
+           }),
+           py::arg("mock"), py::arg("verbose") = false, py::keep_alive<1, 2>())
+      .def("apply",
+           static_cast<bool (Driver::*)(const Setpoint &, uint8_t, bool)>(
+               &Driver::apply),
+           release_gil, py::arg("setpoint"), py::arg("mask") = 7,
+           py::arg("force") = false,
+           "As HeinzingerPSU.apply; SET_RELAY is ignored on models without "
+           "a relay.")
+      .def(
+          "apply_async",
+          [](Driver &psu, const Setpoint &sp, uint8_t mask) {
+            return apply_async(psu, sp, mask & Driver::all_fields());
+          },
+          py::arg("setpoint"), py::arg("mask") = 7,
+          "As HeinzingerPSU.apply_async; SET_RELAY is ignored on models "
+          "without a relay.")
+      .def_static("model_name", []() { return std::string(Model::name()); })
+      .def_static("has_relay", []() { return Model::has_relay(); })
+      .def_static("counts_to_volts", &Driver::counts_to_volts, py::arg("raw"))
+      .def_static("counts_to_current", &Driver::counts_to_current,
+                  py::arg("raw"));
+  if (!Model::has_relay()) {
+    auto refuse = [](Driver &, bool) -> bool {
+      throw std::logic_error(std::string(Model::name()) +
+                             " has no output relay");
+    };
+    auto refuse_async = [](Driver &) -> py::object {
+      throw std::logic_error(std::string(Model::name()) +
+                             " has no output relay");
+    };
+    c.def("switch_on", refuse, py::arg("force") = false)
+        .def("switch_off", refuse, py::arg("force") = false)
+        .def("switch_on_async", refuse_async)
+        .def("switch_off_async", refuse_async);
+  }
+}
+
+// The calls SerialPSU shares with HeinzingerPSU, under the same names; the
+// caller adds the protocol-specific constructor.
+template <class Protocol>
+static py::class_<SerialPSU<Protocol>> bind_serial_psu(py::module &m,
+                                                       const char *name) {
+  typedef SerialPSU<Protocol> PSU;
+  py::call_guard<py::gil_scoped_release> release_gil;
+  py::class_<PSU, IPowerSupply> c(m, name);
+  c.def("apply", &PSU::apply, release_gil, py::arg("setpoint"),
+        py::arg("mask") = 7, py::arg("force") = false,
+        "Writes the fields of setpoint selected by mask (SET_VOLTAGE | "
+        "SET_CURRENT | SET_RELAY) as one pipelined batch. Fields the supply "
+        "already acknowledged are skipped unless force.")
+      .def("is_relay_on", &PSU::is_relay_on,
+           "Output state from the last acknowledged switch or readback.")
+      .def("read_voltage", &PSU::read_voltage, release_gil,
+           "Measured output voltage in V, -1 on timeout.")
+      .def("read_current", &PSU::read_current, release_gil,
+           "Measured output current in A, -1 on timeout.")
+      .def("read_snapshot", &PSU::read_snapshot, release_gil,
+           "Voltage, current and output state in one batch.")
+      .def("query", &PSU::query, release_gil, py::arg("command"),
+           "Sends a raw command line and returns the reply ('' if none).")
+      .def("command", &PSU::command, release_gil, py::arg("command"),
+           "Sends a raw setting; True if the supply acknowledged it.")
+      .def("set_timeout_ms", &PSU::set_timeout_ms, release_gil, py::arg("ms"))
+      .def("set_pipeline_depth", &PSU::set_pipeline_depth, release_gil,
+           py::arg("depth"),
+           "Commands written ahead of their replies; 1 disables pipelining.")
+      .def_property_readonly("identity", &PSU::identity)
+      .def_property_readonly("port", &PSU::port_name)
+      .def("start_stream", &PSU::start_stream, py::arg("rate_hz"),
+           py::arg("capacity") = 65536, release_gil,
+           "As HeinzingerPSU.start_stream, sampling read_snapshot().")
+      .def("read_stream", &stream_block<PSU, SerialPSUSample>,
+           py::arg("max_samples") = (size_t)-1,
+           "As HeinzingerPSU.read_stream; fields t, voltage, current, "
+           "output_on.")
+      .def_property_readonly("stream_samples", &PSU::stream_samples)
+      .def_property_readonly("stream_failures", &PSU::stream_failures)
+      .def_property_readonly("stream_overruns", &PSU::stream_overruns)
+      .def("get_stats", &stats_dict<PSU>,
+           "As HeinzingerPSU.get_stats; queries count commands.")
+      .def("set_interlock", &PSU::set_interlock, py::arg("max_current"),
+           py::arg("max_slew") = 0.0, py::arg("debounce") = 1, release_gil,
+           "As HeinzingerPSU.set_interlock, in A and A/s, checked on every "
+           "streamed readback.")
+      .def_static("model_name", []() { return std::string(Protocol::name()); });
+  return c;
+}
+
+// One "supplies" entry of a rack config, keys as the PSUConfig fields.
+template <class T>
+static void config_field(const py::dict &entry, const char *key, T &field) {
+  if (entry.contains(key))
+    field = entry[key].cast<T>();
+}
+
+static PSUConfig psu_config(const py::dict &entry,
+                            const std::string &moxa_host) {
+  PSUConfig c;
+  c.moxa_host = moxa_host;
+  config_field(entry, "name", c.name);
+  config_field(entry, "type", c.type);
+  config_field(entry, "usb_path", c.usb_path);
+  config_field(entry, "port", c.port);
+  config_field(entry, "moxa_host", c.moxa_host);
+  config_field(entry, "moxa_port", c.moxa_port);
+  config_field(entry, "address", c.address);
+  config_field(entry, "channel", c.channel);
+  config_field(entry, "max_voltage", c.max_voltage);
+  config_field(entry, "max_current", c.max_current);
+  config_field(entry, "max_input_voltage", c.max_input_voltage);
+  config_field(entry, "baudrate", c.baud);
+  config_field(entry, "reset", c.reset);
+  config_field(entry, "verbose", c.verbose);
+  config_field(entry, "lazy", c.lazy);
+  return c;
+}
+
+// Returned as its most derived Python class (HeinzingerPSU, IsegPSU, ...).
+static py::object make_power_supply(const PSUConfig &c) {
+  std::unique_ptr<IPowerSupply> psu;
+  {
+    py::gil_scoped_release release;
+    psu = PSUFactory::make(c);
+  }
+  if (!psu)
+    throw std::runtime_error("Unable to create power supply '" + c.name +
+                             "' of type '" + c.type + "'");
+  return py::cast(psu.release(), py::return_value_policy::take_ownership);
+}
+
 PYBIND11_MODULE(heinzinger_control, m) {
   m.doc() = "Python bindings for Heinzinger Power Supply Control";
 
-  py::class_<HeinzingerVia16BitDAC>(m, "HeinzingerPSU")
+  // Everything that talks to the board drops the GIL for the USB round trip,
+  // so PSUs driven from different Python threads are polled in parallel.
+  // HeinzingerVia16BitDAC serialises calls on the same instance internally.
+  py::call_guard<py::gil_scoped_release> release_gil;
+
+  py::class_<PSUSnapshot>(m, "PSUSnapshot")
+      .def_readonly("ok", &PSUSnapshot::ok)
+      .def_readonly("voltage", &PSUSnapshot::voltage)
+      .def_readonly("current", &PSUSnapshot::current)
+      .def_readonly("relay_on", &PSUSnapshot::relay_on)
+      .def_readonly("daca", &PSUSnapshot::daca)
+      .def_readonly("dacb", &PSUSnapshot::dacb)
+      .def_readonly("sequence_no", &PSUSnapshot::sequence_no)
+      .def_readonly("errors", &PSUSnapshot::errors)
+      .def_readonly("adca", &PSUSnapshot::adca)
+      .def_readonly("adcb", &PSUSnapshot::adcb);
+
+  py::class_<Setpoint>(m, "Setpoint")
+      .def(py::init([](double volt, double curr, bool relay_on) {
+             Setpoint sp = {volt, curr, relay_on};
+             return sp;
+           }),
+           py::arg("volt") = 0.0, py::arg("curr") = 0.0,
+           py::arg("relay_on") = false)
+      .def_readwrite("volt", &Setpoint::volt)
+      .def_readwrite("curr", &Setpoint::curr)
+      .def_readwrite("relay_on", &Setpoint::relay_on);
+
+  py::class_<InterlockTrip>(m, "InterlockTrip")
+      .def_readonly("tripped", &InterlockTrip::tripped)
+      .def_readonly("t", &InterlockTrip::t)
+      .def_readonly("current", &InterlockTrip::current)
+      .def_readonly("slew", &InterlockTrip::slew)
+      .def_readonly("by_slew", &InterlockTrip::by_slew)
+      .def_readonly("shutdown_ok", &InterlockTrip::shutdown_ok);
+
+  // SetMask bits for HeinzingerPSU.apply()
+  m.attr("SET_VOLTAGE") = (int)FGAnalogPSUInterface::SetDACAMask;
+  m.attr("SET_CURRENT") = (int)FGAnalogPSUInterface::SetDACBMask;
+  m.attr("SET_RELAY") = (int)FGAnalogPSUInterface::SetRelayMask;
+
+  py::class_<FGUSBRetryPolicy>(m, "RetryPolicy",
+                               "USB retry, timeout and reconnect settings "
+                               "of one board.")
+      .def(py::init([]() { return FGUSBRetryPolicy::Default(); }))
+      .def_readwrite("max_attempts", &FGUSBRetryPolicy::MaxAttempts)
+      .def_readwrite("min_timeout_ms", &FGUSBRetryPolicy::MinTimeoutMs)
+      .def_readwrite("max_timeout_ms", &FGUSBRetryPolicy::MaxTimeoutMs)
+      .def_readwrite("timeout_factor", &FGUSBRetryPolicy::TimeoutFactor)
+      .def_readwrite("backoff_us", &FGUSBRetryPolicy::BackoffUs)
+      .def_readwrite("max_backoff_us", &FGUSBRetryPolicy::MaxBackoffUs)
+      .def_readwrite("budget_ms", &FGUSBRetryPolicy::BudgetMs)
+      .def_readwrite("lost_after_failures",
+                     &FGUSBRetryPolicy::LostAfterFailures)
+      .def_readwrite("reconnect_min_ms", &FGUSBRetryPolicy::ReconnectMinMs)
+      .def_readwrite("reconnect_max_ms", &FGUSBRetryPolicy::ReconnectMaxMs);
+
+  py::enum_<PSUFilterKind>(m, "FilterKind")
+      .value("NONE", PSUFilterKind::None)
+      .value("MOVING_AVERAGE", PSUFilterKind::MovingAverage)
+      .value("EXPONENTIAL", PSUFilterKind::Exponential)
+      .value("MEDIAN", PSUFilterKind::Median)
+      .value("BOXCAR", PSUFilterKind::Boxcar);
+
+  py::class_<PSUFilterConfig>(m, "FilterConfig")
+      .def(py::init([](PSUFilterKind kind, unsigned int length, double alpha) {
+             PSUFilterConfig c = {kind, length, alpha};
+             return c;
+           }),
+           py::arg("kind") = PSUFilterKind::None, py::arg("length") = 16,
+           py::arg("alpha") = 0.1)
+      .def_readwrite("kind", &PSUFilterConfig::kind)
+      .def_readwrite("length", &PSUFilterConfig::length)
+      .def_readwrite("alpha", &PSUFilterConfig::alpha);
+
+  py::class_<PSURegulatorConfig>(m, "RegulatorConfig",
+                                 "Gains and limits of the closed-loop "
+                                 "voltage regulation, in volts and seconds.")
+      .def(py::init([](double kp, double ki, double max_rate, double max_trim,
+                       double deadband) {
+             PSURegulatorConfig c = {kp, ki, max_rate, max_trim, deadband};
+             if (!PSUVoltageRegulator::valid(c))
+               throw py::value_error("invalid regulator config");
+             return c;
+           }),
+           py::arg("kp"), py::arg("ki"), py::arg("max_rate"),
+           py::arg("max_trim"), py::arg("deadband") = 0.0)
+      .def_static("defaults", &PSURegulatorConfig::defaults,
+                  py::arg("full_scale"),
+                  "The gains regulate_voltage() uses without a config.")
+      .def_readwrite("kp", &PSURegulatorConfig::kp)
+      .def_readwrite("ki", &PSURegulatorConfig::ki)
+      .def_readwrite("max_rate", &PSURegulatorConfig::max_rate)
+      .def_readwrite("max_trim", &PSURegulatorConfig::max_trim)
+      .def_readwrite("deadband", &PSURegulatorConfig::deadband);
+
+  py::class_<PSURegulatorStatus>(m, "RegulatorStatus")
+      .def_readonly("enabled", &PSURegulatorStatus::enabled)
+      .def_readonly("active", &PSURegulatorStatus::active)
+      .def_readonly("target", &PSURegulatorStatus::target)
+      .def_readonly("command", &PSURegulatorStatus::command)
+      .def_readonly("measured", &PSURegulatorStatus::measured)
+      .def_readonly("error", &PSURegulatorStatus::error)
+      .def_readonly("integral", &PSURegulatorStatus::integral)
+      .def_readonly("updates", &PSURegulatorStatus::updates)
+      .def_readonly("writes", &PSURegulatorStatus::writes);
+
+  // The same filter standalone, e.g. over a stream block's adcb column.
+  py::class_<PSUChannelFilter>(m, "ChannelFilter")
+      .def(py::init([](const PSUFilterConfig &c) {
+             PSUChannelFilter *f = new PSUChannelFilter;
+             if (!f->configure(c)) {
+               delete f;
+               throw py::value_error("invalid filter config");
+             }
+             return f;
+           }),
+           py::arg("config"))
+      .def("reset", &PSUChannelFilter::reset)
+      .def("push", &PSUChannelFilter::push, py::arg("x"),
+           "Feeds one value; True if value changed.")
+      .def_property_readonly("value", &PSUChannelFilter::value)
+      .def_property_readonly("ready", &PSUChannelFilter::ready)
+      .def(
+          "run",
+          [](PSUChannelFilter &f,
+             py::array_t<double, py::array::c_style | py::array::forcecast> x) {
+            std::vector<double> out;
+            out.reserve(x.size());
+            const double *in = x.data();
+            for (ssize_t i = 0; i < x.size(); ++i)
+              if (f.push(in[i]))
+                out.push_back(f.value());
+            py::array_t<double> res(out.size());
+            std::copy(out.begin(), out.end(), res.mutable_data());
+            return res;
+          },
+          py::arg("x"),
+          "Feeds all of x; returns the outputs (fewer than x for BOXCAR).");
+
+  py::class_<FGMockAnalogBoard>(m, "MockAnalogBoard",
+                                 "Simulated analog board for benchmarks and "
+                                 "hardware-free testing.")
+      .def(py::init<unsigned int, double, double>(), py::arg("latency_us") = 0,
+           py::arg("error_rate") = 0.0, py::arg("corrupt_rate") = 0.0)
+      .def_readwrite("latency_us", &FGMockAnalogBoard::LatencyUs)
+      .def_readwrite("error_rate", &FGMockAnalogBoard::ErrorRate)
+      .def_readwrite("corrupt_rate", &FGMockAnalogBoard::CorruptRate)
+      .def_readwrite("late_rate", &FGMockAnalogBoard::LateRate)
+      .def_readwrite("counts_packets", &FGMockAnalogBoard::CountsPackets)
+      .def_readwrite("load_fraction", &FGMockAnalogBoard::LoadFraction)
+      .def_readwrite("noise_counts", &FGMockAnalogBoard::NoiseCounts)
+      .def_property_readonly("queries", &FGMockAnalogBoard::QueryCount)
+      .def_property_readonly("failures", &FGMockAnalogBoard::FailureCount);
+
+  py::class_<PSUCalibration>(m, "Calibration")
+      .def(py::init<>())
+      .def("save", &PSUCalibration::save, py::arg("path"))
+      .def("load", &PSUCalibration::load, py::arg("path"),
+           "Replaces both tables with those in `path`; False if unreadable.")
+      .def_property_readonly(
+          "setpoint_valid",
+          [](const PSUCalibration &c) { return c.setpoint.valid(); })
+      .def_property_readonly(
+          "readback_valid",
+          [](const PSUCalibration &c) { return c.readback.valid(); })
+      .def(
+          "setpoint_register",
+          [](const PSUCalibration &c, double volt) {
+            return c.setpoint.eval(volt);
+          },
+          py::arg("volt"), "DACA register the setpoint table maps volt to.")
+      .def(
+          "readback_volts",
+          [](const PSUCalibration &c, double raw) {
+            return c.readback.eval(raw);
+          },
+          py::arg("raw"), "Voltage the readback table maps ADCB[2] counts to.")
+      .def(
+          "fit_readback",
+          [](PSUCalibration &c, const std::vector<double> &raw,
+             const std::vector<double> &volts) {
+            std::vector<std::pair<double, double>> xy;
+            for (size_t i = 0; i < raw.size() && i < volts.size(); ++i)
+              xy.push_back(std::make_pair(raw[i], volts[i]));
+            return c.readback.fit(xy, 0.0, UINT16_MAX);
+          },
+          py::arg("raw"), py::arg("volts"),
+          "Fits the readback table from ADCB[2] counts and reference "
+          "voltages measured externally (e.g. with a HV divider).")
+      .def("clear_setpoint",
+           [](PSUCalibration &c) { c.setpoint.clear(); })
+      .def("clear_readback",
+           [](PSUCalibration &c) { c.readback.clear(); });
+
+  m.def(
+      "convert_block",
+      [](const py::array_t<uint16_t> &raw, double per_count,
+         const PSUCalibration *calibration, const py::object &dtype,
+         const py::object &out) {
+        PSUBlockConverter conv =
+            calibration ? PSUBlockConverter(calibration->readback, per_count)
+                        : PSUBlockConverter(per_count);
+        return convert_block(conv, raw, dtype, out);
+      },
+      py::arg("raw"), py::arg("per_count"), py::arg("calibration") = nullptr,
+      py::arg("dtype") = "float64", py::arg("out") = py::none(),
+      "Offline form of HeinzingerPSU.convert_block: raw * per_count (see "
+      "Recording.header()'s volts_per_count / current_per_count), or the "
+      "calibration's readback table where it is valid.");
+
+  py::class_<CalibrationPoint>(m, "CalibrationPoint")
+      .def_readonly("set_volt", &CalibrationPoint::set_volt)
+      .def_readonly("daca", &CalibrationPoint::daca)
+      .def_readonly("settled", &CalibrationPoint::settled)
+      .def_readonly("settle_s", &CalibrationPoint::settle_s)
+      .def_readonly("samples", &CalibrationPoint::samples)
+      .def_readonly("raw_volt", &CalibrationPoint::raw_volt)
+      .def_readonly("raw_std", &CalibrationPoint::raw_std)
+      .def_readonly("raw_curr", &CalibrationPoint::raw_curr)
+      .def_readonly("measured_volt", &CalibrationPoint::measured_volt);
+
+  // What every driver has; PSUGroup and load_power_supplies() work with it.
+  py::class_<IPowerSupply>(m, "PowerSupply")
+      .def_property_readonly("model", &IPowerSupply::model)
+      .def_property_readonly("capabilities", &IPowerSupply::capabilities)
+      .def("has", &IPowerSupply::has, py::arg("caps"),
+           "True if every CAP_* bit in caps is supported.")
+      .def_property_readonly("max_voltage", &IPowerSupply::max_voltage)
+      .def_property_readonly("max_current", &IPowerSupply::max_current)
+      .def("apply", &IPowerSupply::apply, release_gil, py::arg("setpoint"),
+           py::arg("mask") = 7, py::arg("force") = false)
+      .def("open", &IPowerSupply::open, release_gil,
+           "Brings the link up now instead of on the first call that needs "
+           "it (lazy construction); True if it is up.")
+      .def_property_readonly("is_open", &IPowerSupply::is_open)
+      .def("read_snapshot", &IPowerSupply::read_snapshot, release_gil)
+      .def("is_relay_on", &IPowerSupply::is_relay_on)
+      .def("set_voltage", &IPowerSupply::set_voltage, release_gil,
+           py::arg("voltage"), py::arg("force") = false)
+      .def("set_current", &IPowerSupply::set_current, release_gil,
+           py::arg("current"), py::arg("force") = false)
+      .def("switch_on", &IPowerSupply::switch_on, release_gil,
+           py::arg("force") = false, "False without CAP_RELAY.")
+      .def("switch_off", &IPowerSupply::switch_off, release_gil,
+           py::arg("force") = false, "False without CAP_RELAY.")
+      .def("shutdown", &IPowerSupply::shutdown, release_gil,
+           "0 V and output off in one write, bypassing deduplication.")
+      .def("start_stream", &IPowerSupply::start_stream, py::arg("rate_hz"),
+           py::arg("capacity") = 65536, release_gil)
+      .def("stop_stream", &IPowerSupply::stop_stream, release_gil)
+      .def("is_streaming", &IPowerSupply::is_streaming)
+      .def("set_interlock", &IPowerSupply::set_interlock,
+           py::arg("max_current"), py::arg("max_slew") = 0.0,
+           py::arg("debounce") = 1, release_gil)
+      .def("disable_interlock", &IPowerSupply::disable_interlock, release_gil)
+      .def("interlock_tripped", &IPowerSupply::interlock_tripped)
+      .def("interlock_trip", &IPowerSupply::interlock_trip, release_gil)
+      .def("reset_interlock", &IPowerSupply::reset_interlock, release_gil)
+      .def("get_stats", &stats_dict<IPowerSupply>)
+      .def("reset_stats", &IPowerSupply::reset_stats);
+
+  m.attr("CAP_RELAY") = (int)PSUCapRelay;
+  m.attr("CAP_STREAM") = (int)PSUCapStream;
+  m.attr("CAP_ASYNC") = (int)PSUCapAsync;
+  m.attr("CAP_INTERLOCK") = (int)PSUCapInterlock;
+  m.attr("CAP_RAW_ADC") = (int)PSUCapRawADC;
+  m.attr("CAP_HOTPLUG") = (int)PSUCapHotplug;
+
+  py::class_<HeinzingerVia16BitDAC, IPowerSupply>(m, "HeinzingerPSU")
       // New USB path-based constructor (preferred)
-      .def(py::init<const std::string&, double, double, bool, double>(),
+      .def(py::init([](const std::string &usb_path, double max_voltage,
+                       double max_current, bool verbose,
+                       double max_input_voltage, bool lazy) {
+             check_input_voltage(max_input_voltage);
+             return opened(new HeinzingerVia16BitDAC(usb_path, max_voltage,
+                                                     max_current, verbose,
+                                                     max_input_voltage, true),
+                           lazy, "USB device at path: " + usb_path);
+           }),
            py::arg("usb_path"),
            py::arg("max_voltage") = 30000.0,
            py::arg("max_current") = 2.0, 
            py::arg("verbose") = false,
-           py::arg("max_input_voltage") = 10.0,
-           "Initialize PSU using USB path identification (recommended)")
+           py::arg("max_input_voltage") = 10.0, py::arg("lazy") = false,
+           release_gil,
+           "Initialize PSU using USB path identification (recommended). "
+           "lazy=True returns without touching USB; the board is opened by "
+           "open(), PSUGroup.open_all() or the first blocking call that needs "
+           "it. *_async calls are refused until then; PSUGroup's open it on "
+           "the member's worker first. Otherwise RuntimeError if the board "
+           "cannot be opened.")
       // Legacy device_index constructor (for backward compatibility)
-      .def(py::init<int, double, double, bool, double>(),
+      .def(py::init([](int device_index, double max_voltage,
+                       double max_current, bool verbose,
+                       double max_input_voltage, bool lazy) {
+             check_input_voltage(max_input_voltage);
+             return opened(new HeinzingerVia16BitDAC(device_index, max_voltage,
+                                                     max_current, verbose,
+                                                     max_input_voltage, true),
+                           lazy, "USB device #" + std::to_string(device_index));
+           }),
            py::arg("device_index") = 0,
            py::arg("max_voltage") = 50000.0,
            py::arg("max_current") = 0.0005, // 0.5 mA
            py::arg("verbose") = false,
-           py::arg("max_input_voltage") = 10.0,
+           py::arg("max_input_voltage") = 10.0, py::arg("lazy") = false,
+           release_gil,
            "Initialize PSU using device index (deprecated - use USB path instead)")
-      .def("switch_on", &HeinzingerVia16BitDAC::switch_on,
-           "Switches the PSU relay on.")
-      .def("switch_off", &HeinzingerVia16BitDAC::switch_off,
-           "Switches the PSU relay off.")
-      .def("set_voltage", &HeinzingerVia16BitDAC::set_voltage,
-           py::arg("set_val"), "Sets the output voltage.")
-      .def("set_current", &HeinzingerVia16BitDAC::set_current,
-           py::arg("set_val"), "Sets the output current limit.")
-      .def("read_voltage", &HeinzingerVia16BitDAC::read_voltage,
-           "Reads the measured output voltage.")
-      .def("read_current", &HeinzingerVia16BitDAC::read_current,
-           "Reads the measured output current.")
-      .def("set_max_volt", &HeinzingerVia16BitDAC::set_max_volt,
+      // Simulated board, no USB involved
+      .def(py::init([](FGMockAnalogBoard &board, double max_voltage,
+                       double max_current, bool verbose,
+                       double max_input_voltage) {
+             return new HeinzingerVia16BitDAC(board.Transport(), max_voltage,
+                                              max_current, verbose,
+                                              max_input_voltage);
+           }),
+           py::arg("mock"), py::arg("max_voltage") = 30000.0,
+           py::arg("max_current") = 2.0, py::arg("verbose") = false,
+           py::arg("max_input_voltage") = 10.0, py::keep_alive<1, 2>(),
+           "Initialize PSU against a MockAnalogBoard")
+      // force=True sends the write even if the board already holds the value
+      .def("switch_on", &HeinzingerVia16BitDAC::switch_on, release_gil,
+           py::arg("force") = false, "Switches the PSU relay on.")
+      .def("switch_off", &HeinzingerVia16BitDAC::switch_off, release_gil,
+           py::arg("force") = false, "Switches the PSU relay off.")
+      .def("apply",
+           static_cast<bool (HeinzingerVia16BitDAC::*)(const Setpoint &,
+                                                       uint8_t, bool)>(
+               &HeinzingerVia16BitDAC::apply),
+           release_gil, py::arg("setpoint"),
+           py::arg("mask") = 7, py::arg("force") = false,
+           "Writes the fields of setpoint selected by mask (SET_VOLTAGE | "
+           "SET_CURRENT | SET_RELAY) in a single USB round trip. Fields the "
+           "board already holds are skipped unless force is set.")
+      .def("set_voltage", &HeinzingerVia16BitDAC::set_voltage, release_gil,
+           py::arg("set_val"), py::arg("force") = false,
+           "Sets the output voltage.")
+      .def("set_current", &HeinzingerVia16BitDAC::set_current, release_gil,
+           py::arg("set_val"), py::arg("force") = false,
+           "Sets the output current limit.")
+      .def_property_readonly("skipped_writes",
+                             &HeinzingerVia16BitDAC::skipped_write_count,
+                             "Setpoint fields not sent because unchanged.")
+      .def("read_voltage", &HeinzingerVia16BitDAC::read_voltage, release_gil,
+           py::arg("filtered") = false,
+           "Reads the measured output voltage. filtered=True returns the "
+           "set_filter() output, from the stream if one is running.")
+      .def("read_current", &HeinzingerVia16BitDAC::read_current, release_gil,
+           py::arg("filtered") = false,
+           "Reads the measured output current. filtered=True as for "
+           "read_voltage.")
+      .def("read_snapshot", &HeinzingerVia16BitDAC::read_snapshot, release_gil,
+           "Reads voltage, current, relay and all raw ADC/DAC registers in a "
+           "single USB round trip.")
+      // Awaitable forms: `await psu.read_snapshot_async()`. They never block
+      // the event loop (see PSUAsyncDispatcher); setpoint writes always go
+      // out, without the deduplication of the blocking calls.
+      .def(
+          "read_snapshot_async",
+          [](HeinzingerVia16BitDAC &psu) {
+            return PSUAsyncDispatcher::get().submit(
+                PSUAsyncDispatcher::Snapshot, python_owner(psu),
+                [&psu](uint64_t id) {
+                  psu.read_snapshot_async([id](const PSUSnapshot &snap) {
+                    PSUAsyncDispatcher::get().post(id, snap);
+                  });
+                });
+          },
+          "Future for read_snapshot() on the running asyncio loop.")
+      .def("apply_async", &apply_async, py::arg("setpoint"),
+           py::arg("mask") = 7,
+           "Future for apply(setpoint, mask, force=True); resolves to the "
+           "success flag.")
+      .def(
+          "set_voltage_async",
+          [](HeinzingerVia16BitDAC &psu, double v) {
+            Setpoint sp = {v, 0.0, false};
+            return apply_async(psu, sp, FGAnalogPSUInterface::SetDACAMask);
+          },
+          py::arg("set_val"))
+      .def(
+          "set_current_async",
+          [](HeinzingerVia16BitDAC &psu, double c) {
+            Setpoint sp = {0.0, c, false};
+            return apply_async(psu, sp, FGAnalogPSUInterface::SetDACBMask);
+          },
+          py::arg("set_val"))
+      .def("switch_on_async",
+           [](HeinzingerVia16BitDAC &psu) {
+             Setpoint sp = {0.0, 0.0, true};
+             return apply_async(psu, sp, FGAnalogPSUInterface::SetRelayMask);
+           })
+      .def("switch_off_async",
+           [](HeinzingerVia16BitDAC &psu) {
+             Setpoint sp = {0.0, 0.0, false};
+             return apply_async(psu, sp, FGAnalogPSUInterface::SetRelayMask);
+           })
+      .def("set_max_volt", &HeinzingerVia16BitDAC::set_max_volt, release_gil,
            "Sets the voltage to its maximum configured value.")
-      .def("set_max_curr", &HeinzingerVia16BitDAC::set_max_curr,
+      .def("set_max_curr", &HeinzingerVia16BitDAC::set_max_curr, release_gil,
            "Sets the current limit to its maximum configured value.")
-      .def("is_relay_on", &HeinzingerVia16BitDAC::is_relay_on,
+      .def("is_relay_on", &HeinzingerVia16BitDAC::is_relay_on, release_gil,
          "Return True if the PSU output relay is closed (output ON).")
-      .def("readADC", &HeinzingerVia16BitDAC::readADC,
-           "Reads and prints raw ADC values (for debugging).");
+      .def("readADC", &HeinzingerVia16BitDAC::readADC, release_gil,
+           "Reads and prints raw ADC values (for debugging).")
+      .def("start_stream", &HeinzingerVia16BitDAC::start_stream,
+           py::arg("rate_hz"), py::arg("capacity") = 65536, release_gil,
+           "Starts background acquisition at rate_hz (<= 0: as fast as the "
+           "board answers) into a ring buffer of `capacity` samples.")
+      .def("stop_stream", &HeinzingerVia16BitDAC::stop_stream, release_gil,
+           "Stops background acquisition.")
+      .def("is_streaming", &HeinzingerVia16BitDAC::is_streaming)
+      .def("read_stream",
+           &stream_block<HeinzingerVia16BitDAC, PSUStreamSample>,
+           py::arg("max_samples") = (size_t)-1,
+           "Returns the next block of streamed samples as a read-only NumPy "
+           "structured array (fields t, sequence_no, response, adca, adcb, "
+           "daca, dacb, relay). The array is a view onto the ring buffer: "
+           "its samples are only valid until the next read_stream() call, "
+           "which hands their slots back to the stream (the memory itself "
+           "stays allocated); copy() it to keep it. An empty array means no "
+           "new samples.")
+      .def_property_readonly("stream_samples",
+                             &HeinzingerVia16BitDAC::stream_samples)
+      .def_property_readonly("stream_failures",
+                             &HeinzingerVia16BitDAC::stream_failures)
+      .def_property_readonly("stream_overruns",
+                             &HeinzingerVia16BitDAC::stream_overruns)
+      .def("get_stats", &stats_dict<HeinzingerVia16BitDAC>,
+           "Transaction counters (queries, failures, retries, timeouts, "
+           "magic/checksum errors, device error words, sequence gaps, "
+           "stale responses, desyncs) and log2 latency "
+           "histograms of the write, read and whole-query phases.")
+      .def("reset_stats", &HeinzingerVia16BitDAC::reset_stats)
+      .def_property("sequence_check", &HeinzingerVia16BitDAC::sequence_check,
+                    &HeinzingerVia16BitDAC::set_sequence_check,
+                    "Whether responses are matched to commands by sequence "
+                    "number; set False for firmware that does not count "
+                    "every packet. Turns itself off after repeated losses.")
+      .def("set_retry_policy", &HeinzingerVia16BitDAC::set_retry_policy,
+           py::arg("policy"), release_gil,
+           "Replaces the board's RetryPolicy; False if it is invalid.")
+      .def("retry_policy", &HeinzingerVia16BitDAC::retry_policy, release_gil)
+      .def_property_readonly("link_lost", &HeinzingerVia16BitDAC::link_lost,
+                             "True while the board is being reopened in the "
+                             "background.")
+      .def_property_readonly("hotplug_enabled",
+                             &HeinzingerVia16BitDAC::hotplug_enabled,
+                             "True if unplugging and re-attaching the board "
+                             "is seen from USB hotplug events.")
+      .def("set_interlock", &HeinzingerVia16BitDAC::set_interlock,
+           py::arg("max_current"), py::arg("max_slew") = 0.0,
+           py::arg("debounce") = 1, release_gil,
+           "Arms the overcurrent/arc interlock. While streaming, the stream "
+           "thread drives the voltage to 0 and opens the relay as soon as "
+           "`debounce` consecutive samples exceed max_current or rise faster "
+           "than max_slew per second (0: no slew limit).")
+      .def("disable_interlock", &HeinzingerVia16BitDAC::disable_interlock,
+           release_gil)
+      .def("interlock_tripped", &HeinzingerVia16BitDAC::interlock_tripped)
+      .def("interlock_trip", &HeinzingerVia16BitDAC::interlock_trip,
+           release_gil, "Details of the last trip (an InterlockTrip).")
+      .def("reset_interlock", &HeinzingerVia16BitDAC::reset_interlock,
+           release_gil,
+           "Clears a trip so the output can be raised again.")
+      .def("set_filter", &HeinzingerVia16BitDAC::set_filter,
+           py::arg("config"), release_gil,
+           "Filters every streamed ADCB sample with config (a FilterConfig); "
+           "False if the config is invalid.")
+      .def("filter", &HeinzingerVia16BitDAC::filter, release_gil)
+      .def(
+          "regulate_voltage",
+          [](HeinzingerVia16BitDAC &self, double target, py::object config) {
+            if (config.is_none()) {
+              py::gil_scoped_release release;
+              return self.regulate_voltage(target);
+            }
+            PSURegulatorConfig c = config.cast<PSURegulatorConfig>();
+            py::gil_scoped_release release;
+            return self.regulate_voltage(target, c);
+          },
+          py::arg("target"), py::arg("config") = py::none(),
+          "Holds the output at target: while streaming, the stream thread "
+          "trims DACA from the filtered voltage readback (see set_filter) "
+          "with a rate-limited PI loop, on the stream's own packets. "
+          "set_voltage() then moves the target. config: a RegulatorConfig, "
+          "default RegulatorConfig.defaults(max_voltage). False if the "
+          "target or config is refused.")
+      .def("stop_regulation", &HeinzingerVia16BitDAC::stop_regulation,
+           release_gil, "Ends regulation; the DAC keeps its last command.")
+      .def("regulation", &HeinzingerVia16BitDAC::regulation, release_gil,
+           "The loop's state (a RegulatorStatus).")
+      .def("set_calibration", &HeinzingerVia16BitDAC::set_calibration,
+           py::arg("calibration"), release_gil,
+           "Uses the Calibration's tables for setpoints and readback.")
+      .def("calibration", &HeinzingerVia16BitDAC::calibration, release_gil)
+      .def("clear_calibration", &HeinzingerVia16BitDAC::clear_calibration,
+           release_gil, "Back to the linear conversions.")
+      .def(
+          "convert_block",
+          [](const HeinzingerVia16BitDAC &psu,
+             const py::array_t<uint16_t> &raw, bool current,
+             const py::object &dtype, const py::object &out) {
+            std::shared_ptr<const PSUBlockConverter> conv;
+            {
+              py::gil_scoped_release release;
+              conv = current ? psu.current_converter()
+                             : psu.voltage_converter();
+            }
+            return convert_block(*conv, raw, dtype, out);
+          },
+          py::arg("raw"), py::arg("current") = false,
+          py::arg("dtype") = "float64", py::arg("out") = py::none(),
+          "Converts raw voltage (or current) monitor counts, e.g. "
+          "read_stream()[\"adcb\"][:, 2], to volts (amps) as read_voltage() "
+          "(read_current()) would, calibration included. raw is a 1-D "
+          "uint16 array, read in place whatever its strides; returns a new "
+          "float32/float64 array, or fills `out`.");
+
+  // Fixed-range models; ranges, channels and relay come from their traits.
+  bind_psu_model<Heinzinger30kV>(m, "Heinzinger30kV");
+  bind_psu_model<FUG50kV>(m, "FUG50kV");
+
+  // Serial supplies, same calls as HeinzingerPSU. Construction brings the
+  // supply up (remote mode, identity) and drops the GIL while doing so;
+  // RuntimeError if it does not answer. lazy=True leaves that to open() or
+  // the first call that needs it.
+  bind_serial_psu<TDKLambdaGenesys>(m, "TDKLambdaPSU")
+      .def(py::init([](const std::string &port, double max_voltage,
+                       double max_current, int address,
+                       unsigned int baudrate, bool reset, bool verbose,
+                       bool lazy) {
+             return opened(new TDKLambdaPSU(port,
+                                            TDKLambdaGenesys(address, reset),
+                                            max_voltage, max_current, baudrate,
+                                            verbose, true),
+                           lazy, std::string(TDKLambdaGenesys::name()) +
+                                     " on " + port);
+           }),
+           py::arg("port"), py::arg("max_voltage"), py::arg("max_current"),
+           py::arg("address") = 6, py::arg("baudrate") = 9600,
+           py::arg("reset") = true, py::arg("verbose") = false,
+           py::arg("lazy") = false, release_gil,
+           "TDK-Lambda Genesys at `address` on a serial port; reset=True "
+           "sends RST (output off) at bring-up, as TDKLambda.py did.");
+  bind_serial_psu<IsegSCPI>(m, "IsegPSU")
+      .def(py::init([](const std::string &port, double max_voltage,
+                       double max_current, int channel,
+                       unsigned int baudrate, bool verbose, bool lazy) {
+             return opened(new IsegPSU(port, IsegSCPI(channel), max_voltage,
+                                       max_current, baudrate, verbose, true),
+                           lazy, std::string(IsegSCPI::name()) + " on " +
+                                     port);
+           }),
+           py::arg("port"), py::arg("max_voltage"), py::arg("max_current"),
+           py::arg("channel") = 0, py::arg("baudrate") = 9600,
+           py::arg("verbose") = false, py::arg("lazy") = false, release_gil,
+           "iseg channel over SCPI. HVMICC is not acknowledged "
+           "automatically; use command(':CONF:HVMICC HV_OK').");
+
+  py::class_<FGMoxaPorts>(m, "MoxaPorts")
+      .def(py::init<const std::string &, const std::vector<int> &, double>(),
+           py::arg("host"), py::arg("ports"), py::arg("timeout_s") = 1.0,
+           release_gil,
+           "Persistent connections to the given ports of a Moxa serial "
+           "device server, all connected in parallel.")
+      .def_static(
+          "from_config",
+          [](const std::string &path) {
+            // moxa.py's format; the example config spells the host "ip".
+            py::object f = py::module::import("io").attr("open")(
+                path, "r", py::arg("encoding") = "utf-8");
+            py::dict cfg = py::module::import("json").attr("load")(f);
+            f.attr("close")();
+            py::dict moxa = cfg.attr("get")("moxa", py::dict());
+            std::string host =
+                moxa.attr("get")("host", moxa.attr("get")("ip", ""))
+                    .cast<std::string>();
+            std::vector<int> ports =
+                moxa.attr("get")("ports", py::list()).cast<std::vector<int>>();
+            double timeout = moxa.attr("get")("timeout_s", 1.0).cast<double>();
+            py::gil_scoped_release release;
+            return new FGMoxaPorts(host, ports, timeout);
+          },
+          py::arg("path") = "config_example.json",
+          "Reads {\"moxa\": {\"host\" (or \"ip\"), \"ports\", "
+          "\"timeout_s\"}} as moxa.load_config() does.")
+      .def_readonly("host", &FGMoxaPorts::Host)
+      .def_readonly("ports", &FGMoxaPorts::Ports)
+      .def_readonly("timeout_s", &FGMoxaPorts::TimeoutS)
+      .def("url", &FGMoxaPorts::Url, py::arg("port"),
+           "Port name for TDKLambdaPSU / IsegPSU, e.g. "
+           "TDKLambdaPSU(moxa.url(4001), 60, 12.5).")
+      .def("connected", &FGMoxaPorts::Connected, py::arg("port"))
+      .def(
+          "exchange",
+          [](FGMoxaPorts &moxa, int port, const py::bytes &payload,
+             const py::bytes &terminator, double timeout_s) {
+            std::string out = payload, term = terminator, reply;
+            {
+              py::gil_scoped_release release;
+              reply = moxa.Exchange(port, out, term, timeout_s);
+            }
+            return py::bytes(reply);
+          },
+          py::arg("port"), py::arg("payload") = py::bytes(),
+          py::arg("terminator") = py::bytes(), py::arg("timeout_s") = -1.0,
+          "moxa.exchange() over the persistent connection: sends payload and "
+          "returns the reply up to terminator, or until the port goes quiet "
+          "if none is given. b'' on timeout, or while a TDKLambdaPSU / "
+          "IsegPSU has the port open.")
+      .def("scan", [](const FGMoxaPorts &moxa) {
+        py::list results;
+        for (int port : moxa.Ports) {
+          py::dict r;
+          bool ok = moxa.Connected(port);
+          r["port"] = port;
+          r["ok"] = ok;
+          r["msg"] = ok ? "connect_ok" : "not connected";
+          results.append(r);
+        }
+        return results;
+      }, "As moxa.scan(), from the persistent connections' state.");
+
+  m.def(
+      "make_power_supply",
+      [](const py::dict &entry, const std::string &moxa_host) {
+        return make_power_supply(psu_config(entry, moxa_host));
+      },
+      py::arg("config"), py::arg("moxa_host") = "",
+      "Builds a PowerSupply from one config entry: type (see "
+      "power_supply_types()), usb_path or port or moxa_port, max_voltage, "
+      "max_current, and address, channel, baudrate, reset, verbose, "
+      "max_input_voltage, lazy where they apply.");
+  m.def("power_supply_types", &PSUFactory::types);
+  m.def(
+      "load_power_supplies",
+      [](const std::string &path) {
+        py::object f = py::module::import("io").attr("open")(
+            path, "r", py::arg("encoding") = "utf-8");
+        py::dict cfg = py::module::import("json").attr("load")(f);
+        f.attr("close")();
+        py::dict moxa = cfg.attr("get")("moxa", py::dict());
+        std::string host =
+            moxa.attr("get")("host", moxa.attr("get")("ip", ""))
+                .cast<std::string>();
+        py::list entries = cfg.attr("get")("supplies", py::list());
+        py::dict psus;
+        for (size_t i = 0; i < entries.size(); ++i) {
+          PSUConfig c = psu_config(entries[i].cast<py::dict>(), host);
+          if (c.name.empty())
+            c.name = c.type + std::to_string(i);
+          psus[py::str(c.name)] = make_power_supply(c);
+        }
+        return psus;
+      },
+      py::arg("path") = "config_example.json",
+      "Builds every entry of the config's \"supplies\" list (see "
+      "make_power_supply); moxa_port entries use the \"moxa\" section's "
+      "host. Returns {name: PowerSupply} in file order.");
+
+  py::class_<PSUCalibrator>(m, "Calibrator")
+      .def(py::init<HeinzingerVia16BitDAC &>(), py::arg("psu"),
+           py::keep_alive<1, 2>())
+      .def(
+          "start",
+          [](PSUCalibrator &cal, double from_volt, double to_volt, int steps,
+             int window, double tolerance_counts, int average,
+             double timeout_s, double rate_hz) {
+            CalibrationSweepConfig c = {from_volt, to_volt, steps,
+                                        window, tolerance_counts, average,
+                                        timeout_s, rate_hz};
+            return cal.start(c);
+          },
+          py::arg("from_volt"), py::arg("to_volt"), py::arg("steps") = 33,
+          py::arg("window") = 20, py::arg("tolerance_counts") = 2.0,
+          py::arg("average") = 200, py::arg("timeout_s") = 10.0,
+          py::arg("rate_hz") = 2000.0, release_gil,
+          "Steps the voltage from from_volt to to_volt in `steps` points on "
+          "a C++ thread. Each point waits until the means of consecutive "
+          "`window`-sample blocks of ADCB[2] agree within tolerance_counts, "
+          "then averages `average` samples. Switch the output on first; the "
+          "sweep ends at 0 V.")
+      .def("stop", &PSUCalibrator::stop, release_gil)
+      .def("wait", &PSUCalibrator::wait, py::arg("timeout_s") = -1.0,
+           release_gil)
+      .def("running", &PSUCalibrator::running)
+      .def("has_failed", &PSUCalibrator::has_failed)
+      .def("points", &PSUCalibrator::points)
+      .def(
+          "fit",
+          [](const PSUCalibrator &cal) -> py::object {
+            PSUCalibration c;
+            if (!cal.fit(c))
+              return py::none();
+            return py::cast(c);
+          },
+          "Calibration with the fitted setpoint table (and the PSU's current "
+          "readback table), or None if fewer than two points settled.");
+
+  py::class_<RampPoint>(m, "RampPoint")
+      .def_readonly("t_target", &RampPoint::t_target)
+      .def_readonly("t_issued", &RampPoint::t_issued)
+      .def_readonly("t_done", &RampPoint::t_done)
+      .def_readonly("set_volt", &RampPoint::set_volt)
+      .def_readonly("ok", &RampPoint::ok)
+      .def_readonly("read_volt", &RampPoint::read_volt)
+      .def_readonly("read_curr", &RampPoint::read_curr);
+
+  py::class_<PSURamp>(m, "VoltageRamp")
+      .def(py::init<HeinzingerVia16BitDAC &>(), py::arg("psu"),
+           py::keep_alive<1, 2>())
+      .def(
+          "start",
+          [](PSURamp &ramp,
+             const std::vector<std::pair<double, double>> &steps) {
+            std::vector<RampStep> profile;
+            for (const auto &s : steps) {
+              RampStep step = {s.first, s.second};
+              profile.push_back(step);
+            }
+            return ramp.start(profile);
+          },
+          py::arg("steps"), release_gil,
+          "Plays back a list of (voltage, dwell_seconds) steps on a C++ "
+          "thread. Returns False if a ramp is already running.")
+      .def(
+          "start_slope",
+          [](PSURamp &ramp, double from, double to, double volt_per_s,
+             double step_volt) {
+            return ramp.start(PSURamp::slope(from, to, volt_per_s, step_volt));
+          },
+          py::arg("from_volt"), py::arg("to_volt"), py::arg("volt_per_s"),
+          py::arg("step_volt"), release_gil,
+          "Ramps from from_volt to to_volt at volt_per_s in steps of "
+          "step_volt.")
+      .def("stop", &PSURamp::stop, release_gil,
+           "Aborts the ramp at the next step; the PSU keeps the last "
+           "setpoint.")
+      .def("wait", &PSURamp::wait, py::arg("timeout_s") = -1.0, release_gil,
+           "Waits for the ramp to finish; returns True if it has.")
+      .def("running", &PSURamp::running)
+      .def("has_failed", &PSURamp::has_failed)
+      .def("trace", &PSURamp::trace,
+           "Per-step timing (seconds from ramp start) and readback.")
+      .def("max_jitter", &PSURamp::max_jitter,
+           "Largest deviation of a step's write from its deadline, in s.");
+
+  py::class_<PSUGroup>(m, "PSUGroup")
+      .def(py::init<>())
+      .def("add", &PSUGroup::add, py::arg("psu"), py::keep_alive<1, 2>(),
+           release_gil, "Adds any PowerSupply; returns its result index.")
+      .def("__len__", &PSUGroup::size)
+      .def(
+          "open_all",
+          [](PSUGroup &group) { return as_bools(group.open_all()); },
+          release_gil,
+          "Opens every PSU concurrently (see PowerSupply.open()); True for "
+          "each one that is up.")
+      .def("read_all", &PSUGroup::read_all, release_gil,
+           "Reads a PSUSnapshot from every PSU concurrently.")
+      .def(
+          "apply_all",
+          [](PSUGroup &group, const Setpoint &sp, uint8_t mask, bool force) {
+            return as_bools(group.apply_all(sp, mask, force));
+          },
+          py::arg("setpoint"), py::arg("mask") = 7, py::arg("force") = false,
+          release_gil, "Applies the same setpoint to every PSU concurrently.")
+      .def(
+          "apply_each",
+          [](PSUGroup &group, const std::vector<Setpoint> &sps, uint8_t mask,
+             bool force) {
+            return as_bools(group.apply_each(sps, mask, force));
+          },
+          py::arg("setpoints"), py::arg("mask") = 7, py::arg("force") = false,
+          release_gil,
+          "Applies setpoints[i] to the i-th PSU, all concurrently.")
+      .def(
+          "shutdown",
+          [](PSUGroup &group) { return as_bools(group.shutdown()); },
+          release_gil,
+          "0 V and relay off on every PSU at once, bypassing deduplication.")
+      // Awaitable forms, one future per group call; no worker threads.
+      .def(
+          "read_all_async",
+          [](PSUGroup &group) {
+            return group_async(group, PSUAsyncDispatcher::SnapshotList,
+                               [&group](PSUGroup::AsyncCallback cb) {
+                                 group.read_all_async(std::move(cb));
+                               });
+          },
+          "Future for read_all() on the running asyncio loop.")
+      .def(
+          "apply_all_async",
+          [](PSUGroup &group, const Setpoint &sp, uint8_t mask) {
+            return group_async(group, PSUAsyncDispatcher::OkList,
+                               [&group, sp, mask](PSUGroup::AsyncCallback cb) {
+                                 group.apply_all_async(sp, mask,
+                                                       std::move(cb));
+                               });
+          },
+          py::arg("setpoint"), py::arg("mask") = 7,
+          "Future for apply_all(setpoint, mask, force=True).")
+      .def(
+          "apply_each_async",
+          [](PSUGroup &group, const std::vector<Setpoint> &sps, uint8_t mask) {
+            return group_async(group, PSUAsyncDispatcher::OkList,
+                               [&group, sps, mask](PSUGroup::AsyncCallback cb) {
+                                 group.apply_each_async(sps, mask,
+                                                        std::move(cb));
+                               });
+          },
+          py::arg("setpoints"), py::arg("mask") = 7,
+          "Future for apply_each(setpoints, mask, force=True).")
+      .def(
+          "shutdown_async",
+          [](PSUGroup &group) {
+            return group_async(group, PSUAsyncDispatcher::OkList,
+                               [&group](PSUGroup::AsyncCallback cb) {
+                                 group.shutdown_async(std::move(cb));
+                               });
+          },
+          "Future for shutdown().")
+      .def(
+          "open_all_async",
+          [](PSUGroup &group) {
+            return group_async(group, PSUAsyncDispatcher::OkList,
+                               [&group](PSUGroup::AsyncCallback cb) {
+                                 group.open_all_async(std::move(cb));
+                               });
+          },
+          "Future for open_all(), the members opening on their worker "
+          "threads.");
+
+  py::class_<PSURecorder>(m, "Recorder")
+      .def(py::init<HeinzingerVia16BitDAC &>(), py::arg("psu"),
+           py::keep_alive<1, 2>())
+      .def("start", &PSURecorder::start, py::arg("base_path"),
+           py::arg("rate_hz"), py::arg("chunk_records") = 4 << 20,
+           py::arg("device") = "", release_gil,
+           "Records the PSU's stream (started at rate_hz unless already "
+           "running) into base_path.NNNN.psurec chunk files. The recorder "
+           "then consumes the stream; do not call read_stream meanwhile.")
+      .def("stop", &PSURecorder::stop, release_gil,
+           "Writes out what is queued and closes the files.")
+      .def("running", &PSURecorder::running)
+      .def_property_readonly("records_written",
+                             &PSURecorder::records_written)
+      .def_property_readonly("chunk_count", &PSURecorder::chunk_count);
+
+  py::class_<PSURecording>(m, "Recording")
+      .def(py::init<>())
+      .def("open", &PSURecording::open, py::arg("base_path"), release_gil,
+           "Maps every chunk of a recording; False if there is none.")
+      .def("__len__", &PSURecording::total_records)
+      .def_property_readonly("chunk_count", &PSURecording::chunk_count)
+      .def("header", &recording_header, py::arg("chunk") = 0,
+           "Device and calibration: value = max * (adc_gain * raw / 65535) "
+           "/ 10, for adcb[:, 2] (voltage) and adcb[:, 3] (current); "
+           "volts_per_count and current_per_count are those factors, for "
+           "convert_block().")
+      .def("chunk", &recording_chunk, py::arg("index"),
+           "Structured NumPy view (same dtype as read_stream) of a chunk, "
+           "mapped from the file without copying.")
+      .def(
+          "chunks",
+          [](py::object self) {
+            py::list out;
+            size_t n = self.cast<const PSURecording &>().chunk_count();
+            for (size_t i = 0; i < n; ++i)
+              out.append(recording_chunk(self, i));
+            return out;
+          },
+          "Views of all chunks; numpy.concatenate() them for one array.");
+
+  py::class_<PSUTelemetrySample>(m, "TelemetrySample")
+      .def_readonly("snapshot", &PSUTelemetrySample::snap)
+      .def_readonly("t", &PSUTelemetrySample::t)
+      .def_readonly("updates", &PSUTelemetrySample::updates)
+      .def_readonly("failures", &PSUTelemetrySample::failures)
+      .def_readonly("max_voltage", &PSUTelemetrySample::max_voltage)
+      .def_readonly("max_current", &PSUTelemetrySample::max_current)
+      .def_readonly("setpoint", &PSUTelemetrySample::setpoint);
+
+  // Read side of the device daemon (Heinzinger --daemon). Reads are a
+  // memcpy from shared memory; no USB traffic, no GIL release needed.
+  py::class_<PSUTelemetryReader>(m, "TelemetryReader")
+      .def(py::init<>())
+      .def("open", &PSUTelemetryReader::open,
+           py::arg("shm_name") = PSU_TELEMETRY_DEFAULT_NAME,
+           "Maps the daemon's telemetry; False if no daemon is running.")
+      .def("close", &PSUTelemetryReader::close)
+      .def("is_open", &PSUTelemetryReader::is_open)
+      .def("writer_alive", &PSUTelemetryReader::writer_alive)
+      .def("board_count", &PSUTelemetryReader::board_count)
+      .def("writer_pid", &PSUTelemetryReader::writer_pid)
+      .def("heartbeat", &PSUTelemetryReader::heartbeat,
+           "Poll cycles completed by the daemon; stops moving if it hangs.")
+      .def("path", &PSUTelemetryReader::path, py::arg("board"))
+      .def(
+          "read",
+          [](const PSUTelemetryReader &r, unsigned int board) -> py::object {
+            PSUTelemetrySample s;
+            if (!r.read(board, s))
+              return py::none();
+            return py::cast(s);
+          },
+          py::arg("board"),
+          "Latest TelemetrySample of a board, or None if unavailable.");
+
+  m.def(
+      "list_board_paths",
+      []() {
+        std::vector<std::string> paths;
+        FGUSBRegistry::Get().Refresh();
+        for (const FGUSBDeviceEntry &e : FGUSBRegistry::Get().Devices())
+          if (e.Descriptor.idVendor == 0xA0A0 &&
+              e.Descriptor.idProduct == 0x000C)
+            paths.push_back(e.PathString());
+        return paths;
+      },
+      release_gil,
+      "Lists the USB paths (bus-port.port) of all attached analog PSU "
+      "interface boards, usable as usb_path for HeinzingerPSU.");
+  m.def(
+      "set_usb_device_map",
+      [](const std::string &path) {
+        FGUSBRegistry::Get().SetDeviceMapPath(path);
+      },
+      py::arg("path"), release_gil,
+      "File remembering where boards opened as sn:<serial> were found, so "
+      "the next run opens them without querying every board; \"\" turns "
+      "it off. Defaults to $FG_USB_DEVICE_MAP or ~/.cache/fg_usb_devices.");
+  m.def(
+      "usb_device_map",
+      []() { return FGUSBRegistry::Get().DeviceMapPath(); }, release_gil);
 
   // Expose the global C++ Verbosity variable to Python using getter and setter
   // functions
+  py::class_<FGErrorRecord>(m, "ErrorRecord")
+      .def_readonly("t", &FGErrorRecord::T)
+      .def_property_readonly(
+          "severity",
+          [](const FGErrorRecord &r) { return ErrorSeverityLevel(r.Severity); })
+      .def_readonly("code", &FGErrorRecord::Code)
+      .def_readonly("device", &FGErrorRecord::Device)
+      .def_readonly("usb_error", &FGErrorRecord::USBError)
+      .def_property_readonly("message", [](const FGErrorRecord &r) {
+        return std::string(r.Message);
+      });
+
+  m.def(
+      "recent_errors", []() { return MainErrorCollector.Recent(); },
+      "The last errors/warnings reported by the C++ side, oldest first. "
+      "device is the board's USB locationID (0: not tied to a board).");
+  m.def(
+      "error_counts",
+      []() {
+        py::dict d;
+        for (int i = FGErrorAnswer; i <= FGErrorReturn; ++i)
+          d[ErrorSeverityLevel((FGSeverity)i).c_str()] =
+              MainErrorCollector.Count((FGSeverity)i);
+        d["suppressed"] = MainErrorCollector.SuppressedCount();
+        return d;
+      },
+      "Messages reported per severity, and how many were not printed "
+      "because of the rate limit.");
+  m.def(
+      "set_error_rate_limit",
+      [](double lines_per_s, double burst) {
+        MainErrorCollector.SetRateLimit(lines_per_s, burst);
+      },
+      py::arg("lines_per_s") = 20.0, py::arg("burst") = 50.0,
+      "Limits how many C++ error lines are printed; the rest are only "
+      "recorded. lines_per_s <= 0 prints everything.");
+  m.def("clear_errors", []() { MainErrorCollector.Clear(); });
+
+  m.def(
+      "enable_trace",
+      [](const std::string &path) { return FGPacketTrace::Get().Enable(path); },
+      py::arg("path") = "",
+      "Traces every command/response packet and USB transfer of all boards. "
+      "Records are formatted on a background thread into `path` (appended) "
+      "or, if empty, stdout. Returns False if the file cannot be opened.");
+  m.def(
+      "disable_trace", []() { FGPacketTrace::Get().Disable(); },
+      "Stops tracing; records already queued are still written.");
+  m.def(
+      "flush_trace",
+      [](double timeout_s) { FGPacketTrace::Get().Flush(timeout_s); },
+      py::arg("timeout_s") = 1.0, release_gil,
+      "Waits until queued trace records have been written.");
+  m.def(
+      "trace_dropped", []() { return FGPacketTrace::Get().DroppedCount(); },
+      "Trace records dropped because the queue was full.");
+
   m.def("get_cpp_verbosity_level", &get_cpp_global_verbosity,
         "Gets the C++ global Verbosity level.");
   m.def("set_cpp_verbosity_level", &set_cpp_global_verbosity, py::arg("level"),
@@ -9,9 +9,20 @@
 #include "CommonIncludes.h" // Includes iostream, string, vector, using namespace std
 #include "Error.h"          // Specifically for Warn, Shout
 #include "FGUSBBulk.h" // Includes FGBulk.h, Hex.h, Error.h, StringUtils.h, libusb, etc.
+#include "FGPacketTrace.h"   // Off-thread protocol logging
+#include "FGTransportStats.h"
 #include "Hex.h"   // Specifically for ToHex, ToBin used in logging
+#include <chrono>
+#include <condition_variable>
 #include <cstring> // For memset
+#include <deque>
+#include <functional>
+#include <future> // For QueryAsync
+#include <memory>
+#include <mutex>
 #include <stdint.h>
+#include <string>
+#include <thread>
 
 class FGAnalogPSUInterface {
 public:
@@ -52,20 +63,74 @@ public:
   uint16_t ADCB[4];
   uint16_t DACA_val;
   uint16_t DACB_val;
-  uint8_t Relay_val;
+  uint8_t Relay_val; // 0: output on; off (1) until read back
   uint16_t SequenceNo_val;
   uint16_t Errors;
   bool Verbose = true;
+  // Counters and latency histograms for this board, see FGTransportStats.h
+  FGTransportStats Stats;
+  // Asked about every QueryAsync() command when it takes the link, i.e.
+  // right before it is sent; a refused one completes with Ok=false instead.
+  // Queued commands are judged by the state at their turn, not at the call
+  // (HeinzingerVia16BitDAC refuses raises once its interlock has tripped).
+  // Runs on whichever thread hands over the link. Set before queries start.
+  std::function<bool(const Status_t &)> AsyncAdmit;
 
-  // --- Constructor, Open, Close, operator bool remain the same ---
+  static constexpr uint16_t VendorID = 0xA0A0;
+  static constexpr uint16_t ProductID = 0x000C;
+
+  // Link state of the USB board. A link is Lost after a vanished device or
+  // Policy.LostAfterFailures failed transactions in a row; from then on a
+  // background thread reopens the same board (same path or index) with
+  // exponential backoff while queries fail at once instead of each waiting
+  // out the retry budget. Where libusb supports hotplug, an unplug is seen
+  // from the registry's hotplug event instead, before any transfer fails,
+  // and the board is reopened as soon as it arrives again rather than by
+  // polling.
+  enum LinkState { LinkClosed, LinkUp, LinkLost };
+
+  // Does not touch the bus: the owner opens the board it wants (see
+  // HeinzingerVia16BitDAC), and Query() falls back to Open() if nothing was.
   FGAnalogPSUInterface()
-      : DACA_val(0), DACB_val(0), Relay_val(0), SequenceNo_val(0), Errors(0) {
-    Open();
+      : DACA_val(0), DACB_val(0), Relay_val(1), SequenceNo_val(0), Errors(0),
+        Transport(nullptr), TargetIndex(0), State(LinkClosed), Generation(0),
+        FailureStreak(0), OpenLocation(0), HotplugId(0), StopRecovery(false),
+        RecoveryRequested(false), AwaitArrival(false), ArrivalPending(false),
+        Synced(false), SyncSeq(0), Outstanding(0), DrainPending(false),
+        SequenceCheck(true), Resync(true), DesyncStreak(0) {
+    Bridge.Stats = &Stats;
   }
   FGAnalogPSUInterface(const FGAnalogPSUInterface &) = delete;
+  ~FGAnalogPSUInterface() {
+    if (HotplugId)
+      FGUSBRegistry::Get().Unsubscribe(HotplugId);
+    Close(); // also fails whatever QueryAsync() still has queued
+  }
+
+  // Open the board at a USB path / by enumeration index and remember it as
+  // the one to reopen.
+  bool OpenPath(const std::string &Path) {
+    SetTarget(Path, -1);
+    return Open();
+  }
+  bool OpenIndex(int Index) {
+    SetTarget("", Index);
+    return Open();
+  }
+  // Remember the board without touching the bus; the first Query() (or
+  // Open()) opens it.
+  void SetTargetPath(const std::string &Path) { SetTarget(Path, -1); }
+  void SetTargetIndex(int Index) { SetTarget("", Index); }
+  // (Re)opens the remembered board, the first one if none was given.
   bool Open() {
+    EndRecovery();
     Close();
-    bool success = Bridge.OpenDevice(0xA0A0, 0x000C, 0);
+    {
+      std::lock_guard<std::mutex> Lock(RecoveryMutex);
+      StopRecovery = false; // a link lost from here on is recovered
+      RecoveryRequested = false;
+    }
+    bool success = OpenTarget();
     if (Verbose && success)
       std::cout << "Refactored AnalogPSU: USB Device Opened." << std::endl;
     else if (Verbose && !success)
@@ -74,40 +139,87 @@ public:
     return success;
   }
   bool Close() {
-    if (!Bridge)
+    EndRecovery();
+    AcquireLink(); // lets the transaction in flight finish
+    std::deque<AsyncTransaction *> Dropped;
+    {
+      std::lock_guard<std::mutex> Lock(LinkMutex);
+      Dropped.swap(Queued);
+    }
+    State = LinkClosed;
+    const bool WasOpen = !!Bridge;
+    if (WasOpen)
+      Bridge.CloseDevice();
+    ReleaseLink();
+    for (size_t i = 0; i < Dropped.size(); ++i) {
+      FGTransportStats::Bump(Stats.Refused);
+      FinishAsync(Dropped[i], false);
+    }
+    if (!WasOpen)
       return false;
-    Bridge.CloseDevice();
     if (Verbose)
       std::cout << "Refactored AnalogPSU: USB Device Closed." << std::endl;
     return true;
   }
-  operator bool() { return Bridge; }
+  operator bool() { return Transport != nullptr || Bridge; }
 
-  // --- Setters and Readout remain the same ---
-  bool SetDACA(uint16_t A) {
-    Status_t cmdStatus;
-    memset(&cmdStatus, 0, sizeof(cmdStatus));
-    cmdStatus.MagicNo = ExpectedMagic;
-    cmdStatus.SetMask = 1;
-    cmdStatus.DACA = A;
-    return Query(cmdStatus);
+  LinkState GetLinkState() const { return (LinkState)State.load(); }
+  // Ready for I/O without opening first: an injected transport, or LinkUp.
+  bool IsOpen() const { return Transport != nullptr || State == LinkUp; }
+  // Bumped by every successful open. The board may have been power cycled
+  // in between, so anything cached about its registers is stale when this
+  // changes.
+  uint64_t LinkGeneration() const { return Generation; }
+  // Unplug and re-attach are reported by USB hotplug events, not only by
+  // failing transfers.
+  bool HotplugActive() const { return HotplugId != 0; }
+  // Only while no query is in flight.
+  void SetPolicy(const FGUSBRetryPolicy &P) { Bridge.Policy = P; }
+  const FGUSBRetryPolicy &Policy() const { return Bridge.Policy; }
+
+  // Routes Query() through another FGBulkBridge instead of the USB board,
+  // e.g. an FGMockAnalogBoard. nullptr goes back to the USB bridge. Only
+  // while no query is in flight.
+  void SetTransport(FGBulkBridge *T) {
+    Transport = T;
+    Resync = true;
   }
-  bool SetDACB(uint16_t B) {
-    Status_t cmdStatus;
-    memset(&cmdStatus, 0, sizeof(cmdStatus));
-    cmdStatus.MagicNo = ExpectedMagic;
-    cmdStatus.SetMask = 2;
-    cmdStatus.DACB = B;
-    return Query(cmdStatus);
+
+  // Whether responses are matched to commands by their sequence number (see
+  // CheckSequence). On by default; it turns itself off after
+  // MaxDesyncStreak out-of-sequence responses in a row, as firmware that
+  // counts differently would otherwise fail every query.
+  void SetSequenceCheck(bool On) {
+    Resync = true;
+    SequenceCheck = On;
   }
-  bool SetRelay(bool Power) {
+  bool SequenceCheckEnabled() const { return SequenceCheck; }
+
+  // Bits of Status_t::SetMask; any combination may be sent in one packet.
+  enum SetMaskBits : uint8_t {
+    SetDACAMask = 1,
+    SetDACBMask = 2,
+    SetRelayMask = 4
+  };
+
+  // Writes every register selected in Mask with a single Query. The response
+  // to that packet already carries the full status, so it doubles as the
+  // readback and no separate Readout() is needed.
+  bool Set(uint8_t Mask, uint16_t A, uint16_t B, bool Power) {
     Status_t cmdStatus;
     memset(&cmdStatus, 0, sizeof(cmdStatus));
     cmdStatus.MagicNo = ExpectedMagic;
-    cmdStatus.SetMask = 4;
+    cmdStatus.SetMask = Mask & (SetDACAMask | SetDACBMask | SetRelayMask);
+    cmdStatus.DACA = A;
+    cmdStatus.DACB = B;
     cmdStatus.Relay = Power ? 1 : 0;
     return Query(cmdStatus);
   }
+
+  // --- Setters and Readout remain the same ---
+  bool SetDACA(uint16_t A) { return Set(SetDACAMask, A, 0, false); }
+  bool SetDACB(uint16_t B) { return Set(SetDACBMask, 0, B, false); }
+  bool SetRelay(bool Power) { return Set(SetRelayMask, 0, 0, Power); }
   bool Readout() {
     Status_t cmdStatus;
     memset(&cmdStatus, 0, sizeof(cmdStatus));
@@ -116,136 +228,709 @@ public:
     return Query(cmdStatus);
   }
 
-  // --- Query method with MODIFIED return logic ---
+  // Counted in Stats; the transaction itself is Transact().
   bool Query(Status_t CommandToSend) {
-    if (!Bridge && !Open()) {
-      Shout("Refactored AnalogPSU Query: Unable to open USB interface.", false);
-      return false; // Communication failed
+    std::chrono::steady_clock::time_point Start =
+        std::chrono::steady_clock::now();
+    FGTransportStats::Bump(Stats.Queries);
+    bool Ok = Transact(CommandToSend);
+    if (!Ok)
+      FGTransportStats::Bump(Stats.Failures);
+    Stats.QueryLatency.Record(FGTransportStats::MicrosSince(Start));
+    return Ok;
+  }
+
+  // Completion of QueryAsync(): whether the query succeeded as Query() would
+  // have, and the response packet it was judged on.
+  typedef std::function<void(bool Ok, const Status_t &Response)> AsyncDone;
+
+  // Non-blocking Query: the write and read are submitted to the shared USB
+  // event thread and Done is called from there once the response has been
+  // validated. Never waits for the link: while another transaction on this
+  // board is in flight (asynchronous, a Query() on another thread, the
+  // stream) the query is queued and submitted in order as soon as the link
+  // is free, so any number may be outstanding, and it may be called from a
+  // completion. Threads blocked in Query() get the link before the queue.
+  // Done runs before the link is handed on, so Close() and the destructor
+  // wait for it; it must not block (nor call Query()).
+  // Store=false leaves ADCB, Relay_val etc. alone (and only hands over the
+  // response): their readers hold the owner's lock, which Done does not.
+  // Refused and failed-to-submit queries complete on the calling thread;
+  // with an injected transport the whole query does. Never opens the board:
+  // until it is open (Open(), or a Query()) every query is refused.
+  void QueryAsync(Status_t CommandToSend, AsyncDone Done, bool Store) {
+    AsyncTransaction *T = new AsyncTransaction;
+    T->Start = std::chrono::steady_clock::now();
+    T->Command = CommandToSend;
+    memset(&T->Response, 0, sizeof(T->Response));
+    T->Done = std::move(Done);
+    T->Store = Store;
+    T->Stale = 0;
+    FGTransportStats::Bump(Stats.Queries);
+
+    if (Transport != nullptr) { // callback transports are synchronous
+      PrepareCommand(T->Command);
+      bool InSequence;
+      bool Ok = Exchange(T->Command, T->Response, InSequence, true) &&
+                InSequence && ProcessResponse(T->Response, Store);
+      FinishAsync(T, Ok);
+      return;
+    }
+    if (State == LinkLost) {
+      FGTransportStats::Bump(Stats.Refused);
+      FinishAsync(T, false);
+      return;
     }
+    // Opening blocks and is the owner's to serialise (HeinzingerVia16BitDAC
+    // does it under its io_mutex), so a board that is not open yet is
+    // refused here instead of being opened on the caller's thread.
+    if (!Bridge) {
+      FGTransportStats::Bump(Stats.Refused);
+      ShoutAt("Refactored AnalogPSU QueryAsync: USB interface not open.",
+              Bridge.Location());
+      FinishAsync(T, false);
+      return;
+    }
+    PrepareCommand(T->Command);
+    {
+      std::lock_guard<std::mutex> Lock(LinkMutex);
+      if (LinkBusy || LinkWaiters) {
+        Queued.push_back(T);
+        return;
+      }
+      LinkBusy = true;
+    }
+    StartAsync(T);
+  }
 
-    // Apply command checksum logic (same as before)
-    CommandToSend.Checksum = 0;
-    CommandToSend.Checksum = CommandToSend.ComputeChecksum();
+  // Same, storing the response like Query().
+  void QueryAsync(Status_t CommandToSend, std::function<void(bool)> Done) {
+    QueryAsync(CommandToSend,
+               [Done](bool Ok, const Status_t &) { Done(Ok); }, true);
+  }
 
-    if (Verbose) {
-      // Logging for Sending Command (same as before)
-      std::cout << "--- REFACTORED Sending Command to Analog Board ---"
-                << std::endl;
-      std::cout << "  Raw Bytes (as sent): "
-                << DestToHex((uint8_t *)&CommandToSend, sizeof(Status_t))
-                << std::endl;
-      // ... (print other fields: MagicNo, SetMask, Cmd values, Checksum) ...
-      std::cout << "  MagicNo  : 0x" << std::hex << CommandToSend.MagicNo
-                << std::dec << std::endl;
-      std::cout << "  SetMask  : 0b"
-                << ToBin(static_cast<uint16_t>(CommandToSend.SetMask)) << " (0x"
-                << std::hex << (int)CommandToSend.SetMask << std::dec << ")"
-                << std::endl;
-      if (CommandToSend.SetMask & 1)
-        std::cout << "  DACA Cmd : " << CommandToSend.DACA << std::endl;
-      if (CommandToSend.SetMask & 2)
-        std::cout << "  DACB Cmd : " << CommandToSend.DACB << std::endl;
-      if (CommandToSend.SetMask & 4)
-        std::cout << "  Relay Cmd: " << (int)CommandToSend.Relay << std::endl;
-      std::cout << "  Checksum (calculated and sent): 0x" << std::hex
-                << CommandToSend.Checksum << std::dec << std::endl;
-      std::cout << "------------------------------------" << std::endl;
-    }
-
-    if (!Bridge.Bridge.Write(1, (uint8_t *)&CommandToSend, sizeof(Status_t))) {
-      Shout("Refactored AnalogPSU Query: Unable to write to USB interface.",
-            false);
+  std::future<bool> QueryAsync(Status_t CommandToSend) {
+    std::shared_ptr<std::promise<bool>> Promise =
+        std::make_shared<std::promise<bool>>();
+    std::future<bool> Result = Promise->get_future();
+    QueryAsync(CommandToSend, [Promise](bool Ok) { Promise->set_value(Ok); });
+    return Result;
+  }
+
+private:
+  FGBulkBridge *Transport;
+
+  std::string TargetPath; // reopened by path if set,
+  int TargetIndex;        // else by enumeration index
+  std::atomic<int> State;
+  std::atomic<uint64_t> Generation;
+  std::atomic<unsigned int> FailureStreak; // consecutive transfer failures
+  std::atomic<uint32_t> OpenLocation;      // of the board while LinkUp
+  std::atomic<int> HotplugId;              // registry subscription, 0: none
+  std::mutex RecoveryMutex; // guards the fields below
+  std::thread Recovery;     // from the first link loss until EndRecovery()
+  std::condition_variable RecoveryWake;
+  bool StopRecovery;      // closing: no recovery is started or continued
+  bool RecoveryRequested; // a link loss the recovery thread has not seen
+  bool AwaitArrival;     // unplugged: reopen on arrival, poll only slowly
+  bool ArrivalPending;   // a matching board has arrived since
+  std::string TargetKey; // canonical path of the board; empty matches any
+
+  void SetTarget(const std::string &Path, int Index) {
+    std::lock_guard<std::mutex> Lock(RecoveryMutex);
+    TargetPath = Path;
+    TargetIndex = Index;
+    TargetKey = FGUSBCanonicalPath(Path);
+  }
+
+  bool OpenTarget() {
+    bool Ok = TargetPath.empty()
+                  ? Bridge.OpenDevice(VendorID, ProductID, 0, TargetIndex)
+                  : Bridge.OpenDeviceByPath(VendorID, ProductID, 0, TargetPath);
+    if (Ok) {
+      FailureStreak = 0;
+      Resync = true; // the board may have restarted its counter
+      OpenLocation = Bridge.Location();
+      {
+        // Where it actually is: a path that is not on this bus falls back
+        // to an enumeration index (see OpenDeviceByPath). A board asked
+        // for by serial number may come back on any port.
+        std::lock_guard<std::mutex> Lock(RecoveryMutex);
+        TargetKey = TargetPath.compare(0, 3, "sn:") == 0 ? std::string()
+                                                         : Bridge.DevicePath();
+      }
+      ++Generation;
+      State = LinkUp;
+      if (HotplugId == 0 &&
+          FGUSBRegistry::Get().EnableHotplug(VendorID, ProductID))
+        HotplugId = FGUSBRegistry::Get().Subscribe(
+            VendorID, ProductID,
+            [this](const FGUSBDeviceEntry &E, bool Arrived) {
+              OnHotplug(E, Arrived);
+            });
+    }
+    return Ok;
+  }
+
+  // On the USB event thread.
+  void OnHotplug(const FGUSBDeviceEntry &E, bool Arrived) {
+    if (!Arrived) {
+      if (State == LinkUp && FGUSBLocationID(E.Device) == OpenLocation) {
+        {
+          std::lock_guard<std::mutex> Lock(RecoveryMutex);
+          AwaitArrival = true;
+        }
+        BeginRecovery(LIBUSB_ERROR_NO_DEVICE);
+      }
+      return;
+    }
+    std::lock_guard<std::mutex> Lock(RecoveryMutex);
+    if (State == LinkLost && (TargetKey.empty() || TargetKey == E.PathString())) {
+      ArrivalPending = true;
+      RecoveryWake.notify_all();
+    }
+  }
+
+  // Called after every USB transaction; the asynchronous ones still hold
+  // the link.
+  void NoteTransfer(bool Transferred) {
+    if (Transferred) {
+      FailureStreak = 0;
+      return;
+    }
+    if (Bridge.LastError != LIBUSB_ERROR_NO_DEVICE &&
+        ++FailureStreak < Bridge.Policy.LostAfterFailures)
+      return;
+    BeginRecovery(Bridge.LastError);
+  }
+
+  // On the transfer's thread or the USB event thread, racing Close().
+  void BeginRecovery(int Error) {
+    int Expected = LinkUp;
+    if (!State.compare_exchange_strong(Expected, LinkLost))
+      return;
+    FGTransportStats::Bump(Stats.LinkLosses);
+    WarnAt("Refactored AnalogPSU: link lost, reconnecting in the background.",
+           OpenLocation, Error);
+    // Never joins anything: this may be the USB event thread, which the
+    // thread being joined could need. The recovery thread stays for the
+    // next loss instead.
+    std::lock_guard<std::mutex> Lock(RecoveryMutex);
+    if (StopRecovery)
+      return; // being closed
+    RecoveryRequested = true;
+    if (Recovery.joinable())
+      RecoveryWake.notify_all();
+    else
+      Recovery = std::thread(&FGAnalogPSUInterface::Recover, this);
+  }
+
+  // Background reopen of the same board, once per link loss, until
+  // EndRecovery(); only this thread touches the bridge while State is
+  // LinkLost.
+  void Recover() {
+    std::unique_lock<std::mutex> Lock(RecoveryMutex);
+    while (!StopRecovery) {
+      RecoveryWake.wait(
+          Lock, [this]() { return StopRecovery || RecoveryRequested; });
+      if (StopRecovery)
+        break;
+      RecoveryRequested = false;
+      Reconnect(Lock);
+    }
+  }
+
+  void Reconnect(std::unique_lock<std::mutex> &Lock) {
+    unsigned int DelayMs = Bridge.Policy.ReconnectMinMs;
+    while (!StopRecovery) {
+      // Waiting for an arrival still tries now and then, in case the event
+      // never comes or does not match.
+      RecoveryWake.wait_for(
+          Lock,
+          std::chrono::milliseconds(AwaitArrival ? Bridge.Policy.ReconnectMaxMs
+                                                 : DelayMs),
+          [this]() { return StopRecovery || ArrivalPending; });
+      if (StopRecovery)
+        break;
+      ArrivalPending = false;
+      Lock.unlock();
+      AcquireLink();
+      Bridge.CloseDevice();
+      bool Ok = OpenTarget();
+      ReleaseLink();
+      Lock.lock();
+      if (Ok) {
+        AwaitArrival = false;
+        FGTransportStats::Bump(Stats.Reconnects);
+        WarnAt("Refactored AnalogPSU: reconnected.", Bridge.Location());
+        return;
+      }
+      // Arrived but not ready yet, or never reported gone: poll from here.
+      AwaitArrival = false;
+      DelayMs = DelayMs * 2 < Bridge.Policy.ReconnectMaxMs
+                    ? DelayMs * 2
+                    : Bridge.Policy.ReconnectMaxMs;
+    }
+  }
+
+  void EndRecovery() {
+    std::thread Running;
+    {
+      std::lock_guard<std::mutex> Lock(RecoveryMutex);
+      StopRecovery = true;
+      Running.swap(Recovery);
+    }
+    RecoveryWake.notify_all();
+    if (Running.joinable())
+      Running.join();
+  }
+
+  // --- Query method with MODIFIED return logic ---
+  bool Transact(Status_t &CommandToSend) {
+    if (Transport == nullptr && State == LinkLost) {
+      FGTransportStats::Bump(Stats.Refused);
+      return false; // being reopened in the background
+    }
+    if (Transport == nullptr && !Bridge && !Open()) {
+      ShoutAt("Refactored AnalogPSU Query: Unable to open USB interface.",
+              Bridge.Location());
       return false; // Communication failed
     }
 
+    PrepareCommand(CommandToSend);
+
     Status_t ResponseStatus;
+    bool InSequence;
+    bool Transferred = Exchange(CommandToSend, ResponseStatus, InSequence);
+    if (Transport == nullptr)
+      NoteTransfer(Transferred);
+    return Transferred && InSequence && ProcessResponse(ResponseStatus);
+  }
+
+  // The write and read of one transaction, holding the link; false if
+  // either failed. A response older than the command (see CheckSequence) is
+  // dropped and the next one read in its place. InSequence is false if no
+  // response could be trusted to answer this command; the link itself is
+  // fine then, also when nothing follows a stale response (a board that
+  // does not count answers every command with the same number).
+  bool Exchange(Status_t &CommandToSend, Status_t &ResponseStatus,
+                bool &InSequence, bool Async = false) {
+    FGBulkBridge &Link = Transport ? *Transport : Bridge.Bridge;
+    InSequence = true;
+    LinkGuard Guard(*this);
+    if (Transport == nullptr && State == LinkLost)
+      return false; // lost while we waited for the link
+    if (Async && AsyncAdmit && !AsyncAdmit(CommandToSend)) {
+      FGTransportStats::Bump(Stats.Refused);
+      return false;
+    }
+    if (DrainPending)
+      Drain(Link);
+    std::chrono::steady_clock::time_point Phase =
+        std::chrono::steady_clock::now();
+    bool Written = Link.Write(1, (uint8_t *)&CommandToSend, sizeof(Status_t));
+    Stats.WriteLatency.Record(FGTransportStats::MicrosSince(Phase));
+    if (!Written) {
+      FGTransportStats::Bump(Stats.WriteFailures);
+      ShoutAt("Refactored AnalogPSU Query: Unable to write to USB interface.",
+              Bridge.Location());
+      return false; // Communication failed
+    }
+    ++Outstanding;
+
     memset(&ResponseStatus, 0, sizeof(ResponseStatus));
-    if (!Bridge.Bridge.Read(1, (uint8_t *)&ResponseStatus, sizeof(Status_t))) {
-      Shout("Refactored AnalogPSU Query: Unable to read from USB interface.",
-            false);
+    Phase = std::chrono::steady_clock::now();
+    bool Received = Link.Read(1, (uint8_t *)&ResponseStatus, sizeof(Status_t));
+    const bool Answered = Received;
+    for (unsigned int Stale = 0; Received; ++Stale) {
+      SequenceVerdict Verdict = CheckSequence(ResponseStatus);
+      if (Verdict == SequenceFresh)
+        break;
+      if (Verdict == SequenceLost || Stale == MaxStaleResponses) {
+        if (Verdict != SequenceLost)
+          LoseSequence(ResponseStatus);
+        Drain(Link);
+        InSequence = false;
+        break;
+      }
+      Received = ReadNext(Link, ResponseStatus);
+    }
+    Stats.ReadLatency.Record(FGTransportStats::MicrosSince(Phase));
+    if (!Received && Answered &&
+        Bridge.LastError != LIBUSB_ERROR_NO_DEVICE) {
+      InSequence = false;
+      return true;
+    }
+    if (!Received) {
+      FGTransportStats::Bump(Stats.ReadFailures);
+      ShoutAt("Refactored AnalogPSU Query: Unable to read from USB interface.",
+              Bridge.Location());
       return false; // Communication failed
     }
+    return true;
+  }
 
-    if (Verbose) {
-      // Logging for Received Response (same as before)
-      std::cout << "--- REFACTORED Received Response from Analog Board ---"
-                << std::endl;
-      std::cout << "  Raw Bytes (received): "
-                << DestToHex((uint8_t *)&ResponseStatus, sizeof(Status_t))
-                << std::endl;
-      // ... (print other fields: MagicNo, Checksum, SequenceNo, Response, Relay
-      // etc.) ...
-      std::cout << "  MagicNo    (recv): 0x" << std::hex
-                << ResponseStatus.MagicNo << std::dec << std::endl;
-      std::cout << "  Checksum   (recv): 0x" << std::hex
-                << ResponseStatus.Checksum << std::dec << std::endl;
-      std::cout << "  SequenceNo (recv): " << ResponseStatus.SequenceNo
-                << std::endl;
-      std::cout << "  Response   (recv): 0x" << std::hex
-                << ResponseStatus.Response << std::dec << " (Error Word)"
-                << std::endl;
-      std::cout << "  Relay      (recv): " << (int)ResponseStatus.Relay
-                << std::endl;
-      std::cout << "---------------------------------------" << std::endl;
+  // Response sequence numbers. This relies on the firmware incrementing
+  // SequenceNo once for every packet it accepts (a rejected packet gets no
+  // answer) and answering each with the incremented counter, as
+  // FGMockAnalogBoard does. With SyncSeq the number of the last response
+  // taken and Outstanding the commands written since, the response to the
+  // newest command then carries SyncSeq + Outstanding. Anything lower
+  // answers an earlier command whose read gave up (it arrived late and sat
+  // in the IN endpoint) or repeats one, and is not the state after this
+  // command. Guarded by the link.
+  enum SequenceVerdict { SequenceFresh, SequenceStale, SequenceLost };
+  static constexpr unsigned int MaxStaleResponses = 4;
+  static constexpr uint16_t MaxSequenceGap = 256;
+  static constexpr unsigned int MaxDesyncStreak = 8;
+  bool Synced; // false until the first response after an open
+  uint16_t SyncSeq;
+  unsigned int Outstanding;
+  bool DrainPending; // a flush the event thread could not do itself
+  std::atomic<bool> SequenceCheck;
+  // Set from outside the link (open, SetTransport); clears Synced at the
+  // next response.
+  std::atomic<bool> Resync;
+  unsigned int DesyncStreak; // stale or lost responses without a fresh one
+
+  // Packets whose magic or checksum is off are left to ProcessResponse.
+  SequenceVerdict CheckSequence(Status_t &R) {
+    // DesyncStreak survives a resync: a board that does not count would
+    // otherwise be reopened over and over before the check turns off.
+    if (Resync.exchange(false)) {
+      Synced = false;
+      Outstanding = 0;
+    }
+    if (!SequenceCheck) {
+      Outstanding = 0;
+      DesyncStreak = 0; // a fresh start if it is turned on again
+      return SequenceFresh;
+    }
+    if (R.MagicNo != ExpectedMagic || R.ComputeChecksum() != 0)
+      return SequenceFresh;
+    const uint16_t Delta = R.SequenceNo - SyncSeq;
+    if (!Synced || (Delta >= Outstanding &&
+                    Delta - Outstanding <= MaxSequenceGap)) {
+      // Ahead of the count: responses the board sent and we never saw.
+      if (Synced && Delta > Outstanding)
+        Stats.SequenceGaps.fetch_add(Delta - Outstanding,
+                                     std::memory_order_relaxed);
+      if (Synced)
+        DesyncStreak = 0;
+      Synced = true;
+      SyncSeq = R.SequenceNo;
+      Outstanding = 0;
+      return SequenceFresh;
+    }
+    if (Delta == 0 || Delta < Outstanding) {
+      FGTransportStats::Bump(Stats.StaleResponses);
+      SyncSeq = R.SequenceNo;
+      Outstanding -= Delta;
+      NoteOutOfSequence();
+      return SequenceStale;
+    }
+    // Behind what was taken or far ahead: the board restarted its counter or
+    // someone else is talking to it.
+    LoseSequence(R);
+    return SequenceLost;
+  }
+
+  // Restarts the count at R, which is not trusted as this command's answer.
+  void LoseSequence(const Status_t &R) {
+    FGTransportStats::Bump(Stats.Desyncs);
+    WarnAt("Refactored AnalogPSU Query: response sequence lost, flushing "
+           "the input.",
+           Bridge.Location(), 0, R.SequenceNo);
+    SyncSeq = R.SequenceNo;
+    Outstanding = 0;
+    NoteOutOfSequence();
+  }
+
+  // A late packet costs one or two out-of-sequence responses; a run this
+  // long means the board does not count the way CheckSequence assumes.
+  void NoteOutOfSequence() {
+    if (++DesyncStreak < MaxDesyncStreak || !SequenceCheck)
+      return;
+    SequenceCheck = false;
+    WarnAt("Refactored AnalogPSU Query: this board's sequence numbers do not "
+           "count packets as expected; sequence check turned off.",
+           Bridge.Location());
+  }
+
+  // The next response, which should already be on its way: one attempt
+  // within the usual timeout instead of the whole retry budget.
+  bool ReadNext(FGBulkBridge &Link, Status_t &R) {
+    memset(&R, 0, sizeof(R));
+    if (Transport != nullptr)
+      return Link.Read(1, (uint8_t *)&R, sizeof(Status_t));
+    Bridge.LastError = LIBUSB_SUCCESS; // ReadOnce() keeps it on a timeout
+    return Bridge.ReadOnce(1, (uint8_t *)&R, sizeof(Status_t),
+                           Bridge.Rtt[1].TimeoutMs(Bridge.Policy)) ==
+           (int)sizeof(Status_t);
+  }
+
+  // Throws away every response still queued, so the next one read answers
+  // the next command.
+  void Drain(FGBulkBridge &Link) {
+    DrainPending = false;
+    unsigned int Dropped = 0;
+    if (Transport == nullptr) {
+      Dropped = Bridge.DrainIn(1, sizeof(Status_t));
+    } else {
+      Status_t Junk;
+      while (Dropped < 64 && Link.Read(1, (uint8_t *)&Junk, sizeof(Junk)))
+        ++Dropped;
+    }
+    Stats.Flushed.fetch_add(Dropped, std::memory_order_relaxed);
+  }
+
+  // One write+read transaction at a time per board, whether it was started
+  // by Query() or QueryAsync(). A plain mutex cannot be used because the
+  // asynchronous path releases it from the event thread.
+  std::mutex LinkMutex;
+  std::condition_variable LinkFree;
+  bool LinkBusy = false;
+  unsigned int LinkWaiters = 0; // threads blocked in AcquireLink()
+
+  struct AsyncTransaction {
+    Status_t Command;
+    Status_t Response;
+    AsyncDone Done;
+    bool Store;
+    unsigned int Stale; // responses dropped as stale so far
+    std::chrono::steady_clock::time_point Start;
+  };
+  std::deque<AsyncTransaction *> Queued; // waiting for the link, FIFO
+
+  void AcquireLink() {
+    std::unique_lock<std::mutex> Lock(LinkMutex);
+    ++LinkWaiters;
+    LinkFree.wait(Lock, [this]() { return !LinkBusy; });
+    --LinkWaiters;
+    LinkBusy = true;
+  }
+  void ReleaseLink() { StartAsync(NextQueued()); }
+
+  // Releases the link, or hands it straight to the next queued transaction
+  // (returned, to be started by the caller) if no thread waits for it.
+  // Once the link is free Close() may go ahead and the object be destroyed,
+  // so the caller must not touch any member after this.
+  AsyncTransaction *NextQueued() {
+    AsyncTransaction *Next = nullptr;
+    {
+      std::lock_guard<std::mutex> Lock(LinkMutex);
+      if (LinkWaiters == 0 && !Queued.empty()) {
+        Next = Queued.front();
+        Queued.pop_front();
+      } else {
+        LinkBusy = false;
+        LinkFree.notify_one(); // under the lock: see above
+      }
     }
+    return Next;
+  }
+
+  // T holds the link. A transaction that cannot be submitted completes at
+  // once and the link goes on to the next one. The write and the read are
+  // submitted separately so a written command is counted for CheckSequence.
+  void StartAsync(AsyncTransaction *T) {
+    while (T != nullptr) {
+      if (State == LinkLost || (AsyncAdmit && !AsyncAdmit(T->Command)))
+        FGTransportStats::Bump(Stats.Refused);
+      else if (Bridge.SubmitBulk(1 | LIBUSB_ENDPOINT_OUT,
+                                 (uint8_t *)&T->Command, sizeof(Status_t),
+                                 [this, T](bool Written) {
+                                   if (Written)
+                                     ++Outstanding;
+                                   if (!Written || !SubmitAsyncRead(T))
+                                     CompleteAsync(T, false);
+                                 }))
+        return;
+      else
+        ShoutAt("Refactored AnalogPSU QueryAsync: Unable to submit USB "
+                "transfer.",
+                Bridge.Location());
+      FinishAsync(T, false);
+      T = NextQueued();
+    }
+  }
+
+  bool SubmitAsyncRead(AsyncTransaction *T) {
+    memset(&T->Response, 0, sizeof(T->Response));
+    return Bridge.SubmitBulk(1 | LIBUSB_ENDPOINT_IN, (uint8_t *)&T->Response,
+                             sizeof(Status_t), [this, T](bool Received) {
+                               CompleteAsync(T, Received);
+                             });
+  }
+
+  // On the event thread. A stale response is replaced by the next read as
+  // in Exchange(); the flush after a lost sequence is left to the next
+  // blocking Exchange(), as its reads must not hold up the event thread.
+  void CompleteAsync(AsyncTransaction *T, bool Transferred) {
+    bool InSequence = true;
+    if (!Transferred && T->Stale > 0 &&
+        Bridge.LastError != LIBUSB_ERROR_NO_DEVICE) {
+      Transferred = true; // nothing after a stale response, as in Exchange()
+      InSequence = false;
+    } else if (Transferred) {
+      SequenceVerdict Verdict = CheckSequence(T->Response);
+      if (Verdict == SequenceStale && T->Stale++ < MaxStaleResponses &&
+          SubmitAsyncRead(T))
+        return;
+      if (Verdict != SequenceFresh) {
+        if (Verdict == SequenceStale)
+          LoseSequence(T->Response);
+        DrainPending = true;
+        InSequence = false;
+      }
+    } else {
+      ShoutAt("Refactored AnalogPSU QueryAsync: USB transfer failed.",
+              Bridge.Location());
+    }
+    bool Ok = Transferred && InSequence &&
+              ProcessResponse(T->Response, T->Store);
+    // The link is held until Done has returned, so a Close() (and the
+    // owner's destructor behind it) waits for this completion.
+    NoteTransfer(Transferred);
+    FinishAsync(T, Ok);
+    StartAsync(NextQueued()); // refused at once if that was the last straw
+  }
+
+  void FinishAsync(AsyncTransaction *T, bool Ok) {
+    if (!Ok)
+      FGTransportStats::Bump(Stats.Failures);
+    Stats.QueryLatency.Record(FGTransportStats::MicrosSince(T->Start));
+    T->Done(Ok, T->Response);
+    delete T;
+  }
+  struct LinkGuard {
+    FGAnalogPSUInterface &Owner;
+    LinkGuard(FGAnalogPSUInterface &O) : Owner(O) { Owner.AcquireLink(); }
+    ~LinkGuard() { Owner.ReleaseLink(); }
+  };
+
+  // Trace formatters, run on the FGPacketTrace thread with a copy of the
+  // packet; they print what Query() used to print inline.
+  static_assert(sizeof(Status_t) <= FGTraceRecord::MaxData,
+                "trace records must hold a whole Status_t");
+  static void FormatCommandTrace(std::ostream &Out, const FGTraceRecord &R) {
+    Status_t Command;
+    memcpy(&Command, R.Data, sizeof(Command));
+    Out << "--- REFACTORED Sending Command to Analog Board ---\n";
+    Out << "  Raw Bytes (as sent): " << DestToHex((uint8_t *)R.Data, R.Stored())
+        << "\n";
+    Out << "  MagicNo  : 0x" << std::hex << Command.MagicNo << std::dec << "\n";
+    Out << "  SetMask  : 0b" << ToBin(static_cast<uint16_t>(Command.SetMask))
+        << " (0x" << std::hex << (int)Command.SetMask << std::dec << ")\n";
+    if (Command.SetMask & SetDACAMask)
+      Out << "  DACA Cmd : " << Command.DACA << "\n";
+    if (Command.SetMask & SetDACBMask)
+      Out << "  DACB Cmd : " << Command.DACB << "\n";
+    if (Command.SetMask & SetRelayMask)
+      Out << "  Relay Cmd: " << (int)Command.Relay << "\n";
+    Out << "  Checksum (calculated and sent): 0x" << std::hex << Command.Checksum
+        << std::dec << "\n";
+    Out << "------------------------------------\n";
+  }
+
+  static void FormatResponseTrace(std::ostream &Out, const FGTraceRecord &R) {
+    Status_t Response;
+    memcpy(&Response, R.Data, sizeof(Response));
+    Out << "--- REFACTORED Received Response from Analog Board ---\n";
+    Out << "  Raw Bytes (received): "
+        << DestToHex((uint8_t *)R.Data, R.Stored()) << "\n";
+    Out << "  MagicNo    (recv): 0x" << std::hex << Response.MagicNo << std::dec
+        << "\n";
+    Out << "  Checksum   (recv): 0x" << std::hex << Response.Checksum << std::dec
+        << "\n";
+    Out << "  SequenceNo (recv): " << Response.SequenceNo << "\n";
+    Out << "  Response   (recv): 0x" << std::hex << Response.Response << std::dec
+        << " (Error Word)\n";
+    Out << "  Relay      (recv): " << (int)Response.Relay << "\n";
+    Out << "---------------------------------------\n";
+  }
+
+  // Fills in the checksum and traces the outgoing packet.
+  void PrepareCommand(Status_t &CommandToSend) {
+    // Apply command checksum logic (same as before)
+    CommandToSend.Checksum = 0;
+    CommandToSend.Checksum = CommandToSend.ComputeChecksum();
+
+    if (Verbose || FGPacketTrace::Get().Enabled())
+      FGPacketTrace::Get().Record(&FormatCommandTrace, this, 1, &CommandToSend,
+                                  sizeof(Status_t));
+  }
+
+  // Validates a received packet and, if Store, stores its contents. Returns
+  // what Query() returns: false on a bad packet or a critical device error
+  // word.
+  bool ProcessResponse(Status_t &ResponseStatus, bool Store = true) {
+    if (Verbose || FGPacketTrace::Get().Enabled())
+      FGPacketTrace::Get().Record(&FormatResponseTrace, this, 1,
+                                  &ResponseStatus, sizeof(Status_t));
 
     // Check USB packet validity (MagicNo, Packet Checksum)
     if (ResponseStatus.MagicNo != ExpectedMagic) {
-      Shout("Refactored AnalogPSU Query: Magic number in response does not "
-            "correspond.",
-            false);
+      FGTransportStats::Bump(Stats.MagicErrors);
+      ShoutAt("Refactored AnalogPSU Query: Magic number in response does not "
+              "correspond.",
+              Bridge.Location());
       return false; // Packet integrity failed
     }
     if (ResponseStatus.ComputeChecksum() != 0) {
+      FGTransportStats::Bump(Stats.ChecksumErrors);
       if (Verbose) {
         std::cout
             << "  Computed Checksum over received packet (should be 0): 0x"
             << std::hex << ResponseStatus.ComputeChecksum() << std::dec
             << std::endl;
       }
-      Shout("Refactored AnalogPSU Query: Checksum in response does not "
-            "correspond.",
-            false);
+      ShoutAt("Refactored AnalogPSU Query: Checksum in response does not "
+              "correspond.",
+              Bridge.Location());
       return false; // Packet integrity failed
     }
 
     // Communication and packet structure seem OK. Store results.
-    this->Errors =
-        ResponseStatus.Response; // Store the device's status/error code
-    // ... (copy other fields like ADCA, ADCB, DACA_val, etc. as before) ...
-    for (int i = 0; i < 4; ++i) {
-      this->ADCA[i] = ResponseStatus.ADCA[i];
-      this->ADCB[i] = ResponseStatus.ADCB[i];
-    }
-    this->DACA_val = ResponseStatus.DACA;
-    this->DACB_val = ResponseStatus.DACB;
-    this->Relay_val = ResponseStatus.Relay;
-    this->SequenceNo_val = ResponseStatus.SequenceNo;
+    const uint16_t DeviceErrors = ResponseStatus.Response;
+    if (Store) {
+      this->Errors = DeviceErrors; // Store the device's status/error code
+      // ... (copy other fields like ADCA, ADCB, DACA_val, etc. as before) ...
+      for (int i = 0; i < 4; ++i) {
+        this->ADCA[i] = ResponseStatus.ADCA[i];
+        this->ADCB[i] = ResponseStatus.ADCB[i];
+      }
+      this->DACA_val = ResponseStatus.DACA;
+      this->DACB_val = ResponseStatus.DACB;
+      this->Relay_val = ResponseStatus.Relay;
+      this->SequenceNo_val = ResponseStatus.SequenceNo;
+    }
 
     // ---vvv--- MODIFIED LOGIC HERE ---vvv---
     // Check the device's reported error code, BUT only return 'false' for
     // critical errors. Based on colleague's advice, we treat 0xF00 as
     // non-critical for the return value.
-    if (this->Errors != 0) {
-      if (this->Errors == 0xF00) {
+    if (DeviceErrors != 0) {
+      if (DeviceErrors == 0xF00) {
+        FGTransportStats::Bump(Stats.DeviceF00);
         // It's the specific code we decided to ignore for success/failure
         // reporting
         if (Verbose) {
           // Log it distinctly, perhaps using Warn or just cout
           // Using Warn implies it's still noteworthy
-          Warn("Refactored AnalogPSU Query: Device reported status 0x" +
-                   ToHex(this->Errors) +
-                   " (Ignoring for success/fail return value).",
-               false);
+          // The status word goes into the record's code.
+          WarnAt("Refactored AnalogPSU Query: Device reported status 0xF00 "
+                 "(Ignoring for success/fail return value).",
+                 Bridge.Location(), 0, DeviceErrors);
         }
         // *** Do NOT return false here - proceed to return true ***
       } else {
         // It's a *different* non-zero error code. Treat this as a failure.
+        FGTransportStats::Bump(Stats.DeviceErrors);
         if (Verbose) {
-          Shout("Refactored AnalogPSU Query: Device reported CRITICAL error "
-                "word: 0x" +
-                    ToHex(this->Errors),
-                false);
+          ShoutAt("Refactored AnalogPSU Query: Device reported CRITICAL error "
+                  "word.",
+                  Bridge.Location(), 0, DeviceErrors);
         }
         return false; // Return false for other errors
       }
@@ -255,8 +940,9 @@ public:
     return true;
     // ---^^^--- END OF MODIFIED LOGIC ---^^^---
 
-  }; // End of Query method
+  }
 
+public:
   void Dump(std::ostream &Str = std::cout) { /* ... as before ... */
     Str << "ADC A: ";
     for (auto &a : ADCA)
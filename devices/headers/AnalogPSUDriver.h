@@ -0,0 +1,142 @@
+/*
+ * AnalogPSUDriver.h
+ *
+ * Per-model drivers on top of HeinzingerVia16BitDAC. A model is a traits
+ * struct of constexpr ranges, monitor channels and capabilities, so the
+ * conversion factors are compile-time constants and a model is checked
+ * against the board once, when the driver is instantiated, instead of by
+ * Utter() at run time. Operations a model does not support do not compile:
+ *
+ *   AnalogPSUDriver<FUG50kV> fug("1-2.3");
+ *   fug.switch_on();        // fine
+ *   AnalogPSUDriver<Heinzinger30kV> hz("1-2.4");
+ *   hz.switch_on();         // error: this PSU model has no output relay
+ *
+ * A new model is a new traits struct with the same members.
+ */
+
+#ifndef SOURCE_ANALOGPSUDRIVER_H_
+#define SOURCE_ANALOGPSUDRIVER_H_
+
+#include <stdint.h>
+#include <string>
+
+#include "Heinzinger.h"
+
+// Voltages in V, currents in mA for every model.
+struct Heinzinger30kV {
+  static constexpr const char *name() { return "Heinzinger 30 kV"; }
+  static constexpr double max_voltage() { return 30000.0; }
+  static constexpr double max_current() { return 2.0; }
+  static constexpr double max_input_voltage() { return 10.0; } // 0-10 V program
+  static constexpr int voltage_channel() { return 2; }         // ADCB index
+  static constexpr int current_channel() { return 3; }
+  static constexpr bool has_relay() { return false; }
+};
+
+struct FUG50kV {
+  static constexpr const char *name() { return "FUG 50 kV"; }
+  static constexpr double max_voltage() { return 50000.0; }
+  static constexpr double max_current() { return 0.5; }
+  static constexpr double max_input_voltage() { return 10.0; }
+  static constexpr int voltage_channel() { return 2; }
+  static constexpr int current_channel() { return 3; }
+  static constexpr bool has_relay() { return true; }
+};
+
+template <class Model> class AnalogPSUDriver : public HeinzingerVia16BitDAC {
+  static_assert(Model::max_voltage() > 0 && Model::max_current() > 0,
+                "PSU model ranges must be positive");
+  static_assert(Model::max_input_voltage() > 0 &&
+                    Model::max_input_voltage() <=
+                        HeinzingerVia16BitDAC::board_max_volt(),
+                "the board has insufficient output voltage for this PSU model");
+  static_assert(Model::voltage_channel() >= 0 && Model::voltage_channel() < 4 &&
+                    Model::current_channel() >= 0 &&
+                    Model::current_channel() < 4,
+                "monitor channels must be ADCB[0..3]");
+
+public:
+  typedef Model model_type;
+
+  // Every field apply() can write on this model.
+  static constexpr uint8_t all_fields() {
+    return FGAnalogPSUInterface::SetDACAMask |
+           FGAnalogPSUInterface::SetDACBMask |
+           (Model::has_relay() ? FGAnalogPSUInterface::SetRelayMask : 0);
+  }
+
+  // Readback conversions as constants, e.g. for recorded raw samples
+  // (see HeinzingerVia16BitDAC::adc_gain()).
+  static constexpr double volts_per_count() {
+    return Model::max_voltage() * HeinzingerVia16BitDAC::adc_gain() /
+           UINT16_MAX / 10;
+  }
+  static constexpr double current_per_count() {
+    return Model::max_current() * HeinzingerVia16BitDAC::adc_gain() /
+           UINT16_MAX / 10;
+  }
+  static constexpr double counts_to_volts(uint16_t raw) {
+    return raw * volts_per_count();
+  }
+  static constexpr double counts_to_current(uint16_t raw) {
+    return raw * current_per_count();
+  }
+
+  explicit AnalogPSUDriver(const std::string &usb_path, bool verbose = false,
+                           bool lazy = false)
+      : HeinzingerVia16BitDAC(usb_path, Model::max_voltage(),
+                              Model::max_current(), verbose,
+                              Model::max_input_voltage(), lazy) {
+    set_monitor_channels(Model::voltage_channel(), Model::current_channel());
+  }
+  explicit AnalogPSUDriver(FGBulkBridge &transport, bool verbose = false)
+      : HeinzingerVia16BitDAC(transport, Model::max_voltage(),
+                              Model::max_current(), verbose,
+                              Model::max_input_voltage()) {
+    set_monitor_channels(Model::voltage_channel(), Model::current_channel());
+  }
+
+  std::string model() const override { return Model::name(); }
+  uint32_t capabilities() const override {
+    return HeinzingerVia16BitDAC::capabilities() &
+           ~(Model::has_relay() ? 0u : (uint32_t)PSUCapRelay);
+  }
+
+  // The relay calls only exist for models that have one. Templated so the
+  // assertion fires where they are used, not for every model.
+  template <class M = Model> bool switch_on(bool force = false) {
+    static_assert(M::has_relay(), "this PSU model has no output relay");
+    return HeinzingerVia16BitDAC::switch_on(force);
+  }
+  template <class M = Model> bool switch_off(bool force = false) {
+    static_assert(M::has_relay(), "this PSU model has no output relay");
+    return HeinzingerVia16BitDAC::switch_off(force);
+  }
+  template <class M = Model> bool is_relay_on() const {
+    static_assert(M::has_relay(), "this PSU model has no output relay");
+    return HeinzingerVia16BitDAC::is_relay_on();
+  }
+
+  // The relay bit is dropped from the mask on relay-less models, so a
+  // Setpoint can be shared between models.
+  bool apply(const Setpoint &sp, uint8_t mask = all_fields(),
+             bool force = false) override {
+    return HeinzingerVia16BitDAC::apply(sp, mask & all_fields(), force);
+  }
+  bool apply(const Setpoint &sp, uint8_t mask, PSUSnapshot &readback,
+             bool force = false) {
+    return HeinzingerVia16BitDAC::apply(sp, mask & all_fields(), readback,
+                                        force);
+  }
+  void apply_async(const Setpoint &sp, uint8_t mask,
+                   AsyncCallback done) override {
+    HeinzingerVia16BitDAC::apply_async(sp, mask & all_fields(),
+                                       std::move(done));
+  }
+};
+
+typedef AnalogPSUDriver<Heinzinger30kV> Heinzinger30kVPSU;
+typedef AnalogPSUDriver<FUG50kV> FUG50kVPSU;
+
+#endif /* SOURCE_ANALOGPSUDRIVER_H_ */
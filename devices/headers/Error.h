@@ -8,7 +8,13 @@
 #ifndef FGLIBRARIES_ERROR_H_
 #define FGLIBRARIES_ERROR_H_
 
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream> // For std::ostream, std::cerr (used by ErrorStream default)
+#include <mutex>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -52,33 +58,168 @@ inline std::string ErrorSeverityLevel(FGSeverity Severity) {
   return "Uknown"; // Should be "Unknown"
 }
 
+// One collected message. Fixed size, so recording it never allocates.
+struct FGErrorRecord {
+  static const unsigned int MaxMessage = 120;
+
+  double T;           // Unix seconds
+  FGSeverity Severity;
+  int Code;           // caller-defined (exit code, error word, byte count...)
+  uint32_t Device;    // USB locationID of the board, 0 if not tied to one
+  int USBError;       // libusb_error, 0 if none
+  char Message[MaxMessage]; // truncated, always NUL-terminated
+};
+
 // FGErrorCollector class definition (can stay in header if methods are inline
 // or defined here)
+//
+// Every message goes into a fixed ring of the last Capacity records, under a
+// mutex, so several PSU threads can report at once. Formatting to
+// ErrorStream is rate-limited (token bucket); messages over the limit are
+// only recorded and counted, and the next line that is printed says how
+// many were suppressed. Messages that end the process are always printed.
 class FGErrorCollector {
 public:
+  static const size_t Capacity = 256;
+
   std::vector<std::pair<FGSeverity, std::string>> Log;
   FGErrorCollectorCallback Callback;
 
-  FGErrorCollector()
-      : Callback(nullptr) {
-        }; // Make default constructor explicit if not using (nullptr) for CB
-  FGErrorCollector(FGErrorCollectorCallback CB) : Callback(CB) {};
+  FGErrorCollector() : Callback(nullptr) { Init(); };
+  FGErrorCollector(FGErrorCollectorCallback CB) : Callback(CB) { Init(); };
 
-  // This method could also be in a .cpp if it were larger, but inline is fine
-  // here.
-  inline int Collect(std::string &Description,
-                     FGSeverity Severity = FGErrorError, int ExitCode = 0) {
+  // Lines per second printed to ErrorStream, with bursts of up to Burst.
+  // LinesPerSecond <= 0 prints everything.
+  void SetRateLimit(double LinesPerSecond, double Burst) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Rate = LinesPerSecond;
+    Tokens = MaxTokens = Burst < 1 ? 1 : Burst;
+  }
+
+  // Structured entry point; Message is copied, not kept.
+  int Report(FGSeverity Severity, const char *Message, int ExitCode = 0,
+             uint32_t Device = 0, int USBError = 0) {
     if (Callback != nullptr) {
+      std::string Description(Message);
       Callback(*this, Description, Severity, ExitCode);
       return ExitCode;
     };
 
+    double Now = std::chrono::duration<double>(
+                     std::chrono::system_clock::now().time_since_epoch())
+                     .count();
+    {
+      std::lock_guard<std::mutex> Lock(Mutex);
+      FGErrorRecord &R = Ring[Next++ % Capacity];
+      R.T = Now;
+      R.Severity = Severity;
+      R.Code = ExitCode;
+      R.Device = Device;
+      R.USBError = USBError;
+      strncpy(R.Message, Message, FGErrorRecord::MaxMessage - 1);
+      R.Message[FGErrorRecord::MaxMessage - 1] = '\0';
+      ++Counts[Severity];
+
+      if (Fatal(Severity) || TakeTokenLocked(Now))
+        PrintLocked(R);
+      else
+        ++Suppressed;
+    } // not held across exit(): exit handlers may report too
+
+    // Original code called exit() for FGErrorAnswer, FGErrorCritical,
+    // FGErrorReturn. This is generally problematic for libraries. Consider
+    // using exceptions instead. For now, keeping original behavior.
+    if (Fatal(Severity))
+      exit(ExitCode);
+    return ExitCode;
+  }
+
+  // This method could also be in a .cpp if it were larger, but inline is fine
+  // here.
+  inline int Collect(std::string &Description,
+                     FGSeverity Severity = FGErrorError, int ExitCode = 0) {
+    return Report(Severity, Description.c_str(), ExitCode);
+  };
+
+  // Oldest first, at most Capacity records.
+  std::vector<FGErrorRecord> Recent() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    std::vector<FGErrorRecord> Res;
+    size_t First = Next > Capacity ? Next - Capacity : 0;
+    for (size_t i = First; i < Next; ++i)
+      Res.push_back(Ring[i % Capacity]);
+    return Res;
+  }
+
+  uint64_t Count(FGSeverity Severity) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    return Counts[Severity];
+  }
+  uint64_t SuppressedCount() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    return Suppressed;
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Next = 0;
+    Suppressed = 0;
+    for (int i = 0; i <= FGErrorReturn; ++i)
+      Counts[i] = 0;
+  }
+
+private:
+  std::mutex Mutex;
+  FGErrorRecord Ring[Capacity];
+  size_t Next;
+  uint64_t Counts[FGErrorReturn + 1];
+  uint64_t Suppressed;
+  uint64_t SuppressedPrinted;
+  double Rate, Tokens, MaxTokens, LastRefill;
+
+  static bool Fatal(FGSeverity Severity) {
+    return Severity == FGErrorAnswer || Severity == FGErrorCritical ||
+           Severity == FGErrorReturn;
+  }
+
+  void Init() {
+    Next = 0;
+    Suppressed = 0;
+    SuppressedPrinted = 0;
+    for (int i = 0; i <= FGErrorReturn; ++i)
+      Counts[i] = 0;
+    Rate = 20;
+    Tokens = MaxTokens = 50;
+    LastRefill = 0;
+  }
+
+  bool TakeTokenLocked(double Now) {
+    if (Rate <= 0)
+      return true;
+    if (LastRefill > 0)
+      Tokens += (Now - LastRefill) * Rate;
+    if (Tokens > MaxTokens)
+      Tokens = MaxTokens;
+    LastRefill = Now;
+    if (Tokens < 1)
+      return false;
+    Tokens -= 1;
+    return true;
+  }
+
+  void PrintLocked(const FGErrorRecord &R) {
     // Ensure ErrorStream is non-null before dereferencing, or ensure it's
     // always valid. It's initialized to &std::cerr in ProjectGlobals.cpp.
     if (!ErrorStream)
       ErrorStream = &std::cerr; // Safety, though should be set.
 
-    switch (Severity) {
+    if (Suppressed != SuppressedPrinted) {
+      *ErrorStream << "(" << (Suppressed - SuppressedPrinted)
+                   << " messages suppressed)\n";
+      SuppressedPrinted = Suppressed;
+    }
+
+    switch (R.Severity) {
     case FGErrorAnswer:
       *ErrorStream << "Result: ";
       break;
@@ -99,17 +240,24 @@ public:
       break;
     };
 
-    *ErrorStream << Description << "\n";
+    *ErrorStream << R.Message;
+    if (R.Device || R.USBError || (R.Code && !Fatal(R.Severity))) {
+      char Fields[64];
+      int Len = 0;
+      if (R.Device)
+        Len += snprintf(Fields + Len, sizeof(Fields) - Len, ", @%08X",
+                        R.Device);
+      if (R.USBError)
+        Len += snprintf(Fields + Len, sizeof(Fields) - Len, ", libusb %d",
+                        R.USBError);
+      if (R.Code && !Fatal(R.Severity))
+        Len += snprintf(Fields + Len, sizeof(Fields) - Len, ", code 0x%X",
+                        (unsigned)R.Code);
+      *ErrorStream << " [" << Fields + 2 << "]";
+    }
+    *ErrorStream << "\n";
     ErrorStream->flush(); // Good practice to flush after errors/warnings
-
-    // Original code called exit() for FGErrorAnswer, FGErrorCritical,
-    // FGErrorReturn. This is generally problematic for libraries. Consider
-    // using exceptions instead. For now, keeping original behavior.
-    if (Severity == FGErrorAnswer || Severity == FGErrorCritical ||
-        Severity == FGErrorReturn)
-      exit(ExitCode);
-    return ExitCode;
-  };
+  }
 };
 
 // INLINE function definitions using MainErrorCollector
@@ -140,4 +288,28 @@ inline int Utter(std::string What, int ExitCode = 0) {
   return MainErrorCollector.Collect(What, FGErrorCritical, ExitCode);
 }
 
+// Literal messages skip the std::string temporary.
+inline int Warn(const char *What, int ExitCode = 0) {
+  return MainErrorCollector.Report(FGErrorWarning, What, ExitCode);
+}
+
+inline int Shout(const char *What, int ExitCode = 0) {
+  return MainErrorCollector.Report(FGErrorError, What, ExitCode);
+}
+
+// Structured reports for hot failure paths: a fixed message plus the board
+// and libusb error as fields, instead of a concatenated string. Code is
+// recorded but, unlike ExitCode, never returned.
+inline int WarnAt(const char *What, uint32_t Device, int USBError = 0,
+                  int Code = 0) {
+  MainErrorCollector.Report(FGErrorWarning, What, Code, Device, USBError);
+  return 0;
+}
+
+inline int ShoutAt(const char *What, uint32_t Device, int USBError = 0,
+                   int Code = 0) {
+  MainErrorCollector.Report(FGErrorError, What, Code, Device, USBError);
+  return 0;
+}
+
 #endif /* FGLIBRARIES_ERROR_H_ */
\ No newline at end of file
@@ -0,0 +1,196 @@
+/*
+ * FGMockAnalogBoard.h
+ *
+ * Simulated analog interface board behind an FGBulkBridge, for benchmarks and
+ * for exercising the PSU classes without hardware. It answers Status_t
+ * queries the way the firmware does: the SetMask fields are latched, the
+ * sequence number increments per packet and the response carries a valid
+ * checksum. The PSU's monitor outputs are looped back from the DAC
+ * registers, so a read after set_voltage() returns roughly the setpoint.
+ *
+ * Latency, transport failures, corrupted and late responses can be
+ * injected to measure how the host side behaves under them.
+ */
+
+#ifndef SOURCE_FGMOCKANALOGBOARD_H_
+#define SOURCE_FGMOCKANALOGBOARD_H_
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <stdint.h>
+#include <thread>
+
+#include "AnalogPSU.h"
+#include "FGBulk.h"
+
+class FGMockAnalogBoard {
+public:
+  typedef FGAnalogPSUInterface::Status_t Status_t;
+
+  // Set these before queries start; they are not synchronised.
+  // Round trip added to every Read(), in microseconds.
+  unsigned int LatencyUs;
+  // Probability that a Write() or Read() fails outright (as a USB timeout
+  // would), and that a response arrives with a broken checksum.
+  double ErrorRate;
+  double CorruptRate;
+  // Probability that a Read() times out although the response is on its
+  // way: it stays queued and is what the next Read() returns, as a late
+  // packet in the IN endpoint would be.
+  double LateRate;
+  // false: SequenceNo never moves, as on firmware that does not count
+  // packets (see FGAnalogPSUInterface::SetSequenceCheck).
+  bool CountsPackets;
+  // Fraction of the voltage monitor reported on the current monitor, to
+  // stand in for a resistive load.
+  double LoadFraction;
+  // PSU output dynamics for calibration tests: first-order settling time
+  // constant of the voltage output in seconds (0: instant), and a bow of the
+  // voltage monitor, as a fraction of full scale at mid range.
+  double SettleTauS;
+  double MonitorBow;
+  // Gaussian noise on the voltage and current monitors, RMS in ADC counts.
+  double NoiseCounts;
+
+  explicit FGMockAnalogBoard(unsigned int Latency = 0, double Errors = 0,
+                             double Corrupt = 0)
+      : LatencyUs(Latency), ErrorRate(Errors), CorruptRate(Corrupt),
+        LateRate(0), CountsPackets(true), LoadFraction(0.1), SettleTauS(0),
+        MonitorBow(0), NoiseCounts(0),
+        Queries(0),
+        Failures(0), OutputA(0),
+        Rng(0x5EED),
+        Link(this, (BulkBridgeCallback)&FGMockAnalogBoard::WriteCallback,
+             (BulkBridgeCallback)&FGMockAnalogBoard::ReadCallback) {
+    memset(&State, 0, sizeof(State));
+    State.Relay = 1; // powered up with the output off
+  }
+  FGMockAnalogBoard(const FGMockAnalogBoard &) = delete;
+
+  FGBulkBridge &Transport() { return Link; }
+
+  uint64_t QueryCount() const { return Queries; }
+  uint64_t FailureCount() const { return Failures; }
+
+private:
+  std::mutex Mutex;
+  Status_t State; // last response, i.e. the board's registers
+  std::deque<Status_t> Pending; // responses not read yet, oldest first
+  uint64_t Queries;
+  uint64_t Failures;
+  double OutputA; // settled-towards program voltage A, in volts
+  std::chrono::steady_clock::time_point LastUpdate;
+  std::mt19937 Rng;
+  FGBulkBridge Link;
+
+  bool Roll(double P) {
+    return P > 0 && std::uniform_real_distribution<double>(0, 1)(Rng) < P;
+  }
+
+  // Board side: 0..11.3 V program voltage per DAC, monitors read through
+  // the 3.2 * 3.3 * 1.12 ADC front end. Relay register 0 means output on.
+  static uint16_t MonitorCounts(double Volts, double Noise = 0) {
+    double Raw = Volts / (3.2 * 3.3 * 1.12) * UINT16_MAX + Noise;
+    return Raw >= UINT16_MAX ? UINT16_MAX : (Raw <= 0 ? 0 : (uint16_t)Raw);
+  }
+  double Noise() {
+    return NoiseCounts > 0
+               ? std::normal_distribution<double>(0, NoiseCounts)(Rng)
+               : 0;
+  }
+
+  bool Write(unsigned char, unsigned char *Buffer, unsigned int Length) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    ++Queries;
+    if (Length != sizeof(Status_t) || Roll(ErrorRate)) {
+      ++Failures;
+      return false;
+    }
+    Status_t Command;
+    memcpy(&Command, Buffer, sizeof(Command));
+    if (Command.MagicNo != FGAnalogPSUInterface::ExpectedMagic ||
+        Command.ComputeChecksum() != 0) {
+      ++Failures;
+      return false; // the firmware drops bad packets without answering
+    }
+
+    if (Command.SetMask & FGAnalogPSUInterface::SetDACAMask)
+      State.DACA = Command.DACA;
+    if (Command.SetMask & FGAnalogPSUInterface::SetDACBMask)
+      State.DACB = Command.DACB;
+    if (Command.SetMask & FGAnalogPSUInterface::SetRelayMask)
+      State.Relay = Command.Relay;
+
+    bool On = State.Relay == 0;
+    double ProgA = On ? 11.3 * State.DACA / UINT16_MAX : 0;
+    double ProgB = 11.3 * State.DACB / UINT16_MAX;
+    std::chrono::steady_clock::time_point Now =
+        std::chrono::steady_clock::now();
+    if (SettleTauS > 0) {
+      double Dt = std::chrono::duration<double>(Now - LastUpdate).count();
+      OutputA += (ProgA - OutputA) * (1 - std::exp(-Dt / SettleTauS));
+    } else {
+      OutputA = ProgA;
+    }
+    LastUpdate = Now;
+    double X = OutputA / 11.3;
+    double MonA = OutputA + MonitorBow * 11.3 * 4 * X * (1 - X);
+    double Load = OutputA * LoadFraction;
+    State.MagicNo = FGAnalogPSUInterface::ExpectedMagic;
+    if (CountsPackets)
+      State.SequenceNo++;
+    State.Response = 0;
+    for (int i = 0; i < 4; ++i)
+      State.ADCA[i] = 0;
+    State.ADCB[0] = MonitorCounts(11.3 * State.DACA / UINT16_MAX);
+    State.ADCB[1] = MonitorCounts(ProgB);
+    State.ADCB[2] = MonitorCounts(MonA, Noise());
+    State.ADCB[3] = MonitorCounts(Load < ProgB ? Load : ProgB, Noise());
+    State.SetMask = 0;
+    State.Checksum = 0;
+    State.Checksum = State.ComputeChecksum();
+
+    Pending.push_back(State);
+    if (Roll(CorruptRate))
+      Pending.back().Checksum ^= 0x5A5A;
+    if (Pending.size() > 64) // the endpoint's buffer
+      Pending.pop_front();
+    return true;
+  }
+
+  bool Read(unsigned char, unsigned char *Buffer, unsigned int Length) {
+    if (LatencyUs)
+      std::this_thread::sleep_for(std::chrono::microseconds(LatencyUs));
+
+    std::lock_guard<std::mutex> Lock(Mutex);
+    if (Pending.empty() || Length != sizeof(Status_t) || Roll(LateRate)) {
+      ++Failures;
+      return false;
+    }
+    if (Roll(ErrorRate)) {
+      Pending.pop_front(); // lost
+      ++Failures;
+      return false;
+    }
+    memcpy(Buffer, &Pending.front(), sizeof(Status_t));
+    Pending.pop_front();
+    return true;
+  }
+
+  static bool WriteCallback(void *Self, unsigned char Endpoint,
+                            unsigned char *Buffer, unsigned int Length) {
+    return static_cast<FGMockAnalogBoard *>(Self)->Write(Endpoint, Buffer,
+                                                         Length);
+  }
+  static bool ReadCallback(void *Self, unsigned char Endpoint,
+                           unsigned char *Buffer, unsigned int Length) {
+    return static_cast<FGMockAnalogBoard *>(Self)->Read(Endpoint, Buffer,
+                                                        Length);
+  }
+};
+
+#endif /* SOURCE_FGMOCKANALOGBOARD_H_ */
@@ -0,0 +1,119 @@
+/*
+ * FGMoxa.h
+ *
+ * The ports of one Moxa serial device server, as listed in its config
+ * (moxa/config_example.json: host, ports, timeout_s), each on a persistent
+ * FGTCPMux connection. All ports are connected in parallel when the object
+ * is built and stay connected; Exchange() is the raw request/response of
+ * moxa.py without its per-request connect. For a supply behind a port hand
+ * Url(port) to one of the SerialPSU drivers instead; while a driver has the
+ * port open, Exchange() on it is refused.
+ */
+
+#ifndef SOURCE_FGMOXA_H_
+#define SOURCE_FGMOXA_H_
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FGTCPMux.h"
+
+class FGMoxaPorts {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  FGMoxaPorts(const std::string &Host, const std::vector<int> &Ports,
+              double TimeoutS = 1.0)
+      : Host(Host), Ports(Ports), TimeoutS(TimeoutS) {
+    for (size_t i = 0; i < Ports.size(); ++i)
+      Conns.push_back(FGTCPMux::Get().Connect(Host, Ports[i], 0));
+    Clock::time_point Deadline = Clock::now() + Timeout(TimeoutS);
+    for (size_t i = 0; i < Conns.size(); ++i)
+      Conns[i]->WaitConnected(Deadline);
+  }
+  FGMoxaPorts(const FGMoxaPorts &) = delete;
+
+  const std::string Host;
+  const std::vector<int> Ports;
+  const double TimeoutS;
+
+  // Device name for FGSerialLine / SerialPSU.
+  std::string Url(int Port) const {
+    return "tcp://" + Host + ":" + std::to_string(Port);
+  }
+
+  bool Connected(int Port) const {
+    int i = Index(Port);
+    return i >= 0 && Conns[i]->Connected();
+  }
+
+  // Sends Payload (may be empty) and returns what comes back: up to and
+  // including Terminator if one is given, else everything until the port
+  // has been quiet for QuietMs after the first byte. "" on timeout, as with
+  // moxa.py. Calls on the same port are serialised, also across
+  // FGMoxaPorts objects for the same server; "" if a serial line has the
+  // port open.
+  std::string Exchange(int Port, const std::string &Payload,
+                       const std::string &Terminator = std::string(),
+                       double ExchangeTimeoutS = -1, int QuietMs = 20) {
+    int i = Index(Port);
+    if (i < 0) {
+      Shout("Port " + std::to_string(Port) + " is not configured on " + Host);
+      return std::string();
+    }
+    FGTCPConnection &C = *Conns[i];
+    std::unique_lock<std::mutex> Use = C.Borrow();
+    if (!Use) {
+      Shout("Port " + std::to_string(Port) + " on " + Host +
+            " is in use by a serial line");
+      return std::string();
+    }
+    Clock::time_point Deadline =
+        Clock::now() + Timeout(ExchangeTimeoutS < 0 ? TimeoutS
+                                                    : ExchangeTimeoutS);
+    if (!C.Connected() && !C.WaitConnected(Deadline))
+      return std::string();
+    C.Discard(); // a late reply to an earlier exchange
+    if (!Payload.empty() && !C.Write(Payload))
+      return std::string();
+    std::string Reply;
+    char Buffer[512];
+    for (;;) {
+      Clock::time_point Until = Deadline;
+      if (!Reply.empty() && Terminator.empty())
+        Until = std::min(Deadline,
+                         Clock::now() + std::chrono::milliseconds(QuietMs));
+      ssize_t N = C.Read(Buffer, sizeof(Buffer), Until);
+      if (N <= 0)
+        return Reply;
+      Reply.append(Buffer, N);
+      if (!Terminator.empty()) {
+        size_t End = Reply.find(Terminator);
+        if (End != std::string::npos) {
+          Reply.resize(End + Terminator.size());
+          return Reply;
+        }
+      }
+    }
+  }
+
+private:
+  std::vector<std::shared_ptr<FGTCPConnection>> Conns;
+
+  static Clock::duration Timeout(double Seconds) {
+    return std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(Seconds));
+  }
+
+  int Index(int Port) const {
+    for (size_t i = 0; i < Ports.size(); ++i)
+      if (Ports[i] == Port)
+        return (int)i;
+    return -1;
+  }
+};
+
+#endif /* SOURCE_FGMOXA_H_ */
@@ -0,0 +1,224 @@
+/*
+ * FGPacketTrace.h
+ *
+ * Binary protocol trace. Producers copy the raw packet, a timestamp and a
+ * formatter function into a preallocated lock-free ring (no allocation, no
+ * I/O, no locks on the caller's thread); a background thread turns the
+ * records into text on the configured stream. A full ring drops records and
+ * counts them instead of blocking the control loop.
+ */
+
+#ifndef SOURCE_FGPACKETTRACE_H_
+#define SOURCE_FGPACKETTRACE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+struct FGTraceRecord;
+typedef void (*FGTraceFormatter)(std::ostream &, const FGTraceRecord &);
+
+struct FGTraceRecord {
+  static const unsigned int MaxData = 32; // one Status_t; longer is truncated
+
+  double T;              // Unix seconds
+  const void *Source;    // who recorded it, printed as an id
+  FGTraceFormatter Format;
+  uint8_t Endpoint;
+  uint16_t Length;       // length of the original buffer
+  int32_t Code;          // e.g. a libusb return code
+  int32_t Actual;        // e.g. bytes actually transferred
+  uint8_t Data[MaxData];
+
+  unsigned int Stored() const { return Length < MaxData ? Length : MaxData; }
+};
+
+class FGPacketTrace {
+private:
+  // Bounded MPSC queue (Vyukov): each slot carries a sequence number that
+  // tells producers whether it is free and the consumer whether it is full.
+  struct Slot {
+    std::atomic<size_t> Seq;
+    FGTraceRecord Record;
+  };
+  static const size_t Capacity = 8192;
+
+  std::unique_ptr<Slot[]> Slots;
+  std::atomic<size_t> EnqueuePos;
+  std::atomic<size_t> DequeuePos; // written by the consumer only
+  std::atomic<uint64_t> Dropped;
+  std::atomic<uint64_t> Written;
+
+  std::atomic<bool> TraceAll;
+  std::atomic<bool> Running;
+  std::mutex ControlMutex; // start/stop and sink changes
+  std::thread Worker;
+  std::ostream *Sink;
+  std::unique_ptr<std::ofstream> File;
+
+  FGPacketTrace()
+      : Slots(new Slot[Capacity]), EnqueuePos(0), DequeuePos(0), Dropped(0),
+        Written(0), TraceAll(false), Running(false), Sink(&std::cout) {
+    for (size_t i = 0; i < Capacity; ++i)
+      Slots[i].Seq.store(i, std::memory_order_relaxed);
+  }
+
+  bool Pop(FGTraceRecord &R) {
+    size_t Pos = DequeuePos.load(std::memory_order_relaxed);
+    Slot &S = Slots[Pos & (Capacity - 1)];
+    if (S.Seq.load(std::memory_order_acquire) != Pos + 1)
+      return false;
+    R = S.Record;
+    S.Seq.store(Pos + Capacity, std::memory_order_release);
+    DequeuePos.store(Pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Formats whatever is queued; returns the number of records written.
+  size_t DrainTo(std::ostream &Out) {
+    size_t N = 0;
+    FGTraceRecord R;
+    while (Pop(R)) {
+      std::streamsize Precision = Out.precision(6);
+      Out << std::fixed << R.T << " [" << R.Source << "] ";
+      Out.unsetf(std::ios::floatfield);
+      Out.precision(Precision);
+      R.Format(Out, R);
+      ++N;
+    }
+    if (N) {
+      Out.flush();
+      Written.fetch_add(N, std::memory_order_relaxed);
+    }
+    return N;
+  }
+
+  void Run() {
+    while (Running) {
+      if (DrainTo(*Sink) == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    DrainTo(*Sink);
+  }
+
+  void StartLocked() {
+    if (Running)
+      return;
+    Running = true;
+    Worker = std::thread(&FGPacketTrace::Run, this);
+  }
+
+  void StopLocked() {
+    Running = false;
+    if (Worker.joinable())
+      Worker.join();
+  }
+
+  static void FlushAtExit() { Get().Flush(1.0); }
+
+public:
+  FGPacketTrace(const FGPacketTrace &) = delete;
+
+  // Never destroyed, like FGUSBContext: producers may still run during
+  // static destruction.
+  static FGPacketTrace &Get() {
+    static FGPacketTrace *Instance = new FGPacketTrace();
+    return *Instance;
+  }
+
+  // Global switch for tracing every board/transfer. Individual objects may
+  // still trace on their own (e.g. FGAnalogPSUInterface::Verbose).
+  bool Enabled() const { return TraceAll.load(std::memory_order_relaxed); }
+
+  // Starts tracing everything to Path (empty: the current sink, std::cout
+  // by default). Returns false if the file cannot be opened.
+  bool Enable(const std::string &Path = "") {
+    std::lock_guard<std::mutex> Lock(ControlMutex);
+    if (!Path.empty()) {
+      std::unique_ptr<std::ofstream> NewFile(
+          new std::ofstream(Path.c_str(), std::ios::out | std::ios::app));
+      if (!*NewFile)
+        return false;
+      StopLocked();
+      File = std::move(NewFile);
+      Sink = File.get();
+    }
+    StartLocked();
+    TraceAll = true;
+    return true;
+  }
+
+  // Stops global tracing; the records already queued are still written.
+  void Disable() { TraceAll = false; }
+
+  // Waits up to TimeoutS seconds for the queue to be written out.
+  void Flush(double TimeoutS = 1.0) {
+    std::chrono::steady_clock::time_point Deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(TimeoutS));
+    size_t Target = EnqueuePos.load(std::memory_order_acquire);
+    while (Running && DequeuePos.load(std::memory_order_acquire) < Target &&
+           std::chrono::steady_clock::now() < Deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  uint64_t DroppedCount() const { return Dropped.load(); }
+  uint64_t WrittenCount() const { return Written.load(); }
+
+  void Record(FGTraceFormatter Format, const void *Source,
+              unsigned char Endpoint, const void *Data, unsigned int Length,
+              int Code = 0, int Actual = 0) {
+    if (!Running) {
+      std::lock_guard<std::mutex> Lock(ControlMutex);
+      if (!Running) {
+        static bool AtExitRegistered = false;
+        if (!AtExitRegistered)
+          AtExitRegistered = std::atexit(&FGPacketTrace::FlushAtExit) == 0;
+        StartLocked();
+      }
+    }
+
+    size_t Pos = EnqueuePos.load(std::memory_order_relaxed);
+    Slot *S;
+    for (;;) {
+      S = &Slots[Pos & (Capacity - 1)];
+      size_t Seq = S->Seq.load(std::memory_order_acquire);
+      intptr_t Diff = (intptr_t)Seq - (intptr_t)Pos;
+      if (Diff == 0) {
+        if (EnqueuePos.compare_exchange_weak(Pos, Pos + 1,
+                                             std::memory_order_relaxed))
+          break;
+      } else if (Diff < 0) {
+        Dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        Pos = EnqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+
+    FGTraceRecord &R = S->Record;
+    R.T = std::chrono::duration<double>(
+              std::chrono::system_clock::now().time_since_epoch())
+              .count();
+    R.Source = Source;
+    R.Format = Format;
+    R.Endpoint = Endpoint;
+    R.Length = (uint16_t)Length;
+    R.Code = Code;
+    R.Actual = Actual;
+    if (Data)
+      memcpy(R.Data, Data, R.Stored());
+    S->Seq.store(Pos + 1, std::memory_order_release);
+  }
+};
+
+#endif /* SOURCE_FGPACKETTRACE_H_ */
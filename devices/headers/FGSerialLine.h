@@ -0,0 +1,370 @@
+/*
+ * FGSerialLine.h
+ *
+ * Line-oriented transport for the supplies on RS-232 / USB-serial adapters
+ * (TDK-Lambda, iseg). Raw 8N1 termios and no fixed sleeps: a reply is read
+ * with poll() until its terminator arrives, so a command costs what the wire
+ * and the device take. Transact() pipelines a batch, writing up to Window
+ * commands ahead of their replies, so N commands are not N turnarounds.
+ * A device of the form tcp://host:port is a serial device server port
+ * (Moxa) on a persistent FGTCPMux connection instead; the line settings
+ * are then the server's. Not thread safe; the drivers serialise calls on
+ * their own mutex.
+ */
+
+#ifndef SOURCE_FGSERIALLINE_H_
+#define SOURCE_FGSERIALLINE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Error.h"            // For Shout
+#include "FGTCPMux.h"
+#include "FGTransportStats.h" // Same counters as the USB transport
+
+struct FGSerialCommand {
+  std::string Text; // without the terminator
+  bool Reply;       // the device answers with a line (besides any echo)
+};
+
+class FGSerialLine {
+public:
+  std::string Terminator; // appended to every command
+  bool Echo;              // the device repeats each command line first
+  unsigned int Window;    // commands written ahead of their replies
+  int TimeoutMs;          // per reply line
+  int QuietMs;            // silence that ends the drain after a failure
+  FGTransportStats *Stats;
+
+  FGSerialLine()
+      : Terminator("\r"), Echo(false), Window(1), TimeoutMs(500),
+        QuietMs(100), Stats(nullptr), Fd(-1) {}
+  FGSerialLine(const FGSerialLine &) = delete;
+  ~FGSerialLine() { Close(); }
+
+  bool Open(const std::string &Device, unsigned int Baud) {
+    Close();
+    if (Device.compare(0, 6, "tcp://") == 0)
+      return OpenTCP(Device);
+    speed_t Speed;
+    if (!BaudConstant(Baud, Speed)) {
+      Shout("Unsupported baud rate " + std::to_string(Baud));
+      return false;
+    }
+    int F = open(Device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (F < 0) {
+      Shout("Unable to open serial port " + Device + ": " + strerror(errno));
+      return false;
+    }
+    fcntl(F, F_SETFD, FD_CLOEXEC);
+    termios T;
+    if (tcgetattr(F, &T) != 0) {
+      Shout("Not a serial port: " + Device);
+      close(F);
+      return false;
+    }
+    cfmakeraw(&T); // 8 data bits, no parity, no translation
+    T.c_cflag |= CLOCAL | CREAD;
+    T.c_cflag &= ~(CSTOPB | CRTSCTS);
+    T.c_iflag &= ~(IXON | IXOFF | IXANY);
+    T.c_cc[VMIN] = 0;
+    T.c_cc[VTIME] = 0;
+    cfsetispeed(&T, Speed);
+    cfsetospeed(&T, Speed);
+    if (tcsetattr(F, TCSANOW, &T) != 0) {
+      Shout("Unable to configure serial port " + Device);
+      close(F);
+      return false;
+    }
+    tcflush(F, TCIOFLUSH);
+    Fd = F;
+    Name = Device;
+    Pending.clear();
+    return true;
+  }
+
+  void Close() {
+    if (Fd >= 0)
+      close(Fd);
+    Fd = -1;
+    if (Net)
+      Net->Release();
+    Net.reset(); // the connection itself stays up for the next Open()
+  }
+
+  explicit operator bool() const { return Fd >= 0 || Net; }
+  const std::string &Device() const { return Name; }
+
+  // Throws away the input that has arrived so far. Replies still in flight
+  // are not, see Drain().
+  void Discard() {
+    if (Fd >= 0)
+      tcflush(Fd, TCIFLUSH);
+    if (Net)
+      Net->Discard();
+    Pending.clear();
+  }
+
+  // Sends each command and collects one entry per command: the reply line,
+  // or "" for commands without one. With Echo, each echoed command is
+  // checked and dropped. Returns how many commands completed, in order; on
+  // a timeout or a wrong echo the rest of the batch is abandoned and the
+  // line drained until it has been quiet for QuietMs, so a late reply to an
+  // abandoned command is not taken for the next batch's (a device without
+  // echo gives no other way to tell). One slower than that still can be.
+  size_t Transact(const std::vector<FGSerialCommand> &Commands,
+                  std::vector<std::string> &Replies) {
+    typedef std::chrono::steady_clock Clock;
+    Replies.assign(Commands.size(), std::string());
+    if (!*this) {
+      Count(Commands.size(), 0);
+      return 0;
+    }
+    const size_t Ahead = Window ? Window : 1;
+    std::vector<Clock::time_point> Sent(Commands.size());
+    size_t Written = 0;
+    std::string Out, Line;
+    for (size_t Done = 0; Done < Commands.size(); ++Done) {
+      // Top the window up; the first pass writes it whole, in one write.
+      const size_t Until = std::min(Commands.size(), Done + Ahead);
+      if (Written < Until) {
+        Out.clear();
+        Clock::time_point Now = Clock::now();
+        for (; Written < Until; ++Written) {
+          Out += Commands[Written].Text + Terminator;
+          Sent[Written] = Now;
+        }
+        if (!WriteAll(Out)) {
+          if (Stats)
+            FGTransportStats::Bump(Stats->WriteFailures);
+          return Abandon(Commands.size(), Done);
+        }
+      }
+      if (Echo) {
+        if (!ReadLine(Line))
+          return Abandon(Commands.size(), Done);
+        if (Line != Commands[Done].Text) {
+          Shout("Unexpected echo on " + Name + ": '" + Line + "' for '" +
+                Commands[Done].Text + "'");
+          return Abandon(Commands.size(), Done);
+        }
+      }
+      if (Commands[Done].Reply && !ReadLine(Replies[Done]))
+        return Abandon(Commands.size(), Done);
+      if (Stats)
+        Stats->QueryLatency.Record(FGTransportStats::MicrosSince(Sent[Done]));
+    }
+    Count(Commands.size(), Commands.size());
+    return Commands.size();
+  }
+
+  // Single command convenience; false on timeout. Reply is "" without one.
+  bool Transact(const std::string &Command, bool Reply, std::string &Line) {
+    std::vector<FGSerialCommand> C(1);
+    C[0].Text = Command;
+    C[0].Reply = Reply;
+    std::vector<std::string> R;
+    if (Transact(C, R) != 1)
+      return false;
+    Line.swap(R[0]);
+    return true;
+  }
+
+private:
+  int Fd;
+  std::shared_ptr<FGTCPConnection> Net;
+  std::string Name;
+  std::string Pending; // read but not yet returned
+
+  static bool BaudConstant(unsigned int Baud, speed_t &Speed) {
+    switch (Baud) {
+    case 1200: Speed = B1200; return true;
+    case 2400: Speed = B2400; return true;
+    case 4800: Speed = B4800; return true;
+    case 9600: Speed = B9600; return true;
+    case 19200: Speed = B19200; return true;
+    case 38400: Speed = B38400; return true;
+    case 57600: Speed = B57600; return true;
+    case 115200: Speed = B115200; return true;
+    case 230400: Speed = B230400; return true;
+    default: return false;
+    }
+  }
+
+  void Count(size_t Commands, size_t Completed) {
+    if (!Stats)
+      return;
+    Stats->Queries.fetch_add(Commands, std::memory_order_relaxed);
+    Stats->Failures.fetch_add(Commands - Completed, std::memory_order_relaxed);
+  }
+
+  size_t Abandon(size_t Commands, size_t Completed) {
+    Drain();
+    Count(Commands, Completed);
+    return Completed;
+  }
+
+  // Reads and throws away input until none has come for QuietMs, for at
+  // most TimeoutMs in all so a chattering device cannot hold the caller.
+  void Drain() {
+    typedef std::chrono::steady_clock Clock;
+    Pending.clear();
+    if (!*this)
+      return;
+    const Clock::time_point Limit =
+        Clock::now() + std::chrono::milliseconds(TimeoutMs);
+    char Buffer[256];
+    for (;;) {
+      Clock::time_point Quiet =
+          std::min(Limit, Clock::now() + std::chrono::milliseconds(QuietMs));
+      ssize_t N = ReadSome(Buffer, sizeof(Buffer), Quiet);
+      if (N < 0) {
+        if (Stats)
+          FGTransportStats::Bump(Stats->ReadFailures);
+        Lost(Name + " went away");
+        return;
+      }
+      if (N == 0 || Clock::now() >= Limit)
+        break;
+    }
+    Discard();
+  }
+
+  bool WaitFor(short Events, std::chrono::steady_clock::time_point Deadline) {
+    for (;;) {
+      int Left = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                     Deadline - std::chrono::steady_clock::now())
+                     .count();
+      if (Left < 0)
+        Left = 0;
+      pollfd P = {Fd, Events, 0};
+      int R = poll(&P, 1, Left);
+      if (R > 0)
+        return true;
+      if (R == 0 || errno != EINTR)
+        return false;
+    }
+  }
+
+  // tcp://host:port; waits up to TimeoutMs for the connection.
+  bool OpenTCP(const std::string &Device) {
+    size_t Colon = Device.rfind(':');
+    int Port = Colon > 6 ? atoi(Device.c_str() + Colon + 1) : 0;
+    if (Port <= 0) {
+      Shout("Expected tcp://host:port, got " + Device);
+      return false;
+    }
+    std::shared_ptr<FGTCPConnection> C =
+        FGTCPMux::Get().Connect(Device.substr(6, Colon - 6), Port, TimeoutMs);
+    if (!C->Connected()) {
+      Shout("Unable to connect to " + Device);
+      return false;
+    }
+    if (!C->Claim()) { // replies could not be told apart
+      Shout(Device + " is already open on another serial line");
+      return false;
+    }
+    C->Discard();
+    Net = C;
+    Name = Device;
+    Pending.clear();
+    return true;
+  }
+
+  void Lost(const std::string &What) {
+    Shout(What);
+    if (Stats)
+      FGTransportStats::Bump(Stats->LinkLosses);
+    Close();
+  }
+
+  bool WriteAll(const std::string &Data) {
+    if (Net) {
+      if (Net->Write(Data))
+        return true;
+      Lost("Connection to " + Name + " went away");
+      return false;
+    }
+    const char *P = Data.data();
+    size_t Left = Data.size();
+    std::chrono::steady_clock::time_point Deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(TimeoutMs);
+    while (Left) {
+      ssize_t N = write(Fd, P, Left);
+      if (N > 0) {
+        P += N;
+        Left -= N;
+      } else if (N < 0 && errno != EAGAIN && errno != EINTR) {
+        Lost("Write to " + Name + " failed: " + strerror(errno));
+        return false;
+      } else if (!WaitFor(POLLOUT, Deadline)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // >0 bytes read, 0 on timeout, -1 when the port went away: an unplugged
+  // adapter (POLLHUP, read returns 0) or a dropped connection.
+  ssize_t ReadSome(char *Buffer, size_t Size,
+                   std::chrono::steady_clock::time_point Deadline) {
+    if (Net)
+      return Net->Read(Buffer, Size, Deadline);
+    for (;;) {
+      if (!WaitFor(POLLIN, Deadline))
+        return 0;
+      ssize_t N = read(Fd, Buffer, Size);
+      if (N > 0)
+        return N;
+      if (N == 0 || (errno != EAGAIN && errno != EINTR))
+        return -1;
+    }
+  }
+
+  // Next non-empty line, split at '\r' or '\n' (so "\r\n" is one break).
+  bool ReadLine(std::string &Line) {
+    std::chrono::steady_clock::time_point Deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(TimeoutMs);
+    char Buffer[256];
+    for (;;) {
+      size_t Start = Pending.find_first_not_of("\r\n");
+      if (Start == std::string::npos) {
+        Pending.clear();
+      } else {
+        size_t End = Pending.find_first_of("\r\n", Start);
+        if (End != std::string::npos) {
+          Line.assign(Pending, Start, End - Start);
+          Pending.erase(0, End + 1);
+          return true;
+        }
+      }
+      ssize_t N = ReadSome(Buffer, sizeof(Buffer), Deadline);
+      if (N > 0) {
+        Pending.append(Buffer, N);
+      } else if (N == 0) {
+        if (Stats)
+          FGTransportStats::Bump(Stats->Timeouts);
+        return false;
+      } else {
+        // The owner sees the line closed and may Open() it again.
+        if (Stats)
+          FGTransportStats::Bump(Stats->ReadFailures);
+        Lost(Name + " went away");
+        return false;
+      }
+    }
+  }
+};
+
+#endif /* SOURCE_FGSERIALLINE_H_ */
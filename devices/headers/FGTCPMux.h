@@ -0,0 +1,410 @@
+/*
+ * FGTCPMux.h
+ *
+ * Persistent TCP connections to serial device servers (Moxa NPort in TCP
+ * server mode), all served by one process-wide I/O thread, as FGUSBContext
+ * does for USB. Sockets are non-blocking with TCP_NODELAY, so a command goes
+ * out the moment it is written instead of after a handshake and a Nagle
+ * delay. The thread poll()s every connection, buffers what arrives for the
+ * reader, flushes what a write could not hand to the socket at once, and
+ * reconnects dropped connections in the background. Host names are resolved
+ * by Connect(), on the caller's thread, so a slow resolver never holds up
+ * the I/O thread.
+ */
+
+#ifndef SOURCE_FGTCPMUX_H_
+#define SOURCE_FGTCPMUX_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "Error.h" // For Shout
+
+class FGTCPMux;
+
+class FGTCPConnection {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  FGTCPConnection(const std::string &Host, int Port, FGTCPMux *Mux)
+      : Host(Host), Port(Port), Mux(Mux), Fd(-1), Connecting(false),
+        Up(false), Generation(0), Warned(false), AddrLen(0),
+        Claimed(false) {}
+  FGTCPConnection(const FGTCPConnection &) = delete;
+
+  const std::string Host;
+  const int Port;
+  std::string Name() const { return Host + ":" + std::to_string(Port); }
+
+  bool Connected() const { return Up; }
+  // Successful connects so far; changes whenever the connection was redone.
+  uint64_t Connects() const { return Generation; }
+
+  bool WaitConnected(Clock::time_point Deadline) {
+    std::unique_lock<std::mutex> Lock(Mutex);
+    return Cond.wait_until(Lock, Deadline, [this]() { return (bool)Up; });
+  }
+
+  // Never blocks: what the socket does not take at once is sent by the I/O
+  // thread. False if not connected.
+  inline bool Write(const std::string &Data);
+
+  // Bytes received so far, up to Max, waiting until Deadline for the first.
+  // 0 on timeout, -1 once the connection is down.
+  ssize_t Read(char *Buffer, size_t Max, Clock::time_point Deadline) {
+    std::unique_lock<std::mutex> Lock(Mutex);
+    Cond.wait_until(Lock, Deadline,
+                    [this]() { return !Inbox.empty() || !Up; });
+    if (!Inbox.empty()) {
+      size_t N = std::min(Max, Inbox.size());
+      memcpy(Buffer, Inbox.data(), N);
+      Inbox.erase(0, N);
+      return N;
+    }
+    return Up ? 0 : -1;
+  }
+
+  void Discard() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Inbox.clear();
+  }
+
+  // There is one connection per host:port, so whoever talks to a port
+  // shares it, and a reply cannot tell who asked. An FGSerialLine claims
+  // the port for as long as it is open; a second claim fails. One-off
+  // exchanges (FGMoxaPorts::Exchange) Borrow() it instead: the lock is
+  // held for the whole request and reply, so they are serialised with each
+  // other, and it is empty while the port is claimed.
+  bool Claim() {
+    std::lock_guard<std::mutex> Lock(UseMutex);
+    if (Claimed)
+      return false;
+    Claimed = true;
+    return true;
+  }
+  void Release() {
+    std::lock_guard<std::mutex> Lock(UseMutex);
+    Claimed = false;
+  }
+  std::unique_lock<std::mutex> Borrow() {
+    std::unique_lock<std::mutex> Lock(UseMutex);
+    if (Claimed)
+      Lock.unlock();
+    return Lock;
+  }
+
+private:
+  friend class FGTCPMux;
+
+  FGTCPMux *Mux;
+  std::mutex Mutex; // everything below, and the descriptor's lifetime
+  std::condition_variable Cond;
+  int Fd;
+  bool Connecting; // non-blocking connect() in progress
+  std::atomic<bool> Up;
+  std::atomic<uint64_t> Generation;
+  bool Warned; // connect failure reported once until the next success
+  Clock::time_point RetryAt;
+  std::string Inbox;
+  std::string Outbox;
+  sockaddr_storage Addr; // resolved by FGTCPMux::Connect()
+  socklen_t AddrLen;     // 0 until the host has been resolved
+
+  std::mutex UseMutex; // Claimed, and one Borrow() at a time
+  bool Claimed;
+
+  void DropLocked(const char *Why) {
+    if (Up || !Warned)
+      Shout("Connection to " + Name() + " " + Why);
+    Warned = true;
+    if (Fd >= 0)
+      close(Fd);
+    Fd = -1;
+    Connecting = false;
+    Up = false;
+    Outbox.clear(); // Inbox is kept: a reply may have come with the close
+    RetryAt = Clock::now() + std::chrono::seconds(1);
+    Cond.notify_all();
+  }
+};
+
+class FGTCPMux {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  FGTCPMux(const FGTCPMux &) = delete;
+
+  // Never destroyed, like FGUSBContext: the I/O thread runs until exit.
+  static FGTCPMux &Get() {
+    static FGTCPMux *Instance = new FGTCPMux();
+    return *Instance;
+  }
+
+  // The one connection to Host:Port, created on first use and kept for the
+  // life of the process. Waits up to TimeoutMs for it to be up; check
+  // Connected(), it keeps retrying either way. The host is resolved here,
+  // once; while that fails, every Connect() tries again.
+  std::shared_ptr<FGTCPConnection> Connect(const std::string &Host, int Port,
+                                           int TimeoutMs) {
+    std::shared_ptr<FGTCPConnection> C;
+    {
+      std::lock_guard<std::mutex> Lock(Mutex);
+      for (size_t i = 0; i < Conns.size() && !C; ++i)
+        if (Conns[i]->Host == Host && Conns[i]->Port == Port)
+          C = Conns[i];
+      if (!C) {
+        C = std::make_shared<FGTCPConnection>(Host, Port, this);
+        Conns.push_back(C);
+      }
+    }
+    bool Resolved;
+    {
+      std::lock_guard<std::mutex> CLock(C->Mutex);
+      Resolved = C->AddrLen != 0;
+    }
+    if (!Resolved) {
+      sockaddr_storage Addr;
+      socklen_t Len = Resolve(Host, Port, Addr);
+      if (!Len) {
+        Shout("Connection to " + C->Name() + " failed: unknown host");
+        return C;
+      }
+      std::lock_guard<std::mutex> CLock(C->Mutex);
+      C->Addr = Addr;
+      C->AddrLen = Len;
+    }
+    std::call_once(ThreadOnce,
+                   [this]() { std::thread(&FGTCPMux::Run, this).detach(); });
+    Wake();
+    if (TimeoutMs > 0)
+      C->WaitConnected(Clock::now() + std::chrono::milliseconds(TimeoutMs));
+    return C;
+  }
+
+  void Wake() {
+    char One = 1;
+    ssize_t N = write(WakeW, &One, 1);
+    (void)N; // a full pipe already means a pending wakeup
+  }
+
+private:
+  std::mutex Mutex; // Conns
+  std::vector<std::shared_ptr<FGTCPConnection>> Conns; // never shrinks
+  std::once_flag ThreadOnce;
+  int WakeR, WakeW;
+
+  FGTCPMux() : WakeR(-1), WakeW(-1) {
+    int P[2];
+    if (pipe(P) != 0) {
+      Shout("Unable to create the TCP I/O thread's wakeup pipe");
+      return;
+    }
+    for (int i = 0; i < 2; ++i) {
+      fcntl(P[i], F_SETFL, fcntl(P[i], F_GETFL) | O_NONBLOCK);
+      fcntl(P[i], F_SETFD, FD_CLOEXEC);
+    }
+    WakeR = P[0];
+    WakeW = P[1];
+  }
+
+  // The first address of Host:Port into Addr; its length, 0 if unknown.
+  static socklen_t Resolve(const std::string &Host, int Port,
+                           sockaddr_storage &Addr) {
+    addrinfo Hints, *Res = nullptr;
+    memset(&Hints, 0, sizeof(Hints));
+    Hints.ai_family = AF_UNSPEC;
+    Hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(Host.c_str(), std::to_string(Port).c_str(), &Hints,
+                    &Res) != 0 ||
+        !Res)
+      return 0;
+    socklen_t Len = 0;
+    if (Res->ai_addrlen <= sizeof(Addr)) {
+      memcpy(&Addr, Res->ai_addr, Res->ai_addrlen);
+      Len = Res->ai_addrlen;
+    }
+    freeaddrinfo(Res);
+    return Len;
+  }
+
+  static bool StartConnect(FGTCPConnection &C) {
+    int Fd = socket(C.Addr.ss_family, SOCK_STREAM, 0);
+    if (Fd < 0) {
+      C.DropLocked("failed: no socket");
+      return false;
+    }
+    fcntl(Fd, F_SETFL, fcntl(Fd, F_GETFL) | O_NONBLOCK);
+    fcntl(Fd, F_SETFD, FD_CLOEXEC);
+    int One = 1;
+    setsockopt(Fd, IPPROTO_TCP, TCP_NODELAY, &One, sizeof(One));
+    setsockopt(Fd, SOL_SOCKET, SO_KEEPALIVE, &One, sizeof(One));
+#ifdef SO_NOSIGPIPE
+    setsockopt(Fd, SOL_SOCKET, SO_NOSIGPIPE, &One, sizeof(One));
+#endif
+    int R = connect(Fd, (const sockaddr *)&C.Addr, C.AddrLen);
+    C.Fd = Fd;
+    if (R == 0) {
+      Established(C);
+    } else if (errno == EINPROGRESS) {
+      C.Connecting = true;
+    } else {
+      C.DropLocked("refused");
+      return false;
+    }
+    return true;
+  }
+
+  static void Established(FGTCPConnection &C) {
+    C.Connecting = false;
+    C.Up = true;
+    C.Warned = false;
+    C.Inbox.clear(); // anything the last connection left unread is stale
+    ++C.Generation;
+    C.Cond.notify_all();
+  }
+
+  static ssize_t Send(int Fd, const char *Data, size_t Size) {
+#ifdef MSG_NOSIGNAL
+    return send(Fd, Data, Size, MSG_NOSIGNAL);
+#else
+    return send(Fd, Data, Size, 0); // SO_NOSIGPIPE is set instead
+#endif
+  }
+
+  void Run() {
+    std::vector<pollfd> Polled;
+    std::vector<FGTCPConnection *> Owners;
+    char Buffer[4096];
+    for (;;) {
+      Polled.clear();
+      Owners.clear();
+      pollfd W = {WakeR, POLLIN, 0};
+      Polled.push_back(W);
+      Owners.push_back(nullptr);
+      Clock::time_point Now = Clock::now();
+      Clock::time_point Next = Now + std::chrono::seconds(1);
+      {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        for (size_t i = 0; i < Conns.size(); ++i) {
+          FGTCPConnection &C = *Conns[i];
+          std::lock_guard<std::mutex> CLock(C.Mutex);
+          if (!C.AddrLen)
+            continue; // until a Connect() resolves the host
+          if (C.Fd < 0 && C.RetryAt <= Now)
+            StartConnect(C);
+          if (C.Fd < 0) {
+            Next = std::min(Next, C.RetryAt);
+            continue;
+          }
+          short Events = C.Connecting ? POLLOUT : POLLIN;
+          if (!C.Outbox.empty())
+            Events |= POLLOUT;
+          pollfd P = {C.Fd, Events, 0};
+          Polled.push_back(P);
+          Owners.push_back(&C);
+        }
+      }
+      int Wait = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                     Next - Now)
+                     .count();
+      if (poll(Polled.data(), Polled.size(), Wait < 0 ? 0 : Wait + 1) <= 0)
+        continue;
+      if (Polled[0].revents)
+        while (read(WakeR, Buffer, sizeof(Buffer)) > 0) {
+        }
+      for (size_t i = 1; i < Polled.size(); ++i)
+        if (Polled[i].revents)
+          Service(*Owners[i], Polled[i], Buffer, sizeof(Buffer));
+    }
+  }
+
+  static void Service(FGTCPConnection &C, const pollfd &P, char *Buffer,
+                      size_t Size) {
+    std::lock_guard<std::mutex> Lock(C.Mutex);
+    if (C.Fd != P.fd)
+      return; // dropped meanwhile
+    if (C.Connecting) {
+      int Error = 0;
+      socklen_t Len = sizeof(Error);
+      getsockopt(C.Fd, SOL_SOCKET, SO_ERROR, &Error, &Len);
+      if (Error)
+        C.DropLocked("failed");
+      else
+        Established(C);
+      return;
+    }
+    if (P.revents & (POLLIN | POLLHUP | POLLERR)) {
+      bool Got = false;
+      for (;;) {
+        ssize_t N = recv(C.Fd, Buffer, Size, 0);
+        if (N > 0) {
+          C.Inbox.append(Buffer, N);
+          Got = true;
+          continue;
+        }
+        if (N < 0 &&
+            (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+          break;
+        C.DropLocked("closed by peer");
+        return;
+      }
+      if (Got)
+        C.Cond.notify_all();
+    }
+    if ((P.revents & POLLOUT) && !C.Outbox.empty()) {
+      ssize_t N = Send(C.Fd, C.Outbox.data(), C.Outbox.size());
+      if (N > 0)
+        C.Outbox.erase(0, N);
+      else if (N < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+               errno != EINTR)
+        C.DropLocked("lost");
+    }
+  }
+
+  friend class FGTCPConnection;
+};
+
+inline bool FGTCPConnection::Write(const std::string &Data) {
+  bool Queued = false;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    if (!Up)
+      return false;
+    size_t Sent = 0;
+    if (Outbox.empty()) {
+      ssize_t N = FGTCPMux::Send(Fd, Data.data(), Data.size());
+      if (N > 0)
+        Sent = N;
+      else if (N < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+               errno != EINTR) {
+        DropLocked("lost");
+        return false;
+      }
+    }
+    if (Sent < Data.size()) {
+      Outbox.append(Data, Sent, std::string::npos);
+      Queued = true;
+    }
+  }
+  if (Queued)
+    Mux->Wake();
+  return true;
+}
+
+#endif /* SOURCE_FGTCPMUX_H_ */
@@ -0,0 +1,174 @@
+/*
+ * FGTransportStats.h
+ *
+ * Lock-free per-board transaction counters and latency histograms. Each
+ * update is a relaxed atomic increment, so they are always on; readers take
+ * a Snapshot, which is consistent per field but not across fields.
+ */
+
+#ifndef SOURCE_FGTRANSPORTSTATS_H_
+#define SOURCE_FGTRANSPORTSTATS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+// Log2-bucketed histogram of microsecond latencies: bucket 0 is < 1 us,
+// bucket i >= 1 holds [2^(i-1), 2^i) us and the last bucket everything above.
+class FGLatencyHistogram {
+public:
+  static const int Buckets = 24; // last bucket starts at ~4.2 s
+
+  struct Snapshot {
+    std::array<uint64_t, Buckets> Counts;
+    uint64_t Count;
+    uint64_t SumUs;
+    uint64_t MaxUs;
+  };
+
+  FGLatencyHistogram() { Reset(); }
+  FGLatencyHistogram(const FGLatencyHistogram &) = delete;
+
+  void Record(uint64_t Us) {
+    int Bucket = 0;
+    for (uint64_t V = Us; V && Bucket < Buckets - 1; V >>= 1)
+      ++Bucket;
+    Counts[Bucket].fetch_add(1, std::memory_order_relaxed);
+    SumUs.fetch_add(Us, std::memory_order_relaxed);
+    uint64_t Prev = MaxUs.load(std::memory_order_relaxed);
+    while (Us > Prev &&
+           !MaxUs.compare_exchange_weak(Prev, Us, std::memory_order_relaxed))
+      ;
+  }
+
+  // Upper edge of bucket i in microseconds (the last one is open-ended).
+  static uint64_t BucketLimitUs(int i) { return (uint64_t)1 << i; }
+
+  Snapshot Read() const {
+    Snapshot S;
+    S.Count = 0;
+    for (int i = 0; i < Buckets; ++i) {
+      S.Counts[i] = Counts[i].load(std::memory_order_relaxed);
+      S.Count += S.Counts[i];
+    }
+    S.SumUs = SumUs.load(std::memory_order_relaxed);
+    S.MaxUs = MaxUs.load(std::memory_order_relaxed);
+    return S;
+  }
+
+  void Reset() {
+    for (int i = 0; i < Buckets; ++i)
+      Counts[i] = 0;
+    SumUs = 0;
+    MaxUs = 0;
+  }
+
+private:
+  std::atomic<uint64_t> Counts[Buckets];
+  std::atomic<uint64_t> SumUs;
+  std::atomic<uint64_t> MaxUs;
+};
+
+class FGTransportStats {
+public:
+  // Query level, counted by FGAnalogPSUInterface
+  std::atomic<uint64_t> Queries;
+  std::atomic<uint64_t> Failures;       // Query() returned false, any reason
+  std::atomic<uint64_t> WriteFailures;  // gave up writing the command
+  std::atomic<uint64_t> ReadFailures;   // gave up reading the response
+  std::atomic<uint64_t> MagicErrors;
+  std::atomic<uint64_t> ChecksumErrors;
+  std::atomic<uint64_t> DeviceErrors;   // nonzero error word other than 0xF00
+  std::atomic<uint64_t> DeviceF00;      // the tolerated 0xF00 status word
+  // Response sequence numbers, checked by FGAnalogPSUInterface
+  std::atomic<uint64_t> SequenceGaps;   // sequence numbers never seen
+  std::atomic<uint64_t> StaleResponses; // late or duplicate, discarded
+  std::atomic<uint64_t> Desyncs;        // sequence lost, input flushed
+  std::atomic<uint64_t> Flushed;        // packets thrown away by a flush
+  // Transfer level, counted by FGUSBBulk inside its retry loops
+  std::atomic<uint64_t> Retries;
+  std::atomic<uint64_t> Timeouts;
+  std::atomic<uint64_t> ClearHalts; // stalled endpoint cleared and retried
+  // Link level, counted by FGAnalogPSUInterface's reconnect logic
+  std::atomic<uint64_t> LinkLosses;
+  std::atomic<uint64_t> Reconnects;
+  std::atomic<uint64_t> Refused; // queries failed at once while reconnecting
+
+  FGLatencyHistogram WriteLatency;
+  FGLatencyHistogram ReadLatency;
+  FGLatencyHistogram QueryLatency; // whole Query(), including the lock wait
+
+  struct Snapshot {
+    uint64_t Queries, Failures, WriteFailures, ReadFailures, MagicErrors,
+        ChecksumErrors, DeviceErrors, DeviceF00, SequenceGaps,
+        StaleResponses, Desyncs, Flushed, Retries, Timeouts, ClearHalts,
+        LinkLosses, Reconnects, Refused;
+    FGLatencyHistogram::Snapshot WriteLatency, ReadLatency, QueryLatency;
+  };
+
+  FGTransportStats() { Reset(); }
+  FGTransportStats(const FGTransportStats &) = delete;
+
+  static void Bump(std::atomic<uint64_t> &Counter) {
+    Counter.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static uint64_t MicrosSince(std::chrono::steady_clock::time_point Start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - Start)
+        .count();
+  }
+
+  Snapshot Read() const {
+    Snapshot S;
+    S.Queries = Queries.load(std::memory_order_relaxed);
+    S.Failures = Failures.load(std::memory_order_relaxed);
+    S.WriteFailures = WriteFailures.load(std::memory_order_relaxed);
+    S.ReadFailures = ReadFailures.load(std::memory_order_relaxed);
+    S.MagicErrors = MagicErrors.load(std::memory_order_relaxed);
+    S.ChecksumErrors = ChecksumErrors.load(std::memory_order_relaxed);
+    S.DeviceErrors = DeviceErrors.load(std::memory_order_relaxed);
+    S.DeviceF00 = DeviceF00.load(std::memory_order_relaxed);
+    S.SequenceGaps = SequenceGaps.load(std::memory_order_relaxed);
+    S.StaleResponses = StaleResponses.load(std::memory_order_relaxed);
+    S.Desyncs = Desyncs.load(std::memory_order_relaxed);
+    S.Flushed = Flushed.load(std::memory_order_relaxed);
+    S.Retries = Retries.load(std::memory_order_relaxed);
+    S.Timeouts = Timeouts.load(std::memory_order_relaxed);
+    S.ClearHalts = ClearHalts.load(std::memory_order_relaxed);
+    S.LinkLosses = LinkLosses.load(std::memory_order_relaxed);
+    S.Reconnects = Reconnects.load(std::memory_order_relaxed);
+    S.Refused = Refused.load(std::memory_order_relaxed);
+    S.WriteLatency = WriteLatency.Read();
+    S.ReadLatency = ReadLatency.Read();
+    S.QueryLatency = QueryLatency.Read();
+    return S;
+  }
+
+  void Reset() {
+    Queries = 0;
+    Failures = 0;
+    WriteFailures = 0;
+    ReadFailures = 0;
+    MagicErrors = 0;
+    ChecksumErrors = 0;
+    DeviceErrors = 0;
+    DeviceF00 = 0;
+    SequenceGaps = 0;
+    StaleResponses = 0;
+    Desyncs = 0;
+    Flushed = 0;
+    Retries = 0;
+    Timeouts = 0;
+    ClearHalts = 0;
+    LinkLosses = 0;
+    Reconnects = 0;
+    Refused = 0;
+    WriteLatency.Reset();
+    ReadLatency.Reset();
+    QueryLatency.Reset();
+  }
+};
+
+#endif /* SOURCE_FGTRANSPORTSTATS_H_ */
@@ -0,0 +1,175 @@
+/*
+ * FGUSBAsync.h
+ *
+ * Process-wide libusb context with a single event-handling thread, plus the
+ * plumbing for asynchronous bulk transfers (libusb_submit_transfer) on it.
+ * Every FGUSBBulk shares this context, so transfers on different devices can
+ * be in flight at the same time and all complete on the one event thread.
+ */
+
+#ifndef SOURCE_FGUSBASYNC_H_
+#define SOURCE_FGUSBASYNC_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <libusb-1.0/libusb.h>
+#include <mutex>
+#include <sys/time.h>
+#include <thread>
+
+#include "Error.h" // For Shout
+
+// Called on the event thread with a libusb_error code (LIBUSB_SUCCESS when
+// the transfer completed) and the number of bytes actually transferred.
+typedef std::function<void(int, int)> FGUSBTransferCallback;
+
+class FGUSBContext {
+private:
+  libusb_context *Context;
+  std::once_flag EventThreadOnce;
+  std::thread::id EventThreadId;
+  std::atomic<bool> Running;
+
+  FGUSBContext() : Context(nullptr), Running(false) {
+    if (libusb_init(&Context) < 0) {
+      Context = nullptr;
+      Shout("Unable to initialize shared USB context.");
+    }
+  }
+
+  void EventLoop() {
+    while (Running) {
+      timeval tv = {0, 100000}; // wake up regularly even when idle
+      libusb_handle_events_timeout_completed(Context, &tv, nullptr);
+    }
+  }
+
+public:
+  FGUSBContext(const FGUSBContext &) = delete;
+
+  // Intentionally never destroyed: libusb_exit and joining the event thread
+  // during static destruction (e.g. Python interpreter teardown) would race
+  // with FGUSBBulk objects that are still alive.
+  static FGUSBContext &Get() {
+    static FGUSBContext *Instance = new FGUSBContext();
+    return *Instance;
+  }
+
+  libusb_context *GetContext() { return Context; }
+  operator bool() { return Context != nullptr; }
+
+  // Started lazily by the first asynchronous transfer.
+  void StartEventThread() {
+    if (Context == nullptr)
+      return;
+    std::call_once(EventThreadOnce, [this]() {
+      Running = true;
+      std::thread EventThread(&FGUSBContext::EventLoop, this);
+      EventThreadId = EventThread.get_id();
+      EventThread.detach();
+    });
+  }
+
+  // Only meaningful after StartEventThread() has returned.
+  bool IsEventThread() const {
+    return EventThreadId == std::this_thread::get_id();
+  }
+};
+
+inline int FGUSBTransferStatusToError(libusb_transfer_status Status) {
+  switch (Status) {
+  case LIBUSB_TRANSFER_COMPLETED:
+    return LIBUSB_SUCCESS;
+  case LIBUSB_TRANSFER_TIMED_OUT:
+    return LIBUSB_ERROR_TIMEOUT;
+  case LIBUSB_TRANSFER_STALL:
+    return LIBUSB_ERROR_PIPE;
+  case LIBUSB_TRANSFER_NO_DEVICE:
+    return LIBUSB_ERROR_NO_DEVICE;
+  case LIBUSB_TRANSFER_OVERFLOW:
+    return LIBUSB_ERROR_OVERFLOW;
+  case LIBUSB_TRANSFER_CANCELLED:
+    return LIBUSB_ERROR_INTERRUPTED;
+  default:
+    return LIBUSB_ERROR_IO;
+  }
+}
+
+// Submits one bulk transfer on Handle. Done is always called exactly once on
+// the event thread, unless this returns a negative libusb error, in which case
+// it is never called. Buffer must stay valid until Done runs.
+inline int FGUSBSubmitBulk(libusb_device_handle *Handle,
+                           unsigned char Endpoint, unsigned char *Buffer,
+                           unsigned int Length, unsigned int TimeoutMs,
+                           FGUSBTransferCallback Done) {
+  struct Pending {
+    FGUSBTransferCallback Done;
+    static void Trampoline(libusb_transfer *Transfer) {
+      Pending *P = static_cast<Pending *>(Transfer->user_data);
+      int Error = FGUSBTransferStatusToError(Transfer->status);
+      int Actual = Transfer->actual_length;
+      libusb_free_transfer(Transfer);
+      P->Done(Error, Actual);
+      delete P;
+    }
+  };
+
+  libusb_transfer *Transfer = libusb_alloc_transfer(0);
+  if (Transfer == nullptr)
+    return LIBUSB_ERROR_NO_MEM;
+
+  Pending *P = new Pending{std::move(Done)};
+  libusb_fill_bulk_transfer(Transfer, Handle, Endpoint, Buffer, (int)Length,
+                            &Pending::Trampoline, P, TimeoutMs);
+
+  FGUSBContext::Get().StartEventThread();
+  int Ret = libusb_submit_transfer(Transfer);
+  if (Ret < 0) {
+    libusb_free_transfer(Transfer);
+    delete P;
+  }
+  return Ret;
+}
+
+// Blocking transfer built on the asynchronous path; same contract as
+// libusb_bulk_transfer.
+inline int FGUSBBlockingBulk(libusb_device_handle *Handle,
+                             unsigned char Endpoint, unsigned char *Buffer,
+                             unsigned int Length, int *Transferred,
+                             unsigned int TimeoutMs) {
+  // Waiting for our own completion on the event thread would deadlock;
+  // libusb_bulk_transfer handles events itself in that case.
+  FGUSBContext::Get().StartEventThread();
+  if (FGUSBContext::Get().IsEventThread())
+    return libusb_bulk_transfer(Handle, Endpoint, Buffer, (int)Length,
+                                Transferred, TimeoutMs);
+
+  std::mutex M;
+  std::condition_variable CV;
+  bool Finished = false;
+  int Error = LIBUSB_SUCCESS;
+  int Actual = 0;
+
+  int Ret = FGUSBSubmitBulk(Handle, Endpoint, Buffer, Length, TimeoutMs,
+                            [&](int E, int A) {
+                              std::lock_guard<std::mutex> Lock(M);
+                              Error = E;
+                              Actual = A;
+                              Finished = true;
+                              CV.notify_one();
+                            });
+  if (Ret < 0) {
+    if (Transferred)
+      *Transferred = 0;
+    return Ret;
+  }
+
+  std::unique_lock<std::mutex> Lock(M);
+  CV.wait(Lock, [&]() { return Finished; });
+  if (Transferred)
+    *Transferred = Actual;
+  return Error;
+}
+
+#endif /* SOURCE_FGUSBASYNC_H_ */
@@ -8,6 +8,7 @@
 #ifndef SOURCE_FGUSBBULK_H_
 #define SOURCE_FGUSBBULK_H_
 
+#include <chrono>
 #include <iomanip>  // For std::setw, std::setfill
 #include <iostream> // For std::cout, std::endl, std::hex, std::dec
 #include <libusb-1.0/libusb.h>
@@ -18,7 +19,11 @@
 #include "CommonIncludes.h"
 #include "Error.h" // For Shout, Utter, and global Verbosity
 #include "FGBulk.h"
-#include "Hex.h" // For DestToHex
+#include "FGUSBAsync.h" // Shared context, event thread, async transfers
+#include "FGUSBRegistry.h" // Cached device list on the shared context
+#include "FGPacketTrace.h"
+#include "FGTransportStats.h"
+#include "Hex.h"        // For DestToHex
 #include "StringUtils.h"
 
 class FGUSBBulk;
@@ -30,6 +35,86 @@ bool FGUSBBulk_PrototypeRead(FGUSBBulk *Params, unsigned char Endpoint,
 
 const int MaxUSBAttempts = 10;
 
+#ifdef USBTIMEOUTMS
+const int USBTransferTimeout = USBTIMEOUTMS;
+#else
+const int USBTransferTimeout = 100; // Milliseconds
+#endif
+
+// Per-instance retry behaviour of the blocking transfers, and when the owner
+// should consider the link lost (see FGAnalogPSUInterface). Attempt timeouts
+// follow the measured round trip instead of a fixed value, so a dead board
+// fails fast while a slow one gets as long as it has been needing.
+struct FGUSBRetryPolicy {
+  int MaxAttempts;
+  // First attempt: TimeoutFactor * smoothed RTT + 4 * RTT deviation, within
+  // [MinTimeoutMs, MaxTimeoutMs]; doubled after every timeout. Until a round
+  // trip has been measured USBTransferTimeout is used.
+  unsigned int MinTimeoutMs;
+  unsigned int MaxTimeoutMs;
+  double TimeoutFactor;
+  // Sleep before a retry, doubled each time up to MaxBackoffUs. A stalled
+  // endpoint is cleared and retried without sleeping.
+  unsigned int BackoffUs;
+  unsigned int MaxBackoffUs;
+  // Wall-clock limit for one whole transfer, retries included.
+  unsigned int BudgetMs;
+  // Consecutive failed transactions before the link is declared lost (a
+  // vanished device counts at once), and the background reopen backoff.
+  unsigned int LostAfterFailures;
+  unsigned int ReconnectMinMs;
+  unsigned int ReconnectMaxMs;
+
+  static FGUSBRetryPolicy Default() {
+    FGUSBRetryPolicy P = {MaxUSBAttempts, 5, 250, 4.0, 500, 20000, 400,
+                          3, 50, 2000};
+    return P;
+  }
+  bool Valid() const {
+    return MaxAttempts >= 1 && MinTimeoutMs >= 1 &&
+           MaxTimeoutMs >= MinTimeoutMs && TimeoutFactor > 0 &&
+           BudgetMs >= 1 && LostAfterFailures >= 1 &&
+           ReconnectMaxMs >= ReconnectMinMs;
+  }
+};
+
+// Smoothed round trip and mean deviation of successful transfers
+// (Jacobson/Karels, as TCP does), in microseconds.
+class FGUSBRttEstimator {
+public:
+  FGUSBRttEstimator() { Reset(); }
+  void Reset() {
+    Samples = 0;
+    Srtt = 0;
+    Rttvar = 0;
+  }
+  void Update(double Us) {
+    if (Samples++ == 0) {
+      Srtt = Us;
+      Rttvar = Us / 2;
+      return;
+    }
+    double Err = Us - Srtt;
+    Srtt += Err / 8;
+    Rttvar += ((Err < 0 ? -Err : Err) - Rttvar) / 4;
+  }
+  unsigned int TimeoutMs(const FGUSBRetryPolicy &P) const {
+    if (Samples == 0)
+      return USBTransferTimeout;
+    double Ms = (P.TimeoutFactor * Srtt + 4 * Rttvar) / 1000;
+    if (Ms < P.MinTimeoutMs)
+      return P.MinTimeoutMs;
+    if (Ms > P.MaxTimeoutMs)
+      return P.MaxTimeoutMs;
+    return (unsigned int)Ms + 1;
+  }
+  double SmoothedUs() const { return Srtt; }
+
+private:
+  uint64_t Samples;
+  double Srtt, Rttvar;
+};
+
 class FGUSBDevice : public libusb_device_descriptor {
 public:
   void Dump() {
@@ -91,21 +176,35 @@ private:
   libusb_device_handle *Handle;
   bool InterfaceClaimed;
   int InterfaceNo;
+  uint32_t LocationID; // of the open device, for error reports
 
 public:
   FGBulkBridge Bridge;
+  // Optional sink for retry/timeout counts, owned by whoever set it.
+  FGTransportStats *Stats;
+  // Change only while no transfer is in flight.
+  FGUSBRetryPolicy Policy;
+  // Per direction: [0] OUT, [1] IN. Updated by the transfer functions.
+  FGUSBRttEstimator Rtt[2];
+  // libusb result of the last blocking transfer (LIBUSB_SUCCESS if it
+  // completed), for the owner's reconnect logic.
+  int LastError;
 
   FGUSBBulk()
       : Context(nullptr), Handle(nullptr), InterfaceClaimed(false),
-        InterfaceNo(0),
+        InterfaceNo(0), LocationID(0),
         Bridge(this, (BulkBridgeCallback)FGUSBBulk_PrototypeWrite,
-               (BulkBridgeCallback)FGUSBBulk_PrototypeRead) {};
+               (BulkBridgeCallback)FGUSBBulk_PrototypeRead),
+        Stats(nullptr), Policy(FGUSBRetryPolicy::Default()),
+        LastError(LIBUSB_SUCCESS) {};
 
   FGUSBBulk(FGUSBDevice Device, int Interface)
       : Context(nullptr), Handle(nullptr), InterfaceClaimed(false),
-        InterfaceNo(0),
+        InterfaceNo(0), LocationID(0),
         Bridge(this, (BulkBridgeCallback)FGUSBBulk_PrototypeWrite,
-               (BulkBridgeCallback)FGUSBBulk_PrototypeRead) {
+               (BulkBridgeCallback)FGUSBBulk_PrototypeRead),
+        Stats(nullptr), Policy(FGUSBRetryPolicy::Default()),
+        LastError(LIBUSB_SUCCESS) {
     InterfaceNo = Interface;
     OpenDevice(Device.idVendor, Device.idProduct,
                Interface); // Call the specific OpenDevice
@@ -113,12 +212,15 @@ public:
 
   FGUSBBulk(uint16_t VID, uint16_t PID, int Interface)
       : Context(nullptr), Handle(nullptr), InterfaceClaimed(false),
-        InterfaceNo(Interface),
+        InterfaceNo(Interface), LocationID(0),
         Bridge(this, (BulkBridgeCallback)FGUSBBulk_PrototypeWrite,
-               (BulkBridgeCallback)FGUSBBulk_PrototypeRead) {
+               (BulkBridgeCallback)FGUSBBulk_PrototypeRead),
+        Stats(nullptr), Policy(FGUSBRetryPolicy::Default()),
+        LastError(LIBUSB_SUCCESS) {
     OpenDevice(VID, PID, Interface);
   };
 
+  // The context is the process-wide FGUSBContext and is not ours to exit.
   ~FGUSBBulk() {
     if (Handle != nullptr && Context != nullptr && InterfaceClaimed)
       if (libusb_release_interface(Handle, InterfaceNo) < 0)
@@ -126,8 +228,6 @@ public:
 
     if (Handle != nullptr && Context != nullptr)
       libusb_close(Handle);
-    if (Context != nullptr)
-      libusb_exit(Context);
   };
 
   bool OpenDevice(FGUSBDevice Device, int Interface) // Keep this overload
@@ -139,7 +239,7 @@ public:
   // New USB path-based device opening method
   bool OpenDeviceByPath(uint16_t VID, uint16_t PID, int Interface, const std::string& target_usb_path) {
     this->InterfaceNo = Interface;
-    if (Context == nullptr && libusb_init(&Context) < 0) {
+    if (Context == nullptr && !(Context = FGUSBContext::Get().GetContext())) {
       Shout("Unable to initialize USB context.");
       return false;
     };
@@ -147,26 +247,39 @@ public:
     if (Handle != nullptr)
       CloseDevice();
 
-    // Use system command to find device by USB path (Mac-specific)
-    std::string cmd = "ioreg -p IOUSB -l | grep -A 25 'Analog PSU Interface" + target_usb_path + "'";
-    
-    // Map USB paths to device indexes based on actual enumeration order
-    int skip_value = 0;
-    if (target_usb_path == "@00110000") {
-      skip_value = 0; // Heinzinger path -> device_index 0 (first enumerated)
-    } else if (target_usb_path == "@00120000") {
-      skip_value = 1; // FUG path -> device_index 1 (second enumerated)
-    } else {
-      return Shout("Unknown USB path: " + target_usb_path, 0);
+    int open_ret =
+        FGUSBRegistry::Get().OpenByPath(VID, PID, target_usb_path, &Handle);
+    if (open_ret == LIBUSB_ERROR_NOT_FOUND) {
+      // Scripts written against the macOS test stand pass these two
+      // locationIDs; keep them working where the topology differs.
+      int skip_value = -1;
+      if (target_usb_path == "@00110000")
+        skip_value = 0; // Heinzinger path -> device_index 0
+      else if (target_usb_path == "@00120000")
+        skip_value = 1; // FUG path -> device_index 1
+      if (skip_value < 0)
+        return Shout("No VID:0x" + ToHex(VID) + " PID:0x" + ToHex(PID) +
+                         " device at USB path: " + target_usb_path,
+                     0);
+      Warn("USB path " + target_usb_path +
+           " not found on this bus, falling back to enumeration index " +
+           itos(skip_value));
+      return OpenDevice(VID, PID, Interface, skip_value);
     }
-    
-    return OpenDevice(VID, PID, Interface, skip_value);
+    if (open_ret < 0) {
+      Shout("Unable to open USB device at path " + target_usb_path +
+            ". Libusb error: " + LibusbErrorName(open_ret) + " (" +
+            itos(open_ret) + ")");
+      Handle = nullptr;
+      return false;
+    }
+    return ClaimOpenedInterface();
   }
 
   // Legacy device opening method (keep for compatibility)
   bool OpenDevice(uint16_t VID, uint16_t PID, int Interface, int Skip = 0) {
     this->InterfaceNo = Interface;
-    if (Context == nullptr && libusb_init(&Context) < 0) {
+    if (Context == nullptr && !(Context = FGUSBContext::Get().GetContext())) {
       Shout("Unable to initialize USB context.");
       return false;
     };
@@ -174,51 +287,30 @@ public:
     if (Handle != nullptr)
       CloseDevice();
 
-    libusb_device **DevList;
-    ssize_t DeviceCount = libusb_get_device_list(Context, &DevList);
-    if (DeviceCount < 0)
-      return Shout("Unable to get USB device list", 0);
-
-    int FoundId = -1;
-    int current_skip = Skip; // Use a local copy for the skip counter
-
-    for (ssize_t i = 0; i < DeviceCount; ++i) {
-      libusb_device_descriptor TempDesc; // Use base descriptor
-      int ret = libusb_get_device_descriptor(DevList[i], &TempDesc);
-      if (ret < 0) {
-        Shout("Failed to get device descriptor for a device.");
-        continue; // Skip this device
-      }
-      if (TempDesc.idVendor == VID && TempDesc.idProduct == PID) {
-        if (current_skip > 0) {
-          current_skip--;
-        } else {
-          FoundId = (int)i;
-          break;
-        }
-      }
-    };
-
-    if (FoundId == -1) {
-      libusb_free_device_list(DevList, 1);
+    // The registry enumerates once per process and opens from its cache.
+    int open_ret = FGUSBRegistry::Get().Open(VID, PID, Skip, &Handle);
+    if (open_ret == LIBUSB_ERROR_NOT_FOUND) {
       std::string msg = "Unable to locate requested device VID:0x" +
                         ToHex(VID) + " PID:0x" + ToHex(PID);
       if (Skip > 0)
         msg += " (with skip " + itos(Skip) + ")";
       return Shout(msg, 0);
     }
-
-    int open_ret = libusb_open(DevList[FoundId], &Handle);
     if (open_ret < 0) {
       Handle = nullptr;
       Shout("Unable to open USB device. Libusb error: " +
             LibusbErrorName(open_ret) + " (" + itos(open_ret) + ")");
     };
 
-    libusb_free_device_list(DevList, 1);
     if (Handle == nullptr)
       return false; // Could not open
 
+    return ClaimOpenedInterface();
+  };
+
+  // Detaches a kernel driver if needed and claims InterfaceNo on the freshly
+  // opened Handle; closes the handle again on failure.
+  bool ClaimOpenedInterface() {
     // Detach kernel driver if necessary (important on Linux)
     if (libusb_kernel_driver_active(Handle, this->InterfaceNo) == 1) {
       if (Verbosity > 0)
@@ -243,12 +335,13 @@ public:
       libusb_close(Handle); // Close handle if claim fails
       Handle = nullptr;
     } else {
+      LocationID = FGUSBLocationID(libusb_get_device(Handle));
       if (Verbosity > 0)
         std::cout << "Successfully claimed USB interface " << this->InterfaceNo
                   << std::endl;
     }
     return InterfaceClaimed;
-  };
+  }
 
   bool CloseDevice() {
     bool TempRes = true;
@@ -271,23 +364,158 @@ public:
       InterfaceClaimed = false;
       libusb_close(Handle);
       Handle = nullptr;
+      LocationID = 0;
     }
+    Rtt[0].Reset(); // a reopened device is measured afresh
+    Rtt[1].Reset();
     return TempRes;
   }
 
+  // Asynchronous counterpart of FGUSBBulk_PrototypeWrite/Read: Endpoint must
+  // carry the direction bit. Partial or timed-out transfers are resubmitted
+  // for the remainder up to MaxUSBAttempts times, without sleeping. Done(ok)
+  // runs on the shared event thread; Buffer must stay valid until then.
+  bool SubmitBulk(unsigned char Endpoint, unsigned char *Buffer,
+                  unsigned int Length, std::function<void(bool)> Done);
+
+  // One IN transfer of up to TimeoutMs, without retries; returns the bytes
+  // read. For a packet that should already be waiting.
+  int ReadOnce(unsigned char Endpoint, unsigned char *Buffer,
+               unsigned int Length, unsigned int TimeoutMs) {
+    if (!*this)
+      return 0;
+    int Actual = 0;
+    int Response =
+        FGUSBBlockingBulk(Handle, (Endpoint & 0x0F) | LIBUSB_ENDPOINT_IN,
+                          Buffer, Length, &Actual, TimeoutMs);
+    if (Response != LIBUSB_SUCCESS && Response != LIBUSB_ERROR_TIMEOUT)
+      LastError = Response;
+    return Actual;
+  }
+
+  // Reads and throws away whatever the IN endpoint still holds, until it
+  // stays quiet for QuietMs. Returns the number of packets dropped.
+  unsigned int DrainIn(unsigned char Endpoint, unsigned int Length,
+                       unsigned int QuietMs = 2, unsigned int MaxPackets = 64) {
+    std::vector<unsigned char> Junk(Length);
+    unsigned int Dropped = 0;
+    while (Dropped < MaxPackets &&
+           ReadOnce(Endpoint, Junk.data(), Length, QuietMs) > 0)
+      ++Dropped;
+    return Dropped;
+  }
+
   operator bool() {
     return (Context != nullptr) && (Handle != nullptr) && InterfaceClaimed;
   };
   libusb_context *GetContext() { return Context; };
   libusb_device_handle *GetHandle() { return Handle; };
+  // macOS-style locationID (bus, then one nibble per port); 0 when closed.
+  uint32_t Location() const { return LocationID; }
+  // Canonical path of the open device (see FGUSBCanonicalPath); empty when
+  // closed.
+  std::string DevicePath() const {
+    return Handle ? FGUSBDevicePath(libusb_get_device(Handle)) : "";
+  }
   operator FGBulkBridge *() { return &Bridge; };
 };
 
-#ifdef USBTIMEOUTMS
-const int USBTransferTimeout = USBTIMEOUTMS;
-#else
-const int USBTransferTimeout = 100; // Milliseconds
-#endif
+// FGPacketTrace formatters for the transfer functions below. Data beyond
+// FGTraceRecord::MaxData bytes is not kept.
+inline void FGUSBBulk_FormatWriteTrace(std::ostream &Out,
+                                       const FGTraceRecord &R) {
+  Out << "USB Write (Endpoint: 0x" << std::hex << (int)R.Endpoint << std::dec
+      << ", Length: " << R.Length << "): "
+      << DestToHex((unsigned char *)R.Data, R.Stored()) << "\n";
+}
+
+inline void FGUSBBulk_FormatReadTrace(std::ostream &Out,
+                                      const FGTraceRecord &R) {
+  unsigned int Shown = (unsigned int)R.Actual < R.Stored() ? R.Actual
+                                                           : R.Stored();
+  Out << "USB Read (Endpoint: 0x" << std::hex << (int)R.Endpoint << std::dec
+      << ", Expected: " << R.Length << ", Actual Read: " << R.Actual << "): "
+      << DestToHex((unsigned char *)R.Data, Shown) << "\n";
+}
+
+inline void FGUSBBulk_FormatAttemptTrace(std::ostream &Out,
+                                         const FGTraceRecord &R) {
+  bool In = (R.Endpoint & LIBUSB_ENDPOINT_IN) != 0;
+  Out << "  Attempt " << (In ? "Read" : "Write") << ": Ep=0x" << std::hex
+      << (int)R.Endpoint << std::dec << (In ? ", ToRead=" : ", Sent=")
+      << R.Length << ", Actual=" << R.Actual
+      << ", Resp=" << LibusbErrorName(R.Code) << " (" << R.Code << ")\n";
+}
+
+// Shared retry loop of the blocking transfers, driven by Params->Policy.
+// Endpoint carries the direction bit. Returns the bytes transferred.
+inline int FGUSBBulk_Transfer(FGUSBBulk *Params, unsigned char Endpoint,
+                              unsigned char *Buffer, unsigned int Length) {
+  typedef std::chrono::steady_clock Clock;
+  const FGUSBRetryPolicy &P = Params->Policy;
+  const bool In = (Endpoint & LIBUSB_ENDPOINT_IN) != 0;
+  FGUSBRttEstimator &Rtt = Params->Rtt[In ? 1 : 0];
+  const Clock::time_point Deadline =
+      Clock::now() + std::chrono::milliseconds(P.BudgetMs);
+
+  int Response = 0;
+  int Transferred = 0;
+  unsigned int TimeoutMs = Rtt.TimeoutMs(P);
+  unsigned int BackoffUs = P.BackoffUs;
+  bool Sleep = false;
+
+  for (int Attempt = 0; Transferred < (int)Length && Attempt < P.MaxAttempts;
+       ++Attempt) {
+    if (Attempt > 0) {
+      if (Params->Stats)
+        FGTransportStats::Bump(Params->Stats->Retries);
+      if (Sleep) {
+        usleep(BackoffUs);
+        BackoffUs = BackoffUs * 2 < P.MaxBackoffUs ? BackoffUs * 2
+                                                   : P.MaxBackoffUs;
+      }
+    }
+    long long LeftMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           Deadline - Clock::now())
+                           .count();
+    if (LeftMs <= 0)
+      break;
+
+    int Actual = 0;
+    Clock::time_point Start = Clock::now();
+    Response = FGUSBBlockingBulk(
+        Params->GetHandle(), Endpoint, Buffer + Transferred,
+        Length - Transferred, &Actual,
+        TimeoutMs < LeftMs ? TimeoutMs : (unsigned int)LeftMs);
+
+    if (Verbosity > 2) // More detailed logging for each attempt
+      FGPacketTrace::Get().Record(&FGUSBBulk_FormatAttemptTrace, Params,
+                                  Endpoint, nullptr, Length - Transferred,
+                                  Response, Actual);
+
+    Sleep = true;
+    if (Response == LIBUSB_SUCCESS) {
+      Transferred += Actual;
+      Rtt.Update((double)FGTransportStats::MicrosSince(Start));
+    } else if (Response == LIBUSB_ERROR_TIMEOUT) {
+      // Alive but slow (or gone): be more patient with the next attempt.
+      if (Params->Stats)
+        FGTransportStats::Bump(Params->Stats->Timeouts);
+      TimeoutMs = TimeoutMs * 2 < P.MaxTimeoutMs ? TimeoutMs * 2
+                                                 : P.MaxTimeoutMs;
+    } else if (Response == LIBUSB_ERROR_PIPE) {
+      // Stalled endpoint: nothing gets through until the halt is cleared.
+      if (Params->Stats)
+        FGTransportStats::Bump(Params->Stats->ClearHalts);
+      libusb_clear_halt(Params->GetHandle(), Endpoint);
+      Sleep = false;
+    } else if (Response == LIBUSB_ERROR_NO_DEVICE) {
+      break; // unplugged: retrying cannot help
+    }
+  }
+  Params->LastError = Transferred == (int)Length ? LIBUSB_SUCCESS : Response;
+  return Transferred;
+}
 
 inline bool FGUSBBulk_PrototypeWrite(FGUSBBulk *Params, unsigned char Endpoint,
                                      unsigned char *Buffer,
@@ -300,50 +528,18 @@ inline bool FGUSBBulk_PrototypeWrite(FGUSBBulk *Params, unsigned char Endpoint,
     return false;
   }
 
-  if (Verbosity > 1) { // Use global Verbosity from Error.h
-    std::cout << "USB Write (Endpoint: 0x" << std::hex << (int)Endpoint
-              << std::dec << ", Length: " << Length << "): ";
-    // DestToHex is from Hex.h, which is included by FGUSBBulk.h
-    std::cout << DestToHex(Buffer, Length) << std::endl;
-  }
-
-  Endpoint &= 0x0F; // Keep lower 4 bits for endpoint number, OUT is implicit by
-                    // direction flag
-  int Response = 0;
-  int Transferred = 0;
-  int Iterations = MaxUSBAttempts;
+  if (Verbosity > 1 || FGPacketTrace::Get().Enabled())
+    FGPacketTrace::Get().Record(&FGUSBBulk_FormatWriteTrace, Params, Endpoint,
+                                Buffer, Length);
 
-  while (Transferred < (int)Length && Iterations--) {
-    if (Iterations != MaxUSBAttempts - 1)
-      usleep(1000 * 10); // 10ms delay on retries
-
-    int Actual = 0;
-    Response = libusb_bulk_transfer(
-        Params->GetHandle(),
-        (Endpoint | LIBUSB_ENDPOINT_OUT), // Endpoint direction explicitly OUT
-        Buffer + Transferred, Length - Transferred, &Actual,
-        USBTransferTimeout);
-
-    if (Verbosity > 2) { // More detailed logging for each attempt
-      std::cout << "  Attempt Write: Ep=0x" << std::hex
-                << (Endpoint | LIBUSB_ENDPOINT_OUT)
-                << ", Sent=" << (Length - Transferred) << ", Actual=" << Actual
-                << ", Resp=" << LibusbErrorName(Response) << " (" << std::dec
-                << Response << ")" << std::endl;
-    }
-
-    if (Response < 0) {
-      // Error already logged by Shout below if total transfer fails
-    } else {
-      Transferred += Actual;
-    };
-  };
+  // Keep lower 4 bits for the endpoint number, direction explicitly OUT
+  int Transferred = FGUSBBulk_Transfer(
+      Params, (Endpoint & 0x0F) | LIBUSB_ENDPOINT_OUT, Buffer, Length);
 
   if (Transferred != (int)Length) {
-    Shout("Unable to write bulk transfer! Wrote " + itos(Transferred) + "/" +
-              itos(Length) + " bytes. Last Error: [" + itos(Response) + " " +
-              LibusbErrorName(Response) + "]",
-          0);
+    // Bytes actually written go into the record's code.
+    ShoutAt("Unable to write bulk transfer", Params->Location(),
+            Params->LastError, Transferred);
     return false; // Indicate failure
   }
   return true; // Indicate success
@@ -361,86 +557,104 @@ inline bool FGUSBBulk_PrototypeRead(FGUSBBulk *Params, unsigned char Endpoint,
   }
 
   Endpoint &= 0x0F; // Keep lower 4 bits, IN is implicit
-  int Response = 0;
-  int Transferred = 0;
-  int Iterations = MaxUSBAttempts;
+  int Transferred = FGUSBBulk_Transfer(Params, Endpoint | LIBUSB_ENDPOINT_IN,
+                                       Buffer, Length);
 
-  while (Transferred < (int)Length && Iterations--) {
-    if (Iterations != MaxUSBAttempts - 1)
-      usleep(1000 * 10); // 10ms delay
+  if ((Verbosity > 1 || FGPacketTrace::Get().Enabled()) &&
+      Transferred > 0) // Log data if any was read, even if not full length
+    FGPacketTrace::Get().Record(&FGUSBBulk_FormatReadTrace, Params, Endpoint,
+                                Buffer, Length, 0, Transferred);
 
-    int Actual = 0;
-    Response = libusb_bulk_transfer(
-        Params->GetHandle(),
-        (Endpoint | LIBUSB_ENDPOINT_IN), // Endpoint direction explicitly IN
-        Buffer + Transferred,            // Read into this part of the buffer
-        Length - Transferred,            // How much more to read
-        &Actual, USBTransferTimeout);
-
-    if (Verbosity > 2) {
-      std::cout << "  Attempt Read: Ep=0x" << std::hex
-                << (Endpoint | LIBUSB_ENDPOINT_IN)
-                << ", ToRead=" << (Length - Transferred)
-                << ", Actual=" << Actual
-                << ", Resp=" << LibusbErrorName(Response) << " (" << std::dec
-                << Response << ")" << std::endl;
+  if (Transferred != (int)Length) {
+    ShoutAt("Unable to read bulk transfer", Params->Location(),
+            Params->LastError, Transferred);
+    return false; // Indicate failure
+  }
+  return true; // Indicate success
+}
+
+inline bool FGUSBBulk::SubmitBulk(unsigned char Endpoint, unsigned char *Buffer,
+                                  unsigned int Length,
+                                  std::function<void(bool)> Done) {
+  if (!*this)
+    return false;
+
+  // Shared between resubmissions; freed once Done has been called.
+  struct Op {
+    FGUSBBulk *Owner;
+    unsigned char Endpoint;
+    unsigned char *Buffer;
+    unsigned int Length;
+    unsigned int Transferred;
+    int AttemptsLeft;
+    std::function<void(bool)> Done;
+
+    bool Submit() {
+      Op *Self = this;
+      const bool In = (Endpoint & LIBUSB_ENDPOINT_IN) != 0;
+      return FGUSBSubmitBulk(Owner->GetHandle(), Endpoint, Buffer + Transferred,
+                             Length - Transferred,
+                             Owner->Rtt[In ? 1 : 0].TimeoutMs(Owner->Policy),
+                             [Self](int Error, int Actual) {
+                               Self->Completed(Error, Actual);
+                             }) == LIBUSB_SUCCESS;
     }
 
-    if (Response < 0) {
-      // Error logged by Shout below if total transfer fails
-    } else {
-      Transferred += Actual;
-    };
+    void Completed(int Error, int Actual) {
+      if (Actual > 0)
+        Transferred += Actual;
+      bool Retry = Transferred < Length && --AttemptsLeft > 0 &&
+                   Error != LIBUSB_ERROR_NO_DEVICE;
+      if (Owner->Stats) {
+        if (Error == LIBUSB_ERROR_TIMEOUT)
+          FGTransportStats::Bump(Owner->Stats->Timeouts);
+        if (Retry)
+          FGTransportStats::Bump(Owner->Stats->Retries);
+      }
+      // Clearing a halt is a blocking control transfer, which must not run
+      // on the event thread: a stalled async transfer just fails.
+      if (Error == LIBUSB_ERROR_PIPE)
+        Retry = false;
+      Owner->LastError = Transferred == Length ? LIBUSB_SUCCESS : Error;
+      if (Retry && Submit())
+        return;
+      if (Transferred != Length && Verbosity > 0)
+        ShoutAt("Asynchronous bulk transfer failed", Owner->Location(), Error,
+                Transferred);
+      Done(Transferred == Length);
+      delete this;
+    }
   };
 
-  if (Verbosity > 1 &&
-      Transferred > 0) { // Log data if any was read, even if not full length
-    std::cout << "USB Read (Endpoint: 0x" << std::hex << (int)Endpoint
-              << std::dec << ", Expected: " << Length
-              << ", Actual Read: " << Transferred << "): ";
-    std::cout << DestToHex(Buffer, Transferred) << std::endl;
-  }
-
-  if (Transferred != (int)Length) {
-    Shout("Unable to read bulk transfer! Read " + itos(Transferred) + "/" +
-              itos(Length) + " bytes. Last Error: [" + itos(Response) + " " +
-              LibusbErrorName(Response) + "]",
-          0);
-    return false; // Indicate failure
+  Op *NewOp =
+      new Op{this, Endpoint, Buffer, Length, 0, Policy.MaxAttempts, std::move(Done)};
+  if (!NewOp->Submit()) {
+    delete NewOp;
+    return false;
   }
-  return true; // Indicate success
+  return true;
 }
 
-inline std::vector<FGUSBDevice> EnumerateUSBDevices() {
-  libusb_context *MyContext;
-  if (libusb_init(&MyContext) < 0) {
+// Lists the devices seen by the shared registry; pass Refresh to rescan the
+// bus instead of returning the cached list.
+inline std::vector<FGUSBDevice> EnumerateUSBDevices(bool Refresh = false) {
+  if (!FGUSBContext::Get()) {
     Utter("Unable to initialize USB context for enumeration.");
     return {}; // Return empty vector on failure
   }
-
-  libusb_device **MyDevList;
-  ssize_t DeviceCount = libusb_get_device_list(MyContext, &MyDevList);
-
-  if (DeviceCount < 0) {
+  if (Refresh && !FGUSBRegistry::Get().Refresh()) {
     Utter("Unable to get USB device list for enumeration.");
-    libusb_exit(MyContext);
     return {};
   }
 
+  std::vector<FGUSBDeviceEntry> Entries = FGUSBRegistry::Get().Devices();
   std::vector<FGUSBDevice> TempRes;
-  TempRes.reserve(DeviceCount); // Reserve space
-
-  for (ssize_t i = 0; i < DeviceCount; ++i) {
+  TempRes.reserve(Entries.size()); // Reserve space
+  for (auto &E : Entries) {
     FGUSBDevice current_device_info; // Use your derived class
-    int ret = libusb_get_device_descriptor(
-        MyDevList[i], (libusb_device_descriptor *)&current_device_info);
-    if (ret == 0) {
-      TempRes.push_back(current_device_info);
-    }
+    *(libusb_device_descriptor *)&current_device_info = E.Descriptor;
+    TempRes.push_back(current_device_info);
   }
-
-  libusb_free_device_list(MyDevList, 1);
-  libusb_exit(MyContext);
   return TempRes;
 }
 
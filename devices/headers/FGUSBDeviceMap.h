@@ -0,0 +1,164 @@
+/*
+ * FGUSBDeviceMap.h
+ *
+ * Where each board asked for by serial number ("sn:ABC123") was found last
+ * time, kept in a small file between runs. FGUSBRegistry opens the board at
+ * that bus position directly and only checks its serial, instead of opening
+ * every VID:PID match and reading its string descriptor. A moved or swapped
+ * board costs one mismatch, after which the full search runs and the entry
+ * is rewritten.
+ *
+ * The file is $FG_USB_DEVICE_MAP if set (empty: no map), else
+ * $XDG_CACHE_HOME/fg_usb_devices, else ~/.cache/fg_usb_devices. One line
+ * per board: "VID PID serial path", VID:PID in hex, path in the canonical
+ * bus-port form. It is rewritten whole (via rename) whenever an entry
+ * changes, so concurrent processes see either version.
+ */
+
+#ifndef SOURCE_FGUSBDEVICEMAP_H_
+#define SOURCE_FGUSBDEVICEMAP_H_
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+class FGUSBDeviceMap {
+public:
+  FGUSBDeviceMap() : Loaded(false) {}
+
+  static std::string DefaultPath() {
+    if (const char *Env = getenv("FG_USB_DEVICE_MAP"))
+      return Env;
+    std::string Dir;
+    if (const char *Cache = getenv("XDG_CACHE_HOME"))
+      Dir = Cache;
+    else if (const char *Home = getenv("HOME"))
+      Dir = std::string(Home) + "/.cache";
+    return Dir.empty() ? std::string() : Dir + "/fg_usb_devices";
+  }
+
+  // "" turns the map off. Takes effect for the next lookup.
+  void SetPath(const std::string &P) {
+    File = P;
+    Entries.clear();
+    Loaded = true;
+    Load();
+  }
+  const std::string &GetPath() {
+    EnsureLoaded();
+    return File;
+  }
+
+  bool Lookup(uint16_t VID, uint16_t PID, const std::string &Serial,
+              std::string &Path) {
+    EnsureLoaded();
+    int i = Find(VID, PID, Serial);
+    if (i < 0)
+      return false;
+    Path = Entries[i].Path;
+    return true;
+  }
+
+  void Record(uint16_t VID, uint16_t PID, const std::string &Serial,
+              const std::string &Path) {
+    EnsureLoaded();
+    if (File.empty() || Serial.empty() || Path.empty() ||
+        Serial.find_first_of(" \t\n") != std::string::npos)
+      return;
+    int i = Find(VID, PID, Serial);
+    if (i >= 0 && Entries[i].Path == Path)
+      return;
+    if (i < 0) {
+      Entry E = {VID, PID, Serial, Path};
+      Entries.push_back(E);
+    } else
+      Entries[i].Path = Path;
+    Save();
+  }
+
+  void Forget(uint16_t VID, uint16_t PID, const std::string &Serial) {
+    EnsureLoaded();
+    int i = Find(VID, PID, Serial);
+    if (i < 0)
+      return;
+    Entries.erase(Entries.begin() + i);
+    Save();
+  }
+
+private:
+  struct Entry {
+    uint16_t VID, PID;
+    std::string Serial, Path;
+  };
+  std::string File;
+  std::vector<Entry> Entries;
+  bool Loaded;
+
+  void EnsureLoaded() {
+    if (Loaded)
+      return;
+    Loaded = true;
+    File = DefaultPath();
+    Load();
+  }
+
+  int Find(uint16_t VID, uint16_t PID, const std::string &Serial) const {
+    for (size_t i = 0; i < Entries.size(); ++i)
+      if (Entries[i].VID == VID && Entries[i].PID == PID &&
+          Entries[i].Serial == Serial)
+        return (int)i;
+    return -1;
+  }
+
+  // A missing or unreadable file is an empty map; bad lines are skipped.
+  void Load() {
+    if (File.empty())
+      return;
+    std::ifstream In(File.c_str());
+    std::string Line;
+    while (std::getline(In, Line)) {
+      std::istringstream Fields(Line);
+      Entry E;
+      unsigned int VID, PID;
+      if (Fields >> std::hex >> VID >> PID >> std::dec >> E.Serial >> E.Path &&
+          VID <= 0xFFFF && PID <= 0xFFFF) {
+        E.VID = (uint16_t)VID;
+        E.PID = (uint16_t)PID;
+        Entries.push_back(E);
+      }
+    }
+  }
+
+  // Best effort: without a writable cache directory lookups just miss.
+  void Save() {
+    size_t Slash = File.rfind('/');
+    if (Slash != std::string::npos && Slash > 0)
+      mkdir(File.substr(0, Slash).c_str(), 0755);
+    std::string Tmp = File + ".tmp" + std::to_string((long)getpid());
+    {
+      std::ofstream Out(Tmp.c_str());
+      for (size_t i = 0; i < Entries.size(); ++i) {
+        char Ids[16];
+        snprintf(Ids, sizeof(Ids), "%04x %04x", Entries[i].VID,
+                 Entries[i].PID);
+        Out << Ids << " " << Entries[i].Serial << " " << Entries[i].Path
+            << "\n";
+      }
+      if (!Out) {
+        Out.close();
+        unlink(Tmp.c_str());
+        return;
+      }
+    }
+    if (rename(Tmp.c_str(), File.c_str()) != 0)
+      unlink(Tmp.c_str());
+  }
+};
+
+#endif /* SOURCE_FGUSBDEVICEMAP_H_ */
@@ -0,0 +1,478 @@
+/*
+ * FGUSBRegistry.h
+ *
+ * Process-wide cache of the devices found on the shared FGUSBContext. The bus
+ * is enumerated once and every FGUSBBulk opens its board from the cached
+ * list; the list is only rebuilt when a lookup misses or a cached device has
+ * gone away, so bringing up N boards costs a single libusb_get_device_list.
+ *
+ * With EnableHotplug() the cache is also kept current by libusb hotplug
+ * events on the shared event thread, applied at the next lookup so that
+ * thread never waits for a lookup's USB I/O, and subscribers
+ * (FGAnalogPSUInterface) learn about an unplugged or re-attached board the
+ * moment it happens instead of from failing transfers.
+ *
+ * Boards can also be looked up by their position on the bus, which unlike
+ * enumeration order does not change between runs. Accepted path forms:
+ *   "1-1.2"       Linux sysfs style: bus 1, port 1, then port 2 on that hub
+ *   "@00110000"   macOS IORegistry locationID: bus in the top byte, then one
+ *                 port per nibble (bus 0, ports 1.1 here)
+ *   "sn:ABC123"   iSerialNumber string descriptor; where the board was last
+ *                 found is remembered across runs, see FGUSBDeviceMap.h
+ */
+
+#ifndef SOURCE_FGUSBREGISTRY_H_
+#define SOURCE_FGUSBREGISTRY_H_
+
+#include <cstdlib>
+#include <functional>
+#include <libusb-1.0/libusb.h>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Error.h" // For Shout
+#include "FGUSBAsync.h"
+#include "FGUSBDeviceMap.h"
+
+class FGUSBDeviceEntry {
+public:
+  libusb_device *Device; // referenced for as long as it is cached
+  libusb_device_descriptor Descriptor;
+  uint8_t Bus;
+  std::vector<uint8_t> Ports; // port path from the root hub
+  std::string Serial;         // filled in on first lookup by serial number
+  bool SerialRead;
+
+  // "bus-port.port..." as used by FGUSBRegistry::OpenByPath
+  std::string PathString() const {
+    std::string Res = std::to_string(Bus) + "-";
+    for (size_t i = 0; i < Ports.size(); ++i)
+      Res += (i ? "." : "") + std::to_string(Ports[i]);
+    return Res;
+  }
+};
+
+// Turns any accepted path form (see top of file) into the canonical
+// "bus-port.port" key. Returns an empty string for serial-number paths and
+// for anything that cannot be parsed.
+inline std::string FGUSBCanonicalPath(const std::string &Path) {
+  if (Path.size() == 9 && Path[0] == '@') {
+    char *End = nullptr;
+    unsigned long Location = strtoul(Path.c_str() + 1, &End, 16);
+    if (*End != '\0')
+      return "";
+    std::string Res = std::to_string((Location >> 24) & 0xFF) + "-";
+    for (int Shift = 20; Shift >= 0; Shift -= 4) {
+      unsigned int Port = (Location >> Shift) & 0xF;
+      if (Port == 0)
+        break;
+      Res += (Shift != 20 ? "." : "") + std::to_string(Port);
+    }
+    return Res;
+  }
+
+  size_t Dash = Path.find('-');
+  if (Dash == std::string::npos || Dash == 0 || Dash + 1 == Path.size())
+    return "";
+  for (size_t i = 0; i < Path.size(); ++i)
+    if (i != Dash && Path[i] != '.' && (Path[i] < '0' || Path[i] > '9'))
+      return "";
+  return Path;
+}
+
+// Inverse of the "@XXXXXXXX" form: bus in the top byte, then one port per
+// nibble. Ports above 15 or hubs deeper than six do not fit and are clamped.
+inline uint32_t FGUSBLocationID(libusb_device *Device) {
+  if (Device == nullptr)
+    return 0;
+  uint8_t Ports[8];
+  int Depth = libusb_get_port_numbers(Device, Ports, sizeof(Ports));
+  uint32_t Location = (uint32_t)libusb_get_bus_number(Device) << 24;
+  for (int i = 0; i < Depth && i < 6; ++i)
+    Location |= (uint32_t)(Ports[i] > 0xF ? 0xF : Ports[i]) << (20 - 4 * i);
+  return Location;
+}
+
+// The canonical "bus-port.port" path of a device, as PathString().
+inline std::string FGUSBDevicePath(libusb_device *Device) {
+  if (Device == nullptr)
+    return "";
+  uint8_t Ports[8];
+  int Depth = libusb_get_port_numbers(Device, Ports, sizeof(Ports));
+  std::string Res = std::to_string(libusb_get_bus_number(Device)) + "-";
+  for (int i = 0; i < Depth; ++i)
+    Res += (i ? "." : "") + std::to_string(Ports[i]);
+  return Res;
+}
+
+class FGUSBRegistry {
+public:
+  // Called on the USB event thread for every hotplug event matching the
+  // subscription; must return quickly and must not do blocking USB I/O.
+  typedef std::function<void(const FGUSBDeviceEntry &, bool Arrived)>
+      HotplugListener;
+
+private:
+  std::mutex Mutex;
+  std::vector<FGUSBDeviceEntry> Entries;
+  std::map<std::string, size_t> ByPath; // PathString() -> index in Entries
+  bool Enumerated;
+
+  struct Subscription {
+    int Id;
+    uint16_t VID, PID;
+    HotplugListener Fn;
+  };
+  struct HotplugFilter {
+    uint16_t VID, PID;
+    libusb_hotplug_callback_handle Handle;
+  };
+  // Hotplug events waiting to be applied to Entries. The event thread must
+  // not wait for Mutex: it is held across serial-number reads, which are
+  // control transfers the event thread has to complete.
+  struct HotplugEvent {
+    libusb_device *Device; // referenced until applied
+    bool Arrived;
+  };
+  std::mutex EventMutex;
+  std::vector<HotplugEvent> Events; // guarded by EventMutex
+  std::mutex ListenerMutex; // held while listeners run
+  std::vector<Subscription> Listeners;
+  std::vector<HotplugFilter> Filters; // guarded by Mutex
+  int NextListenerId;
+  FGUSBDeviceMap Map; // guarded by Mutex
+
+  FGUSBRegistry() : Enumerated(false), NextListenerId(1) {}
+
+  void ClearLocked() {
+    for (auto &E : Entries)
+      libusb_unref_device(E.Device);
+    Entries.clear();
+    ByPath.clear();
+  }
+
+  static bool MakeEntry(libusb_device *Device, FGUSBDeviceEntry &E) {
+    if (libusb_get_device_descriptor(Device, &E.Descriptor) < 0)
+      return false;
+    uint8_t Path[8];
+    int Depth = libusb_get_port_numbers(Device, Path, sizeof(Path));
+    E.Bus = libusb_get_bus_number(Device);
+    E.Ports.clear();
+    if (Depth > 0)
+      E.Ports.assign(Path, Path + Depth);
+    E.SerialRead = false;
+    E.Device = Device;
+    return true;
+  }
+
+  void ReindexLocked() {
+    ByPath.clear();
+    for (size_t i = 0; i < Entries.size(); ++i)
+      ByPath[Entries[i].PathString()] = i;
+  }
+
+  // Queues the event for the cache (see ApplyEventsLocked), then tells the
+  // subscribers.
+  static int LIBUSB_CALL OnHotplug(libusb_context *, libusb_device *Device,
+                                   libusb_hotplug_event Event, void *) {
+    FGUSBRegistry &R = Get();
+    const bool Arrived = Event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED;
+    FGUSBDeviceEntry E;
+    if (!MakeEntry(Device, E))
+      return 0;
+    {
+      std::lock_guard<std::mutex> Lock(R.EventMutex);
+      HotplugEvent Ev = {libusb_ref_device(Device), Arrived};
+      R.Events.push_back(Ev);
+    }
+    std::lock_guard<std::mutex> Lock(R.ListenerMutex);
+    for (size_t i = 0; i < R.Listeners.size(); ++i)
+      if (R.Listeners[i].VID == E.Descriptor.idVendor &&
+          R.Listeners[i].PID == E.Descriptor.idProduct)
+        R.Listeners[i].Fn(E, Arrived);
+    return 0; // stay registered
+  }
+
+  // Brings the cache up to date with the hotplug events so far; every
+  // lookup starts with this. Duplicates (an arrival the enumeration
+  // already found) are skipped.
+  void ApplyEventsLocked() {
+    std::vector<HotplugEvent> Pending;
+    {
+      std::lock_guard<std::mutex> Lock(EventMutex);
+      Pending.swap(Events);
+    }
+    for (size_t k = 0; k < Pending.size(); ++k) {
+      libusb_device *Device = Pending[k].Device;
+      size_t i = 0;
+      while (i < Entries.size() && Entries[i].Device != Device)
+        ++i;
+      FGUSBDeviceEntry E;
+      if (Pending[k].Arrived && i == Entries.size() && Enumerated &&
+          MakeEntry(Device, E)) {
+        E.Device = libusb_ref_device(Device);
+        Entries.push_back(E);
+        ReindexLocked();
+      } else if (!Pending[k].Arrived && i < Entries.size()) {
+        libusb_unref_device(Entries[i].Device);
+        Entries.erase(Entries.begin() + i);
+        ReindexLocked();
+      }
+      libusb_unref_device(Device);
+    }
+  }
+
+  bool EnumerateLocked() {
+    libusb_context *Context = FGUSBContext::Get().GetContext();
+    if (Context == nullptr)
+      return false;
+
+    libusb_device **DevList;
+    ssize_t DeviceCount = libusb_get_device_list(Context, &DevList);
+    if (DeviceCount < 0)
+      return Shout("Unable to get USB device list", 0);
+
+    ClearLocked();
+    Entries.reserve(DeviceCount);
+    for (ssize_t i = 0; i < DeviceCount; ++i) {
+      FGUSBDeviceEntry E;
+      if (!MakeEntry(DevList[i], E)) {
+        Shout("Failed to get device descriptor for a device.");
+        continue;
+      }
+      E.Device = libusb_ref_device(DevList[i]);
+      ByPath[E.PathString()] = Entries.size();
+      Entries.push_back(E);
+    }
+    libusb_free_device_list(DevList, 1);
+    Enumerated = true;
+    return true;
+  }
+
+  // Skip-th match of VID:PID in enumeration order, or -1.
+  int FindLocked(uint16_t VID, uint16_t PID, int Skip) {
+    for (size_t i = 0; i < Entries.size(); ++i) {
+      const libusb_device_descriptor &D = Entries[i].Descriptor;
+      if (D.idVendor == VID && D.idProduct == PID && Skip-- <= 0)
+        return (int)i;
+    }
+    return -1;
+  }
+
+  static void ReadSerial(libusb_device_handle *H, FGUSBDeviceEntry &E) {
+    unsigned char Buffer[128];
+    int Len = libusb_get_string_descriptor_ascii(
+        H, E.Descriptor.iSerialNumber, Buffer, sizeof(Buffer));
+    if (Len > 0)
+      E.Serial.assign((const char *)Buffer, Len);
+  }
+
+  // Tries the board the device map places `Serial` at: opened and kept
+  // only if it reports that serial. Stale entries are dropped.
+  bool OpenMappedLocked(uint16_t VID, uint16_t PID, const std::string &Serial,
+                        libusb_device_handle **Handle) {
+    std::string Where;
+    if (!Map.Lookup(VID, PID, Serial, Where))
+      return false;
+    int Index = FindByPathLocked(VID, PID, Where);
+    if (Index >= 0 && libusb_open(Entries[Index].Device, Handle) == 0) {
+      FGUSBDeviceEntry &E = Entries[Index];
+      if (!E.SerialRead && E.Descriptor.iSerialNumber != 0) {
+        ReadSerial(*Handle, E);
+        E.SerialRead = true;
+      }
+      if (E.Serial == Serial)
+        return true;
+      libusb_close(*Handle);
+    }
+    *Handle = nullptr;
+    Map.Forget(VID, PID, Serial);
+    return false;
+  }
+
+  // Index of the VID:PID device at Path, or -1. Serial numbers are read only
+  // from VID:PID matches, and only once per enumeration.
+  int FindByPathLocked(uint16_t VID, uint16_t PID, const std::string &Path) {
+    if (Path.compare(0, 3, "sn:") == 0) {
+      std::string Wanted = Path.substr(3);
+      for (size_t i = 0; i < Entries.size(); ++i) {
+        FGUSBDeviceEntry &E = Entries[i];
+        if (E.Descriptor.idVendor != VID || E.Descriptor.idProduct != PID ||
+            E.Descriptor.iSerialNumber == 0)
+          continue;
+        if (!E.SerialRead) {
+          libusb_device_handle *H = nullptr;
+          if (libusb_open(E.Device, &H) == 0) {
+            ReadSerial(H, E);
+            libusb_close(H);
+          }
+          E.SerialRead = true;
+        }
+        if (E.Serial == Wanted)
+          return (int)i;
+      }
+      return -1;
+    }
+
+    std::map<std::string, size_t>::iterator It =
+        ByPath.find(FGUSBCanonicalPath(Path));
+    if (It == ByPath.end())
+      return -1;
+    const libusb_device_descriptor &D = Entries[It->second].Descriptor;
+    if (D.idVendor != VID || D.idProduct != PID)
+      return -1;
+    return (int)It->second;
+  }
+
+  // Shared tail of Open/OpenByPath: one retry with a fresh enumeration when
+  // the device is missing from the cache or its cached entry is stale.
+  template <class Finder>
+  int OpenLocked(Finder Find, libusb_device_handle **Handle) {
+    *Handle = nullptr;
+    if (!Enumerated && !EnumerateLocked())
+      return LIBUSB_ERROR_OTHER;
+
+    int Ret = LIBUSB_ERROR_NOT_FOUND;
+    for (int Pass = 0; Pass < 2; ++Pass) {
+      if (Pass == 1 && !EnumerateLocked())
+        break;
+      int Index = Find();
+      if (Index < 0) {
+        Ret = LIBUSB_ERROR_NOT_FOUND;
+        continue;
+      }
+      Ret = libusb_open(Entries[Index].Device, Handle);
+      if (Ret != LIBUSB_ERROR_NO_DEVICE)
+        break;
+    }
+    if (Ret < 0)
+      *Handle = nullptr;
+    return Ret;
+  }
+
+public:
+  FGUSBRegistry(const FGUSBRegistry &) = delete;
+
+  // Never destroyed, for the same reason as FGUSBContext.
+  static FGUSBRegistry &Get() {
+    static FGUSBRegistry *Instance = new FGUSBRegistry();
+    return *Instance;
+  }
+
+  // Registers a libusb hotplug callback for VID:PID (once per pair) on the
+  // shared context. False where libusb has no hotplug support; callers then
+  // have to notice lost devices from failing transfers.
+  bool EnableHotplug(uint16_t VID, uint16_t PID) {
+    libusb_context *Context = FGUSBContext::Get().GetContext();
+    if (Context == nullptr || !libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+      return false;
+    std::lock_guard<std::mutex> Lock(Mutex);
+    for (size_t i = 0; i < Filters.size(); ++i)
+      if (Filters[i].VID == VID && Filters[i].PID == PID)
+        return true;
+    HotplugFilter F = {VID, PID, 0};
+    int Ret = libusb_hotplug_register_callback(
+        Context,
+        (libusb_hotplug_event)(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+                               LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+        (libusb_hotplug_flag)0, VID, PID, LIBUSB_HOTPLUG_MATCH_ANY,
+        &FGUSBRegistry::OnHotplug, nullptr, &F.Handle);
+    if (Ret != LIBUSB_SUCCESS)
+      return Shout("Unable to register USB hotplug callback: " +
+                       std::to_string(Ret),
+                   0);
+    Filters.push_back(F);
+    // Events are delivered by the shared event thread.
+    FGUSBContext::Get().StartEventThread();
+    return true;
+  }
+
+  bool HotplugEnabled(uint16_t VID, uint16_t PID) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    for (size_t i = 0; i < Filters.size(); ++i)
+      if (Filters[i].VID == VID && Filters[i].PID == PID)
+        return true;
+    return false;
+  }
+
+  // Returns an id for Unsubscribe(). Listeners only hear about VID:PID
+  // pairs passed to EnableHotplug().
+  int Subscribe(uint16_t VID, uint16_t PID, HotplugListener Fn) {
+    std::lock_guard<std::mutex> Lock(ListenerMutex);
+    Subscription S = {NextListenerId++, VID, PID, std::move(Fn)};
+    Listeners.push_back(S);
+    return S.Id;
+  }
+  // Once this returns the listener is not running and will not run again.
+  // Must not be called from a listener.
+  void Unsubscribe(int Id) {
+    std::lock_guard<std::mutex> Lock(ListenerMutex);
+    for (size_t i = 0; i < Listeners.size(); ++i)
+      if (Listeners[i].Id == Id) {
+        Listeners.erase(Listeners.begin() + i);
+        return;
+      }
+  }
+
+  // Forces a fresh enumeration pass.
+  bool Refresh() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    ApplyEventsLocked(); // releases the devices the events hold
+    return EnumerateLocked();
+  }
+
+  // Copy of the cached list, enumerating first if that never happened.
+  std::vector<FGUSBDeviceEntry> Devices() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    ApplyEventsLocked();
+    if (!Enumerated)
+      EnumerateLocked();
+    return Entries;
+  }
+
+  // Opens the Skip-th VID:PID device. Returns a libusb error code; on
+  // LIBUSB_ERROR_NOT_FOUND or a stale cache entry the bus is re-enumerated
+  // once before giving up.
+  int Open(uint16_t VID, uint16_t PID, int Skip, libusb_device_handle **Handle) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    ApplyEventsLocked();
+    return OpenLocked([&]() { return FindLocked(VID, PID, Skip); }, Handle);
+  }
+
+  // Same as Open(), but selects the board by its position on the bus (or its
+  // serial number) instead of by enumeration order.
+  int OpenByPath(uint16_t VID, uint16_t PID, const std::string &Path,
+                 libusb_device_handle **Handle) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    ApplyEventsLocked();
+    std::string Serial;
+    if (Path.compare(0, 3, "sn:") == 0) {
+      Serial = Path.substr(3);
+      if ((Enumerated || EnumerateLocked()) &&
+          OpenMappedLocked(VID, PID, Serial, Handle))
+        return LIBUSB_SUCCESS;
+    }
+    int Ret = OpenLocked(
+        [&]() { return FindByPathLocked(VID, PID, Path); }, Handle);
+    FGUSBDeviceEntry E;
+    if (Ret == LIBUSB_SUCCESS && !Serial.empty() &&
+        MakeEntry(libusb_get_device(*Handle), E))
+      Map.Record(VID, PID, Serial, E.PathString());
+    return Ret;
+  }
+
+  // The file FGUSBDeviceMap keeps serial-number lookups in; "" disables it.
+  void SetDeviceMapPath(const std::string &Path) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Map.SetPath(Path);
+  }
+  std::string DeviceMapPath() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    return Map.GetPath();
+  }
+};
+
+#endif /* SOURCE_FGUSBREGISTRY_H_ */
@@ -2,11 +2,40 @@
 #define HEINZINGER_H
 
 #include "AnalogPSU.h" // For the FGAnalogPSUInterface member
+#include "PSUCalibration.h" // Optional LUT corrections of the conversions
+#include "PSUConvert.h"     // Batch conversion of raw sample blocks
+#include "PSUFilter.h" // Per-channel noise filters fed by the stream
+#include "PSURegulator.h" // Closed-loop voltage trim run by the stream
+#include "PSUStream.h" // Background acquisition thread + ring buffer
+#include "PowerSupply.h" // IPowerSupply, Setpoint, PSUSnapshot
+#include <array>       // For the raw ADC arrays in PSUSnapshot
+#include <atomic>
+#include <functional> // For the *_async callbacks
+#include <memory>      // For the shared block converters
+#include <mutex>       // For the per-instance I/O lock
 #include <stdint.h>    // For uint16_t etc.
 #include <string>      // For std::string in USB path constructor
 
+// One streamed Readout(), raw. Plain layout so a block of these can be handed
+// to NumPy as a structured array without copying.
+struct PSUStreamSample {
+  double t; // seconds since the Unix epoch
+  uint16_t sequence_no;
+  int16_t response; // device error word
+  int16_t adca[4];
+  uint16_t adcb[4]; // monitors: adcb[2] voltage, adcb[3] current by default
+  uint16_t daca;
+  uint16_t dacb;
+  uint8_t relay;
+};
+
+static_assert((int)PSUSetVoltage == FGAnalogPSUInterface::SetDACAMask &&
+                  (int)PSUSetCurrent == FGAnalogPSUInterface::SetDACBMask &&
+                  (int)PSUSetRelay == FGAnalogPSUInterface::SetRelayMask,
+              "IPowerSupply mask bits must match the board's");
+
 // Declaration of the HeinzingerVia16BitDAC class
-class HeinzingerVia16BitDAC {
+class HeinzingerVia16BitDAC : public IPowerSupply {
 private:
   FGAnalogPSUInterface
       Interface; // Definition of FGAnalogPSUInterface comes from AnalogPSU.h
@@ -14,51 +43,328 @@ private:
   double max_analog_in_volt;
   uint16_t max_analog_in_volt_bin;
 
-  // These seem to be for storing current state, but are not read from in the
-  // provided .cpp You might want to ensure they are updated if they are meant
-  // to reflect PSU state.
+  // Last setpoints the board acknowledged, in physical units, and the
+  // register values behind them. apply() skips fields whose register would
+  // not change (see apply_locked); the *_known flags are cleared whenever
+  // the board's state is uncertain, which forces the next write.
   double
       set_volt_cache; // Renamed from set_volt to avoid confusion with parameter
   double set_curr_cache; // Renamed from set_curr
   bool relay_cache;      // Renamed from relay
+  struct {
+    bool daca_known, dacb_known, relay_known;
+    uint16_t daca, dacb;
+    uint8_t relay;
+  } acked;
+  uint64_t skipped_writes; // fields not sent because they were unchanged
+  void forget_setpoints() { memset(&acked, 0, sizeof(acked)); }
+  uint64_t link_generation; // Interface.LinkGeneration() the cache is from
 
   double max_volt;
   double max_curr;
+  // Monitor channels in ADCB and the conversion factors derived from the
+  // ranges, computed once in init_scales() instead of on every call.
+  int volt_channel, curr_channel;
+  double volt_per_count, curr_per_count; // ADCB counts -> physical units
+  double reg_per_volt, reg_per_curr;     // physical units -> DAC register
+  double max_reg;                        // register at max_analog_in_volt
+  void init_scales();
 
   bool verbose;
   int _usbIndex;   // store which identical device to open
 
+  // Held by every public method for the whole USB exchange plus the reads of
+  // the Interface fields it produced, so one instance can be shared between
+  // threads (the Python bindings release the GIL around these calls).
+  mutable std::mutex io_mutex;
+
+  // Declared after Interface so it is torn down first.
+  PSUStream<PSUStreamSample> stream;
+  size_t stream_lent; // samples handed out by the last borrow_stream()
+  bool acquire_sample(PSUStreamSample &s);
+
+  // Interlock state, only touched with io_mutex held (the stream thread
+  // holds it while sampling). Limits are kept in raw current-monitor counts
+  // so the per-sample check needs no conversion.
+  struct {
+    bool enabled;
+    PSUTripDetector detector; // counts, counts per second
+    InterlockTrip trip;
+  } ilk;
+  void clear_interlock();
+  std::atomic<bool> ilk_tripped; // lock-free copy of ilk.trip.tripped
+  void check_interlock(const PSUStreamSample &s, double now);
+  bool interlock_shutdown();
+
   bool update(); // This is a private helper
+  bool apply_locked(const Setpoint &sp, uint8_t mask, bool force,
+                    bool *sent = nullptr);
+  void fill_snapshot(PSUSnapshot &snap) const;
+
+  // Voltage corrections, see set_calibration(). Guarded by io_mutex.
+  PSUCalibration cal;
+  // cal.readback expanded for voltage_converter(), built on first use.
+  // Guarded by conv_mutex.
+  mutable std::shared_ptr<const PSUBlockConverter> volt_block;
+
+  // Also guards cal and the monitor channels (writers take both locks), for
+  // the *_async paths: their callbacks run on the USB event thread, which
+  // must never wait for io_mutex while a holder waits for a transfer.
+  mutable std::mutex conv_mutex;
+  // Asynchronous writes bypass the acknowledged-setpoint cache; while any
+  // is in flight or one has finished since, apply() trusts nothing cached.
+  std::atomic<unsigned int> async_pending;
+  std::atomic<bool> async_written;
+  // Voltage of the latest apply_async() while regulating, for the stream
+  // thread to retarget to. Guarded by conv_mutex.
+  bool async_target_pending;
+  double async_target;
+  bool setpoint_allowed(const Setpoint &sp, uint8_t mask, bool tripped) const;
+  bool async_admitted(const FGAnalogPSUInterface::Status_t &cmd) const;
+  void submit_async(const FGAnalogPSUInterface::Status_t &cmd,
+                    std::function<void(const PSUSnapshot &)> done, bool write);
+  void snapshot_from(const FGAnalogPSUInterface::Status_t &r,
+                     PSUSnapshot &snap) const;
+
+  // One filter per ADCB channel, fed by the stream thread (see set_filter).
+  // Guarded by io_mutex.
+  std::array<PSUChannelFilter, 4> filt;
+  bool filtered_counts(int channel, double &counts);
+
+  // Voltage regulation (see regulate_voltage), run by the stream thread.
+  // Guarded by io_mutex.
+  struct {
+    bool enabled;
+    bool active;
+    PSUVoltageRegulator ctl;
+    uint64_t updates, writes;
+  } reg;
+  void clear_regulation();
+  bool retarget_locked(Setpoint &sp, uint8_t mask);
+  bool regulate_step(bool &sent);
+
+  // Raw ADCB counts -> physical units (used by read_* and read_snapshot)
+  double adc_to_voltage(double raw) const; // double: also filtered counts
+  double adc_to_current(double raw) const;
+  double current_to_adc(double curr) const; // inverse of adc_to_current
+  // Physical setpoint -> DAC register value (clamped to the analog range)
+  uint16_t voltage_to_register(double set_val) const;
+  uint16_t current_to_register(double set_val) const;
 
 public:
-  // Constructor - USB path-based identification
+  // Constructor - USB path-based identification. lazy=true only remembers
+  // the board: nothing touches the bus until open() or the first I/O.
   HeinzingerVia16BitDAC(const std::string& usb_path, double max_voltage = 30000.0, double max_current = 2.0,
-                        bool verbose = false, double max_input_voltage = 10.0);
+                        bool verbose = false, double max_input_voltage = 10.0,
+                        bool lazy = false);
   
   // Legacy constructor for backward compatibility (deprecated)
   HeinzingerVia16BitDAC(int device_index, double max_voltage, double max_current,
-                        bool verbose, double max_input_voltage);
+                        bool verbose, double max_input_voltage,
+                        bool lazy = false);
+
+  // Talks through `transport` (e.g. FGMockAnalogBoard::Transport()) instead
+  // of USB; the transport must outlive this object.
+  HeinzingerVia16BitDAC(FGBulkBridge &transport, double max_voltage,
+                        double max_current, bool verbose = false,
+                        double max_input_voltage = 10.0);
   
   // Destructor - CRITICAL for USB resource cleanup
   ~HeinzingerVia16BitDAC() {
+    stream.stop();
+    std::lock_guard<std::mutex> lock(io_mutex);
     Interface.Close();  // Properly release USB resources
   }
 
   // Public interface methods
-  bool switch_on();
-  bool switch_off();
-  bool set_voltage(double set_val);
-  bool set_current(double set_val);
-  bool is_relay_on() const               // true => output enabled
+  std::string model() const override { return "analog PSU board"; }
+  uint32_t capabilities() const override {
+    return PSUCapRelay | PSUCapStream | PSUCapAsync | PSUCapInterlock |
+           PSUCapRawADC | (hotplug_enabled() ? (uint32_t)PSUCapHotplug : 0u);
+  }
+  // Any combination of FGAnalogPSUInterface::SetDACAMask / SetDACBMask /
+  // SetRelayMask in one USB round trip, response used as the readback.
+  // Fields whose DAC/relay register already holds the requested value (as
+  // last acknowledged and confirmed by the latest readback) are dropped from
+  // the mask, and nothing is sent if none are left; force writes anyway.
+  bool apply(const Setpoint &sp,
+             uint8_t mask = FGAnalogPSUInterface::SetDACAMask |
+                            FGAnalogPSUInterface::SetDACBMask |
+                            FGAnalogPSUInterface::SetRelayMask,
+             bool force = false) override;
+  // Same, also returning the converted readback from that packet's response
+  // (from a plain Readout() if every field was skipped).
+  bool apply(const Setpoint &sp, uint8_t mask, PSUSnapshot &readback,
+             bool force = false);
+  bool switch_on(bool force = false);
+  bool switch_off(bool force = false);
+  bool set_voltage(double set_val, bool force = false);
+  bool set_current(double set_val, bool force = false);
+  uint64_t skipped_write_count() const {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    return skipped_writes;
+  }
+  bool is_relay_on() const override      // true => output enabled
   {
-    return Interface.Relay_val != 0;   // Relay_val comes from the board
+    std::lock_guard<std::mutex> lock(io_mutex);
+    return Interface.Relay_val == 0;   // board relay register 0 = on
   }
 
-  double read_voltage();
-  double read_current();
+  // Calibration, e.g. for converting recorded raw samples offline:
+  // value = max * (adc_gain() * raw / UINT16_MAX) / 10, from
+  // ADCB[voltage_channel()] / ADCB[current_channel()].
+  static constexpr double adc_gain() { return 3.2 * 3.3 * 1.12; }
+  // Highest DAC output of the analog board; max_input_voltage must not
+  // exceed it.
+  static constexpr double board_max_volt() { return 11.3; }
+  int voltage_channel() const { return volt_channel; }
+  int current_channel() const { return curr_channel; }
+  double max_voltage() const override { return max_volt; }
+  double max_current() const override { return max_curr; }
+  double max_input_voltage() const { return max_analog_in_volt; }
+  uint32_t location() const { return Interface.Bridge.Location(); }
+
+  // Replaces the linear voltage conversions with the given tables (see
+  // PSUCalibrator for measuring them); an invalid table keeps the linear
+  // fit for that direction. Takes effect for the next command/readout.
+  void set_calibration(const PSUCalibration &c) {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    std::lock_guard<std::mutex> conv_lock(conv_mutex);
+    cal = c;
+    volt_block.reset();
+    forget_setpoints(); // the same volts may now mean another register
+  }
+  PSUCalibration calibration() const {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    return cal;
+  }
+  void clear_calibration() { set_calibration(PSUCalibration()); }
+
+  // Batch conversions of raw voltage / current monitor counts with the
+  // conversions in use (calibration included), e.g. for stream blocks or
+  // recorded chunks. The converters are immutable; a later
+  // set_calibration() does not change one already returned.
+  std::shared_ptr<const PSUBlockConverter> voltage_converter() const;
+  std::shared_ptr<const PSUBlockConverter> current_converter() const;
+
+  // filtered=true returns the filter output instead of a single sample
+  // (see set_filter). While streaming that is the stream's running value
+  // and costs no USB traffic; otherwise the call takes as many readouts as
+  // the filter needs to settle, in one go (at most
+  // PSUChannelFilter::MaxLength, also for a very small Exponential alpha).
+  double read_voltage(bool filtered = false);
+  double read_current(bool filtered = false);
+  PSUSnapshot read_snapshot() override; // one USB round trip for all readings
   bool set_max_volt();
   bool set_max_curr();
   void readADC();
+
+  // Non-blocking counterparts for event loops (see the Python *_async
+  // methods). They return at once and call done(result) from the USB event
+  // thread; result.ok is the success flag, and for apply_async the rest is
+  // the readback from the write's response. Invalid or refused calls
+  // complete at once on the calling thread, and so does every call on a
+  // lazily constructed board before open(). Any number may be outstanding;
+  // they are sent in order. They never wait for the lock the blocking
+  // methods hold, so they do not update is_relay_on() and always send every
+  // field in the mask (no deduplication).
+  void read_snapshot_async(AsyncCallback done) override;
+  void apply_async(const Setpoint &sp, uint8_t mask,
+                   AsyncCallback done) override;
+
+  // Background acquisition: a dedicated thread calls Readout() at rate_hz
+  // (<= 0: as fast as the board answers) and queues raw samples in a ring of
+  // `capacity` entries. Other calls keep working while streaming; they just
+  // share the USB link with the stream thread.
+  bool start_stream(double rate_hz, size_t capacity = 65536) override;
+  void stop_stream() override;
+  bool is_streaming() const override { return stream.running(); }
+  // Releases the block returned by the previous call, then returns the next
+  // contiguous block of up to max_samples queued samples, in place. `data`
+  // holds them until the next borrow_stream() or stop_stream(); *storage,
+  // if given, keeps its memory allocated even past a restart of the stream.
+  size_t borrow_stream(const PSUStreamSample *&data, size_t max_samples,
+                       std::shared_ptr<const void> *storage = nullptr);
+  uint64_t stream_samples() const { return stream.sample_count(); }
+  uint64_t stream_failures() const { return stream.failure_count(); }
+  uint64_t stream_overruns() const { return stream.ring().OverrunCount(); }
+
+  // Retry and reconnect behaviour of the USB link (see FGUSBRetryPolicy);
+  // false if the policy is invalid. No effect on an injected transport.
+  bool set_retry_policy(const FGUSBRetryPolicy &p);
+  FGUSBRetryPolicy retry_policy() const;
+  // Opens a lazily constructed board now; true if it is (or already was)
+  // open. Not needed before I/O, whose first call opens the board anyway.
+  bool open() override;
+  bool is_open() const override { return Interface.IsOpen(); }
+  // True while the board is unreachable and being reopened in the
+  // background; commands fail at once meanwhile. Setpoints are written
+  // afresh after a reconnect.
+  bool link_lost() const {
+    return Interface.GetLinkState() == FGAnalogPSUInterface::LinkLost;
+  }
+  // An unplugged board is noticed and reopened from USB hotplug events.
+  bool hotplug_enabled() const { return Interface.HotplugActive(); }
+
+  // Matching of responses to commands by sequence number (see
+  // FGAnalogPSUInterface::SetSequenceCheck). Turn it off for firmware that
+  // does not count every accepted packet; it also turns itself off after
+  // repeated losses.
+  void set_sequence_check(bool on) { Interface.SetSequenceCheck(on); }
+  bool sequence_check() const { return Interface.SequenceCheckEnabled(); }
+
+  // Transaction counters and latency histograms of this board's link.
+  FGTransportStats::Snapshot get_stats() const override {
+    return Interface.Stats.Read();
+  }
+  void reset_stats() override { Interface.Stats.Reset(); }
+
+  // Overcurrent/arc interlock. While streaming, every sample's current
+  // monitor is compared against max_current and, if max_slew > 0, its rise
+  // rate against max_slew (current units per second). After `debounce`
+  // consecutive violations the stream thread itself writes DACA=0 and opens
+  // the relay in one packet, so the reaction takes at most one stream
+  // period and never involves Python; a shutdown the board does not
+  // acknowledge is resent every stream period until it does (see
+  // InterlockTrip::shutdown_ok). Once tripped, commands that raise the
+  // voltage or switch the output on are refused until reset_interlock().
+  void set_interlock(double max_current, double max_slew = 0,
+                     int debounce = 1) override;
+  void disable_interlock() override;
+  bool interlock_tripped() const override { return ilk_tripped; }
+  InterlockTrip interlock_trip() const override;
+  void reset_interlock() override;
+
+  // Filter applied to every ADCB channel of every streamed sample, on the
+  // stream thread. Restarts the filters; false for an invalid config.
+  bool set_filter(const PSUFilterConfig &config);
+  PSUFilterConfig filter() const;
+
+  // Closed-loop voltage regulation. While streaming, each new filtered
+  // voltage readback (see set_filter) is compared with `target` and DACA is
+  // trimmed by a rate-limited PI controller (PSUVoltageRegulator); the
+  // correction rides on the stream's own packet for the next sample, so it
+  // costs no extra USB exchange. The loop holds, keeping what it has
+  // learnt, while the stream is stopped or the output is off. Writes that
+  // set the voltage meanwhile (apply, set_voltage, ramps) move the target;
+  // apply_async() ones from the next sample on;
+  // an interlock trip ends regulation. false for an invalid config or a
+  // target the supply refuses; otherwise the target is written at once.
+  bool regulate_voltage(double target);
+  bool regulate_voltage(double target, const PSURegulatorConfig &config);
+  // The DAC keeps the last regulated command.
+  void stop_regulation();
+  PSURegulatorStatus regulation() const;
+
+protected:
+  // For model drivers (AnalogPSUDriver) whose monitors sit on other ADCB
+  // channels than the default 2 (voltage) and 3 (current).
+  void set_monitor_channels(int voltage, int current) {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    std::lock_guard<std::mutex> conv_lock(conv_mutex);
+    volt_channel = voltage;
+    curr_channel = current;
+  }
 };
 
 #endif // HEINZINGER_H
\ No newline at end of file
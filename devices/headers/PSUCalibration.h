@@ -0,0 +1,141 @@
+/*
+ * PSUCalibration.h
+ *
+ * Piecewise-linear correction tables for the analog PSU conversions. A fit
+ * resamples measured (x, y) pairs onto a fixed uniform grid, so evaluating
+ * the correction is one multiply, one index and one interpolation whatever
+ * the number of calibration points: cheap enough for every setpoint and
+ * every readback.
+ */
+
+#ifndef SOURCE_PSUCALIBRATION_H_
+#define SOURCE_PSUCALIBRATION_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+class PSUCalibrationTable {
+public:
+  static const int Knots = 257; // 256 segments
+
+  PSUCalibrationTable() : ok(false), x0(0), x1(0), inv_step(0) { y.fill(0); }
+
+  bool valid() const { return ok; }
+  double x_min() const { return x0; }
+  double x_max() const { return x1; }
+
+  // Interpolates within [x_min, x_max] and extrapolates the end segments
+  // outside it.
+  double eval(double x) const {
+    double t = (x - x0) * inv_step;
+    int i = (int)std::floor(t);
+    i = i < 0 ? 0 : (i > Knots - 2 ? Knots - 2 : i);
+    return y[i] + (y[i + 1] - y[i]) * (t - i);
+  }
+
+  // Fits y(x) through `points` (any order; repeated x are averaged) and
+  // samples it on the grid over [lo, hi]. Needs two distinct x at least.
+  bool fit(std::vector<std::pair<double, double>> points, double lo,
+           double hi) {
+    ok = false;
+    if (!(hi > lo))
+      return false;
+    std::sort(points.begin(), points.end());
+    std::vector<std::pair<double, double>> xy;
+    for (size_t i = 0; i < points.size();) {
+      size_t j = i;
+      double sum = 0;
+      for (; j < points.size() && points[j].first == points[i].first; ++j)
+        sum += points[j].second;
+      xy.push_back(std::make_pair(points[i].first, sum / (j - i)));
+      i = j;
+    }
+    if (xy.size() < 2)
+      return false;
+
+    x0 = lo;
+    x1 = hi;
+    inv_step = (Knots - 1) / (hi - lo);
+    size_t seg = 0;
+    for (int k = 0; k < Knots; ++k) {
+      double x = lo + (hi - lo) * k / (Knots - 1);
+      while (seg + 2 < xy.size() && x > xy[seg + 1].first)
+        ++seg;
+      const std::pair<double, double> &a = xy[seg], &b = xy[seg + 1];
+      y[k] = a.second + (b.second - a.second) * (x - a.first) /
+                            (b.first - a.first);
+    }
+    ok = true;
+    return true;
+  }
+
+  void clear() { ok = false; }
+
+  // Text form: "x_min x_max" then the knot values, one per line.
+  void write(std::ostream &out) const {
+    out.precision(17);
+    out << x0 << " " << x1 << "\n";
+    for (int k = 0; k < Knots; ++k)
+      out << y[k] << "\n";
+  }
+  bool read(std::istream &in) {
+    ok = false;
+    if (!(in >> x0 >> x1) || !(x1 > x0))
+      return false;
+    for (int k = 0; k < Knots; ++k)
+      if (!(in >> y[k]))
+        return false;
+    inv_step = (Knots - 1) / (x1 - x0);
+    ok = true;
+    return true;
+  }
+
+private:
+  bool ok;
+  double x0, x1, inv_step;
+  std::array<double, Knots> y;
+};
+
+// Per-device corrections; an invalid table leaves the nominal linear
+// conversion in place.
+struct PSUCalibration {
+  PSUCalibrationTable setpoint; // voltage -> DACA register
+  PSUCalibrationTable readback; // raw ADCB[2] -> voltage
+
+  bool save(const std::string &path) const {
+    std::ofstream out(path.c_str());
+    if (!out)
+      return false;
+    out << "psu-calibration 1\n";
+    out << "setpoint " << (setpoint.valid() ? 1 : 0) << "\n";
+    if (setpoint.valid())
+      setpoint.write(out);
+    out << "readback " << (readback.valid() ? 1 : 0) << "\n";
+    if (readback.valid())
+      readback.write(out);
+    return (bool)out;
+  }
+
+  bool load(const std::string &path) {
+    std::ifstream in(path.c_str());
+    std::string tag;
+    int version = 0, has = 0;
+    PSUCalibration c;
+    if (!(in >> tag >> version) || tag != "psu-calibration" || version != 1)
+      return false;
+    if (!(in >> tag >> has) || tag != "setpoint" || (has && !c.setpoint.read(in)))
+      return false;
+    if (!(in >> tag >> has) || tag != "readback" || (has && !c.readback.read(in)))
+      return false;
+    *this = c;
+    return true;
+  }
+};
+
+#endif /* SOURCE_PSUCALIBRATION_H_ */
@@ -0,0 +1,272 @@
+/*
+ * PSUCalibrator.h
+ *
+ * Linearity sweep for HeinzingerVia16BitDAC. DAC A is stepped across a
+ * voltage range on a worker thread; after each step the streamed voltage
+ * monitor samples are watched until consecutive window means agree
+ * (instead of a fixed sleep), then averaged. fit() turns the points into the setpoint
+ * table of a PSUCalibration, which the PSU applies in O(1) per command.
+ *
+ * The output must already be switched on; the sweep finishes at 0 V. While
+ * it runs the calibrator consumes the PSU's stream, like PSURecorder.
+ */
+
+#ifndef SOURCE_PSUCALIBRATOR_H_
+#define SOURCE_PSUCALIBRATOR_H_
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Heinzinger.h"
+
+struct CalibrationSweepConfig {
+  double from_volt;
+  double to_volt;
+  int steps;               // points, including both ends
+  int window;              // samples per settle window
+  double tolerance_counts; // settled: successive window means differ less
+  int average;             // samples averaged once settled
+  double timeout_s;        // per step; the point is kept but not settled
+  double rate_hz;          // stream rate if the sweep has to start it
+};
+
+struct CalibrationPoint {
+  double set_volt;
+  uint16_t daca; // register the board acknowledged
+  bool settled;
+  double settle_s;  // from the write to the settled window
+  size_t samples;   // averaged
+  double raw_volt;  // mean voltage monitor counts
+  double raw_std;   // their standard deviation
+  double raw_curr;  // mean current monitor counts
+  double measured_volt; // raw_volt through the readback conversion
+};
+
+class PSUCalibrator {
+public:
+  explicit PSUCalibrator(HeinzingerVia16BitDAC &psu)
+      : psu(psu), active(false), abort(false), failed(false) {}
+  PSUCalibrator(const PSUCalibrator &) = delete;
+  ~PSUCalibrator() { stop(); }
+
+  static CalibrationSweepConfig default_config(double max_volt) {
+    CalibrationSweepConfig c = {0.0, max_volt, 33, 20, 2.0, 200, 10.0, 2000.0};
+    return c;
+  }
+
+  // Returns false if a sweep is already running or the config is unusable.
+  bool start(const CalibrationSweepConfig &config) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (active || config.steps < 2 || config.window < 1 ||
+        config.average < 1)
+      return false;
+    if (worker.joinable())
+      worker.join();
+    cfg = config;
+    results.clear();
+    abort = false;
+    failed = false;
+    active = true;
+    worker = std::thread(&PSUCalibrator::run, this);
+    return true;
+  }
+
+  // Aborts after the current step; the output is still set to 0 V.
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      abort = true;
+    }
+    if (worker.joinable())
+      worker.join();
+  }
+
+  bool wait(double timeout_s = -1) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (timeout_s < 0)
+      done.wait(lock, [this]() { return !active; });
+    else
+      done.wait_for(lock, std::chrono::duration<double>(timeout_s),
+                    [this]() { return !active; });
+    return !active;
+  }
+
+  bool running() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return active;
+  }
+  // A write was refused or the stream delivered nothing.
+  bool has_failed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+  }
+  std::vector<CalibrationPoint> points() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return results;
+  }
+
+  // Fits the setpoint table (volts -> DACA register) from the settled points
+  // on top of the PSU's current calibration. Install it with
+  // psu.set_calibration(); false if fewer than two points settled.
+  bool fit(PSUCalibration &out) const {
+    std::vector<std::pair<double, double>> xy;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (const CalibrationPoint &p : results)
+        if (p.settled)
+          xy.push_back(std::make_pair(p.measured_volt, (double)p.daca));
+    }
+    out = psu.calibration();
+    return out.setpoint.fit(xy, 0.0, psu.max_voltage());
+  }
+
+private:
+  HeinzingerVia16BitDAC &psu;
+  CalibrationSweepConfig cfg;
+  std::vector<CalibrationPoint> results;
+  mutable std::mutex mutex;
+  std::condition_variable done;
+  std::thread worker;
+  bool active;
+  bool abort;
+  bool failed;
+
+  // Borrowed stream block being walked through.
+  const PSUStreamSample *block;
+  size_t block_n, block_i;
+
+  bool aborted() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return abort;
+  }
+
+  // Next streamed sample, or false at `deadline`.
+  bool next_sample(PSUStreamSample &s,
+                   std::chrono::steady_clock::time_point deadline) {
+    while (block_i == block_n) {
+      block_n = psu.borrow_stream(block, 4096);
+      block_i = 0;
+      if (block_n)
+        break;
+      if (std::chrono::steady_clock::now() >= deadline)
+        return false;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    s = block[block_i++];
+    return true;
+  }
+
+  double readback_volts(const PSUCalibration &cal, double raw) const {
+    if (cal.readback.valid())
+      return cal.readback.eval(raw);
+    return psu.max_voltage() *
+           (HeinzingerVia16BitDAC::adc_gain() * raw / UINT16_MAX) / 10;
+  }
+
+  bool measure(double volt, const PSUCalibration &cal, CalibrationPoint &p) {
+    typedef std::chrono::steady_clock clock;
+    Setpoint sp = {volt, 0.0, true};
+    PSUSnapshot ack;
+    if (!psu.apply(sp, FGAnalogPSUInterface::SetDACAMask, ack, true))
+      return false;
+    const clock::time_point t0 = clock::now();
+    const clock::time_point deadline =
+        t0 + std::chrono::duration_cast<clock::duration>(
+                 std::chrono::duration<double>(cfg.timeout_s));
+    p.set_volt = volt;
+    p.daca = ack.daca;
+    p.settled = false;
+
+    // Settle: samples taken before the new register was live are skipped.
+    const int vch = psu.voltage_channel(), ich = psu.current_channel();
+    PSUStreamSample s;
+    bool have_prev = false;
+    double prev_mean = 0;
+    while (!p.settled) {
+      double sum = 0;
+      int n = 0;
+      while (n < cfg.window) {
+        if (!next_sample(s, deadline))
+          break;
+        if (s.daca != p.daca)
+          continue;
+        sum += s.adcb[vch];
+        ++n;
+      }
+      if (n < cfg.window)
+        break; // timed out, average what comes next anyway
+      double mean = sum / n;
+      p.settled = have_prev && std::fabs(mean - prev_mean) <= cfg.tolerance_counts;
+      prev_mean = mean;
+      have_prev = true;
+    }
+    p.settle_s = std::chrono::duration<double>(clock::now() - t0).count();
+
+    double sum = 0, sum2 = 0, sum_i = 0;
+    size_t n = 0;
+    const clock::time_point avg_deadline =
+        clock::now() + std::chrono::duration_cast<clock::duration>(
+                           std::chrono::duration<double>(cfg.timeout_s));
+    while (n < (size_t)cfg.average && next_sample(s, avg_deadline)) {
+      if (s.daca != p.daca)
+        continue;
+      sum += s.adcb[vch];
+      sum2 += (double)s.adcb[vch] * s.adcb[vch];
+      sum_i += s.adcb[ich];
+      ++n;
+    }
+    if (n == 0)
+      return false;
+    p.samples = n;
+    p.raw_volt = sum / n;
+    p.raw_std = std::sqrt(std::max(0.0, sum2 / n - p.raw_volt * p.raw_volt));
+    p.raw_curr = sum_i / n;
+    p.measured_volt = readback_volts(cal, p.raw_volt);
+    return true;
+  }
+
+  void run() {
+    // Sweep on the plain linear setpoint conversion; readback stays as is.
+    const PSUCalibration saved = psu.calibration();
+    PSUCalibration linear = saved;
+    linear.setpoint.clear();
+    psu.set_calibration(linear);
+
+    block = nullptr;
+    block_n = block_i = 0;
+    const bool started_stream = !psu.is_streaming();
+    bool ok = !started_stream || psu.start_stream(cfg.rate_hz);
+
+    for (int k = 0; ok && k < cfg.steps && !aborted(); ++k) {
+      double v = cfg.from_volt + (cfg.to_volt - cfg.from_volt) * k /
+                                     (cfg.steps - 1);
+      CalibrationPoint p;
+      ok = measure(v, saved, p);
+      if (ok) {
+        std::lock_guard<std::mutex> lock(mutex);
+        results.push_back(p);
+      }
+    }
+
+    Setpoint zero = {0.0, 0.0, true};
+    psu.apply(zero, FGAnalogPSUInterface::SetDACAMask, true);
+    if (started_stream)
+      psu.stop_stream();
+    else
+      psu.borrow_stream(block, 0); // hand the last block back
+    psu.set_calibration(saved);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    failed = !ok;
+    active = false;
+    done.notify_all();
+  }
+};
+
+#endif /* SOURCE_PSUCALIBRATOR_H_ */
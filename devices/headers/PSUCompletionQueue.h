@@ -0,0 +1,89 @@
+/*
+ * PSUCompletionQueue.h
+ *
+ * Hands results of asynchronous PSU calls from the USB event thread to one
+ * consumer that sleeps on a file descriptor: an asyncio loop
+ * (loop.add_reader, see the bindings) or any poll/epoll loop. post() never
+ * waits for the consumer, and the descriptor is only signalled when the
+ * queue goes from empty to non-empty, so a burst of completions costs a
+ * single wakeup however many calls are outstanding. An eventfd on Linux, a
+ * non-blocking pipe elsewhere (macOS).
+ */
+
+#ifndef SOURCE_PSUCOMPLETIONQUEUE_H_
+#define SOURCE_PSUCOMPLETIONQUEUE_H_
+
+#include <fcntl.h>
+#include <mutex>
+#include <stdint.h>
+#include <unistd.h>
+#include <vector>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+template <class T> class PSUCompletionQueue {
+public:
+  PSUCompletionQueue() {
+#ifdef __linux__
+    efd = wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+    int p[2];
+    efd = wfd = -1;
+    if (pipe(p) == 0) {
+      for (int i = 0; i < 2; ++i) {
+        fcntl(p[i], F_SETFL, fcntl(p[i], F_GETFL) | O_NONBLOCK);
+        fcntl(p[i], F_SETFD, FD_CLOEXEC);
+      }
+      efd = p[0];
+      wfd = p[1];
+    }
+#endif
+  }
+  PSUCompletionQueue(const PSUCompletionQueue &) = delete;
+  ~PSUCompletionQueue() {
+    if (wfd >= 0 && wfd != efd)
+      close(wfd);
+    if (efd >= 0)
+      close(efd);
+  }
+
+  bool valid() const { return efd >= 0; }
+  // Readable while results are waiting.
+  int fd() const { return efd; }
+
+  // Any thread.
+  void post(T item) {
+    bool was_empty;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      was_empty = items.empty();
+      items.push_back(std::move(item));
+    }
+    if (was_empty) {
+      uint64_t one = 1; // an eventfd takes exactly 8 bytes; so does the pipe
+      ssize_t n = write(wfd, &one, sizeof(one));
+      (void)n; // at most one signal per batch is ever pending
+    }
+  }
+
+  // Consumer: everything posted so far, oldest first, and the fd is no
+  // longer readable. Swaps buffers, so out's capacity is reused.
+  size_t drain(std::vector<T> &out) {
+    uint64_t count;
+    ssize_t n = read(efd, &count, sizeof(count));
+    (void)n; // EAGAIN: a previous drain already took this batch
+    out.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    out.swap(items);
+    return out.size();
+  }
+
+private:
+  int efd; // read end
+  int wfd; // write end, the same descriptor for an eventfd
+  std::mutex mutex;
+  std::vector<T> items;
+};
+
+#endif /* SOURCE_PSUCOMPLETIONQUEUE_H_ */
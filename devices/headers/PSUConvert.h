@@ -0,0 +1,191 @@
+/*
+ * PSUConvert.h
+ *
+ * Batch conversion of raw ADCB counts to physical units, for stream blocks
+ * and recordings (PSURecording chunks are converted straight from the
+ * mapped files). The linear path is value = raw * per_count, with SSE2 or
+ * NEON kernels where the target has them; both are baseline on x86-64 and
+ * arm64, so no build flag is needed. A calibration table is expanded once
+ * into one value per possible count (the input is 16 bit), which makes the
+ * LUT path a plain gather giving exactly PSUCalibrationTable::eval().
+ *
+ * Input may be strided (stride in bytes), e.g. &samples[0].adcb[2] with
+ * stride sizeof(PSUStreamSample); strided input is gathered in short runs
+ * and fed to the same kernels.
+ */
+
+#ifndef SOURCE_PSUCONVERT_H_
+#define SOURCE_PSUCONVERT_H_
+
+#include <cstring>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PSU_CONVERT_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define PSU_CONVERT_NEON 1
+#endif
+
+#include "PSUCalibration.h"
+
+class PSUBlockConverter {
+public:
+  // The nominal linear conversion, as adc_to_voltage()/adc_to_current().
+  explicit PSUBlockConverter(double per_count = 0)
+      : scale(per_count), scale_f((float)per_count) {}
+
+  // The table's mapping over every count; an invalid table falls back to
+  // per_count.
+  PSUBlockConverter(const PSUCalibrationTable &table, double per_count)
+      : scale(per_count), scale_f((float)per_count) {
+    if (!table.valid())
+      return;
+    lut.resize(65536);
+    lut_f.resize(65536);
+    for (size_t raw = 0; raw < lut.size(); ++raw) {
+      lut[raw] = table.eval((double)raw);
+      lut_f[raw] = (float)lut[raw];
+    }
+  }
+
+  bool uses_table() const { return !lut.empty(); }
+  double per_count() const { return scale; }
+
+  double convert(uint16_t raw) const {
+    return lut.empty() ? raw * scale : lut[raw];
+  }
+
+  // out[i] = value of the i-th count, the counts being stride bytes apart
+  // (negative strides walk backwards, as NumPy's do).
+  // float output is computed in single precision throughout.
+  void convert(const uint16_t *raw, ptrdiff_t stride, size_t n,
+               double *out) const {
+    run(raw, stride, n, out);
+  }
+  void convert(const uint16_t *raw, ptrdiff_t stride, size_t n,
+               float *out) const {
+    run(raw, stride, n, out);
+  }
+  template <class Out>
+  void convert(const uint16_t *raw, size_t n, Out *out) const {
+    run(raw, sizeof(uint16_t), n, out);
+  }
+
+private:
+  double scale;
+  float scale_f;
+  std::vector<double> lut; // empty: linear
+  std::vector<float> lut_f;
+
+  enum { Run = 256 }; // strided counts gathered per kernel call
+
+  template <class Out>
+  void run(const uint16_t *raw, ptrdiff_t stride, size_t n, Out *out) const {
+    if (stride == (ptrdiff_t)sizeof(uint16_t)) {
+      kernel(raw, n, out);
+      return;
+    }
+    uint16_t packed[Run];
+    const char *p = (const char *)raw;
+    while (n) {
+      size_t take = n < (size_t)Run ? n : (size_t)Run;
+      for (size_t i = 0; i < take; ++i, p += stride)
+        memcpy(&packed[i], p, sizeof(uint16_t)); // counts may be unaligned
+      kernel(packed, take, out);
+      out += take;
+      n -= take;
+    }
+  }
+
+  void kernel(const uint16_t *raw, size_t n, double *out) const {
+    if (!lut.empty())
+      gather(raw, n, lut.data(), out);
+    else
+      linear(raw, n, out);
+  }
+  void kernel(const uint16_t *raw, size_t n, float *out) const {
+    if (!lut_f.empty())
+      gather(raw, n, lut_f.data(), out);
+    else
+      linear(raw, n, out);
+  }
+
+  template <class Out>
+  static void gather(const uint16_t *raw, size_t n, const Out *table,
+                     Out *out) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      Out a = table[raw[i]], b = table[raw[i + 1]];
+      Out c = table[raw[i + 2]], d = table[raw[i + 3]];
+      out[i] = a;
+      out[i + 1] = b;
+      out[i + 2] = c;
+      out[i + 3] = d;
+    }
+    for (; i < n; ++i)
+      out[i] = table[raw[i]];
+  }
+
+  void linear(const uint16_t *raw, size_t n, float *out) const {
+    size_t i = 0;
+#if defined(PSU_CONVERT_SSE2)
+    const __m128 k = _mm_set1_ps(scale_f);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(raw + i));
+      __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+      __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero));
+      _mm_storeu_ps(out + i, _mm_mul_ps(lo, k));
+      _mm_storeu_ps(out + i + 4, _mm_mul_ps(hi, k));
+    }
+#elif defined(PSU_CONVERT_NEON)
+    const float32x4_t k = vdupq_n_f32(scale_f);
+    for (; i + 8 <= n; i += 8) {
+      uint16x8_t v = vld1q_u16(raw + i);
+      float32x4_t lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(v)));
+      float32x4_t hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(v)));
+      vst1q_f32(out + i, vmulq_f32(lo, k));
+      vst1q_f32(out + i + 4, vmulq_f32(hi, k));
+    }
+#endif
+    for (; i < n; ++i)
+      out[i] = raw[i] * scale_f;
+  }
+
+  void linear(const uint16_t *raw, size_t n, double *out) const {
+    size_t i = 0;
+#if defined(PSU_CONVERT_SSE2)
+    const __m128d k = _mm_set1_pd(scale);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(raw + i));
+      __m128i lo = _mm_unpacklo_epi16(v, zero);
+      __m128i hi = _mm_unpackhi_epi16(v, zero);
+      // cvtepi32_pd converts the low two lanes; shift the others down.
+      _mm_storeu_pd(out + i, _mm_mul_pd(_mm_cvtepi32_pd(lo), k));
+      _mm_storeu_pd(out + i + 2,
+                    _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(lo, 8)), k));
+      _mm_storeu_pd(out + i + 4, _mm_mul_pd(_mm_cvtepi32_pd(hi), k));
+      _mm_storeu_pd(out + i + 6,
+                    _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(hi, 8)), k));
+    }
+#elif defined(PSU_CONVERT_NEON)
+    const float64x2_t k = vdupq_n_f64(scale);
+    for (; i + 4 <= n; i += 4) {
+      uint32x4_t v = vmovl_u16(vld1_u16(raw + i));
+      float64x2_t lo = vcvtq_f64_u64(vmovl_u32(vget_low_u32(v)));
+      float64x2_t hi = vcvtq_f64_u64(vmovl_u32(vget_high_u32(v)));
+      vst1q_f64(out + i, vmulq_f64(lo, k));
+      vst1q_f64(out + i + 2, vmulq_f64(hi, k));
+    }
+#endif
+    for (; i < n; ++i)
+      out[i] = raw[i] * scale;
+  }
+};
+
+#endif /* SOURCE_PSUCONVERT_H_ */
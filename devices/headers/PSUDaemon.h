@@ -0,0 +1,386 @@
+/*
+ * PSUDaemon.h
+ *
+ * Device server: the one process that claims the analog boards. It polls
+ * them all through a PSUGroup, publishes every readout to PSUTelemetry
+ * shared memory and takes setpoint commands on a Unix stream socket, so the
+ * GUI, loggers and scripts no longer compete for the USB interface.
+ *
+ * Command protocol: one ASCII line per command, answered by one line that
+ * starts with "ok" or "err". Boards are numbered in the order given.
+ *
+ *   list                          ok <n> <path0> <path1> ...
+ *   set <i> <volt>                DAC A (voltage setpoint)
+ *   curr <i> <curr>               DAC B (current limit)
+ *   on <i> | off <i>              relay
+ *   apply <i> <volt> <curr> <0|1> all three in one packet
+ *   shutdown                      0 V and relay off on every board
+ *
+ * Successful writes answer "ok <voltage> <current> <relay>" from the
+ * readback in the same response, which is also published at once, along
+ * with the new setpoint (shutdown's too, though it answers just "ok").
+ */
+
+#ifndef SOURCE_PSUDAEMON_H_
+#define SOURCE_PSUDAEMON_H_
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "Error.h"
+#include "PSUGroup.h"
+#include "PSUTelemetry.h"
+
+#define PSU_DAEMON_DEFAULT_SOCKET "/tmp/heinzinger_psu.sock"
+
+struct PSUDaemonBoard {
+  std::string path; // as for HeinzingerPSU(usb_path)
+  double max_voltage;
+  double max_current;
+};
+
+class PSUDaemon {
+public:
+  PSUDaemon(double rate_hz = 50.0,
+            const std::string &shm_name = PSU_TELEMETRY_DEFAULT_NAME,
+            const std::string &socket_path = PSU_DAEMON_DEFAULT_SOCKET)
+      : rate_hz(rate_hz), shm_name(shm_name), socket_path(socket_path),
+        listener(-1) {}
+  PSUDaemon(const PSUDaemon &) = delete;
+  ~PSUDaemon() { close_socket(); }
+
+  // Opens the board; an unreachable board ends the process (Utter), as for
+  // any HeinzingerVia16BitDAC.
+  bool add_board(const PSUDaemonBoard &cfg) {
+    if (boards.size() >= PSUTelemetryRegion::MaxBoards)
+      return false;
+    return add(cfg, new HeinzingerVia16BitDAC(cfg.path, cfg.max_voltage,
+                                              cfg.max_current, false, 10.0));
+  }
+  // Same over another transport (e.g. FGMockAnalogBoard); cfg.path is only
+  // reported to clients.
+  bool add_board(const PSUDaemonBoard &cfg, FGBulkBridge &transport) {
+    if (boards.size() >= PSUTelemetryRegion::MaxBoards)
+      return false;
+    return add(cfg, new HeinzingerVia16BitDAC(transport, cfg.max_voltage,
+                                              cfg.max_current, false, 10.0));
+  }
+
+  // Serves until SIGINT/SIGTERM. Returns the process exit code.
+  int run() {
+    if (boards.empty()) {
+      Shout("psu daemon: no boards configured");
+      return 1;
+    }
+    if (int pid = PSUTelemetryWriter::running_writer(shm_name)) {
+      Shout("psu daemon: already running as pid " + std::to_string(pid) +
+            " on " + shm_name);
+      return 1;
+    }
+    if (!telemetry.open(shm_name, boards.size())) {
+      Shout("psu daemon: cannot create shared memory " + shm_name);
+      return 1;
+    }
+    for (size_t i = 0; i < boards.size(); ++i)
+      telemetry.set_path(i, boards[i]->cfg.path);
+    if (!open_socket())
+      return 1;
+
+    stop_flag() = false;
+    signal(SIGINT, &PSUDaemon::on_signal);
+    signal(SIGTERM, &PSUDaemon::on_signal);
+    signal(SIGPIPE, SIG_IGN); // a client going away is not our problem
+
+    std::thread poller(&PSUDaemon::poll_boards, this);
+    serve();
+    poller.join();
+    close_socket();
+    telemetry.close();
+    return 0;
+  }
+
+  static void request_stop() { stop_flag() = true; }
+
+  // Handles one command line; public so it can be driven without a socket.
+  std::string execute(const std::string &line) {
+    std::istringstream in(line);
+    std::string cmd;
+    in >> cmd;
+    if (cmd == "list") {
+      std::ostringstream out;
+      out << "ok " << boards.size();
+      for (size_t i = 0; i < boards.size(); ++i)
+        out << " " << boards[i]->cfg.path;
+      return out.str();
+    }
+    if (cmd == "shutdown") {
+      Setpoint off = {0.0, 0.0, false};
+      std::vector<char> ok = group.fan_out<char>(
+          [this, &off](IPowerSupply &, size_t i) {
+            PSUSnapshot readback;
+            return (char)write(i, off,
+                               FGAnalogPSUInterface::SetDACAMask |
+                                   FGAnalogPSUInterface::SetRelayMask,
+                               true, readback);
+          });
+      std::string res = "ok";
+      for (size_t i = 0; i < ok.size(); ++i)
+        if (!ok[i])
+          res = "err board " + std::to_string(i) + " did not confirm";
+      return res;
+    }
+
+    if (cmd != "set" && cmd != "curr" && cmd != "on" && cmd != "off" &&
+        cmd != "apply")
+      return "err unknown command";
+    size_t i;
+    if (!(in >> i) || i >= boards.size())
+      return "err bad board index";
+    Entry &b = *boards[i];
+    Setpoint sp;
+    {
+      std::lock_guard<std::mutex> lock(b.mutex);
+      sp = b.setpoint;
+    }
+    uint8_t mask;
+    if (cmd == "set" && (in >> sp.volt)) {
+      mask = FGAnalogPSUInterface::SetDACAMask;
+    } else if (cmd == "curr" && (in >> sp.curr)) {
+      mask = FGAnalogPSUInterface::SetDACBMask;
+    } else if (cmd == "on" || cmd == "off") {
+      sp.relay_on = cmd == "on";
+      mask = FGAnalogPSUInterface::SetRelayMask;
+    } else if (cmd == "apply" && (in >> sp.volt >> sp.curr >> sp.relay_on)) {
+      mask = FGAnalogPSUInterface::SetDACAMask |
+             FGAnalogPSUInterface::SetDACBMask |
+             FGAnalogPSUInterface::SetRelayMask;
+    } else {
+      return "err bad arguments";
+    }
+
+    PSUSnapshot readback;
+    if (!write(i, sp, mask, false, readback))
+      return "err write rejected or not acknowledged";
+    std::ostringstream out;
+    out << "ok " << readback.voltage << " " << readback.current << " "
+        << (readback.relay_on ? 1 : 0);
+    return out.str();
+  }
+
+private:
+  struct Entry {
+    PSUDaemonBoard cfg;
+    std::unique_ptr<HeinzingerVia16BitDAC> psu;
+    std::mutex mutex; // setpoint
+    Setpoint setpoint;
+  };
+  struct Client {
+    int fd;
+    std::string pending; // bytes after the last complete line
+  };
+  static const size_t MaxLine = 256;
+
+  double rate_hz;
+  std::string shm_name;
+  std::string socket_path;
+  int listener;
+  std::vector<std::unique_ptr<Entry>> boards;
+  PSUGroup group;
+  PSUTelemetryWriter telemetry;
+  std::mutex publish_mutex; // the seqlock allows one writer at a time
+
+  bool add(const PSUDaemonBoard &cfg, HeinzingerVia16BitDAC *psu) {
+    std::unique_ptr<Entry> e(new Entry);
+    e->cfg = cfg;
+    e->psu.reset(psu);
+    Setpoint none = {0.0, 0.0, false};
+    e->setpoint = none;
+    group.add(*e->psu);
+    boards.push_back(std::move(e));
+    return true;
+  }
+
+  // Read by the poller thread too, so an atomic rather than a
+  // sig_atomic_t; std::atomic<bool> is lock-free, so the handler may set it.
+  static std::atomic<bool> &stop_flag() {
+    static std::atomic<bool> flag(false);
+    return flag;
+  }
+  static void on_signal(int) { stop_flag() = true; }
+
+  // Fields of sp in mask to board i; on success the setpoint they make up
+  // is recorded and published with the readback.
+  bool write(size_t i, const Setpoint &sp, uint8_t mask, bool force,
+             PSUSnapshot &readback) {
+    Entry &b = *boards[i];
+    if (!b.psu->apply(sp, mask, readback, force))
+      return false;
+    {
+      std::lock_guard<std::mutex> lock(b.mutex);
+      if (mask & FGAnalogPSUInterface::SetDACAMask)
+        b.setpoint.volt = sp.volt;
+      if (mask & FGAnalogPSUInterface::SetDACBMask)
+        b.setpoint.curr = sp.curr;
+      if (mask & FGAnalogPSUInterface::SetRelayMask)
+        b.setpoint.relay_on = sp.relay_on;
+    }
+    publish(i, readback);
+    return true;
+  }
+
+  void publish(size_t i, const PSUSnapshot &snap) {
+    PSUTelemetrySample s;
+    memset(&s, 0, sizeof(s));
+    s.snap = snap;
+    s.t = psu_wall_time();
+    s.max_voltage = boards[i]->cfg.max_voltage;
+    s.max_current = boards[i]->cfg.max_current;
+    {
+      std::lock_guard<std::mutex> lock(boards[i]->mutex);
+      s.setpoint = boards[i]->setpoint;
+    }
+    std::lock_guard<std::mutex> lock(publish_mutex);
+    telemetry.publish(i, s);
+  }
+
+  void poll_boards() {
+    typedef std::chrono::steady_clock clock;
+    const clock::duration period =
+        std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(1.0 / (rate_hz > 0 ? rate_hz : 1.0)));
+    clock::time_point deadline = clock::now();
+    while (!stop_flag()) {
+      std::vector<PSUSnapshot> snaps = group.read_all();
+      for (size_t i = 0; i < snaps.size(); ++i)
+        publish(i, snaps[i]);
+      telemetry.heartbeat();
+      deadline += period;
+      clock::time_point now = clock::now();
+      if (deadline < now)
+        deadline = now; // fell behind: do not try to catch up
+      else
+        std::this_thread::sleep_until(deadline);
+    }
+  }
+
+  bool open_socket() {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+      Shout("psu daemon: socket path too long: " + socket_path);
+      return false;
+    }
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+      Shout("psu daemon: socket() failed");
+      return false;
+    }
+    if (listening(addr)) {
+      Shout("psu daemon: another daemon is listening on " + socket_path);
+      close_socket(false);
+      return false;
+    }
+    unlink(socket_path.c_str()); // left behind by a previous run
+    if (bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listener, 16) != 0) {
+      Shout("psu daemon: cannot listen on " + socket_path);
+      close_socket();
+      return false;
+    }
+    return true;
+  }
+
+  // A socket file that still accepts connections belongs to a live daemon.
+  static bool listening(const sockaddr_un &addr) {
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0)
+      return false;
+    bool up = connect(probe, (const sockaddr *)&addr, sizeof(addr)) == 0;
+    close(probe);
+    return up;
+  }
+
+  // unlink_path false: the path is another daemon's, leave it.
+  void close_socket(bool unlink_path = true) {
+    if (listener >= 0) {
+      close(listener);
+      if (unlink_path)
+        unlink(socket_path.c_str());
+    }
+    listener = -1;
+  }
+
+  // Runs on the calling thread; commands execute here, concurrently with the
+  // poller (each PSU serialises its own I/O).
+  void serve() {
+    std::vector<Client> clients;
+    while (!stop_flag()) {
+      std::vector<pollfd> fds(1 + clients.size());
+      fds[0].fd = listener;
+      fds[0].events = POLLIN;
+      for (size_t i = 0; i < clients.size(); ++i) {
+        fds[i + 1].fd = clients[i].fd;
+        fds[i + 1].events = POLLIN;
+      }
+      int n = poll(&fds[0], fds.size(), 100);
+      if (n < 0 && errno != EINTR)
+        break;
+      if (n <= 0)
+        continue;
+
+      for (size_t i = clients.size(); i-- > 0;) {
+        if (!fds[i + 1].revents)
+          continue;
+        if (!service(clients[i])) {
+          close(clients[i].fd);
+          clients.erase(clients.begin() + i);
+        }
+      }
+      if (fds[0].revents & POLLIN) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd >= 0) {
+          Client c = {fd, std::string()};
+          clients.push_back(c);
+        }
+      }
+    }
+    for (size_t i = 0; i < clients.size(); ++i)
+      close(clients[i].fd);
+    stop_flag() = true; // also stops the poller if serve() ended on an error
+  }
+
+  // Reads what is available and answers every complete line. False when
+  // the client is gone or misbehaves.
+  bool service(Client &c) {
+    char buf[512];
+    ssize_t got = recv(c.fd, buf, sizeof(buf), 0);
+    if (got <= 0)
+      return false;
+    c.pending.append(buf, got);
+    size_t eol;
+    while ((eol = c.pending.find('\n')) != std::string::npos) {
+      std::string reply = execute(c.pending.substr(0, eol)) + "\n";
+      c.pending.erase(0, eol + 1);
+      if (send(c.fd, reply.data(), reply.size(), 0) != (ssize_t)reply.size())
+        return false;
+    }
+    return c.pending.size() <= MaxLine;
+  }
+};
+
+#endif /* SOURCE_PSUDAEMON_H_ */
@@ -0,0 +1,180 @@
+/*
+ * PSUFactory.h
+ *
+ * Builds any supply driver from one description, so a rack is a list of
+ * entries in a config file (moxa/config_example.json, "supplies") instead of
+ * a script per device type. Each type name maps to a builder; the built-in
+ * ones are
+ *
+ *   heinzinger      HeinzingerVia16BitDAC on usb_path, ranges from the entry
+ *   heinzinger30kv  AnalogPSUDriver<Heinzinger30kV> on usb_path
+ *   fug50kv         AnalogPSUDriver<FUG50kV> on usb_path
+ *   tdk-lambda      TDKLambdaPSU on port (tty or tcp://), address
+ *   iseg            IsegPSU on port, channel
+ *
+ * and add() registers more. Serial entries may name a Moxa port instead of
+ * a device (moxa_host + moxa_port, see FGMoxaPorts::Url()).
+ */
+
+#ifndef SOURCE_PSUFACTORY_H_
+#define SOURCE_PSUFACTORY_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AnalogPSUDriver.h"
+#include "Error.h" // For Shout
+#include "PowerSupply.h"
+#include "SerialPSU.h"
+
+struct PSUConfig {
+  PSUConfig()
+      : moxa_port(0), address(6), channel(0), max_voltage(0), max_current(0),
+        max_input_voltage(10.0), baud(9600), reset(true), verbose(false),
+        lazy(false) {}
+
+  std::string name; // free-form, for the caller's bookkeeping
+  std::string type; // a registered builder, see PSUFactory
+  std::string usb_path;  // analog board, as for HeinzingerPSU(usb_path)
+  std::string port;      // serial device or tcp://host:port
+  std::string moxa_host; // with moxa_port: used instead of port
+  int moxa_port;
+  int address; // TDK-Lambda bus address
+  int channel; // iseg channel
+  double max_voltage; // 0: the model's own range, where it has one
+  double max_current;
+  double max_input_voltage; // analog board program voltage
+  unsigned int baud;
+  bool reset; // TDK-Lambda: *RST on first bring-up
+  bool verbose;
+  bool lazy; // open on the first I/O or open() instead of at once
+
+  std::string serial_port() const {
+    if (moxa_port > 0)
+      return "tcp://" + moxa_host + ":" + std::to_string(moxa_port);
+    return port;
+  }
+};
+
+class PSUFactory {
+public:
+  typedef std::function<std::unique_ptr<IPowerSupply>(const PSUConfig &)>
+      Builder;
+
+  // Registers (or replaces) the builder for `type`.
+  static void add(const std::string &type, Builder build) {
+    PSUFactory &f = get();
+    std::lock_guard<std::mutex> lock(f.mutex);
+    f.builders[type] = std::move(build);
+  }
+
+  static std::vector<std::string> types() {
+    PSUFactory &f = get();
+    std::lock_guard<std::mutex> lock(f.mutex);
+    std::vector<std::string> names;
+    for (auto &b : f.builders)
+      names.push_back(b.first);
+    return names;
+  }
+
+  // nullptr (with a message) for an unknown type or invalid ranges. A
+  // supply that is not there yet is reported and returned anyway; open() or
+  // the first call that needs it brings it up once it appears.
+  static std::unique_ptr<IPowerSupply> make(const PSUConfig &cfg) {
+    Builder build;
+    {
+      PSUFactory &f = get();
+      std::lock_guard<std::mutex> lock(f.mutex);
+      auto b = f.builders.find(cfg.type);
+      if (b != f.builders.end())
+        build = b->second;
+    }
+    if (!build) {
+      Shout("Unknown power supply type '" + cfg.type + "'");
+      return nullptr;
+    }
+    return build(cfg);
+  }
+
+private:
+  std::mutex mutex;
+  std::map<std::string, Builder> builders;
+
+  // The analog boards are always built lazily and then opened: their eager
+  // constructors Utter() (and exit) when the board is missing.
+  PSUFactory() {
+    builders["heinzinger"] = [](const PSUConfig &c) {
+      std::unique_ptr<IPowerSupply> psu;
+      if (ranges_given(c) && input_range_ok(c))
+        psu.reset(new HeinzingerVia16BitDAC(c.usb_path, c.max_voltage,
+                                            c.max_current, c.verbose,
+                                            c.max_input_voltage, true));
+      return opened(std::move(psu), c);
+    };
+    builders["heinzinger30kv"] = [](const PSUConfig &c) {
+      return opened(std::unique_ptr<IPowerSupply>(
+                        new Heinzinger30kVPSU(c.usb_path, c.verbose, true)),
+                    c);
+    };
+    builders["fug50kv"] = [](const PSUConfig &c) {
+      return opened(std::unique_ptr<IPowerSupply>(
+                        new FUG50kVPSU(c.usb_path, c.verbose, true)),
+                    c);
+    };
+    builders["tdk-lambda"] = [](const PSUConfig &c) {
+      std::unique_ptr<IPowerSupply> psu;
+      if (ranges_given(c))
+        psu.reset(new TDKLambdaPSU(c.serial_port(),
+                                   TDKLambdaGenesys(c.address, c.reset),
+                                   c.max_voltage, c.max_current, c.baud,
+                                   c.verbose, c.lazy));
+      return psu;
+    };
+    builders["iseg"] = [](const PSUConfig &c) {
+      std::unique_ptr<IPowerSupply> psu;
+      if (ranges_given(c))
+        psu.reset(new IsegPSU(c.serial_port(), IsegSCPI(c.channel),
+                              c.max_voltage, c.max_current, c.baud,
+                              c.verbose, c.lazy));
+      return psu;
+    };
+  }
+
+  static PSUFactory &get() {
+    static PSUFactory instance;
+    return instance;
+  }
+
+  static bool ranges_given(const PSUConfig &c) {
+    if (c.max_voltage > 0 && c.max_current > 0)
+      return true;
+    Shout("Power supply '" + c.name + "' (" + c.type +
+          ") needs max_voltage and max_current");
+    return false;
+  }
+
+  static bool input_range_ok(const PSUConfig &c) {
+    if (c.max_input_voltage > 0 &&
+        c.max_input_voltage <= HeinzingerVia16BitDAC::board_max_volt())
+      return true;
+    Shout("Power supply '" + c.name + "' (" + c.type +
+          "): the board has insufficient output voltage for "
+          "max_input_voltage");
+    return false;
+  }
+
+  // Opens a lazily built supply unless the entry asks for lazy; open()
+  // reports a failure itself.
+  static std::unique_ptr<IPowerSupply>
+  opened(std::unique_ptr<IPowerSupply> psu, const PSUConfig &c) {
+    if (psu && !c.lazy)
+      psu->open();
+    return psu;
+  }
+};
+
+#endif /* SOURCE_PSUFACTORY_H_ */
@@ -0,0 +1,169 @@
+/*
+ * PSUFilter.h
+ *
+ * Incremental noise filters for the ADC monitor channels. Each push() costs
+ * O(1) (O(length) for the median), so the stream thread can filter every
+ * sample as it arrives and a filtered reading is available at the stream
+ * rate without extra round trips. Values are raw ADC counts; convert after
+ * filtering.
+ */
+
+#ifndef SOURCE_PSUFILTER_H_
+#define SOURCE_PSUFILTER_H_
+
+#include <algorithm>
+#include <vector>
+
+enum class PSUFilterKind {
+  None,          // last sample
+  MovingAverage, // mean of the last `length` samples
+  Exponential,   // y += alpha * (x - y)
+  Median,        // median of the last `length` samples, rejects spikes
+  Boxcar         // mean of each block of `length`, one output per block
+};
+
+struct PSUFilterConfig {
+  PSUFilterKind kind;
+  unsigned int length; // window / block size (MovingAverage, Median, Boxcar)
+  double alpha;        // 0 < alpha <= 1 (Exponential)
+
+  // Samples a one-shot filtered read takes when not streaming; at most
+  // PSUChannelFilter::MaxLength, however small alpha is.
+  inline unsigned int settle_samples() const;
+};
+
+class PSUChannelFilter {
+public:
+  static const unsigned int MaxLength = 4096;
+
+  PSUChannelFilter() { configure(none()); }
+
+  static PSUFilterConfig none() {
+    PSUFilterConfig c = {PSUFilterKind::None, 1, 1.0};
+    return c;
+  }
+
+  // None is always valid; otherwise rejects a length of 0 or above
+  // MaxLength, or alpha outside (0, 1] for Exponential.
+  static bool valid(const PSUFilterConfig &c) {
+    if (c.kind == PSUFilterKind::None)
+      return true;
+    if (c.kind == PSUFilterKind::Exponential)
+      return c.alpha > 0 && c.alpha <= 1;
+    return c.length >= 1 && c.length <= MaxLength;
+  }
+
+  // Allocates here, never in push(). Also resets.
+  bool configure(const PSUFilterConfig &c) {
+    if (!valid(c))
+      return false;
+    cfg = c;
+    size_t n = uses_window() ? c.length : 0;
+    window.assign(n, 0.0);
+    sorted.clear();
+    sorted.reserve(cfg.kind == PSUFilterKind::Median ? n : 0);
+    reset();
+    return true;
+  }
+  const PSUFilterConfig &config() const { return cfg; }
+
+  void reset() {
+    count = 0;
+    head = 0;
+    sum = 0;
+    block_sum = 0;
+    block_n = 0;
+    out = 0;
+    sorted.clear();
+  }
+
+  // True once a first output exists: after one sample, or after the first
+  // full block for Boxcar.
+  bool ready() const { return count > 0; }
+  double value() const { return out; }
+  // Outputs produced so far (one per sample, one per block for Boxcar).
+  unsigned long long outputs() const { return count; }
+
+  // Returns true if value() changed, i.e. on every sample except inside a
+  // Boxcar block.
+  bool push(double x) {
+    switch (cfg.kind) {
+    case PSUFilterKind::None:
+      out = x;
+      break;
+    case PSUFilterKind::Exponential:
+      out = count ? out + cfg.alpha * (x - out) : x;
+      break;
+    case PSUFilterKind::MovingAverage: {
+      // Partial mean until the window has filled.
+      const size_t filled = std::min<unsigned long long>(count, cfg.length);
+      sum += x - (filled == cfg.length ? window[head] : 0.0);
+      window[head] = x;
+      head = (head + 1) % cfg.length;
+      out = sum / (filled == cfg.length ? filled : filled + 1);
+      // Resum now and then so rounding does not accumulate.
+      if (head == 0) {
+        sum = 0;
+        for (size_t i = 0; i < window.size(); ++i)
+          sum += window[i];
+      }
+      break;
+    }
+    case PSUFilterKind::Median: {
+      if (sorted.size() == cfg.length)
+        sorted.erase(std::lower_bound(sorted.begin(), sorted.end(),
+                                      window[head]));
+      sorted.insert(std::upper_bound(sorted.begin(), sorted.end(), x), x);
+      window[head] = x;
+      head = (head + 1) % cfg.length;
+      const size_t m = sorted.size();
+      out = m & 1 ? sorted[m / 2] : 0.5 * (sorted[m / 2 - 1] + sorted[m / 2]);
+      break;
+    }
+    case PSUFilterKind::Boxcar:
+      block_sum += x;
+      if (++block_n < cfg.length)
+        return false;
+      out = block_sum / block_n;
+      block_sum = 0;
+      block_n = 0;
+      break;
+    }
+    ++count;
+    return true;
+  }
+
+private:
+  PSUFilterConfig cfg;
+  std::vector<double> window; // ring of the last `length` inputs
+  std::vector<double> sorted; // Median: the same values, in order
+  size_t head;
+  double sum;
+  double block_sum;
+  unsigned int block_n;
+  unsigned long long count;
+  double out;
+
+  bool uses_window() const {
+    return cfg.kind == PSUFilterKind::MovingAverage ||
+           cfg.kind == PSUFilterKind::Median;
+  }
+};
+
+unsigned int PSUFilterConfig::settle_samples() const {
+  switch (kind) {
+  case PSUFilterKind::None:
+    return 1;
+  case PSUFilterKind::Exponential: { // ~99% of a step
+    // A one-shot filter starts from its first sample, so past the cap it
+    // only averages less noise; it has no old state left to forget.
+    const double n = alpha >= 1 ? 1 : 4.6 / alpha + 1;
+    return n < PSUChannelFilter::MaxLength ? (unsigned int)n
+                                           : PSUChannelFilter::MaxLength;
+  }
+  default:
+    return length;
+  }
+}
+
+#endif /* SOURCE_PSUFILTER_H_ */
@@ -0,0 +1,279 @@
+/*
+ * PSUGroup.h
+ *
+ * Fan-out over several supplies of any kind (IPowerSupply). Every member
+ * gets its own worker thread, so one group call runs the members' round
+ * trips at the same time and returns when the slowest one is done: "all to
+ * 0 V, relays open" across a rack costs about one round trip instead of N.
+ *
+ * The *_async forms need no worker threads for members with PSUCapAsync:
+ * every such member's query is submitted to the USB event thread at once and
+ * the callback runs when the last one has completed. The other members run
+ * theirs on their worker thread, and so do PSUCapAsync members that are not
+ * open yet (lazy construction): the worker opens them first.
+ */
+
+#ifndef SOURCE_PSUGROUP_H_
+#define SOURCE_PSUGROUP_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "PowerSupply.h"
+
+class PSUGroup {
+public:
+  PSUGroup() {}
+  PSUGroup(const PSUGroup &) = delete;
+  ~PSUGroup() {
+    for (size_t i = 0; i < workers.size(); ++i)
+      workers[i]->stop();
+  }
+
+  // The PSU must outlive the group. Returns its index in the results.
+  size_t add(IPowerSupply &psu) {
+    std::lock_guard<std::mutex> lock(call_mutex);
+    workers.push_back(std::unique_ptr<Worker>(new Worker(psu)));
+    return workers.size() - 1;
+  }
+  size_t size() const { return workers.size(); }
+
+  // Runs fn(psu, index) on every member concurrently and waits for all of
+  // them; results are in add() order.
+  template <class R>
+  std::vector<R>
+  fan_out(const std::function<R(IPowerSupply &, size_t)> &fn) {
+    std::lock_guard<std::mutex> lock(call_mutex);
+    std::vector<R> results(workers.size());
+    Latch done(workers.size());
+    for (size_t i = 0; i < workers.size(); ++i) {
+      R *slot = &results[i];
+      workers[i]->post([&fn, slot, i, &done](IPowerSupply &psu) {
+        *slot = fn(psu, i);
+        done.count_down();
+      });
+    }
+    done.wait();
+    return results;
+  }
+
+  // Brings every member's link up at once, e.g. after lazy construction;
+  // true for each member that is open.
+  std::vector<char> open_all() {
+    return fan_out<char>(
+        [](IPowerSupply &psu, size_t) { return (char)psu.open(); });
+  }
+
+  std::vector<PSUSnapshot> read_all() {
+    return fan_out<PSUSnapshot>(
+        [](IPowerSupply &psu, size_t) { return psu.read_snapshot(); });
+  }
+
+  // std::vector<bool> is avoided: its elements cannot be written from
+  // several threads at once.
+  std::vector<char> apply_all(const Setpoint &sp, uint8_t mask,
+                              bool force = false) {
+    return fan_out<char>([&sp, mask, force](IPowerSupply &psu, size_t) {
+      return (char)psu.apply(sp, mask, force);
+    });
+  }
+
+  // One setpoint per member, in add() order.
+  std::vector<char> apply_each(const std::vector<Setpoint> &sps, uint8_t mask,
+                               bool force = false) {
+    if (sps.size() != workers.size())
+      return std::vector<char>(workers.size(), 0);
+    return fan_out<char>(
+        [&sps, mask, force](IPowerSupply &psu, size_t i) {
+          return (char)psu.apply(sps[i], mask, force);
+        });
+  }
+
+  // Voltage to 0 and relay open on every member in one combined write each,
+  // always sent (no write deduplication).
+  std::vector<char> shutdown() {
+    return fan_out<char>(
+        [](IPowerSupply &psu, size_t) { return (char)psu.shutdown(); });
+  }
+
+  // Called once with one result per member, in add() order, from whichever
+  // thread completed the last member (see IPowerSupply::apply_async for
+  // what `ok` and the readback mean). Not concurrently with add().
+  typedef std::function<void(std::vector<PSUSnapshot> &)> AsyncCallback;
+
+  void read_all_async(AsyncCallback done) {
+    fan_out_async(
+        [](IPowerSupply &psu, size_t, IPowerSupply::AsyncCallback cb) {
+          psu.read_snapshot_async(std::move(cb));
+        },
+        std::move(done));
+  }
+
+  void apply_all_async(const Setpoint &sp, uint8_t mask, AsyncCallback done) {
+    fan_out_async(
+        [sp, mask](IPowerSupply &psu, size_t, IPowerSupply::AsyncCallback cb) {
+          psu.apply_async(sp, mask, std::move(cb));
+        },
+        std::move(done));
+  }
+
+  void apply_each_async(const std::vector<Setpoint> &sps, uint8_t mask,
+                        AsyncCallback done) {
+    if (sps.size() != workers.size()) {
+      std::vector<PSUSnapshot> failed(workers.size());
+      for (size_t i = 0; i < failed.size(); ++i)
+        memset(&failed[i], 0, sizeof(PSUSnapshot));
+      done(failed);
+      return;
+    }
+    fan_out_async(
+        [sps, mask](IPowerSupply &psu, size_t i,
+                    IPowerSupply::AsyncCallback cb) {
+          psu.apply_async(sps[i], mask, std::move(cb));
+        },
+        std::move(done));
+  }
+
+  void shutdown_async(AsyncCallback done) {
+    Setpoint off = {0.0, 0.0, false};
+    apply_all_async(off, PSUSetVoltage | PSUSetRelay, std::move(done));
+  }
+
+  // open_all() with a callback; snapshot.ok is the member's open() result,
+  // the rest is zero. Opening blocks on every driver, so each member's runs
+  // on its worker.
+  void open_all_async(AsyncCallback done) {
+    fan_out_async(
+        [](IPowerSupply &psu, size_t, IPowerSupply::AsyncCallback cb) {
+          PSUSnapshot snap;
+          memset(&snap, 0, sizeof(snap));
+          snap.ok = psu.open();
+          cb(snap);
+        },
+        std::move(done), true);
+  }
+
+private:
+  struct AsyncJoin {
+    std::vector<PSUSnapshot> results;
+    std::atomic<size_t> pending;
+    AsyncCallback done;
+  };
+
+  // start(psu, index, cb) must make sure cb is called exactly once. It may
+  // run on a worker after the caller returned, so it holds copies. blocking:
+  // on the workers even for PSUCapAsync members.
+  template <class Start>
+  void fan_out_async(Start start, AsyncCallback done, bool blocking = false) {
+    std::shared_ptr<AsyncJoin> join = std::make_shared<AsyncJoin>();
+    join->results.resize(workers.size());
+    join->pending = workers.size();
+    join->done = std::move(done);
+    if (workers.empty()) {
+      join->done(join->results);
+      return;
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+      IPowerSupply::AsyncCallback cb = [join, i](const PSUSnapshot &snap) {
+        join->results[i] = snap;
+        if (--join->pending == 0)
+          join->done(join->results);
+      };
+      IPowerSupply &psu = workers[i]->psu;
+      if (!blocking && psu.has(PSUCapAsync) && psu.is_open())
+        start(psu, i, std::move(cb));
+      else if (!blocking && psu.has(PSUCapAsync))
+        workers[i]->post([start, i, cb](IPowerSupply &psu) {
+          psu.open(); // on failure start() is refused and reports it
+          start(psu, i, cb);
+        });
+      else
+        workers[i]->post([start, i, cb](IPowerSupply &psu) {
+          start(psu, i, cb);
+        });
+    }
+  }
+
+  class Latch {
+  public:
+    explicit Latch(size_t n) : pending(n) {}
+    void count_down() {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--pending == 0)
+        cv.notify_all();
+    }
+    void wait() {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this]() { return pending == 0; });
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t pending;
+  };
+
+  // One thread per member; runs its jobs one at a time, in order. stop()
+  // lets it finish the queue first, so every *_async callback is called.
+  class Worker {
+  public:
+    typedef std::function<void(IPowerSupply &)> Job;
+
+    explicit Worker(IPowerSupply &p)
+        : psu(p), quit(false), thread(&Worker::run, this) {}
+
+    void post(Job j) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(j));
+      }
+      cv.notify_one();
+    }
+
+    void stop() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+      }
+      cv.notify_one();
+      if (thread.joinable())
+        thread.join();
+    }
+
+    IPowerSupply &psu;
+
+  private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Job> jobs;
+    bool quit;
+    std::thread thread;
+
+    void run() {
+      for (;;) {
+        Job next;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv.wait(lock, [this]() { return quit || !jobs.empty(); });
+          if (jobs.empty())
+            return; // quit, but only once every posted job has run
+          next = std::move(jobs.front());
+          jobs.pop_front();
+        }
+        next(psu);
+      }
+    }
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::mutex call_mutex; // one fan-out at a time
+};
+
+#endif /* SOURCE_PSUGROUP_H_ */
@@ -0,0 +1,181 @@
+/*
+ * PSURamp.h
+ *
+ * Voltage ramp / sequence engine for HeinzingerVia16BitDAC. A profile of
+ * (setpoint, dwell) steps is played back on its own thread against absolute
+ * std::chrono::steady_clock deadlines, so a late step does not push all the
+ * following ones back and the timing does not depend on Python scheduling.
+ * Each step is a single combined write whose response is the readback.
+ */
+
+#ifndef SOURCE_PSURAMP_H_
+#define SOURCE_PSURAMP_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Heinzinger.h"
+
+struct RampStep {
+  double volt;  // setpoint, same units as the PSU's max_voltage
+  double dwell; // seconds to hold it before the next step starts
+};
+
+// What happened at one step. Times are seconds from the start of the ramp.
+struct RampPoint {
+  double t_target; // scheduled start of the step
+  double t_issued; // when the write was sent
+  double t_done;   // when the response arrived
+  double set_volt;
+  bool ok;
+  double read_volt; // readback from the same packet
+  double read_curr;
+};
+
+class PSURamp {
+public:
+  explicit PSURamp(HeinzingerVia16BitDAC &psu)
+      : psu(psu), active(false), abort(false), failed(false) {}
+  PSURamp(const PSURamp &) = delete;
+  ~PSURamp() { stop(); }
+
+  // Steps from `from` to `to` in increments of step_volt, timed so that the
+  // average slope is volt_per_s. The last step lands exactly on `to`.
+  static std::vector<RampStep> slope(double from, double to,
+                                     double volt_per_s, double step_volt) {
+    std::vector<RampStep> profile;
+    if (volt_per_s <= 0 || step_volt <= 0)
+      return profile;
+    int n = (int)std::ceil(std::fabs(to - from) / step_volt);
+    for (int i = 1; i <= n; ++i) {
+      double v = (i == n) ? to : from + (to - from) * i / n;
+      RampStep step = {v, std::fabs(to - from) / n / volt_per_s};
+      profile.push_back(step);
+    }
+    return profile;
+  }
+
+  // Returns false if a ramp is already running.
+  bool start(const std::vector<RampStep> &steps) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (active)
+      return false;
+    if (worker.joinable())
+      worker.join();
+    profile = steps;
+    points.clear();
+    points.reserve(profile.size());
+    abort = false;
+    failed = false;
+    active = true;
+    worker = std::thread(&PSURamp::run, this);
+    return true;
+  }
+
+  // Aborts at the next step boundary; the PSU keeps the last setpoint.
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      abort = true;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+      worker.join();
+  }
+
+  // Waits up to timeout_s (< 0: forever); true once the ramp has finished.
+  bool wait(double timeout_s = -1) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (timeout_s < 0)
+      wake.wait(lock, [this]() { return !active; });
+    else
+      wake.wait_for(lock, std::chrono::duration<double>(timeout_s),
+                    [this]() { return !active; });
+    return !active;
+  }
+
+  bool running() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return active;
+  }
+  // True if a step's write failed; the ramp stops at that step.
+  bool has_failed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+  }
+  std::vector<RampPoint> trace() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return points;
+  }
+  // Largest |t_issued - t_target| over the steps run so far.
+  double max_jitter() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    double worst = 0;
+    for (const RampPoint &p : points)
+      worst = std::max(worst, std::fabs(p.t_issued - p.t_target));
+    return worst;
+  }
+
+private:
+  HeinzingerVia16BitDAC &psu;
+  std::vector<RampStep> profile;
+  std::vector<RampPoint> points;
+  mutable std::mutex mutex;
+  std::condition_variable wake;
+  std::thread worker;
+  bool active;
+  bool abort;
+  bool failed;
+
+  void run() {
+    typedef std::chrono::steady_clock clock;
+    const clock::time_point t0 = clock::now();
+    clock::time_point deadline = t0;
+    auto since_t0 = [&t0](clock::time_point t) {
+      return std::chrono::duration<double>(t - t0).count();
+    };
+
+    for (const RampStep &step : profile) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (wake.wait_until(lock, deadline, [this]() { return abort; }))
+          break;
+      }
+
+      RampPoint p;
+      p.t_target = since_t0(deadline);
+      p.set_volt = step.volt;
+      Setpoint sp = {step.volt, 0.0, false};
+      PSUSnapshot readback;
+      p.t_issued = since_t0(clock::now());
+      p.ok = psu.apply(sp, FGAnalogPSUInterface::SetDACAMask, readback);
+      p.t_done = since_t0(clock::now());
+      p.read_volt = readback.voltage;
+      p.read_curr = readback.current;
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        points.push_back(p);
+        if (!p.ok) {
+          failed = true;
+          break;
+        }
+      }
+      deadline += std::chrono::duration_cast<clock::duration>(
+          std::chrono::duration<double>(step.dwell));
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      active = false;
+    }
+    wake.notify_all();
+  }
+};
+
+#endif /* SOURCE_PSURAMP_H_ */
@@ -0,0 +1,344 @@
+/*
+ * PSURecorder.h
+ *
+ * Binary recording of a PSU's acquisition stream. Samples are copied
+ * straight from the stream ring into memory-mapped chunk files of fixed-size
+ * PSUStreamSample records behind a one-page header (device, calibration,
+ * rate), so a run is written without formatting and read back by mapping
+ * the files: PSURecording hands out the records in place.
+ *
+ * Files are <base>.0000.psurec, <base>.0001.psurec, ...; each holds up to
+ * chunk_records samples. record_count in the header is updated after every
+ * batch, so a chunk can be read while it is still being written, and a
+ * crashed run loses at most the last batch.
+ */
+
+#ifndef SOURCE_PSURECORDER_H_
+#define SOURCE_PSURECORDER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "Error.h"
+#include "Heinzinger.h"
+
+struct PSURecordingHeader {
+  static const uint32_t Version = 1;
+  static const uint32_t Size = 4096; // records start here, page aligned
+
+  char magic[8]; // "PSUREC\0\0"
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t record_size; // sizeof(PSUStreamSample) of the writer
+  uint32_t chunk_index;
+  uint64_t chunk_capacity;             // records that fit in this file
+  std::atomic<uint64_t> record_count;  // records written so far
+  double t_start;                      // Unix seconds, first chunk opened
+  double rate_hz;                      // requested stream rate
+  // Calibration: value = max * (adc_gain * raw / UINT16_MAX) / 10
+  double max_voltage;
+  double max_current;
+  double max_input_voltage;
+  double adc_gain;
+  uint32_t location_id; // USB locationID of the board (0: not USB)
+  char device[128];     // caller's label, e.g. the usb_path
+};
+
+static_assert(sizeof(PSURecordingHeader) <= PSURecordingHeader::Size,
+              "recording header must fit in its page");
+
+inline std::string psu_recording_chunk_path(const std::string &base,
+                                            unsigned int index) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%04u.psurec", index);
+  return base + suffix;
+}
+
+// Maps one chunk file; shared by the writer (read/write) and the reader.
+class PSURecordingChunk {
+public:
+  PSURecordingChunk() : map(nullptr), size(0), fd(-1), writing(false) {}
+  PSURecordingChunk(const PSURecordingChunk &) = delete;
+  ~PSURecordingChunk() { close(); }
+
+  bool create(const std::string &path, const PSURecordingHeader &h) {
+    close();
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return false;
+    size = PSURecordingHeader::Size + h.chunk_capacity * h.record_size;
+    // Sparse until written; trimmed to the used length in close().
+    if (ftruncate(fd, size) != 0 || !map_fd(PROT_READ | PROT_WRITE)) {
+      close();
+      return false;
+    }
+    memcpy((void *)map, (const void *)&h, sizeof(h));
+    header()->record_count.store(0, std::memory_order_release);
+    return true;
+  }
+
+  bool open(const std::string &path) {
+    close();
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < PSURecordingHeader::Size) {
+      close();
+      return false;
+    }
+    size = st.st_size;
+    if (!map_fd(PROT_READ)) {
+      close();
+      return false;
+    }
+    const PSURecordingHeader *h = header();
+    if (memcmp(h->magic, "PSUREC", 6) != 0 ||
+        h->version != PSURecordingHeader::Version ||
+        h->header_size != PSURecordingHeader::Size ||
+        h->record_size != sizeof(PSUStreamSample)) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  // A writer trims the file to what was recorded.
+  void close() {
+    if (map) {
+      uint64_t used = 0;
+      bool writable = writing;
+      if (writable)
+        used = PSURecordingHeader::Size +
+               header()->record_count.load() * header()->record_size;
+      munmap(map, size);
+      map = nullptr;
+      if (writable && ftruncate(fd, used) != 0)
+        Warn("PSURecorder: could not trim chunk file");
+    }
+    if (fd >= 0)
+      ::close(fd);
+    fd = -1;
+    writing = false;
+  }
+
+  PSURecordingHeader *header() const { return (PSURecordingHeader *)map; }
+  PSUStreamSample *records() const {
+    return (PSUStreamSample *)((char *)map + PSURecordingHeader::Size);
+  }
+  // Records available to a reader: never more than the file holds.
+  size_t count() const {
+    if (!map)
+      return 0;
+    uint64_t n = header()->record_count.load(std::memory_order_acquire);
+    uint64_t fits = (size - PSURecordingHeader::Size) / sizeof(PSUStreamSample);
+    return n < fits ? n : fits;
+  }
+
+private:
+  char *map;
+  size_t size;
+  int fd;
+  bool writing;
+
+  bool map_fd(int prot) {
+    void *p = mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+      return false;
+    map = static_cast<char *>(p);
+    writing = (prot & PROT_WRITE) != 0;
+    return true;
+  }
+};
+
+// Consumes the PSU's stream (starting it if needed) on its own thread and
+// appends every sample. While recording, the recorder is the stream's
+// consumer: do not also call borrow_stream()/stream_block() on that PSU.
+class PSURecorder {
+public:
+  explicit PSURecorder(HeinzingerVia16BitDAC &psu)
+      : psu(psu), active(false), written(0), chunks(0), started_stream(false) {}
+  PSURecorder(const PSURecorder &) = delete;
+  ~PSURecorder() { stop(); }
+
+  bool start(const std::string &base_path, double rate_hz,
+             size_t chunk_records = 4 << 20, const std::string &device = "") {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (active || chunk_records == 0)
+      return false;
+    if (worker.joinable())
+      worker.join();
+
+    memset((void *)&proto, 0, sizeof(proto));
+    memcpy(proto.magic, "PSUREC\0\0", 8);
+    proto.version = PSURecordingHeader::Version;
+    proto.header_size = PSURecordingHeader::Size;
+    proto.record_size = sizeof(PSUStreamSample);
+    proto.chunk_capacity = chunk_records;
+    proto.t_start = psu_wall_time();
+    proto.rate_hz = rate_hz;
+    proto.max_voltage = psu.max_voltage();
+    proto.max_current = psu.max_current();
+    proto.max_input_voltage = psu.max_input_voltage();
+    proto.adc_gain = HeinzingerVia16BitDAC::adc_gain();
+    proto.location_id = psu.location();
+    strncpy(proto.device, device.c_str(), sizeof(proto.device) - 1);
+
+    base = base_path;
+    written = 0;
+    chunks = 0;
+    if (!next_chunk())
+      return false;
+
+    started_stream = !psu.is_streaming();
+    if (started_stream && !psu.start_stream(rate_hz)) {
+      chunk.close();
+      return false;
+    }
+    active = true;
+    worker = std::thread(&PSURecorder::run, this);
+    return true;
+  }
+
+  // Writes out what is queued, closes the chunk and stops the stream if
+  // start() started it.
+  void stop() {
+    active = false;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (worker.joinable())
+      worker.join();
+  }
+
+  bool running() const { return active; }
+  uint64_t records_written() const { return written; }
+  unsigned int chunk_count() const { return chunks; }
+
+private:
+  HeinzingerVia16BitDAC &psu;
+  PSURecordingHeader proto; // copied into every chunk
+  PSURecordingChunk chunk;
+  std::string base;
+  std::mutex mutex; // start/stop
+  std::thread worker;
+  std::atomic<bool> active;
+  std::atomic<uint64_t> written;
+  std::atomic<unsigned int> chunks;
+  bool started_stream;
+
+  bool next_chunk() {
+    chunk.close();
+    proto.chunk_index = chunks;
+    std::string path = psu_recording_chunk_path(base, chunks);
+    if (!chunk.create(path, proto)) {
+      Shout("PSURecorder: cannot create " + path);
+      return false;
+    }
+    ++chunks;
+    return true;
+  }
+
+  // Copies one borrowed block; false if a new chunk could not be opened.
+  bool append(const PSUStreamSample *data, size_t n) {
+    while (n) {
+      PSURecordingHeader *h = chunk.header();
+      uint64_t used = h->record_count.load(std::memory_order_relaxed);
+      if (used == h->chunk_capacity) {
+        if (!next_chunk())
+          return false;
+        continue;
+      }
+      size_t room = h->chunk_capacity - used;
+      size_t take = n < room ? n : room;
+      memcpy(chunk.records() + used, data, take * sizeof(PSUStreamSample));
+      h->record_count.store(used + take, std::memory_order_release);
+      written += take;
+      data += take;
+      n -= take;
+    }
+    return true;
+  }
+
+  void run() {
+    bool ok = true;
+    for (bool last = false; ok;) {
+      const PSUStreamSample *data;
+      size_t n = psu.borrow_stream(data, 4096);
+      if (n)
+        ok = append(data, n);
+      else if (last)
+        break;
+      else if (!active) {
+        // Stop the producer first so the final drain gets everything.
+        if (started_stream)
+          psu.stop_stream();
+        last = true;
+      } else
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    if (!ok && started_stream)
+      psu.stop_stream();
+    const PSUStreamSample *none;
+    psu.borrow_stream(none, 0); // releases the last block
+    chunk.close();
+    active = false;
+  }
+};
+
+// Read side: maps all chunks of a recording without copying. A chunk that
+// is still being written grows in place; chunks started after open() need
+// another open().
+class PSURecording {
+public:
+  PSURecording() {}
+  PSURecording(const PSURecording &) = delete;
+
+  // base_path as given to PSURecorder::start(). False if chunk 0 is missing
+  // or not a recording. Chunks of a previous open() stay mapped for as long
+  // as someone holds them (see chunk()).
+  bool open(const std::string &base_path) {
+    chunks.clear();
+    for (unsigned int i = 0;; ++i) {
+      std::shared_ptr<PSURecordingChunk> c(new PSURecordingChunk);
+      if (!c->open(psu_recording_chunk_path(base_path, i)))
+        break;
+      chunks.push_back(std::move(c));
+    }
+    return !chunks.empty();
+  }
+
+  size_t chunk_count() const { return chunks.size(); }
+  const PSURecordingHeader &header(size_t i = 0) const {
+    return *chunks[i]->header();
+  }
+  size_t records(size_t i, const PSUStreamSample *&data) const {
+    data = chunks[i]->records();
+    return chunks[i]->count();
+  }
+  // Owner of chunk i's mapping, for views that may outlive this open().
+  std::shared_ptr<const PSURecordingChunk> chunk(size_t i) const {
+    return chunks[i];
+  }
+  uint64_t total_records() const {
+    uint64_t n = 0;
+    for (size_t i = 0; i < chunks.size(); ++i)
+      n += chunks[i]->count();
+    return n;
+  }
+
+private:
+  std::vector<std::shared_ptr<PSURecordingChunk>> chunks;
+};
+
+#endif /* SOURCE_PSURECORDER_H_ */
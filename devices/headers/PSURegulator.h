@@ -0,0 +1,158 @@
+/*
+ * PSURegulator.h
+ *
+ * Closed-loop trim of a voltage setpoint against its filtered readback. The
+ * command sent to the supply is target + kp * error + integral, so the PI
+ * part only has to take out the drift and the conversion error of the open
+ * loop setpoint. The command moves by at most max_rate per second and stays
+ * within max_trim of the target; the integral stops accumulating while
+ * either limit holds it back. Values are in the supply's units; timestamps
+ * in seconds on a steady clock (psu_steady_time()), never the wall clock.
+ * Not thread safe.
+ */
+
+#ifndef SOURCE_PSUREGULATOR_H_
+#define SOURCE_PSUREGULATOR_H_
+
+#include <cmath>
+#include <stdint.h>
+
+struct PSURegulatorConfig {
+  double kp;       // command change per unit of error
+  double ki;       // per second
+  double max_rate; // largest command slope, units per second (0: no limit)
+  double max_trim; // largest |command - target|
+  double deadband; // errors smaller than this count as 0
+
+  // Integral-dominated gains: the loop takes out a step in the drift within
+  // about a second, slower than the supply itself settles.
+  static PSURegulatorConfig defaults(double full_scale) {
+    PSURegulatorConfig c = {0.1, 2.0, 0.05 * full_scale, 0.05 * full_scale,
+                            0.0};
+    return c;
+  }
+};
+
+struct PSURegulatorStatus {
+  bool enabled;
+  bool active;     // false while holding: not streaming, output off, tripped
+  double target;
+  double command;  // what the DAC is set to, in the same units
+  double measured; // filtered readback the last update used
+  double error;    // target - measured
+  double integral;
+  uint64_t updates; // controller steps taken
+  uint64_t writes;  // steps that changed the DAC register
+};
+
+class PSUVoltageRegulator {
+public:
+  PSUVoltageRegulator() : lo(0), hi(0) {
+    cfg = PSURegulatorConfig::defaults(0);
+    start(0);
+  }
+
+  static bool valid(const PSURegulatorConfig &c) {
+    return c.kp >= 0 && c.ki >= 0 && c.max_rate >= 0 && c.max_trim >= 0 &&
+           c.deadband >= 0 && std::isfinite(c.kp) && std::isfinite(c.ki) &&
+           std::isfinite(c.max_rate) && std::isfinite(c.max_trim) &&
+           std::isfinite(c.deadband);
+  }
+
+  // [min_command, max_command] is the supply's programmable range.
+  bool configure(const PSURegulatorConfig &c, double min_command,
+                 double max_command) {
+    if (!valid(c) || min_command > max_command)
+      return false;
+    cfg = c;
+    lo = min_command;
+    hi = max_command;
+    return true;
+  }
+  const PSURegulatorConfig &config() const { return cfg; }
+
+  // Fresh start at `target`, the command being the bare target.
+  void start(double target) {
+    goal = target;
+    cmd = clamp(target);
+    integ = 0;
+    meas = err = 0;
+    have_prev = false;
+    prev_t = 0;
+  }
+
+  // New target, keeping what the loop has learnt. The drift of the analog
+  // path is mostly a gain error, so the integral is scaled along.
+  void retarget(double target) {
+    if (goal > 0 && target > 0)
+      integ *= target / goal;
+    else
+      integ = 0;
+    goal = target;
+    cmd = clamp(goal + integ);
+    have_prev = false;
+  }
+
+  // Stops the clock; the next update() only records its sample, so time
+  // spent holding is not integrated.
+  void hold() { have_prev = false; }
+
+  // One step from a readback taken at time t; returns the new command.
+  double update(double t, double measured) {
+    meas = measured;
+    err = goal - measured;
+    double e = std::fabs(err) < cfg.deadband ? 0 : err;
+    if (!have_prev || !(t > prev_t)) {
+      have_prev = true;
+      prev_t = t;
+      return cmd;
+    }
+    double dt = t - prev_t;
+    prev_t = t;
+
+    double next_integ = integ + cfg.ki * e * dt;
+    if (next_integ > cfg.max_trim)
+      next_integ = cfg.max_trim;
+    else if (next_integ < -cfg.max_trim)
+      next_integ = -cfg.max_trim;
+
+    const double want = goal + cfg.kp * e + next_integ;
+    double out = want;
+    if (out > goal + cfg.max_trim)
+      out = goal + cfg.max_trim;
+    else if (out < goal - cfg.max_trim)
+      out = goal - cfg.max_trim;
+    if (cfg.max_rate > 0) {
+      const double step = cfg.max_rate * dt;
+      if (out > cmd + step)
+        out = cmd + step;
+      else if (out < cmd - step)
+        out = cmd - step;
+    }
+    out = clamp(out);
+
+    // Conditional integration: keep the old integral if a limit is what
+    // stops the command from following it.
+    if (!((out < want && e > 0) || (out > want && e < 0)))
+      integ = next_integ;
+    cmd = out;
+    return cmd;
+  }
+
+  double target() const { return goal; }
+  double command() const { return cmd; }
+  double measured() const { return meas; }
+  double error() const { return err; }
+  double integral() const { return integ; }
+
+private:
+  PSURegulatorConfig cfg;
+  double lo, hi;
+  double goal, cmd, integ, meas, err;
+  bool have_prev;
+  double prev_t;
+
+  double clamp(double v) const { return v < lo ? lo : (v > hi ? hi : v); }
+};
+
+#endif /* SOURCE_PSUREGULATOR_H_ */
@@ -0,0 +1,118 @@
+/*
+ * PSUStream.h
+ *
+ * Background acquisition thread shared by the PSU drivers. It calls an
+ * acquire function at a fixed rate (deadlines on std::chrono::steady_clock,
+ * so the rate does not drift with the time each acquisition takes) and
+ * pushes the samples into a preallocated FGSPSCRing for a single consumer.
+ */
+
+#ifndef SOURCE_PSUSTREAM_H_
+#define SOURCE_PSUSTREAM_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdint.h>
+#include <thread>
+
+#include "SPSCRing.h"
+
+// Seconds since the Unix epoch, for sample timestamps.
+inline double psu_wall_time() {
+  return std::chrono::duration<double>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Seconds on std::chrono::steady_clock, for intervals between samples: a
+// wall clock step (NTP) must not look like a long gap or a negative one.
+inline double psu_steady_time() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+template <class Sample> class PSUStream {
+public:
+  // Fills in one sample; returning false counts a failure and pushes nothing.
+  typedef std::function<bool(Sample &)> Acquire;
+
+  PSUStream()
+      : active(false), samples(0), failures(0), rate_hz(0), retry_ms(50) {}
+  PSUStream(const PSUStream &) = delete;
+  ~PSUStream() { stop(); }
+
+  // rate_hz <= 0 runs back to back, as fast as acquire() returns, but
+  // waits the retry delay after a failure.
+  bool start(double rate, size_t capacity, Acquire fn) {
+    if (active)
+      return false;
+    buffer.Resize(capacity);
+    samples = 0;
+    failures = 0;
+    rate_hz = rate;
+    acquire = fn;
+    active = true;
+    worker = std::thread(&PSUStream::run, this);
+    return true;
+  }
+
+  void stop() {
+    active = false;
+    if (worker.joinable())
+      worker.join();
+  }
+
+  // Unpaced only: pause after a failed acquire(), which on a lost link is
+  // refused at once and would otherwise be retried in a busy loop.
+  void set_retry_delay(unsigned int ms) { retry_ms = ms; }
+
+  bool running() const { return active; }
+  double rate() const { return rate_hz; }
+  uint64_t sample_count() const { return samples; }
+  uint64_t failure_count() const { return failures; }
+  FGSPSCRing<Sample> &ring() { return buffer; }
+  const FGSPSCRing<Sample> &ring() const { return buffer; }
+
+private:
+  FGSPSCRing<Sample> buffer;
+  Acquire acquire;
+  std::thread worker;
+  std::atomic<bool> active;
+  std::atomic<uint64_t> samples;
+  std::atomic<uint64_t> failures;
+  double rate_hz;
+  std::atomic<unsigned int> retry_ms;
+
+  void run() {
+    typedef std::chrono::steady_clock clock;
+    const bool paced = rate_hz > 0;
+    const clock::duration period =
+        paced ? std::chrono::duration_cast<clock::duration>(
+                    std::chrono::duration<double>(1.0 / rate_hz))
+              : clock::duration::zero();
+    clock::time_point deadline = clock::now();
+
+    Sample s;
+    while (active) {
+      if (acquire(s)) {
+        buffer.Push(s);
+        ++samples;
+      } else {
+        ++failures;
+        if (!paced)
+          std::this_thread::sleep_for(std::chrono::milliseconds(retry_ms));
+      }
+      if (!paced)
+        continue;
+      deadline += period;
+      clock::time_point now = clock::now();
+      if (deadline < now)
+        deadline = now; // fell behind (slow USB): don't burst to catch up
+      std::this_thread::sleep_until(deadline);
+    }
+  }
+};
+
+#endif /* SOURCE_PSUSTREAM_H_ */
@@ -0,0 +1,269 @@
+/*
+ * PSUTelemetry.h
+ *
+ * Latest PSU state in POSIX shared memory, one seqlock slot per board. The
+ * daemon (PSUDaemon.h) is the only writer; any number of local processes map
+ * the region read-only and copy a slot out without locks, system calls or
+ * USB traffic. A reader that races a write sees an odd or changed sequence
+ * number and simply copies again.
+ */
+
+#ifndef SOURCE_PSUTELEMETRY_H_
+#define SOURCE_PSUTELEMETRY_H_
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Heinzinger.h"
+
+#define PSU_TELEMETRY_DEFAULT_NAME "/heinzinger_psu"
+
+struct PSUTelemetrySample {
+  PSUSnapshot snap;   // last readout; snap.ok is false if it failed
+  double t;           // when it was taken (Unix seconds)
+  uint64_t updates;   // readouts published so far
+  uint64_t failures;  // of which failed
+  double max_voltage; // scale of snap.voltage
+  double max_current; // scale of snap.current
+  Setpoint setpoint;  // last setpoint accepted through the daemon
+};
+
+struct PSUTelemetryRegion {
+  static const uint32_t Magic = 0x48545350; // "PSTH"
+  static const uint32_t Version = 1;
+  static const unsigned int MaxBoards = 16;
+  static const unsigned int PathLength = 64;
+
+  struct Slot {
+    std::atomic<uint32_t> seq; // odd while the writer is in the slot
+    char path[PathLength];
+    PSUTelemetrySample sample;
+  };
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t board_count;
+  int32_t writer_pid;
+  std::atomic<uint64_t> heartbeat; // bumped once per poll cycle
+  Slot slots[MaxBoards];
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+                  sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+              "atomics in the shared region must be plain words");
+
+// Creates the region, replacing one left behind by a writer that is gone.
+// Owned by the daemon, unlinked on destruction so stale telemetry does not
+// outlive it.
+class PSUTelemetryWriter {
+public:
+  PSUTelemetryWriter() : region(nullptr), fd(-1) {}
+  PSUTelemetryWriter(const PSUTelemetryWriter &) = delete;
+  ~PSUTelemetryWriter() { close(); }
+
+  bool open(const std::string &shm_name, unsigned int boards) {
+    close();
+    if (boards > PSUTelemetryRegion::MaxBoards)
+      return false;
+    if (running_writer(shm_name) != 0)
+      return false;
+    // A fresh object: an existing one cannot be resized everywhere (macOS).
+    shm_unlink(shm_name.c_str());
+    fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+      return false;
+    if (ftruncate(fd, sizeof(PSUTelemetryRegion)) != 0) {
+      close();
+      return false;
+    }
+    void *p = mmap(nullptr, sizeof(PSUTelemetryRegion), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      close();
+      return false;
+    }
+    name = shm_name;
+    region = static_cast<PSUTelemetryRegion *>(p);
+    // Magic goes in last, so readers reject a half-initialised region.
+    memset((void *)region, 0, sizeof(PSUTelemetryRegion));
+    region->version = PSUTelemetryRegion::Version;
+    region->board_count = boards;
+    region->writer_pid = (int32_t)getpid();
+    std::atomic_thread_fence(std::memory_order_release);
+    region->magic = PSUTelemetryRegion::Magic;
+    return true;
+  }
+
+  void close() {
+    if (region) {
+      region->magic = 0;
+      munmap((void *)region, sizeof(PSUTelemetryRegion));
+      region = nullptr;
+      shm_unlink(name.c_str());
+    }
+    if (fd >= 0)
+      ::close(fd);
+    fd = -1;
+  }
+
+  bool is_open() const { return region != nullptr; }
+
+  // pid of a live process other than this one still publishing under
+  // shm_name, else 0. A writer that died without closing leaves its pid
+  // behind, hence the kill(pid, 0).
+  static int running_writer(const std::string &shm_name) {
+    int f = shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if (f < 0)
+      return 0;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(f, &st) == 0 && (size_t)st.st_size >= sizeof(PSUTelemetryRegion))
+      p = mmap(nullptr, sizeof(PSUTelemetryRegion), PROT_READ, MAP_SHARED, f,
+               0);
+    ::close(f);
+    if (p == MAP_FAILED)
+      return 0;
+    const PSUTelemetryRegion *r = static_cast<const PSUTelemetryRegion *>(p);
+    int pid = r->magic == PSUTelemetryRegion::Magic ? r->writer_pid : 0;
+    munmap(p, sizeof(PSUTelemetryRegion));
+    if (pid <= 0 || pid == (int)getpid())
+      return 0;
+    return kill(pid, 0) == 0 || errno == EPERM ? pid : 0;
+  }
+
+  void set_path(unsigned int board, const std::string &path) {
+    PSUTelemetryRegion::Slot &s = region->slots[board];
+    begin(s);
+    strncpy(s.path, path.c_str(), PSUTelemetryRegion::PathLength - 1);
+    end(s);
+  }
+
+  // Fills in everything but the counters, which are kept here.
+  void publish(unsigned int board, const PSUTelemetrySample &sample) {
+    PSUTelemetryRegion::Slot &s = region->slots[board];
+    begin(s);
+    uint64_t updates = s.sample.updates + 1;
+    uint64_t failures = s.sample.failures + (sample.snap.ok ? 0 : 1);
+    s.sample = sample;
+    s.sample.updates = updates;
+    s.sample.failures = failures;
+    end(s);
+  }
+
+  void heartbeat() { region->heartbeat.fetch_add(1, std::memory_order_release); }
+
+private:
+  PSUTelemetryRegion *region;
+  int fd;
+  std::string name;
+
+  // Single writer, so no CAS is needed to enter the slot.
+  static void begin(PSUTelemetryRegion::Slot &s) {
+    s.seq.store(s.seq.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  static void end(PSUTelemetryRegion::Slot &s) {
+    s.seq.store(s.seq.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+};
+
+class PSUTelemetryReader {
+public:
+  PSUTelemetryReader() : region(nullptr) {}
+  PSUTelemetryReader(const PSUTelemetryReader &) = delete;
+  ~PSUTelemetryReader() { close(); }
+
+  // Fails if no daemon has published under shm_name.
+  bool open(const std::string &shm_name = PSU_TELEMETRY_DEFAULT_NAME) {
+    close();
+    int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(PSUTelemetryRegion))
+      p = mmap(nullptr, sizeof(PSUTelemetryRegion), PROT_READ, MAP_SHARED, fd,
+               0);
+    ::close(fd); // the mapping stays valid
+    if (p == MAP_FAILED)
+      return false;
+    region = static_cast<const PSUTelemetryRegion *>(p);
+    if (region->magic != PSUTelemetryRegion::Magic ||
+        region->version != PSUTelemetryRegion::Version) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (region)
+      munmap((void *)region, sizeof(PSUTelemetryRegion));
+    region = nullptr;
+  }
+
+  bool is_open() const { return region != nullptr; }
+  // False once the daemon has shut down (it clears magic on the way out).
+  bool writer_alive() const {
+    return region && region->magic == PSUTelemetryRegion::Magic;
+  }
+  unsigned int board_count() const { return region ? region->board_count : 0; }
+  int writer_pid() const { return region ? region->writer_pid : 0; }
+  uint64_t heartbeat() const {
+    return region ? region->heartbeat.load(std::memory_order_acquire) : 0;
+  }
+
+  std::string path(unsigned int board) const {
+    char buf[PSUTelemetryRegion::PathLength];
+    PSUTelemetryRegion::Slot const *s = slot(board);
+    if (!s)
+      return std::string();
+    if (!copy(*s, buf, s->path, sizeof(buf)))
+      return std::string();
+    buf[sizeof(buf) - 1] = 0;
+    return buf;
+  }
+
+  bool read(unsigned int board, PSUTelemetrySample &out) const {
+    PSUTelemetryRegion::Slot const *s = slot(board);
+    if (!s)
+      return false;
+    return copy(*s, &out, &s->sample, sizeof(out));
+  }
+
+private:
+  const PSUTelemetryRegion *region;
+
+  PSUTelemetryRegion::Slot const *slot(unsigned int board) const {
+    if (!region || board >= region->board_count)
+      return nullptr;
+    return &region->slots[board];
+  }
+
+  // Gives up if the slot stays locked, i.e. the writer died inside it.
+  static bool copy(const PSUTelemetryRegion::Slot &s, void *dst,
+                   const void *src, size_t n) {
+    for (int attempt = 0; attempt < 1000000; ++attempt) {
+      uint32_t before = s.seq.load(std::memory_order_acquire);
+      if (before & 1)
+        continue;
+      memcpy(dst, src, n);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (s.seq.load(std::memory_order_relaxed) == before)
+        return true;
+    }
+    return false;
+  }
+};
+
+#endif /* SOURCE_PSUTELEMETRY_H_ */
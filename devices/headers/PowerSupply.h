@@ -0,0 +1,201 @@
+/*
+ * PowerSupply.h
+ *
+ * What every supply driver has in common: the Setpoint / PSUSnapshot
+ * vocabulary, capability flags, and IPowerSupply, the interface PSUGroup and
+ * the factory (PSUFactory.h) work with. HeinzingerVia16BitDAC (USB analog
+ * board) and SerialPSU (TDK-Lambda, iseg; tty or Moxa TCP) implement it.
+ * Each call is one virtual dispatch into the driver's own fast path; the
+ * defaults only run where a driver has nothing better (no asynchronous
+ * transport, no native interlock).
+ */
+
+#ifndef SOURCE_POWERSUPPLY_H_
+#define SOURCE_POWERSUPPLY_H_
+
+#include <array>
+#include <functional>
+#include <stdint.h>
+#include <string>
+
+#include "FGTransportStats.h"
+
+// Everything a supply reports in one readback. All fields come from the
+// same query, so voltage and current are sampled at the same moment. The
+// register and ADC fields are the analog board's; other drivers leave them 0.
+struct PSUSnapshot {
+  bool ok;        // false if the readout failed; the other fields are then 0
+  double voltage; // same units as max_voltage
+  double current; // same units as max_current
+  bool relay_on;  // same meaning as is_relay_on()
+  uint16_t daca;  // DAC A readback (voltage setpoint register)
+  uint16_t dacb;  // DAC B readback (current limit register)
+  uint16_t sequence_no;
+  uint16_t errors; // device error word (0xF00 is tolerated, see Query)
+  std::array<int16_t, 4> adca;
+  std::array<uint16_t, 4> adcb;
+};
+
+// Target state for apply(). Only the fields selected by the mask passed to
+// apply() are written; the others are ignored.
+struct Setpoint {
+  double volt;   // same units as max_voltage
+  double curr;   // same units as max_current
+  bool relay_on; // true = output enabled, as with switch_on()
+};
+
+// apply() mask bits; the same values as FGAnalogPSUInterface's SetDACAMask,
+// SetDACBMask and SetRelayMask.
+enum PSUSetMask : uint8_t {
+  PSUSetVoltage = 1,
+  PSUSetCurrent = 2,
+  PSUSetRelay = 4,
+  PSUSetAll = 7
+};
+
+// Native overcurrent/arc protection, see set_interlock().
+struct InterlockTrip {
+  bool tripped;
+  double t;         // timestamp of the offending sample (Unix seconds)
+  double current;   // current at that sample, same units as max_current
+  double slew;      // current slope at that sample, per second
+  bool by_slew;     // true: slew limit, false: max_current
+  bool shutdown_ok; // the voltage-0 + output-off write was acknowledged
+};
+
+// Limit and slew-rate check over a sampled value, in whatever units the
+// caller samples in (the analog board checks raw counts). Timestamps are
+// steady clock seconds (psu_steady_time()), so a wall clock step does not
+// fake or hide a slope. Not thread safe.
+class PSUTripDetector {
+public:
+  PSUTripDetector() : limit(0), slew_limit(0), debounce(1) { reset(); }
+
+  // slew_limit <= 0: no slew check. debounce: consecutive violating samples
+  // needed to trip.
+  void configure(double max_value, double max_slew, int samples) {
+    limit = max_value;
+    slew_limit = max_slew > 0 ? max_slew : 0;
+    debounce = samples < 1 ? 1 : samples;
+    reset();
+  }
+  void reset() {
+    hits = 0;
+    have_prev = false;
+    prev_t = prev_value = 0;
+  }
+
+  // True if this sample completes a run of violations. slew is the rise
+  // rate at this sample; by_slew tells which limit it was.
+  bool check(double t, double value, double &slew, bool &by_slew) {
+    slew = 0;
+    if (have_prev && t > prev_t)
+      slew = (value - prev_value) / (t - prev_t);
+    have_prev = true;
+    prev_value = value;
+    prev_t = t;
+    const bool over_limit = value > limit;
+    const bool over_slew = slew_limit > 0 && slew > slew_limit;
+    if (!(over_limit || over_slew)) {
+      hits = 0;
+      return false;
+    }
+    by_slew = !over_limit;
+    return ++hits >= debounce;
+  }
+
+private:
+  double limit, slew_limit;
+  int debounce, hits;
+  bool have_prev;
+  double prev_t, prev_value;
+};
+
+// Capability flags, see IPowerSupply::capabilities().
+enum PSUCapability : uint32_t {
+  PSUCapRelay = 1 << 0,     // output can be switched (switch_on/off)
+  PSUCapStream = 1 << 1,    // start_stream() runs a native sampling thread
+  PSUCapAsync = 1 << 2,     // *_async calls never block the caller
+  PSUCapInterlock = 1 << 3, // set_interlock() shuts down from the stream
+  PSUCapRawADC = 1 << 4,    // snapshots carry raw DAC/ADC registers
+  PSUCapHotplug = 1 << 5    // reconnects by itself after unplug / link loss
+};
+
+class IPowerSupply {
+public:
+  typedef std::function<void(const PSUSnapshot &)> AsyncCallback;
+
+  virtual ~IPowerSupply() {}
+
+  virtual std::string model() const = 0;
+  virtual uint32_t capabilities() const = 0;
+  bool has(uint32_t caps) const { return (capabilities() & caps) == caps; }
+  virtual double max_voltage() const = 0;
+  virtual double max_current() const = 0;
+
+  virtual bool apply(const Setpoint &sp, uint8_t mask = PSUSetAll,
+                     bool force = false) = 0;
+  virtual PSUSnapshot read_snapshot() = 0;
+  virtual bool is_relay_on() const = 0;
+
+  // Completion with the readback; snapshot.ok is false if the write was not
+  // acknowledged. The defaults run synchronously, done before returning.
+  virtual void read_snapshot_async(AsyncCallback done) {
+    done(read_snapshot());
+  }
+  virtual void apply_async(const Setpoint &sp, uint8_t mask,
+                           AsyncCallback done) {
+    bool ok = apply(sp, mask, true);
+    PSUSnapshot snap = read_snapshot();
+    snap.ok = snap.ok && ok;
+    done(snap);
+  }
+
+  virtual bool start_stream(double rate_hz, size_t capacity = 65536) = 0;
+  virtual void stop_stream() = 0;
+  virtual bool is_streaming() const = 0;
+
+  // While streaming, shut the output down once the current exceeds
+  // max_current or rises faster than max_slew; see PSUCapInterlock.
+  virtual void set_interlock(double max_current, double max_slew = 0,
+                             int debounce = 1) = 0;
+  virtual void disable_interlock() = 0;
+  virtual bool interlock_tripped() const = 0;
+  virtual InterlockTrip interlock_trip() const = 0;
+  virtual void reset_interlock() = 0;
+
+  // Brings the link up now instead of on the first call that needs it
+  // (drivers built lazily, links that went away); true if it is up.
+  virtual bool open() { return is_open(); }
+  virtual bool is_open() const { return true; }
+
+  virtual FGTransportStats::Snapshot get_stats() const = 0;
+  virtual void reset_stats() = 0;
+
+  // Through apply(), so they behave alike on every driver. Relay calls fail
+  // on supplies without PSUCapRelay.
+  bool set_voltage(double volt, bool force = false) {
+    Setpoint sp = {volt, 0, false};
+    return apply(sp, PSUSetVoltage, force);
+  }
+  bool set_current(double curr, bool force = false) {
+    Setpoint sp = {0, curr, false};
+    return apply(sp, PSUSetCurrent, force);
+  }
+  bool switch_on(bool force = false) {
+    Setpoint sp = {0, 0, true};
+    return has(PSUCapRelay) && apply(sp, PSUSetRelay, force);
+  }
+  bool switch_off(bool force = false) {
+    Setpoint sp = {0, 0, false};
+    return has(PSUCapRelay) && apply(sp, PSUSetRelay, force);
+  }
+  // Voltage to 0 and output off in one write, always sent.
+  bool shutdown() {
+    Setpoint off = {0.0, 0.0, false};
+    return apply(off, PSUSetVoltage | (has(PSUCapRelay) ? PSUSetRelay : 0),
+                 true);
+  }
+};
+
+#endif /* SOURCE_POWERSUPPLY_H_ */
@@ -0,0 +1,90 @@
+/*
+ * SPSCRing.h
+ *
+ * Fixed-capacity single-producer/single-consumer ring buffer. The storage is
+ * allocated once; Push() and Peek()/Pop() never allocate or lock, so it can
+ * sit between an acquisition thread and a consumer that reads the samples in
+ * place (e.g. as a NumPy view). The storage is shared: Resize() allocates
+ * anew, and the old block lives on as long as a Storage() handle holds it.
+ */
+
+#ifndef SOURCE_SPSCRING_H_
+#define SOURCE_SPSCRING_H_
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+template <class T> class FGSPSCRing {
+private:
+  std::shared_ptr<std::vector<T>> Buffer;
+  T *Slots; // Buffer's elements
+  size_t Mask;
+  // Free-running counters; the slot is Counter & Mask.
+  std::atomic<size_t> Head; // next slot the producer writes
+  std::atomic<size_t> Tail; // next slot the consumer reads
+  std::atomic<uint64_t> Overruns;
+
+public:
+  // Capacity is rounded up to a power of two.
+  explicit FGSPSCRing(size_t Capacity = 1024) : Head(0), Tail(0), Overruns(0) {
+    Resize(Capacity);
+  }
+  FGSPSCRing(const FGSPSCRing &) = delete;
+
+  // Not thread-safe: only while neither side is running.
+  void Resize(size_t Capacity) {
+    size_t Size = 1;
+    while (Size < Capacity)
+      Size <<= 1;
+    Buffer = std::make_shared<std::vector<T>>(Size, T());
+    Slots = Buffer->data();
+    Mask = Size - 1;
+    Head = 0;
+    Tail = 0;
+    Overruns = 0;
+  }
+
+  size_t Capacity() const { return Mask + 1; }
+  size_t Size() const { return Head.load(std::memory_order_acquire) -
+                               Tail.load(std::memory_order_acquire); }
+  uint64_t OverrunCount() const { return Overruns.load(); }
+  // Keeps the current storage allocated, e.g. for views onto Peek() data
+  // that may outlive the next Resize().
+  std::shared_ptr<const void> Storage() const { return Buffer; }
+
+  // Producer side. A full ring drops the new element and counts an overrun
+  // rather than overwriting data the consumer may still be reading.
+  bool Push(const T &Item) {
+    size_t H = Head.load(std::memory_order_relaxed);
+    if (H - Tail.load(std::memory_order_acquire) > Mask) {
+      Overruns.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    Slots[H & Mask] = Item;
+    Head.store(H + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side: longest contiguous run of unread elements (at most Max),
+  // without consuming it. The elements stay valid until Pop() releases them.
+  size_t Peek(const T *&Data, size_t Max = ~(size_t)0) const {
+    size_t T0 = Tail.load(std::memory_order_relaxed);
+    size_t Available = Head.load(std::memory_order_acquire) - T0;
+    size_t Contiguous = Capacity() - (T0 & Mask);
+    size_t Count = Available < Contiguous ? Available : Contiguous;
+    if (Count > Max)
+      Count = Max;
+    Data = &Slots[T0 & Mask];
+    return Count;
+  }
+
+  void Pop(size_t Count) {
+    Tail.store(Tail.load(std::memory_order_relaxed) + Count,
+               std::memory_order_release);
+  }
+};
+
+#endif /* SOURCE_SPSCRING_H_ */
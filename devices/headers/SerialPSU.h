@@ -0,0 +1,617 @@
+/*
+ * SerialPSU.h
+ *
+ * Drivers for the supplies on a serial line instead of the analog board.
+ * They implement IPowerSupply like HeinzingerVia16BitDAC (apply() with the
+ * same mask bits, read_snapshot(), streaming, interlock, transport stats),
+ * so groups and scripts drive either kind the same way. A protocol struct
+ * spells the commands and parses the replies; SerialPSU does the I/O,
+ * pipelining a multi-field apply() or a snapshot into one FGSerialLine
+ * batch:
+ *
+ *   TDKLambdaPSU tdk("/dev/ttyUSB0", TDKLambdaGenesys(6), 60.0, 12.5);
+ *   IsegPSU hv("/dev/ttyUSB1", IsegSCPI(0), 3000.0, 0.005);
+ *   TDKLambdaPSU moxa("tcp://192.168.1.20:4001", TDKLambdaGenesys(6), 60, 12.5);
+ *
+ * Voltages in V, currents in A, as the supplies report them.
+ */
+
+#ifndef SOURCE_SERIALPSU_H_
+#define SOURCE_SERIALPSU_H_
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "FGSerialLine.h"
+#include "PSUStream.h"
+#include "PowerSupply.h"
+
+// One streamed read_snapshot(). Plain layout, for NumPy like PSUStreamSample.
+struct SerialPSUSample {
+  double t; // Unix seconds, when the readback was requested
+  double voltage;
+  double current;
+  uint8_t output_on;
+};
+
+inline FGSerialCommand serial_command(const std::string &text, bool reply) {
+  FGSerialCommand c = {text, reply};
+  return c;
+}
+
+inline std::string serial_number(const char *format, double value) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), format, value);
+  return buf;
+}
+
+// Leading number of a reply; trailing units ("1.234E3V") are ignored.
+inline bool serial_parse(const std::string &reply, double &value) {
+  const char *begin = reply.c_str();
+  char *end;
+  value = strtod(begin, &end);
+  return end != begin;
+}
+
+// TDK-Lambda Genesys / Z+ in the RS-232/485 language. Every command,
+// settings included, is answered with a line ("OK", a value or an error
+// code such as "E01"), so several can be written ahead of their replies.
+struct TDKLambdaGenesys {
+  int address; // ADR, 0-30 on a multi-drop bus
+  bool reset;  // RST at the first bring-up: output off, factory defaults
+
+  explicit TDKLambdaGenesys(int address = 6, bool reset = true)
+      : address(address), reset(reset) {}
+
+  static constexpr const char *name() { return "TDK-Lambda Genesys"; }
+  static constexpr const char *terminator() { return "\r"; }
+  static constexpr bool echoes() { return false; }
+  static constexpr unsigned int pipeline_depth() { return 4; }
+
+  // first is false when reopening a lost line: the output stays as it is.
+  std::vector<FGSerialCommand> init(bool first) const {
+    std::vector<FGSerialCommand> c;
+    c.push_back(serial_command("ADR " + std::to_string(address), true));
+    c.push_back(serial_command("CLS", true));
+    if (reset && first)
+      c.push_back(serial_command("RST", true));
+    c.push_back(serial_command("RMT REM", true));
+    return c;
+  }
+  static FGSerialCommand identify() { return serial_command("IDN?", true); }
+  static bool replies(const std::string &) { return true; }
+  static bool acknowledged(const FGSerialCommand &, const std::string &reply) {
+    return reply == "OK";
+  }
+
+  static FGSerialCommand set_voltage(double v) {
+    return serial_command(serial_number("PV %.3f", v), true);
+  }
+  static FGSerialCommand set_current(double a) {
+    return serial_command(serial_number("PC %.3f", a), true);
+  }
+  static FGSerialCommand output(bool on) {
+    return serial_command(on ? "OUT 1" : "OUT 0", true);
+  }
+  static FGSerialCommand measure_voltage() {
+    return serial_command("MV?", true);
+  }
+  static FGSerialCommand measure_current() {
+    return serial_command("MC?", true);
+  }
+
+  static std::vector<FGSerialCommand> readback() {
+    std::vector<FGSerialCommand> c;
+    c.push_back(measure_voltage());
+    c.push_back(measure_current());
+    c.push_back(serial_command("OUT?", true));
+    return c;
+  }
+  static bool parse_readback(const std::vector<std::string> &r, double &volt,
+                             double &curr, bool &on) {
+    if (r.size() != 3 || !serial_parse(r[0], volt) ||
+        !serial_parse(r[1], curr))
+      return false;
+    on = r[2] == "ON" || r[2] == "1";
+    return on || r[2] == "OFF" || r[2] == "0";
+  }
+};
+
+// iseg SHR/SHQ/HPS in SCPI. The device echoes every command line; only
+// queries are answered beyond that, and answers carry a unit suffix. It is
+// kept to one command in flight, but the snapshot is one ';'-chained line.
+// The HVMICC safety state is left alone: acknowledge it by hand with
+// command(":CONF:HVMICC HV_OK") where the setup allows.
+struct IsegSCPI {
+  int channel;
+
+  explicit IsegSCPI(int channel = 0) : channel(channel) {}
+
+  static constexpr const char *name() { return "iseg"; }
+  static constexpr const char *terminator() { return "\r\n"; }
+  static constexpr bool echoes() { return true; }
+  static constexpr unsigned int pipeline_depth() { return 1; }
+
+  std::vector<FGSerialCommand> init(bool) const {
+    return std::vector<FGSerialCommand>();
+  }
+  static FGSerialCommand identify() { return serial_command("*IDN?", true); }
+  static bool replies(const std::string &cmd) {
+    return cmd.find('?') != std::string::npos;
+  }
+  // Settings have no reply; the echo (checked by FGSerialLine) is the ack.
+  static bool acknowledged(const FGSerialCommand &, const std::string &) {
+    return true;
+  }
+
+  FGSerialCommand set_voltage(double v) const {
+    return serial_command(serial_number(":VOLT %.3f", v) + at(), false);
+  }
+  FGSerialCommand set_current(double a) const {
+    return serial_command(serial_number(":CURR %.6E", a) + at(), false);
+  }
+  FGSerialCommand output(bool on) const {
+    return serial_command((on ? ":VOLT ON" : ":VOLT OFF") + at(), false);
+  }
+  FGSerialCommand measure_voltage() const {
+    return serial_command(":MEAS:VOLT? (@" + ch() + ")", true);
+  }
+  FGSerialCommand measure_current() const {
+    return serial_command(":MEAS:CURR? (@" + ch() + ")", true);
+  }
+
+  std::vector<FGSerialCommand> readback() const {
+    std::vector<FGSerialCommand> c;
+    c.push_back(serial_command(measure_voltage().Text + ";" +
+                                   measure_current().Text +
+                                   ";:READ:VOLT:ON? (@" + ch() + ")",
+                               true));
+    return c;
+  }
+  static bool parse_readback(const std::vector<std::string> &r, double &volt,
+                             double &curr, bool &on) {
+    if (r.size() != 1)
+      return false;
+    size_t a = r[0].find(';');
+    size_t b = a == std::string::npos ? a : r[0].find(';', a + 1);
+    double state;
+    if (b == std::string::npos || !serial_parse(r[0], volt) ||
+        !serial_parse(r[0].substr(a + 1), curr) ||
+        !serial_parse(r[0].substr(b + 1), state))
+      return false;
+    on = state != 0;
+    return true;
+  }
+
+private:
+  std::string ch() const { return std::to_string(channel); }
+  std::string at() const { return ",(@" + ch() + ")"; }
+};
+
+template <class Protocol> class SerialPSU : public IPowerSupply {
+public:
+  typedef Protocol protocol_type;
+
+  // Brings the supply up unless lazy. One that does not answer is reported
+  // and left closed; open() or the first call that needs it tries again.
+  SerialPSU(const std::string &port, const Protocol &protocol,
+            double max_voltage, double max_current, unsigned int baud = 9600,
+            bool verbose = false, bool lazy = false)
+      : protocol(protocol), port(port), baud(baud), max_volt(max_voltage),
+        max_curr(max_current), verbose(verbose), brought_up(false),
+        relay(false), sequence(0), ilk_enabled(false), ilk_tripped(false),
+        stream_lent(0) {
+    line.Terminator = Protocol::terminator();
+    line.Echo = Protocol::echoes();
+    line.Window = Protocol::pipeline_depth();
+    line.Stats = &stats;
+    forget_setpoints();
+    memset(&ilk_trip, 0, sizeof(ilk_trip));
+    if (lazy)
+      return;
+    std::lock_guard<std::mutex> lock(io_mutex);
+    if (!open_locked())
+      Shout(std::string("Unable to bring up ") + Protocol::name() + " on " +
+            port + "; retrying on the next call");
+  }
+  SerialPSU(const SerialPSU &) = delete;
+  ~SerialPSU() { stream.stop(); }
+
+  std::string model() const override { return Protocol::name(); }
+  uint32_t capabilities() const override {
+    return PSUCapRelay | PSUCapStream | PSUCapInterlock | PSUCapHotplug;
+  }
+
+  bool is_open() const override { return (bool)line; }
+  bool open() override {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    return (bool)line || open_locked();
+  }
+  const std::string &identity() const { return ident; }
+  const std::string &port_name() const { return port; }
+  double max_voltage() const override { return max_volt; }
+  double max_current() const override { return max_curr; }
+
+  // Replies slower than this count as lost (default 500 ms).
+  void set_timeout_ms(int ms) {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    line.TimeoutMs = ms;
+  }
+  // Commands written ahead of their replies; 1 disables pipelining.
+  void set_pipeline_depth(unsigned int depth) {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    line.Window = depth ? depth : 1;
+  }
+
+  // Writes the fields of sp selected by mask (PSUSetVoltage, PSUSetCurrent,
+  // PSUSetRelay) as one batch. Fields the supply already acknowledged are
+  // skipped unless force. Turning the output off goes out first and turning
+  // it on last, so the output never sees a half-applied setpoint.
+  bool apply(const Setpoint &sp, uint8_t mask = PSUSetAll,
+             bool force = false) override {
+    // Checked under the lock the stream thread trips with, so a raise
+    // cannot slip out after the interlock's shutdown.
+    std::lock_guard<std::mutex> lock(io_mutex);
+    if (ilk_trip.tripped && (((mask & PSUSetVoltage) && sp.volt > 0) ||
+                             ((mask & PSUSetRelay) && sp.relay_on))) {
+      std::cerr << "Interlock tripped; call reset_interlock() before raising "
+                   "the output again\n";
+      return false;
+    }
+    if ((mask & PSUSetVoltage) && (sp.volt > max_volt || sp.volt < 0)) {
+      std::cerr << "Set voltage value lies outside of device's specified range\n";
+      return false;
+    }
+    if ((mask & PSUSetCurrent) && (sp.curr > max_curr || sp.curr < 0)) {
+      std::cerr << "Set current value lies outside of device's specified range\n";
+      return false;
+    }
+    return apply_locked(sp, mask, force);
+  }
+
+  // Output state from the last acknowledged switch or readback.
+  bool is_relay_on() const override { return relay; }
+
+  // Measured output values; -1 if the supply did not answer.
+  double read_voltage() { return measure(protocol.measure_voltage()); }
+  double read_current() { return measure(protocol.measure_current()); }
+
+  // Voltage, current and output state in one batch. daca, dacb, errors and
+  // the ADC arrays have no meaning here and are 0.
+  PSUSnapshot read_snapshot() override {
+    PSUSnapshot snap;
+    std::lock_guard<std::mutex> lock(io_mutex);
+    read_locked(snap);
+    return snap;
+  }
+
+  // Raw command line, e.g. query("*IDN?") or query(":CONF:HVMICC?"); returns
+  // the reply, "" without one or on timeout.
+  std::string query(const std::string &cmd) {
+    std::string reply;
+    std::lock_guard<std::mutex> lock(io_mutex);
+    if (ensure_open_locked())
+      line.Transact(cmd, Protocol::replies(cmd), reply);
+    return reply;
+  }
+  // Raw setting; true if the supply acknowledged it. The setpoint cache is
+  // dropped, as the command may have gone around it.
+  bool command(const std::string &cmd) {
+    std::string reply;
+    std::lock_guard<std::mutex> lock(io_mutex);
+    forget_setpoints();
+    FGSerialCommand c = serial_command(cmd, Protocol::replies(cmd));
+    return ensure_open_locked() && line.Transact(cmd, c.Reply, reply) &&
+           (!c.Reply || protocol.acknowledged(c, reply));
+  }
+
+  // As HeinzingerVia16BitDAC: read_snapshot() at rate_hz on a background
+  // thread into a ring of `capacity` samples, checked against the
+  // interlock. Other calls keep working.
+  bool start_stream(double rate_hz, size_t capacity = 65536) override {
+    bool started = stream.start(rate_hz, capacity, [this](SerialPSUSample &s) {
+      PSUSnapshot snap;
+      s.t = psu_wall_time();
+      const double now = psu_steady_time(); // for the slew
+      std::lock_guard<std::mutex> lock(io_mutex);
+      // An interlock shutdown the supply has not acknowledged is resent
+      // every sample until it is, whether the readbacks work or not.
+      if (ilk_trip.tripped && !ilk_trip.shutdown_ok)
+        ilk_trip.shutdown_ok = interlock_shutdown();
+      if (!read_locked(snap))
+        return false;
+      s.voltage = snap.voltage;
+      s.current = snap.current;
+      s.output_on = snap.relay_on;
+      if (ilk_enabled)
+        check_interlock(s, now);
+      return true;
+    });
+    if (started)
+      stream_lent = 0; // else the lent block is still the consumer's
+    return started;
+  }
+  void stop_stream() override {
+    stream.stop();
+    stream_lent = 0;
+  }
+  bool is_streaming() const override { return stream.running(); }
+  size_t borrow_stream(const SerialPSUSample *&data, size_t max_samples,
+                       std::shared_ptr<const void> *storage = nullptr) {
+    stream.ring().Pop(stream_lent);
+    stream_lent = stream.ring().Peek(data, max_samples);
+    if (storage)
+      *storage = stream.ring().Storage();
+    return stream_lent;
+  }
+  uint64_t stream_samples() const { return stream.sample_count(); }
+  uint64_t stream_failures() const { return stream.failure_count(); }
+  uint64_t stream_overruns() const { return stream.ring().OverrunCount(); }
+
+  // Queries count commands, QueryLatency is per command from its write to
+  // its reply; Timeouts, LinkLosses and Reconnects as on USB.
+  FGTransportStats::Snapshot get_stats() const override {
+    return stats.Read();
+  }
+  void reset_stats() override { stats.Reset(); }
+
+  // As HeinzingerVia16BitDAC::set_interlock, on the streamed readbacks (so
+  // the reaction time is one stream period plus a batch of two commands).
+  void set_interlock(double max_current, double max_slew = 0,
+                     int debounce = 1) override {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    ilk_detector.configure(max_current, max_slew, debounce);
+    ilk_enabled = true;
+  }
+  void disable_interlock() override {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    ilk_enabled = false;
+  }
+  bool interlock_tripped() const override { return ilk_tripped; }
+  InterlockTrip interlock_trip() const override {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    return ilk_trip;
+  }
+  void reset_interlock() override {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    memset(&ilk_trip, 0, sizeof(ilk_trip));
+    ilk_tripped = false;
+    ilk_detector.reset();
+  }
+
+private:
+  Protocol protocol;
+  const std::string port;
+  const unsigned int baud;
+  const double max_volt;
+  const double max_curr;
+  const bool verbose;
+  bool brought_up; // init has succeeded once
+  std::string ident;
+
+  FGSerialLine line;
+  FGTransportStats stats;
+  mutable std::mutex io_mutex; // guards line, acked, sequence, ilk_*
+  std::chrono::steady_clock::time_point last_open;
+
+  // Last value of each field the supply acknowledged.
+  struct {
+    bool volt_known, curr_known, out_known;
+    double volt, curr;
+    bool out;
+  } acked;
+  std::atomic<bool> relay;
+  uint16_t sequence;
+
+  bool ilk_enabled;
+  PSUTripDetector ilk_detector; // amperes, amperes per second
+  InterlockTrip ilk_trip;
+  std::atomic<bool> ilk_tripped; // lock-free copy of ilk_trip.tripped
+
+  PSUStream<SerialPSUSample> stream;
+  size_t stream_lent;
+
+  bool apply_locked(const Setpoint &sp, uint8_t mask, bool force) {
+    if (!ensure_open_locked())
+      return false;
+    std::vector<FGSerialCommand> cmds;
+    std::vector<uint8_t> fields;
+    const bool out = (mask & PSUSetRelay) &&
+                     (force || !acked.out_known || acked.out != sp.relay_on);
+    if (out && !sp.relay_on) {
+      cmds.push_back(protocol.output(false));
+      fields.push_back(PSUSetRelay);
+    }
+    if ((mask & PSUSetVoltage) &&
+        (force || !acked.volt_known || acked.volt != sp.volt)) {
+      cmds.push_back(protocol.set_voltage(sp.volt));
+      fields.push_back(PSUSetVoltage);
+    }
+    if ((mask & PSUSetCurrent) &&
+        (force || !acked.curr_known || acked.curr != sp.curr)) {
+      cmds.push_back(protocol.set_current(sp.curr));
+      fields.push_back(PSUSetCurrent);
+    }
+    if (out && sp.relay_on) {
+      cmds.push_back(protocol.output(true));
+      fields.push_back(PSUSetRelay);
+    }
+    if (cmds.empty())
+      return true;
+
+    // A leading output-off is confirmed on its own before the rest is
+    // written: if the supply refuses it, a voltage raise behind it must not
+    // reach a live output.
+    std::vector<std::string> replies;
+    size_t done;
+    bool held_back = false;
+    if (out && !sp.relay_on && cmds.size() > 1) {
+      std::vector<FGSerialCommand> rest(cmds.begin() + 1, cmds.end());
+      std::vector<std::string> more;
+      done = line.Transact(std::vector<FGSerialCommand>(1, cmds[0]), replies);
+      if (done == 1 && (!cmds[0].Reply ||
+                        protocol.acknowledged(cmds[0], replies[0])))
+        done += line.Transact(rest, more);
+      else
+        held_back = true;
+      replies.insert(replies.end(), more.begin(), more.end());
+      replies.resize(cmds.size());
+    } else {
+      done = line.Transact(cmds, replies);
+    }
+    bool ok = true;
+    for (size_t i = 0; i < cmds.size(); ++i) {
+      const bool acked_i =
+          i < done &&
+          (!cmds[i].Reply || protocol.acknowledged(cmds[i], replies[i]));
+      if (i < done && !acked_i)
+        Shout(std::string(Protocol::name()) + " refused '" + cmds[i].Text +
+              "': " + replies[i]);
+      ok = ok && acked_i;
+      switch (fields[i]) {
+      case PSUSetVoltage:
+        acked.volt_known = acked_i;
+        acked.volt = sp.volt;
+        break;
+      case PSUSetCurrent:
+        acked.curr_known = acked_i;
+        acked.curr = sp.curr;
+        break;
+      default:
+        acked.out_known = acked_i;
+        acked.out = sp.relay_on;
+        if (acked_i)
+          relay = sp.relay_on;
+        break;
+      }
+    }
+    if (held_back)
+      Shout(std::string(Protocol::name()) +
+            ": output off not confirmed, rest of the batch not sent");
+    return ok;
+  }
+
+  // Stream thread, io_mutex held. now is psu_steady_time().
+  void check_interlock(const SerialPSUSample &s, double now) {
+    double slew;
+    bool by_slew;
+    if (!ilk_detector.check(now, s.current, slew, by_slew) ||
+        ilk_trip.tripped)
+      return; // an unacknowledged shutdown is retried before the readback
+    ilk_trip.tripped = true;
+    ilk_tripped = true;
+    ilk_trip.t = s.t;
+    ilk_trip.current = s.current;
+    ilk_trip.slew = slew;
+    ilk_trip.by_slew = by_slew;
+    ilk_trip.shutdown_ok = interlock_shutdown();
+    std::cerr << "Interlock tripped at " << ilk_trip.current
+              << (ilk_trip.by_slew ? " (slew limit)" : " (current limit)")
+              << (ilk_trip.shutdown_ok ? ", output shut down\n"
+                                       : ", shutdown not acknowledged, "
+                                         "retrying every sample\n");
+  }
+
+  // Stream thread, io_mutex held: output off, then voltage 0, always sent.
+  bool interlock_shutdown() {
+    Setpoint off = {0.0, 0.0, false};
+    return apply_locked(off, PSUSetVoltage | PSUSetRelay, true);
+  }
+
+  void forget_setpoints() {
+    acked.volt_known = acked.curr_known = acked.out_known = false;
+    acked.volt = acked.curr = 0;
+    acked.out = false;
+  }
+
+  // Opens the port and sends the protocol's init burst plus the identity
+  // query, pipelined.
+  bool open_locked() {
+    last_open = std::chrono::steady_clock::now();
+    if (!line.Open(port, baud))
+      return false;
+    std::vector<FGSerialCommand> cmds = protocol.init(!brought_up);
+    cmds.push_back(Protocol::identify());
+    std::vector<std::string> replies;
+    size_t done = line.Transact(cmds, replies);
+    for (size_t i = 0; i + 1 < cmds.size(); ++i)
+      if (i >= done || !protocol.acknowledged(cmds[i], replies[i])) {
+        Shout(std::string(Protocol::name()) + " on " + port +
+              " did not acknowledge '" + cmds[i].Text + "'" +
+              (i < done ? ": " + replies[i] : std::string()));
+        line.Close();
+        return false;
+      }
+    if (done != cmds.size()) {
+      line.Close();
+      return false;
+    }
+    ident = replies.back();
+    brought_up = true;
+    if (verbose)
+      std::cout << Protocol::name() << " on " << port << ": " << ident
+                << std::endl;
+    return true;
+  }
+
+  // A line that went away (adapter unplugged, connection dropped) is
+  // reopened at most once a second; the supply may have been power cycled,
+  // so the cache goes too.
+  bool ensure_open_locked() {
+    if (line)
+      return true;
+    if (std::chrono::steady_clock::now() - last_open <
+        std::chrono::seconds(1)) {
+      FGTransportStats::Bump(stats.Refused);
+      return false;
+    }
+    forget_setpoints();
+    if (!open_locked())
+      return false;
+    FGTransportStats::Bump(stats.Reconnects);
+    return true;
+  }
+
+  bool read_locked(PSUSnapshot &snap) {
+    memset(&snap, 0, sizeof(snap));
+    if (!ensure_open_locked())
+      return false;
+    std::vector<FGSerialCommand> cmds = protocol.readback();
+    std::vector<std::string> replies;
+    bool on = false;
+    if (line.Transact(cmds, replies) != cmds.size() ||
+        !Protocol::parse_readback(replies, snap.voltage, snap.current, on)) {
+      snap.voltage = snap.current = 0;
+      return false;
+    }
+    snap.ok = true;
+    snap.relay_on = on;
+    snap.sequence_no = sequence++;
+    relay = on;
+    return true;
+  }
+
+  double measure(const FGSerialCommand &cmd) {
+    std::string reply;
+    double value;
+    std::lock_guard<std::mutex> lock(io_mutex);
+    if (!ensure_open_locked() || !line.Transact(cmd.Text, true, reply) ||
+        !serial_parse(reply, value))
+      return -1;
+    return value;
+  }
+};
+
+typedef SerialPSU<TDKLambdaGenesys> TDKLambdaPSU;
+typedef SerialPSU<IsegSCPI> IsegPSU;
+
+#endif /* SOURCE_SERIALPSU_H_ */
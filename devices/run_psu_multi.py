@@ -1,28 +1,26 @@
+import importlib
 import sys
 import os
-import time
-import subprocess
-import sysconfig
 
 # --- Configuration ---
 # Path to the directory where your .so module was built
 MODULE_BUILD_DIR = os.path.join(os.path.dirname(__file__), 'build')
 
-# The expected name of your compiled module.
-MODULE_FILENAME = (
-     'heinzinger_control' + sysconfig.get_config_var('EXT_SUFFIX')
-)
 PYTHON_MODULE_NAME = 'heinzinger_control' 
 CPP_CLASS_NAME_IN_PYTHON = 'HeinzingerPSU'
 
 # --- USB Path Configuration ---
 # USB paths for reliable device identification (keep PSUs in same physical ports!)
+# Either the macOS locationID ("@00110000"), the Linux bus-port form ("1-1.2")
+# or "sn:<serial>". heinzinger_control.list_board_paths() shows what is attached.
 USB_PATH_HEINZINGER = "@00110000"  # Heinzinger PSU (30kV, no relay)
 USB_PATH_FUG = "@00120000"         # FUG PSU (50kV, with relay)
 
 # --- Global variables for PSU instances ---
 _psu_instances = {}  # Dictionary to store multiple PSU instances by device_index
 _module_loaded = False
+_psu_group = None  # heinzinger_control.PSUGroup over _psu_instances
+_psu_group_keys = ()
 
 def setup_module_path_and_load():
     """
@@ -32,25 +30,16 @@ def setup_module_path_and_load():
     for better performance. Before we can use that C++ code from Python, we need
     to load it like loading a library book from a specific shelf.
     
-    This function does three main things:
-    1. Tells Python where to find the C++ code file (in the 'build' folder)
-    2. Checks that the code file actually exists there
-    3. Loads the C++ code so Python can use it
+    This function does two main things:
+    1. Imports the C++ code directly if Python can already find it
+    2. Otherwise tells Python to look in the 'build' folder and tries again
     
     Returns:
         bool: True if everything loaded successfully, False if something went wrong
     
-    What This Function Does:
-        - Adds the 'build' folder to Python's search path
-        - Looks for the compiled C++ module file (ends in .so on Linux/Mac)
-        - Imports the C++ code so other functions can use it
-        - Prints helpful messages about what's happening
-        - Sets a flag so we know the module is ready to use
-    
     Common Problems:
-        - "Build directory not found" = The C++ code hasn't been compiled yet
-        - "Module file not found" = Compilation failed or file was moved
-        - "Failed to import" = The compiled code has missing dependencies
+        - "Failed to import" = The C++ code hasn't been compiled yet, the
+          compiled file was moved, or it has missing dependencies
     
     Notes:
         - Safe to call multiple times (won't reload if already loaded)
@@ -62,39 +51,28 @@ def setup_module_path_and_load():
     if _module_loaded:
         return True
 
-    if not os.path.isdir(MODULE_BUILD_DIR):
-        print(f"ERROR: Build directory not found at {MODULE_BUILD_DIR}")
-        _module_loaded = False
-        return False
-
-    sys.path.insert(0, MODULE_BUILD_DIR)
-    print(f"Added '{MODULE_BUILD_DIR}' to sys.path.")
-
-    so_file_path = os.path.join(MODULE_BUILD_DIR, MODULE_FILENAME)
-    if not os.path.exists(so_file_path):
-        print(f"ERROR: Module file not found at {so_file_path}")
-        print("Please ensure you've built the module correctly and it's in the build directory.")
-        _module_loaded = False
-        return False
-    else:
-        print(f"Module file found at {so_file_path}")
-
-    # Try to import the module
+    # Already importable (installed, or build/ on PYTHONPATH): no path
+    # changes and no file checks, the import itself is the check.
     try:
-        module = __import__(PYTHON_MODULE_NAME)
-        globals()[PYTHON_MODULE_NAME] = module 
-        print(f"Successfully imported '{PYTHON_MODULE_NAME}' module.")
-        _module_loaded = True
-        return True 
-    except ImportError as e:
-        print(f"ERROR: Failed to import '{PYTHON_MODULE_NAME}' module.")
-        print(f"Import error details: {e}")
-        _module_loaded = False
-        return False
-    except Exception as e:
-        print(f"An unexpected error occurred during import: {e}")
-        _module_loaded = False
-        return False
+        module = importlib.import_module(PYTHON_MODULE_NAME)
+    except ImportError:
+        module = None
+    if module is None:
+        if MODULE_BUILD_DIR not in sys.path:
+            sys.path.insert(0, MODULE_BUILD_DIR)
+        try:
+            module = importlib.import_module(PYTHON_MODULE_NAME)
+        except ImportError as e:
+            print(f"ERROR: Failed to import '{PYTHON_MODULE_NAME}' from "
+                  f"{MODULE_BUILD_DIR}: {e}")
+            print("Please ensure you've built the module (cmake and make in "
+                  "the 'build' folder).")
+            _module_loaded = False
+            return False
+
+    globals()[PYTHON_MODULE_NAME] = module
+    _module_loaded = True
+    return True
 
 def initialize_psu_by_path(usb_path, max_v=30000.0, max_c=25, verb=False, max_in_v=10.0):
     """
@@ -129,13 +107,14 @@ def initialize_psu_by_path(usb_path, max_v=30000.0, max_c=25, verb=False, max_in
         cpp_module = globals()[PYTHON_MODULE_NAME]
         cpp_class = getattr(cpp_module, CPP_CLASS_NAME_IN_PYTHON)
         
-        # Create PSU instance using USB path
-        psu_instance = cpp_class(usb_path, max_v, max_c, verb, max_in_v)
+        # Create PSU instance using USB path. lazy: the board is opened by
+        # the first command (or open_all_psus()), not here.
+        psu_instance = cpp_class(usb_path, max_v, max_c, verb, max_in_v,
+                                 lazy=True)
         
         # Store the instance
         _psu_instances[usb_path] = psu_instance
         print(f"PSU at USB path {usb_path} initialized successfully.")
-        time.sleep(0.1)  # Small delay after initialization
         return True
         
     except AttributeError as e:
@@ -172,7 +151,8 @@ def initialize_psu(device_index=0, max_v=30000.0, max_c=25, verb=False, max_in_v
     Side Effects:
         - Stores PSU instance in global _psu_instances dictionary
         - Prints status messages to stdout
-        - Adds 100ms delay after successful initialization
+        - Does not touch USB: the board is opened by the first command sent
+          to it, or by open_all_psus() for all PSUs at once
     
     Raises:
         AttributeError: If C++ class binding is not found
@@ -208,15 +188,13 @@ def initialize_psu(device_index=0, max_v=30000.0, max_c=25, verb=False, max_in_v
             max_voltage=max_v, 
             max_current=max_c, 
             verbose=verb, 
-            max_input_voltage=max_in_v
+            max_input_voltage=max_in_v,
+            lazy=True
         )
         
         # Store the instance
         _psu_instances[device_index] = psu_instance
         print(f"PSU C++ object instance created successfully for device {device_index}.")
-        
-        # Small delay after initialization
-        time.sleep(0.1)
         return True
         
     except AttributeError as e:
@@ -510,6 +488,38 @@ def read_psu_current(device_index):
         print(f"ERROR reading current for device {device_index}: {e}")
         raise
 
+def read_psu_snapshot(device_index):
+    """
+    Reads voltage, current and relay state of a PSU in one go.
+
+    read_psu_voltage() and read_psu_current() each talk to the PSU separately,
+    so a monitor loop calling both pays for two USB exchanges per sample and
+    gets two readings taken at slightly different times. This asks the PSU
+    once and returns everything from that single answer.
+
+    Args:
+        device_index: Which PSU to read from (same keys as read_psu_voltage)
+
+    Returns:
+        PSUSnapshot: object with .ok, .voltage, .current, .relay_on, the DAC
+                     readbacks (.daca, .dacb), .sequence_no, .errors and the
+                     raw ADC channels (.adca, .adcb)
+
+    Example:
+        snap = read_psu_snapshot(0)
+        if snap.ok:
+            print(f"{snap.voltage:.1f} V, {snap.current:.3f} mA")
+    """
+    psu_instance = _psu_instances.get(device_index)
+    if psu_instance is None:
+        print(f"ERROR: PSU on device {device_index} not initialized.")
+        raise RuntimeError(f"PSU on device {device_index} not initialized")
+    try:
+        return psu_instance.read_snapshot()
+    except Exception as e:
+        print(f"ERROR reading snapshot for device {device_index}: {e}")
+        raise
+
 def switch_psu_on(device_index):
     """
     Turns ON the electrical output of a specific PSU device.
@@ -658,6 +668,98 @@ def is_relay_on(device_index):
         print(f"ERROR checking relay state for device {device_index}: {e}")
         return False
 
+def _get_psu_group():
+    """Returns a PSUGroup over all initialized PSUs, rebuilt when they change."""
+    global _psu_group, _psu_group_keys
+    keys = tuple(_psu_instances.keys())
+    if _psu_group is None or keys != _psu_group_keys:
+        group = heinzinger_control.PSUGroup()
+        for key in keys:
+            group.add(_psu_instances[key])
+        _psu_group, _psu_group_keys = group, keys
+    return _psu_group
+
+def open_all_psus():
+    """
+    Opens every initialized PSU's USB board now, all at the same time.
+
+    PSUs are created without touching USB and each opens on its first
+    command. Call this once after initializing them to bring all boards up
+    in parallel (about the time of the slowest one) and see which failed.
+
+    Returns:
+        dict: device_index/usb_path -> True if that PSU's board is open
+    """
+    group = _get_psu_group()
+    results = dict(zip(_psu_group_keys, group.open_all()))
+    for key, ok in results.items():
+        if not ok:
+            print(f"ERROR: PSU {key} could not be opened.")
+    return results
+
+def read_all_snapshots():
+    """
+    Reads a snapshot from every initialized PSU at the same time.
+
+    Calling read_psu_snapshot() in a loop waits for each PSU in turn, so N
+    PSUs cost N USB exchanges. This asks all of them in parallel (from C++)
+    and returns when the slowest one has answered.
+
+    Returns:
+        dict: device_index/usb_path -> PSUSnapshot (check .ok on each)
+
+    Example:
+        for key, snap in read_all_snapshots().items():
+            print(key, snap.voltage if snap.ok else "no answer")
+    """
+    group = _get_psu_group()
+    return dict(zip(_psu_group_keys, group.read_all()))
+
+def shutdown_all_psus():
+    """
+    Emergency stop: 0 V and relay off on every initialized PSU at once.
+
+    All PSUs are commanded in parallel, each with a single combined packet
+    that is always sent, so the whole rack is off after about one USB round
+    trip instead of one per PSU.
+
+    Returns:
+        dict: device_index/usb_path -> True if that PSU confirmed the command
+    """
+    group = _get_psu_group()
+    results = dict(zip(_psu_group_keys, group.shutdown()))
+    for key, ok in results.items():
+        if not ok:
+            print(f"ERROR: PSU {key} did not confirm the shutdown.")
+    return results
+
+def daemon_command(command, socket_path="/tmp/heinzinger_psu.sock"):
+    """
+    Sends one command to a running device daemon (Heinzinger --daemon).
+
+    While the daemon owns the boards, other programs cannot open them
+    directly; they read telemetry through heinzinger_control.TelemetryReader
+    and change setpoints through this. See headers/PSUDaemon.h for the
+    commands ("list", "set 0 1500", "on 0", "shutdown", ...).
+
+    Returns:
+        str: the daemon's one-line reply, starting with "ok" or "err"
+
+    Example:
+        daemon_command("set 0 1500")   # -> "ok 1499.2 0.012 1"
+    """
+    import socket
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(socket_path)
+        sock.sendall((command.strip() + "\n").encode())
+        reply = b""
+        while not reply.endswith(b"\n"):
+            chunk = sock.recv(4096)
+            if not chunk:
+                break
+            reply += chunk
+    return reply.decode().strip()
+
 def cleanup_psu(device_index=None):
     """
     Properly shuts down and releases PSU resources to prevent memory leaks.
@@ -701,7 +803,7 @@ def cleanup_psu(device_index=None):
         - Doesn't change PSU hardware settings, just releases software control
         - Good programming practice to always clean up resources
     """
-    global _psu_instances
+    global _psu_instances, _psu_group
     if device_index is None:
         # Clean up all instances
         for idx in list(_psu_instances.keys()):
@@ -709,6 +811,7 @@ def cleanup_psu(device_index=None):
     else:
         if device_index in _psu_instances:
             print(f"Cleaning up PSU instance for device {device_index}")
+            _psu_group = None  # its worker threads hold on to the PSU
             del _psu_instances[device_index]
         else:
             print(f"PSU instance for device {device_index} already None or not initialized.")
@@ -765,12 +868,13 @@ if __name__ == '__main__':
         print("FUG PSU initialized successfully.")
     else:
         print("Failed to initialize FUG PSU.")
-    time.sleep(3)
     print("\nInitializing Heinzinger PSU (device 0)...")
     if initialize_psu(device_index=0, max_v=30000.0, max_c=2.0, verb=True):
         print("Heinzinger PSU initialized successfully.")
     else:
         print("Failed to initialize Heinzinger PSU.")
+
+    print(f"\nOpened: {open_all_psus()}")
     
     print(f"\nTotal PSU instances: {len(_psu_instances)}")
     print(f"Device indices: {list(_psu_instances.keys())}")